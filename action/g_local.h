@@ -66,6 +66,10 @@
 
 #define FRAMETIME               0.1
 
+// set in the sv_features cvar by engines that have gi.unlagged_trace,
+// an older engine's import table ends before it
+#define SVFEAT_UNLAGGED_TRACE   1
+
 // memory tags to allow dynamic memory to be cleaned up
 #define TAG_GAME        765             // clear when unloading the dll
 #define TAG_LEVEL       766             // clear when loading a new level
@@ -517,6 +521,7 @@ extern  edict_t                 *g_edicts;
 #define crandom()       (2.0 * (random() - 0.5))
 
 extern  cvar_t  *maxentities;
+extern  cvar_t  *sv_features;
 extern  cvar_t  *deathmatch;
 extern  cvar_t  *coop;
 extern  cvar_t  *dmflags;
@@ -671,6 +676,8 @@ void    G_FreeEdict (edict_t *e);
 void    G_TouchTriggers (edict_t *ent);
 void    G_TouchSolids (edict_t *ent);
 
+trace_t G_UnlaggedTrace (edict_t *shooter, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passent, int contentmask);
+
 char    *G_CopyString (char *in);
 
 float   *tv (float x, float y, float z);
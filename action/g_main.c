@@ -72,6 +72,7 @@ cvar_t  *timelimit;
 cvar_t  *password;
 cvar_t  *maxclients;
 cvar_t  *maxentities;
+cvar_t  *sv_features;
 cvar_t  *g_select_empty;
 cvar_t  *dedicated;
 
@@ -184,6 +184,9 @@ void InitGame (void)
         skill = gi.cvar ("skill", "1", CVAR_LATCH);
         maxentities = gi.cvar ("maxentities", "1024", CVAR_LATCH);
 
+        // imports this engine has past the original table
+        sv_features = gi.cvar ("sv_features", "0", CVAR_NOSET);
+
 //FIREBLADE
         if (!deathmatch->value)
         {
@@ -552,3 +552,19 @@ qboolean KillBox (edict_t *ent)
 
         return true;            // all clear
 }
+
+/*
+=================
+G_UnlaggedTrace
+
+gi.unlagged_trace where the engine has it, a plain trace
+against the present otherwise
+=================
+*/
+trace_t G_UnlaggedTrace (edict_t *shooter, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passent, int contentmask)
+{
+        if ((int)sv_features->value & SVFEAT_UNLAGGED_TRACE)
+                return gi.unlagged_trace (shooter, start, mins, maxs, end, passent, contentmask);
+
+        return gi.trace (start, mins, maxs, end, passent, contentmask);
+}
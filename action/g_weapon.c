@@ -196,7 +196,7 @@ static void fire_lead (edict_t *self, vec3_t start, vec3_t aimdir, int damage, i
                 }
 
                 PRETRACE();
-                tr = gi.trace (start, NULL, NULL, end, self, content_mask);
+                tr = G_UnlaggedTrace (self, start, NULL, NULL, end, self, content_mask);
                 POSTTRACE();
 
 // glass fx
@@ -211,7 +211,7 @@ static void fire_lead (edict_t *self, vec3_t start, vec3_t aimdir, int damage, i
                     CGF_SFX_ShootBreakableGlass(tr.ent, self, &tr, mod);
                     // continue trace from current endpos to start
 			PRETRACE();
-                    tr = gi.trace (tr.endpos, NULL, NULL, end, tr.ent, content_mask);
+                    tr = G_UnlaggedTrace (self, tr.endpos, NULL, NULL, end, tr.ent, content_mask);
 			POSTTRACE();
                   }
 // ---
@@ -264,7 +264,7 @@ static void fire_lead (edict_t *self, vec3_t start, vec3_t aimdir, int damage, i
 
                         // re-trace ignoring water this time
                         PRETRACE();
-                        tr = gi.trace (water_start, NULL, NULL, end, self, MASK_SHOT);
+                        tr = G_UnlaggedTrace (self, water_start, NULL, NULL, end, self, MASK_SHOT);
                         POSTTRACE();
                 }
         }
@@ -394,7 +394,7 @@ static void fire_lead_ap (edict_t *self, vec3_t start, vec3_t aimdir, int damage
         {
                 PRETRACE();
                 //tr = gi.trace (from, NULL, NULL, end, ignore, mask);
-                tr = gi.trace (from, NULL, NULL, end, ignore, content_mask);
+                tr = G_UnlaggedTrace (self, from, NULL, NULL, end, ignore, content_mask);
                 POSTTRACE();
 
 // glass fx
@@ -409,7 +409,7 @@ static void fire_lead_ap (edict_t *self, vec3_t start, vec3_t aimdir, int damage
                     CGF_SFX_ShootBreakableGlass(tr.ent, self, &tr, mod);
                     // continue trace from current endpos to start
 			PRETRACE();
-                    tr = gi.trace (tr.endpos, NULL, NULL, end, tr.ent, content_mask);
+                    tr = G_UnlaggedTrace (self, tr.endpos, NULL, NULL, end, tr.ent, content_mask);
 			POSTTRACE();
                   }
 // ---
@@ -462,7 +462,7 @@ static void fire_lead_ap (edict_t *self, vec3_t start, vec3_t aimdir, int damage
                         
                         // re-trace ignoring water this time
                         PRETRACE();
-                        tr = gi.trace (water_start, NULL, NULL, end, ignore, MASK_SHOT);
+                        tr = G_UnlaggedTrace (self, water_start, NULL, NULL, end, ignore, MASK_SHOT);
                         POSTTRACE();
                         
                 }
@@ -1025,7 +1025,7 @@ void fire_rail (edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick
         while (ignore)
         {
                 PRETRACE();
-                tr = gi.trace (from, NULL, NULL, end, ignore, mask);
+                tr = G_UnlaggedTrace (self, from, NULL, NULL, end, ignore, mask);
                 POSTTRACE();
 
                 if (tr.contents & (CONTENTS_SLIME|CONTENTS_LAVA))
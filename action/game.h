@@ -155,6 +155,18 @@ typedef struct
         void    (*AddCommandString) (char *text);
 
         void    (*DebugGraph) (float value, int color);
+
+        // added after the original interface, so older games never see it.
+        // older engines don't have it, only call it when the sv_features
+        // cvar has SVFEAT_UNLAGGED_TRACE.
+        // trace with the other clients where they were in the last frame
+        // the shooter client had, for hitscan weapons
+        trace_t (*unlagged_trace) (edict_t *shooter, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passent, int contentmask);
+
+        // unlagged_trace for count rays at once, from starts[i] to ends[i]
+        // into traces[i].  Cheaper than count calls for rays close together.
+        // only there when sv_features has SVFEAT_TRACE_BATCH
+        void (*trace_batch) (edict_t *shooter, int count, vec3_t *starts, vec3_t *ends, vec3_t mins, vec3_t maxs, edict_t *passent, int contentmask, trace_t *traces);
 } game_import_t;
 
 //
@@ -54,161 +54,6 @@ FRAME PARSING
 =========================================================================
 */
 
-#if 0
-
-typedef struct
-{
-	int		modelindex;
-	int		num; // entity number
-	int		effects;
-	vec3_t	origin;
-	vec3_t	oldorigin;
-	vec3_t	angles;
-	qboolean present;
-} projectile_t;
-
-#define	MAX_PROJECTILES	64
-projectile_t	cl_projectiles[MAX_PROJECTILES];
-
-void CL_ClearProjectiles (void)
-{
-	int i;
-
-	for (i = 0; i < MAX_PROJECTILES; i++) {
-//		if (cl_projectiles[i].present)
-//			Com_DPrintf(DEVELOPER_MSG_ENTITY, "PROJ: %d CLEARED\n", cl_projectiles[i].num);
-		cl_projectiles[i].present = false;
-	}
-}
-
-/*
-=====================
-CL_ParseProjectiles
-
-Flechettes are passed as efficient temporary entities
-=====================
-*/
-void CL_ParseProjectiles (void)
-{
-	int		i, c, j;
-	byte	bits[8];
-	byte	b;
-	projectile_t	pr;
-	int lastempty = -1;
-	qboolean old = false;
-
-	c = MSG_ReadByte (&net_message);
-	for (i=0 ; i<c ; i++)
-	{
-		bits[0] = MSG_ReadByte (&net_message);
-		bits[1] = MSG_ReadByte (&net_message);
-		bits[2] = MSG_ReadByte (&net_message);
-		bits[3] = MSG_ReadByte (&net_message);
-		bits[4] = MSG_ReadByte (&net_message);
-		pr.origin[0] = ( ( bits[0] + ((bits[1]&15)<<8) ) <<1) - 4096;
-		pr.origin[1] = ( ( (bits[1]>>4) + (bits[2]<<4) ) <<1) - 4096;
-		pr.origin[2] = ( ( bits[3] + ((bits[4]&15)<<8) ) <<1) - 4096;
-		VectorCopy(pr.origin, pr.oldorigin);
-
-		if (bits[4] & 64)
-			pr.effects = EF_BLASTER;
-		else
-			pr.effects = 0;
-
-		if (bits[4] & 128) {
-			old = true;
-			bits[0] = MSG_ReadByte (&net_message);
-			bits[1] = MSG_ReadByte (&net_message);
-			bits[2] = MSG_ReadByte (&net_message);
-			bits[3] = MSG_ReadByte (&net_message);
-			bits[4] = MSG_ReadByte (&net_message);
-			pr.oldorigin[0] = ( ( bits[0] + ((bits[1]&15)<<8) ) <<1) - 4096;
-			pr.oldorigin[1] = ( ( (bits[1]>>4) + (bits[2]<<4) ) <<1) - 4096;
-			pr.oldorigin[2] = ( ( bits[3] + ((bits[4]&15)<<8) ) <<1) - 4096;
-		}
-
-		bits[0] = MSG_ReadByte (&net_message);
-		bits[1] = MSG_ReadByte (&net_message);
-		bits[2] = MSG_ReadByte (&net_message);
-
-		pr.angles[0] = 360*bits[0]/256;
-		pr.angles[1] = 360*bits[1]/256;
-		pr.modelindex = bits[2];
-
-		b = MSG_ReadByte (&net_message);
-		pr.num = (b & 0x7f);
-		if (b & 128) // extra entity number byte
-			pr.num |= (MSG_ReadByte (&net_message) << 7);
-
-		pr.present = true;
-
-		// find if this projectile already exists from previous frame 
-		for (j = 0; j < MAX_PROJECTILES; j++) {
-			if (cl_projectiles[j].modelindex) {
-				if (cl_projectiles[j].num == pr.num) {
-					// already present, set up oldorigin for interpolation
-					if (!old)
-						VectorCopy(cl_projectiles[j].origin, pr.oldorigin);
-					cl_projectiles[j] = pr;
-					break;
-				}
-			} else
-				lastempty = j;
-		}
-
-		// not present previous frame, add it
-		if (j == MAX_PROJECTILES) {
-			if (lastempty != -1) {
-				cl_projectiles[lastempty] = pr;
-			}
-		}
-	}
-}
-
-/*
-=============
-CL_LinkProjectiles
-
-=============
-*/
-void CL_AddProjectiles (void)
-{
-	int		i, j;
-	projectile_t	*pr;
-	entity_t		ent;
-
-	memset (&ent, 0, sizeof(ent));
-
-	for (i=0, pr=cl_projectiles ; i < MAX_PROJECTILES ; i++, pr++)
-	{
-		// grab an entity to fill in
-		if (pr->modelindex < 1)
-			continue;
-		if (!pr->present) {
-			pr->modelindex = 0;
-			continue; // not present this frame (it was in the previous frame)
-		}
-
-		ent.model = cl.model_draw[pr->modelindex];
-
-		// interpolate origin
-		for (j=0 ; j<3 ; j++)
-		{
-			ent.origin[j] = ent.oldorigin[j] = pr->oldorigin[j] + cl.lerpfrac * 
-				(pr->origin[j] - pr->oldorigin[j]);
-
-		}
-
-		if (pr->effects & EF_BLASTER)
-			CL_BlasterTrail (pr->oldorigin, ent.origin, 0xe0);
-		V_AddLight (pr->origin, 200, 1, 1, 0);
-
-		VectorCopy (pr->angles, ent.angles);
-		V_AddEntity (&ent);
-	}
-}
-#endif
-
 /*
 =================
 CL_ParseEntityBits
@@ -336,24 +181,17 @@ void CL_ParseDelta (entity_state_t *from, entity_state_t *to, int number, int bi
 
 /*
 ==================
-CL_DeltaEntity
+CL_SetEntityState
 
-Parses deltas from the given base and adds the resulting entity
-to the current frame
+Moves the entity on to a state that has just been parsed into the
+current frame
 ==================
 */
-void CL_DeltaEntity (frame_t *frame, int newnum, entity_state_t *old, int bits)
+void CL_SetEntityState (entity_state_t *state)
 {
 	centity_t	*ent;
-	entity_state_t	*state;
 
-	ent = &cl_entities[newnum];
-
-	state = &cl_parse_entities[cl.parse_entities & (MAX_PARSE_ENTITIES-1)];
-	cl.parse_entities++;
-	frame->num_entities++;
-
-	CL_ParseDelta (old, state, newnum, bits);
+	ent = &cl_entities[state->number];
 
 	// some data changes will force no lerping
 	if (state->modelindex != ent->current.modelindex
@@ -395,6 +233,27 @@ void CL_DeltaEntity (frame_t *frame, int newnum, entity_state_t *old, int bits)
 	ent->current = *state;
 }
 
+/*
+==================
+CL_DeltaEntity
+
+Parses deltas from the given base and adds the resulting entity
+to the current frame
+==================
+*/
+void CL_DeltaEntity (frame_t *frame, int newnum, entity_state_t *old, int bits)
+{
+	entity_state_t	*state;
+
+	state = &cl_parse_entities[cl.parse_entities & (MAX_PARSE_ENTITIES-1)];
+	cl.parse_entities++;
+	frame->num_entities++;
+
+	CL_ParseDelta (old, state, newnum, bits);
+	CL_SetEntityState (state);
+}
+
+
 /*
 ==================
 CL_ParsePacketEntities
@@ -408,18 +267,21 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 	int			newnum;
 	unsigned int			bits;
 	entity_state_t	*oldstate = NULL; /* FS: Compiler warning */
-	int			oldindex, oldnum;
+	int			oldindex, oldnum, oldcount;
 
 	newframe->parse_entities = cl.parse_entities;
 	newframe->num_entities = 0;
 
+	// the old frame's projectiles are delta'd by CL_ParseProjectiles
+	oldcount = oldframe ? oldframe->num_entities - oldframe->num_projectiles : 0;
+
 	// delta from the entities present in oldframe
 	oldindex = 0;
 	if (!oldframe)
 		oldnum = 99999;
 	else
 	{
-		if (oldindex >= oldframe->num_entities)
+		if (oldindex >= oldcount)
 			oldnum = 99999;
 		else
 		{
@@ -448,7 +310,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 			
 			oldindex++;
 
-			if (oldindex >= oldframe->num_entities)
+			if (oldindex >= oldcount)
 				oldnum = 99999;
 			else
 			{
@@ -466,7 +328,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 
 			oldindex++;
 
-			if (oldindex >= oldframe->num_entities)
+			if (oldindex >= oldcount)
 				oldnum = 99999;
 			else
 			{
@@ -484,7 +346,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 
 			oldindex++;
 
-			if (oldindex >= oldframe->num_entities)
+			if (oldindex >= oldcount)
 				oldnum = 99999;
 			else
 			{
@@ -513,7 +375,7 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 		
 		oldindex++;
 
-		if (oldindex >= oldframe->num_entities)
+		if (oldindex >= oldcount)
 			oldnum = 99999;
 		else
 		{
@@ -524,6 +386,104 @@ void CL_ParsePacketEntities (frame_t *oldframe, frame_t *newframe)
 }
 
 
+/*
+==================
+CL_ParseProjectiles
+
+An svc_projectiles has just been parsed.  The projectiles go in the
+frame after its packet entities, each delta'd from the same number in
+the old frame's projectiles, or from nothing if it wasn't there.
+
+This replaced the old #if 0 flechette parser instead of reusing its
+format.  That one sent origins in 2 unit steps clamped to +-4096,
+knew no effect but EF_BLASTER and had no sound, so it could only
+carry blaster bolts in small maps.
+==================
+*/
+void CL_ParseProjectiles (frame_t *oldframe, frame_t *newframe)
+{
+	static entity_state_t	nullstate;
+	entity_state_t	*state, *from, *oldstate;
+	int			i, j, count, num, bits;
+	int			oldfirst, oldindex, oldcount;
+
+	oldfirst = oldcount = 0;
+	if (oldframe)
+	{
+		oldcount = oldframe->num_projectiles;
+		oldfirst = oldframe->parse_entities + oldframe->num_entities - oldcount;
+	}
+	oldindex = 0;
+
+	count = MSG_ReadByte (&net_message);
+	for (i=0 ; i<count ; i++)
+	{
+		num = MSG_ReadByte (&net_message);
+		if (num & 128)
+			num = (num & 127) | (MSG_ReadByte (&net_message) << 7);
+		bits = MSG_ReadByte (&net_message);
+
+		if (num < 1 || num >= MAX_EDICTS)
+			Com_Error (ERR_DROP, "CL_ParseProjectiles: bad number:%i", num);
+		if (net_message.readcount > net_message.cursize)
+			Com_Error (ERR_DROP, "CL_ParseProjectiles: end of message");
+
+		// both lists are in entity order
+		from = &nullstate;
+		while (oldindex < oldcount)
+		{
+			oldstate = &cl_parse_entities[(oldfirst+oldindex) & (MAX_PARSE_ENTITIES-1)];
+			if (oldstate->number > num)
+				break;
+			oldindex++;
+			if (oldstate->number == num)
+			{
+				from = oldstate;
+				break;
+			}
+		}
+
+		state = &cl_parse_entities[cl.parse_entities & (MAX_PARSE_ENTITIES-1)];
+		cl.parse_entities++;
+		newframe->num_entities++;
+		newframe->num_projectiles++;
+
+		*state = *from;
+		state->number = num;
+		state->event = 0;
+		VectorCopy (from->origin, state->old_origin);
+
+		if (bits & PR_ORIGIN)
+			MSG_ReadPos (&net_message, state->origin);
+		else if (bits & PR_MOVE)
+		{
+			for (j=0 ; j<3 ; j++)
+				state->origin[j] += MSG_ReadChar (&net_message);
+		}
+		if (bits & PR_OLDORIGIN)
+			MSG_ReadPos (&net_message, state->old_origin);
+		else if (from == &nullstate)
+			VectorCopy (state->origin, state->old_origin);
+		if (bits & PR_ANGLES)
+		{
+			for (j=0 ; j<3 ; j++)
+				state->angles[j] = MSG_ReadAngle (&net_message);
+		}
+		if (bits & PR_MODEL)
+			state->modelindex = MSG_ReadByte (&net_message);
+		if (bits & PR_EFFECTS)
+			state->effects = MSG_ReadLong (&net_message);
+		if (bits & PR_SOUND)
+			state->sound = MSG_ReadByte (&net_message);
+
+		if (cl_shownet->intValue == 3)
+			Com_Printf ("   projectile: %i\n", num);
+
+		CL_SetEntityState (state);
+	}
+}
+
+
 
 /*
 ===================
@@ -686,10 +646,6 @@ void CL_ParseFrame (void)
 
 	memset (&cl.frame, 0, sizeof(cl.frame));
 
-#if 0
-	CL_ClearProjectiles(); // clear projectiles for new frame
-#endif
-
 	cl.frame.serverframe = MSG_ReadLong (&net_message); /* FS: Regular Q2 Protocol is going to send this is a long instead of float */
 	cl.frame.deltaframe = MSG_ReadLong (&net_message);
 	if(cls.state != ca_active)
@@ -698,7 +654,7 @@ void CL_ParseFrame (void)
 	}
 	else
 	{
-		cl.frame.servertime = (cl.frame.serverframe - cl.initial_server_frame) * (100); /* R1Q2: initial_server_frame is for fixing precision loss with high serverframes */
+		cl.frame.servertime = (cl.frame.serverframe - cl.initial_server_frame) * cl.framemsec; /* R1Q2: initial_server_frame is for fixing precision loss with high serverframes */
 	}
 
 	// BIG HACK to let old demos continue to work
@@ -742,8 +698,8 @@ void CL_ParseFrame (void)
 	// clamp time 
 	if (cl.time > cl.frame.servertime)
 		cl.time = cl.frame.servertime;
-	else if (cl.time < cl.frame.servertime - 100)
-		cl.time = cl.frame.servertime - 100;
+	else if (cl.time < cl.frame.servertime - cl.framemsec)
+		cl.time = cl.frame.servertime - cl.framemsec;
 
 	// read areabits
 	len = MSG_ReadByte (&net_message);
@@ -763,10 +719,14 @@ void CL_ParseFrame (void)
 		Com_Error (ERR_DROP, "CL_ParseFrame: not packetentities");
 	CL_ParsePacketEntities (old, &cl.frame);
 
-#if 0
-	if (cmd == svc_packetentities2)
-		CL_ParseProjectiles();
-#endif
+	// a server that knows we take them sends the projectiles on their own
+	if (net_message.readcount < net_message.cursize
+		&& net_message.data[net_message.readcount] == svc_projectiles)
+	{
+		cmd = MSG_ReadByte (&net_message);
+		SHOWNET(svc_strings[cmd]);
+		CL_ParseProjectiles (old, &cl.frame);
+	}
 
 	// save the frame off in the backup array for later delta comparisons
 	cl.frames[cl.frame.serverframe & UPDATE_MASK] = cl.frame;
@@ -780,7 +740,7 @@ void CL_ParseFrame (void)
 
 			/* R1Q2: fix for precision loss with high serverframes (when map runs for over several hours) */
 			cl.initial_server_frame = cl.frame.serverframe;
-			cl.frame.servertime = (cl.frame.serverframe - cl.initial_server_frame) * (100);
+			cl.frame.servertime = (cl.frame.serverframe - cl.initial_server_frame) * cl.framemsec;
 
 			cl.force_refdef = true;
 			cl.predicted_origin[0] = cl.frame.playerstate.pmove.origin[0]*0.125;
@@ -1607,15 +1567,15 @@ void CL_AddEntities (void)
 		cl.time = cl.frame.servertime;
 		cl.lerpfrac = 1.0;
 	}
-	else if (cl.time < cl.frame.servertime - 100)
+	else if (cl.time < cl.frame.servertime - cl.framemsec)
 	{
 		if (cl_showclamp->intValue)
-			Com_Printf ("low clamp %i\n", cl.frame.servertime-100 - cl.time);
-		cl.time = cl.frame.servertime - 100;
+			Com_Printf ("low clamp %i\n", cl.frame.servertime-cl.framemsec - cl.time);
+		cl.time = cl.frame.servertime - cl.framemsec;
 		cl.lerpfrac = 0;
 	}
 	else
-		cl.lerpfrac = 1.0 - (cl.frame.servertime - cl.time) * 0.01;
+		cl.lerpfrac = 1.0 - (float)(cl.frame.servertime - cl.time) / cl.framemsec;
 
 	if (CL_IsDemoWithTimeDemo())
 		cl.lerpfrac = 1.0;
@@ -1629,9 +1589,6 @@ void CL_AddEntities (void)
 	CL_CalcViewValues ();
 	// PMM - moved this here so the heat beam has the right values for the vieworg, and can lock the beam to the gun
 	CL_AddPacketEntities (&cl.frame);
-#if 0
-	CL_AddProjectiles ();
-#endif
 	CL_AddTEnts ();
 	CL_AddParticles ();
 	CL_AddDLights ();
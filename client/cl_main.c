@@ -288,6 +288,13 @@ void CL_Record_f (void)
 
 	MSG_WriteString (&buf, cl.configstrings[CS_NAME]);
 
+	// demos of a 10 Hz server stay readable by any client
+	if (cl.framemsec != 100)
+	{
+		MSG_WriteByte (&buf, svc_tickrate);
+		MSG_WriteByte (&buf, cl.framemsec);
+	}
+
 	// configstrings
 	for (i=0 ; i<MAX_CONFIGSTRINGS ; i++)
 	{
@@ -505,8 +512,10 @@ void CL_SendConnectPacket (void)
 	port = Cvar_VariableValue ("qport");
 	userinfo_modified = false;
 
-	Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
-		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
+	// the trailing capabilities are ignored by servers that don't know them
+	Netchan_OutOfBandPrint (NS_CLIENT, adr, "connect %i %i %i \"%s\" %i\n",
+		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo(),
+		(net_fragment->intValue ? NETCAPS_FRAGMENT : 0) | NETCAPS_ZPACKET | NETCAPS_DLWINDOW | NETCAPS_TICKRATE | NETCAPS_PROJECTILES );
 }
 
 /*
@@ -1009,8 +1018,10 @@ void CL_ConnectionlessPacket (void)
 				Com_Printf ("HTTP downloading supported by server but this client was built without libcurl.\n");
 #endif	/* USE_CURL */
 			}
+			// end HTTP downloading from R1Q2
+			else if (!strcmp (p, "fragment=1") && net_fragment->intValue)
+				cls.netchan.fragment = true;
 		}
-		// end HTTP downloading from R1Q2
 		MSG_WriteChar (&cls.netchan.message, clc_stringcmd);
 		MSG_WriteString (&cls.netchan.message, "new");	
 		cls.state = ca_connected;
@@ -46,7 +46,12 @@ char *svc_strings[256] =
 	"svc_playerinfo",
 	"svc_packetentities",
 	"svc_deltapacketentities",
-	"svc_frame"
+	"svc_frame",
+	"svc_zpacket",
+	"svc_dlchunk",
+	"svc_multicast",
+	"svc_tickrate",
+	"svc_projectiles"
 };
 
 //=============================================================================
@@ -164,6 +169,8 @@ qboolean	CL_CheckOrDownloadFile (char *filename)
 		len = ftell(fp);
 
 		cls.download = fp;
+		cls.downloadack = len;
+		cls.downloadnack = -1;
 
 		// give the server an offset to start the download
 		Com_Printf ("Resuming %s\n", cls.downloadname);
@@ -241,6 +248,68 @@ void CL_RegisterSounds (void)
 }
 
 
+/*
+=====================
+CL_OpenDownload
+
+Creates the temp file a download is written to
+=====================
+*/
+qboolean CL_OpenDownload (void)
+{
+	char	name[MAX_OSPATH];
+
+	CL_Download_Reset_KBps_counter ();	// Knightmare- for KB/s counter
+
+	CL_DownloadFileName(name, sizeof(name), cls.downloadtempname);
+
+	FS_CreatePath (name);
+
+	cls.download = fopen (name, "wb");
+	if (!cls.download)
+	{
+		Com_Printf ("Failed to open %s\n", cls.downloadtempname);
+		CL_RequestNextDownload ();
+		return false;
+	}
+
+	cls.downloadack = 0;
+	cls.downloadnack = -1;
+	return true;
+}
+
+/*
+=====================
+CL_FinishDownload
+
+Renames a completed download and goes on to the next one
+=====================
+*/
+void CL_FinishDownload (void)
+{
+	char	oldn[MAX_OSPATH];
+	char	newn[MAX_OSPATH];
+	int		r;
+
+//	Com_Printf ("100%%\n");
+
+	fclose (cls.download);
+
+	// rename the temp file to it's final name
+	CL_DownloadFileName(oldn, sizeof(oldn), cls.downloadtempname);
+	CL_DownloadFileName(newn, sizeof(newn), cls.downloadname);
+	r = rename (oldn, newn);
+	if (r)
+		Com_Printf ("failed to rename.\n");
+
+	cls.download = NULL;
+	cls.downloadpercent = 0;
+
+	// get another file if needed
+
+	CL_RequestNextDownload ();
+}
+
 /*
 =====================
 CL_ParseDownload
@@ -251,8 +320,6 @@ A download message has been received from the server
 void CL_ParseDownload (void)
 {
 	int		size, percent;
-	char	name[MAX_OSPATH];
-	int		r;
 
 	// read the data
 	size = MSG_ReadShort (&net_message);
@@ -279,22 +346,10 @@ void CL_ParseDownload (void)
 	}
 
 	// open the file if not opened yet
-	if (!cls.download)
+	if (!cls.download && !CL_OpenDownload ())
 	{
-		CL_Download_Reset_KBps_counter ();	// Knightmare- for KB/s counter
-
-		CL_DownloadFileName(name, sizeof(name), cls.downloadtempname);
-
-		FS_CreatePath (name);
-
-		cls.download = fopen (name, "wb");
-		if (!cls.download)
-		{
-			net_message.readcount += size;
-			Com_Printf ("Failed to open %s\n", cls.downloadtempname);
-			CL_RequestNextDownload ();
-			return;
-		}
+		net_message.readcount += size;
+		return;
 	}
 
 	//r1: downloading something, drop to console to show status bar
@@ -315,27 +370,98 @@ void CL_ParseDownload (void)
 		cls.forcePacket = true;
 	}
 	else
+		CL_FinishDownload ();
+}
+
+/*
+=====================
+CL_AckDownload
+
+Tells the server how much of a windowed download we have
+=====================
+*/
+void CL_AckDownload (int offset)
+{
+	MSG_WriteByte (&cls.netchan.message, clc_stringcmd);
+	MSG_WriteString (&cls.netchan.message, va("nextdl %i", offset));
+	cls.forcePacket = true;
+}
+
+/*
+=====================
+CL_ParseDownloadChunk
+
+A piece of a windowed download.  Pieces are only taken in order, the
+first one past a gap gets the server to go back and send it again.
+=====================
+*/
+void CL_ParseDownloadChunk (void)
+{
+	int		offset, size, percent;
+	int		have;
+	byte	*data;
+
+	offset = MSG_ReadLong (&net_message);
+	size = MSG_ReadShort (&net_message);
+	percent = MSG_ReadByte (&net_message);
+	if (size < 0 || net_message.readcount + size > net_message.cursize)
+		Com_Error (ERR_DROP, "CL_ParseDownloadChunk: bad size %i", size);
+
+	data = net_message.data + net_message.readcount;
+	net_message.readcount += size;
+
+	// a resume has the file open already, a piece of a download
+	// that has finished can't start a new one
+	if (!cls.downloadtempname[0] || (!cls.download && offset))
+		return;
+	if (!cls.download && !CL_OpenDownload ())
+		return;
+
+	have = ftell (cls.download);
+	if (offset != have)
 	{
-		char	oldn[MAX_OSPATH];
-		char	newn[MAX_OSPATH];
+		if (offset > have && cls.downloadnack != have)
+		{
+			cls.downloadnack = have;
+			CL_AckDownload (have);
+		}
+		return;
+	}
 
-//		Com_Printf ("100%%\n");
+	//r1: downloading something, drop to console to show status bar
+	SCR_EndLoadingPlaque();
 
-		fclose (cls.download);
+	fwrite (data, 1, size, cls.download);
+	CL_Download_Calculate_KBps (size, 0);	// Knightmare- for KB/s counter
+	cls.downloadpercent = percent;
 
-		// rename the temp file to it's final name
-		CL_DownloadFileName(oldn, sizeof(oldn), cls.downloadtempname);
-		CL_DownloadFileName(newn, sizeof(newn), cls.downloadname);
-		r = rename (oldn, newn);
-		if (r)
-			Com_Printf ("failed to rename.\n");
+	if (percent == 100)
+	{
+		// must get there before the request for the next file
+		CL_AckDownload (offset + size);
+		CL_FinishDownload ();
+	}
+}
 
-		cls.download = NULL;
-		cls.downloadpercent = 0;
+/*
+=====================
+CL_AckDownloadChunks
 
-		// get another file if needed
+Acks the pieces that came in a message all at once
+=====================
+*/
+void CL_AckDownloadChunks (void)
+{
+	int		have;
 
-		CL_RequestNextDownload ();
+	if (!cls.download)
+		return;
+
+	have = ftell (cls.download);
+	if (have != cls.downloadack)
+	{
+		cls.downloadack = have;
+		CL_AckDownload (have);
 	}
 }
 
@@ -365,6 +491,7 @@ void CL_ParseServerData (void)
 //
 	CL_ClearState ();
 	cls.state = ca_connected;
+	cl.framemsec = 100;		// until svc_tickrate says otherwise
 
 // parse protocol version number
 	i = MSG_ReadLong (&net_message);
@@ -891,6 +1018,39 @@ qboolean CL_MaliciousStuffText(char *s)
 	return false;
 }
 
+/*
+=====================
+CL_ParseZPacket
+
+Expands the compressed messages in place of the svc_zpacket, so they
+are parsed next and recorded demos stay readable by any client.
+=====================
+*/
+void CL_ParseZPacket (void)
+{
+	static byte	buf[MAX_MSGLEN];
+	int			start, zlen, len, rest;
+
+	start = net_message.readcount - 1;
+	zlen = MSG_ReadShort (&net_message);
+	len = MSG_ReadShort (&net_message);
+
+	if (zlen < 0 || net_message.readcount + zlen > net_message.cursize)
+		Com_Error (ERR_DROP, "CL_ParseZPacket: bad compressed size");
+
+	if (Com_Decompress (net_message.data + net_message.readcount, zlen, buf, sizeof(buf)) != len)
+		Com_Error (ERR_DROP, "CL_ParseZPacket: bad compressed data");
+
+	rest = net_message.cursize - (net_message.readcount + zlen);
+	if (start + len + rest > net_message.maxsize)
+		Com_Error (ERR_DROP, "CL_ParseZPacket: %i bytes doesn't fit", len);
+
+	memmove (net_message.data + start + len, net_message.data + net_message.readcount + zlen, rest);
+	memcpy (net_message.data + start, buf, len);
+	net_message.cursize = start + len + rest;
+	net_message.readcount = start;
+}
+
 /*
 =====================
 CL_ParseServerMessage
@@ -1035,6 +1195,21 @@ void CL_ParseServerMessage (void)
 			CL_ParseFrame ();
 			break;
 
+		case svc_zpacket:
+			CL_ParseZPacket ();
+			break;
+
+		case svc_dlchunk:
+			CL_ParseDownloadChunk ();
+			break;
+
+		case svc_tickrate:
+			i = MSG_ReadByte (&net_message);
+			if (i < 1 || i > 100)
+				Com_Error (ERR_DROP, "CL_ParseServerMessage: bad tickrate %i", i);
+			cl.framemsec = i;
+			break;
+
 		case svc_inventory:
 			CL_ParseInventory ();
 			break;
@@ -1052,6 +1227,8 @@ void CL_ParseServerMessage (void)
 		}
 	}
 
+	CL_AckDownloadChunks ();
+
 	CL_AddNetgraph ();
 
 	//
@@ -87,6 +87,7 @@ typedef struct
 	player_state_t	playerstate;
 	int				num_entities;
 	int				parse_entities;	// non-masked index into cl_parse_entities array
+	int				num_projectiles;	// the last ones of num_entities, from svc_projectiles
 } frame_t;
 
 typedef struct
@@ -203,6 +204,7 @@ typedef struct
 	int			time;			// this is the time value that the client
 								// is rendering at.  always <= cls.realtime
 	int			initial_server_frame; /* R1Q2: initial_server_frame is for fixing precision loss with high serverframes */
+	int			framemsec;		// length of a server frame
 	float		lerpfrac;		// between oldframe and frame
 
 	refdef_t	refdef;
@@ -315,6 +317,8 @@ typedef struct
 	dltype_t	downloadtype;
 	size_t		downloadposition;	// added for HTTP downloads
 	int			downloadpercent;
+	int			downloadack;		// offset last acked in a windowed download
+	int			downloadnack;		// offset last asked for again
 	float		downloadrate;		/* Knightmare- to display KB/s */
 
 #ifdef GAMESPY /* FS: For gamespy */
@@ -440,7 +444,7 @@ extern	cdlight_t	cl_dlights[MAX_DLIGHTS];
 // the cl_parse_entities must be large enough to hold UPDATE_BACKUP frames of
 // entities, so that when a delta compressed message arives from the server
 // it can be un-deltad from the original 
-#define	MAX_PARSE_ENTITIES	1024
+#define	MAX_PARSE_ENTITIES	4096
 extern	entity_state_t	cl_parse_entities[MAX_PARSE_ENTITIES];
 
 //=============================================================================
@@ -75,7 +75,15 @@
 #define FL_POWER_ARMOR 0x00001000           /* power armor (if any) is active */
 #define FL_RESPAWN 0x80000000               /* used for item respawning */
 
-#define FRAMETIME 0.1
+#define FRAMETIME 0.1 /* think and animation step, whatever sv_fps is */
+
+/* set in the g_features cvar when the game can run faster than 10 Hz */
+#define GMF_VARIABLE_FPS 1
+
+/* set in the sv_features cvar by engines that have gi.unlagged_trace
+   and gi.trace_batch, an older engine's import table ends before them */
+#define SVFEAT_UNLAGGED_TRACE 1
+#define SVFEAT_TRACE_BATCH 2
 
 /* memory tags to allow dynamic memory to be cleaned up */
 #define TAG_GAME 765        /* clear when unloading the dll */
@@ -443,6 +451,10 @@ extern game_import_t gi;
 extern game_export_t globals;
 extern spawn_temp_t st;
 
+extern float frametime; /* seconds per server frame */
+extern int framediv; /* server frames per FRAMETIME */
+extern int subframe; /* 0 on the frames that advance level.framenum */
+
 extern int sm_meat_index;
 extern int snd_fry;
 
@@ -500,6 +512,7 @@ extern edict_t *g_edicts;
 #define crandom() (2.0 * (random() - 0.5))
 
 extern cvar_t *maxentities;
+extern cvar_t *sv_features;
 extern cvar_t *deathmatch;
 extern cvar_t *coop;
 extern cvar_t *dmflags;
@@ -616,6 +629,12 @@ void G_FreeEdict(edict_t *e);
 void G_TouchTriggers(edict_t *ent);
 void G_TouchSolids(edict_t *ent);
 
+trace_t G_UnlaggedTrace(edict_t *shooter, vec3_t start, vec3_t mins,
+		vec3_t maxs, vec3_t end, edict_t *passent, int contentmask);
+void G_TraceBatch(edict_t *shooter, int count, vec3_t *starts, vec3_t *ends,
+		vec3_t mins, vec3_t maxs, edict_t *passent, int contentmask,
+		trace_t *traces);
+
 char *G_CopyString(char *in);
 
 float *tv(float x, float y, float z);
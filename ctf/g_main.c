@@ -34,6 +34,10 @@ spawn_temp_t st;
 
 int sm_meat_index;
 int snd_fry;
+
+float frametime = FRAMETIME;
+int framediv = 1;
+int subframe;
 int meansOfDeath;
 
 edict_t *g_edicts;
@@ -49,6 +53,7 @@ cvar_t *instantweap;
 cvar_t *password;
 cvar_t *maxclients;
 cvar_t *maxentities;
+cvar_t *sv_features;
 cvar_t *g_select_empty;
 cvar_t *dedicated;
 
@@ -394,7 +399,8 @@ ExitLevel(void)
 }
 
 /*
- * Advances the world by 0.1 seconds
+ * Advances the world by one server frame,
+ * 0.1 seconds unless sv_fps is raised
  */
 void
 G_RunFrame(void)
@@ -402,11 +408,22 @@ G_RunFrame(void)
 	int i;
 	edict_t *ent;
 
-	level.framenum++;
-	level.time = level.framenum * FRAMETIME;
+	/* level.framenum keeps counting tenths of a second,
+	   the frames in between only run physics */
+	subframe = (subframe + 1) % framediv;
+
+	if (!subframe)
+	{
+		level.framenum++;
+	}
+
+	level.time = level.framenum * FRAMETIME + subframe * frametime;
 
 	/* choose a client for monsters to target this frame */
-	AI_SetSightClient();
+	if (!subframe)
+	{
+		AI_SetSightClient();
+	}
 
 	/* exit intermissions */
 
@@ -446,7 +463,11 @@ G_RunFrame(void)
 
 		if ((i > 0) && (i <= maxclients->value))
 		{
-			ClientBeginServerFrame(ent);
+			if (!subframe)
+			{
+				ClientBeginServerFrame(ent);
+			}
+
 			continue;
 		}
 
@@ -344,7 +344,7 @@ SV_FlyMove(edict_t *ent, float time, int mask)
 void
 SV_AddGravity(edict_t *ent)
 {
-	ent->velocity[2] -= ent->gravity * sv_gravity->value * FRAMETIME;
+	ent->velocity[2] -= ent->gravity * sv_gravity->value * frametime;
 }
 
 /*
@@ -741,8 +741,8 @@ SV_Physics_Pusher(edict_t *ent)
 			part->avelocity[0] || part->avelocity[1] || part->avelocity[2])
 		{   
 			/* object is moving */
-			VectorScale(part->velocity, FRAMETIME, move);
-			VectorScale(part->avelocity, FRAMETIME, amove);
+			VectorScale(part->velocity, frametime, move);
+			VectorScale(part->avelocity, frametime, amove);
 
 			if (!SV_Push(part, move, amove))
 			{
@@ -763,7 +763,7 @@ SV_Physics_Pusher(edict_t *ent)
 		{
 			if (mv->nextthink > 0)
 			{
-				mv->nextthink += FRAMETIME;
+				mv->nextthink += frametime;
 			}
 		}
 
@@ -809,8 +809,8 @@ SV_Physics_Noclip(edict_t *ent)
 		return;
 	}
 
-	VectorMA(ent->s.angles, FRAMETIME, ent->avelocity, ent->s.angles);
-	VectorMA(ent->s.origin, FRAMETIME, ent->velocity, ent->s.origin);
+	VectorMA(ent->s.angles, frametime, ent->avelocity, ent->s.angles);
+	VectorMA(ent->s.origin, frametime, ent->velocity, ent->s.origin);
 
 	gi.linkentity(ent);
 }
@@ -878,10 +878,10 @@ SV_Physics_Toss(edict_t *ent)
 	}
 
 	/* move angles */
-	VectorMA(ent->s.angles, FRAMETIME, ent->avelocity, ent->s.angles);
+	VectorMA(ent->s.angles, frametime, ent->avelocity, ent->s.angles);
 
 	/* move origin */
-	VectorScale(ent->velocity, FRAMETIME, move);
+	VectorScale(ent->velocity, frametime, move);
 	trace = SV_PushEntity(ent, move);
 
 	if (!ent->inuse)
@@ -974,8 +974,8 @@ SV_AddRotationalFriction(edict_t *ent)
 	int n;
 	float adjustment;
 
-	VectorMA(ent->s.angles, FRAMETIME, ent->avelocity, ent->s.angles);
-	adjustment = FRAMETIME * sv_stopspeed * sv_friction;
+	VectorMA(ent->s.angles, frametime, ent->avelocity, ent->s.angles);
+	adjustment = frametime * sv_stopspeed * sv_friction;
 
 	for (n = 0; n < 3; n++)
 	{
@@ -1063,7 +1063,7 @@ SV_Physics_Step(edict_t *ent)
 		speed = fabs(ent->velocity[2]);
 		control = speed < sv_stopspeed ? sv_stopspeed : speed;
 		friction = sv_friction / 3;
-		newspeed = speed - (FRAMETIME * control * friction);
+		newspeed = speed - (frametime * control * friction);
 
 		if (newspeed < 0)
 		{
@@ -1080,7 +1080,7 @@ SV_Physics_Step(edict_t *ent)
 		speed = fabs(ent->velocity[2]);
 		control = speed < sv_stopspeed ? sv_stopspeed : speed;
 		newspeed = speed -
-				   (FRAMETIME * control * sv_waterfriction * ent->waterlevel);
+				   (frametime * control * sv_waterfriction * ent->waterlevel);
 
 		if (newspeed < 0)
 		{
@@ -1107,7 +1107,7 @@ SV_Physics_Step(edict_t *ent)
 					friction = sv_friction;
 
 					control = speed < sv_stopspeed ? sv_stopspeed : speed;
-					newspeed = speed - FRAMETIME * control * friction;
+					newspeed = speed - frametime * control * friction;
 
 					if (newspeed < 0)
 					{
@@ -1131,7 +1131,7 @@ SV_Physics_Step(edict_t *ent)
 			mask = MASK_SOLID;
 		}
 
-		SV_FlyMove(ent, FRAMETIME, mask);
+		SV_FlyMove(ent, frametime, mask);
 
 		gi.linkentity(ent);
 		G_TouchTriggers(ent);
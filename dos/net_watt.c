@@ -595,6 +595,21 @@ char *NET_ErrorString (void)
 	return strerror (errno);
 }
 
+/*
+====================
+NET_BeginBatch
+
+No batched sends here, packets go out as they are sent
+====================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+}
+
+void NET_FlushBatch (netsrc_t sock)
+{
+}
+
 // sleeps msec or until net socket is ready
 void NET_Sleep(int msec)
 {
@@ -87,6 +87,11 @@ int	Sys_Milliseconds (void)
 	return curtime;
 }
 
+unsigned Sys_Microseconds (void)
+{
+	return (unsigned)(uclock() * 1000000 / UCLOCKS_PER_SEC);
+}
+
 int	Sys_DOSTime (void) /* FS: DOS needs this for random qport */
 {
 	static time_t secbase;
@@ -207,3 +212,52 @@ void Sys_FindClose (void)
 {
 	findhandle = -1;
 }
+
+/* no threads under DOS: callers fall back to doing the work themselves */
+void	*Sys_CreateThread (void (*func) (void *parm), void *parm)
+{
+	return NULL;
+}
+
+void	Sys_WaitThread (void *thread)
+{
+}
+
+void	*Sys_CreateMutex (void)
+{
+	return NULL;
+}
+
+void	Sys_DestroyMutex (void *mutex)
+{
+}
+
+void	Sys_LockMutex (void *mutex)
+{
+}
+
+void	Sys_UnlockMutex (void *mutex)
+{
+}
+
+void	*Sys_CreateSemaphore (int value)
+{
+	return NULL;
+}
+
+void	Sys_DestroySemaphore (void *sem)
+{
+}
+
+void	Sys_SemaphorePost (void *sem)
+{
+}
+
+void	Sys_SemaphoreWait (void *sem)
+{
+}
+
+int	Sys_NumProcessors (void)
+{
+	return 1;
+}
@@ -28,6 +28,10 @@ spawn_temp_t st;
 
 int sm_meat_index;
 int snd_fry;
+
+float frametime = FRAMETIME;
+int framediv = 1;
+int subframe;
 int meansOfDeath;
 
 edict_t *g_edicts;
@@ -43,6 +47,7 @@ cvar_t *spectator_password;
 cvar_t *needpass;
 cvar_t *maxspectators;
 cvar_t *maxentities;
+cvar_t *sv_features;
 cvar_t *g_select_empty;
 #ifndef GAME_HARD_LINKED
 cvar_t *maxclients;
@@ -435,7 +440,8 @@ void ExitLevel (void)
 ================
 G_RunFrame
 
-Advances the world by 0.1 seconds
+Advances the world by one server frame,
+0.1 seconds unless sv_fps is raised
 ================
 */
 void G_RunFrame (void)
@@ -443,11 +449,22 @@ void G_RunFrame (void)
 	int i;
 	edict_t *ent;
 
-	level.framenum++;
-	level.time = level.framenum * FRAMETIME;
+	/* level.framenum keeps counting tenths of a second,
+	   the frames in between only run physics */
+	subframe = (subframe + 1) % framediv;
+
+	if (!subframe)
+	{
+		level.framenum++;
+	}
+
+	level.time = level.framenum * FRAMETIME + subframe * frametime;
 
 	/* choose a client for monsters to target this frame */
-	AI_SetSightClient();
+	if (!subframe)
+	{
+		AI_SetSightClient();
+	}
 
 	/* exit intermissions */
 	if (level.exitintermission)
@@ -487,7 +504,11 @@ void G_RunFrame (void)
 
 		if ((i > 0) && (i <= maxclients->value))
 		{
-			ClientBeginServerFrame(ent);
+			if (!subframe)
+			{
+				ClientBeginServerFrame(ent);
+			}
+
 			continue;
 		}
 
@@ -374,7 +374,7 @@ SV_AddGravity(edict_t *ent)
 		return;
 	}
 
-	ent->velocity[2] -= ent->gravity * sv_gravity->value * FRAMETIME;
+	ent->velocity[2] -= ent->gravity * sv_gravity->value * frametime;
 }
 
 /*
@@ -790,8 +790,8 @@ SV_Physics_Pusher(edict_t *ent)
 			part->avelocity[0] || part->avelocity[1] || part->avelocity[2])
 		{
 			/* object is moving */
-			VectorScale(part->velocity, FRAMETIME, move);
-			VectorScale(part->avelocity, FRAMETIME, amove);
+			VectorScale(part->velocity, frametime, move);
+			VectorScale(part->avelocity, frametime, amove);
 
 			if (!SV_Push(part, move, amove))
 			{
@@ -813,7 +813,7 @@ SV_Physics_Pusher(edict_t *ent)
 		{
 			if (mv->nextthink > 0)
 			{
-				mv->nextthink += FRAMETIME;
+				mv->nextthink += frametime;
 			}
 		}
 
@@ -869,8 +869,8 @@ SV_Physics_Noclip(edict_t *ent)
 		return;
 	}
 
-	VectorMA(ent->s.angles, FRAMETIME, ent->avelocity, ent->s.angles);
-	VectorMA(ent->s.origin, FRAMETIME, ent->velocity, ent->s.origin);
+	VectorMA(ent->s.angles, frametime, ent->avelocity, ent->s.angles);
+	VectorMA(ent->s.origin, frametime, ent->velocity, ent->s.origin);
 
 	gi.linkentity(ent);
 }
@@ -941,10 +941,10 @@ SV_Physics_Toss(edict_t *ent)
 	}
 
 	/* move angles */
-	VectorMA(ent->s.angles, FRAMETIME, ent->avelocity, ent->s.angles);
+	VectorMA(ent->s.angles, frametime, ent->avelocity, ent->s.angles);
 
 	/* move origin */
-	VectorScale(ent->velocity, FRAMETIME, move);
+	VectorScale(ent->velocity, frametime, move);
 	trace = SV_PushEntity(ent, move);
 
 	if (!ent->inuse)
@@ -1035,8 +1035,8 @@ SV_AddRotationalFriction(edict_t *ent)
 		return;
 	}
 
-	VectorMA(ent->s.angles, FRAMETIME, ent->avelocity, ent->s.angles);
-	adjustment = FRAMETIME * STOPSPEED * FRICTION;
+	VectorMA(ent->s.angles, frametime, ent->avelocity, ent->s.angles);
+	adjustment = frametime * STOPSPEED * FRICTION;
 
 	for (n = 0; n < 3; n++)
 	{
@@ -1129,7 +1129,7 @@ SV_Physics_Step(edict_t *ent)
 		speed = fabs(ent->velocity[2]);
 		control = speed < STOPSPEED ? STOPSPEED : speed;
 		friction = FRICTION / 3;
-		newspeed = speed - (FRAMETIME * control * friction);
+		newspeed = speed - (frametime * control * friction);
 
 		if (newspeed < 0)
 		{
@@ -1145,7 +1145,7 @@ SV_Physics_Step(edict_t *ent)
 	{
 		speed = fabs(ent->velocity[2]);
 		control = speed < STOPSPEED ? STOPSPEED : speed;
-		newspeed = speed - (FRAMETIME * control * WATERFRICTION * ent->waterlevel);
+		newspeed = speed - (frametime * control * WATERFRICTION * ent->waterlevel);
 
 		if (newspeed < 0)
 		{
@@ -1172,7 +1172,7 @@ SV_Physics_Step(edict_t *ent)
 					friction = FRICTION;
 
 					control = speed < STOPSPEED ? STOPSPEED : speed;
-					newspeed = speed - FRAMETIME * control * friction;
+					newspeed = speed - frametime * control * friction;
 
 					if (newspeed < 0)
 					{
@@ -1196,7 +1196,7 @@ SV_Physics_Step(edict_t *ent)
 			mask = MASK_SOLID;
 		}
 
-		SV_FlyMove(ent, FRAMETIME, mask);
+		SV_FlyMove(ent, frametime, mask);
 
 		gi.linkentity(ent);
 		G_TouchTriggers(ent);
@@ -202,6 +202,8 @@ field_t clientfields[] = {
 void
 InitGame(void)
 {
+	cvar_t *fps;
+
 	gi.dprintf(DEVELOPER_MSG_SAVE, "Game is starting up.\n");
 	gi.dprintf(DEVELOPER_MSG_SAVE, "Game is %s built on %s.\n", GAMEVERSION, __DATE__);
 
@@ -227,6 +229,26 @@ InitGame(void)
 	skill = gi.cvar("skill", "1", CVAR_LATCH);
 	maxentities = gi.cvar("maxentities", "1024", CVAR_LATCH);
 
+	/* imports this engine has past the original table */
+	sv_features = gi.cvar("sv_features", "0", CVAR_NOSET);
+
+	/* run physics at sv_fps, the engine only uses it if
+	   g_features says so */
+	fps = gi.cvar("sv_fps", "10", CVAR_LATCH);
+	framediv = (int)fps->value / 10;
+
+	if (framediv < 1)
+	{
+		framediv = 1;
+	}
+	else if (framediv > 4)
+	{
+		framediv = 4;
+	}
+
+	frametime = FRAMETIME / framediv;
+	gi.cvar_forceset("g_features", va("%i", GMF_VARIABLE_FPS));
+
 	/* change anytime vars */
 	dmflags = gi.cvar("dmflags", "0", CVAR_SERVERINFO);
 	fraglimit = gi.cvar("fraglimit", "0", CVAR_SERVERINFO);
@@ -603,6 +603,7 @@ void SpawnEntities (char *mapname, char *entities, char *spawnpoint)
 	gi.FreeTags(TAG_LEVEL);
 
 	memset(&level, 0, sizeof(level));
+	subframe = 0;
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
 
 	strncpy(level.mapname, mapname, sizeof(level.mapname) - 1);
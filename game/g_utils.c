@@ -684,3 +684,44 @@ KillBox(edict_t *ent)
 	return true; /* all clear */
 }
 
+/*
+ * gi.unlagged_trace where the engine has it,
+ * a plain trace against the present otherwise.
+ */
+trace_t
+G_UnlaggedTrace(edict_t *shooter, vec3_t start, vec3_t mins, vec3_t maxs,
+		vec3_t end, edict_t *passent, int contentmask)
+{
+	if ((int)sv_features->value & SVFEAT_UNLAGGED_TRACE)
+	{
+		return gi.unlagged_trace(shooter, start, mins, maxs, end,
+				passent, contentmask);
+	}
+
+	return gi.trace(start, mins, maxs, end, passent, contentmask);
+}
+
+/*
+ * gi.trace_batch where the engine has it,
+ * a G_UnlaggedTrace for each ray otherwise.
+ */
+void
+G_TraceBatch(edict_t *shooter, int count, vec3_t *starts, vec3_t *ends,
+		vec3_t mins, vec3_t maxs, edict_t *passent, int contentmask,
+		trace_t *traces)
+{
+	int i;
+
+	if ((int)sv_features->value & SVFEAT_TRACE_BATCH)
+	{
+		gi.trace_batch(shooter, count, starts, ends, mins, maxs, passent,
+				contentmask, traces);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		traces[i] = G_UnlaggedTrace(shooter, starts[i], mins, maxs, ends[i],
+				passent, contentmask);
+	}
+}
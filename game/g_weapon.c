@@ -153,111 +153,85 @@ fire_hit(edict_t *self, vec3_t aim, int damage, int kick)
 	return true;
 }
 
+#define MAX_PELLETS 32 /* traced together, see G_TraceBatch */
+
 /*
- * This is an internal support routine
- * used for bullet/pellet based weapons.
+ * Bends a pellet that entered water and traces
+ * the rest of its way, ignoring the water.
  */
-void
-fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick,
-		int te_impact, int hspread, int vspread, int mod)
+static void
+fire_lead_water(edict_t *self, vec3_t start, vec3_t end, int hspread,
+		int vspread, trace_t *tr, vec3_t water_start)
 {
-	trace_t tr;
 	vec3_t dir;
 	vec3_t forward, right, up;
-	vec3_t end;
 	float r;
 	float u;
-	vec3_t water_start;
-	qboolean water = false;
-	int content_mask = MASK_SHOT | MASK_WATER;
-
-	if (!self)
-	{
-		return;
-	}
+	int color;
 
-	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+	VectorCopy(tr->endpos, water_start);
 
-	if (!(tr.fraction < 1.0))
+	if (!VectorCompare(start, tr->endpos))
 	{
-		vectoangles(aimdir, dir);
-		AngleVectors(dir, forward, right, up);
-
-		r = crandom() * hspread;
-		u = crandom() * vspread;
-		VectorMA(start, 8192, forward, end);
-		VectorMA(end, r, right, end);
-		VectorMA(end, u, up, end);
-
-		if (gi.pointcontents(start) & MASK_WATER)
+		if (tr->contents & CONTENTS_WATER)
 		{
-			water = true;
-			VectorCopy(start, water_start);
-			content_mask &= ~MASK_WATER;
+			if (strcmp(tr->surface->name, "*brwater") == 0)
+			{
+				color = SPLASH_BROWN_WATER;
+			}
+			else
+			{
+				color = SPLASH_BLUE_WATER;
+			}
 		}
-
-		tr = gi.trace(start, NULL, NULL, end, self, content_mask);
-
-		/* see if we hit water */
-		if (tr.contents & MASK_WATER)
+		else if (tr->contents & CONTENTS_SLIME)
 		{
-			int color;
-
-			water = true;
-			VectorCopy(tr.endpos, water_start);
+			color = SPLASH_SLIME;
+		}
+		else if (tr->contents & CONTENTS_LAVA)
+		{
+			color = SPLASH_LAVA;
+		}
+		else
+		{
+			color = SPLASH_UNKNOWN;
+		}
 
-			if (!VectorCompare(start, tr.endpos))
-			{
-				if (tr.contents & CONTENTS_WATER)
-				{
-					if (strcmp(tr.surface->name, "*brwater") == 0)
-					{
-						color = SPLASH_BROWN_WATER;
-					}
-					else
-					{
-						color = SPLASH_BLUE_WATER;
-					}
-				}
-				else if (tr.contents & CONTENTS_SLIME)
-				{
-					color = SPLASH_SLIME;
-				}
-				else if (tr.contents & CONTENTS_LAVA)
-				{
-					color = SPLASH_LAVA;
-				}
-				else
-				{
-					color = SPLASH_UNKNOWN;
-				}
+		if (color != SPLASH_UNKNOWN)
+		{
+			gi.WriteByte(svc_temp_entity);
+			gi.WriteByte(TE_SPLASH);
+			gi.WriteByte(8);
+			gi.WritePosition(tr->endpos);
+			gi.WriteDir(tr->plane.normal);
+			gi.WriteByte(color);
+			gi.multicast(tr->endpos, MULTICAST_PVS);
+		}
 
-				if (color != SPLASH_UNKNOWN)
-				{
-					gi.WriteByte(svc_temp_entity);
-					gi.WriteByte(TE_SPLASH);
-					gi.WriteByte(8);
-					gi.WritePosition(tr.endpos);
-					gi.WriteDir(tr.plane.normal);
-					gi.WriteByte(color);
-					gi.multicast(tr.endpos, MULTICAST_PVS);
-				}
+		/* change bullet's course when it enters water */
+		VectorSubtract(end, start, dir);
+		vectoangles(dir, dir);
+		AngleVectors(dir, forward, right, up);
+		r = crandom() * hspread * 2;
+		u = crandom() * vspread * 2;
+		VectorMA(water_start, 8192, forward, end);
+		VectorMA(end, r, right, end);
+		VectorMA(end, u, up, end);
+	}
 
-				/* change bullet's course when it enters water */
-				VectorSubtract(end, start, dir);
-				vectoangles(dir, dir);
-				AngleVectors(dir, forward, right, up);
-				r = crandom() * hspread * 2;
-				u = crandom() * vspread * 2;
-				VectorMA(water_start, 8192, forward, end);
-				VectorMA(end, r, right, end);
-				VectorMA(end, u, up, end);
-			}
+	/* re-trace ignoring water this time */
+	*tr = G_UnlaggedTrace(self, water_start, NULL, NULL, end, self, MASK_SHOT);
+}
 
-			/* re-trace ignoring water this time */
-			tr = gi.trace(water_start, NULL, NULL, end, self, MASK_SHOT);
-		}
-	}
+/*
+ * Damage or a puff where the pellet hit, and a
+ * bubble trail for the part of it under water.
+ */
+static void
+fire_lead_impact(edict_t *self, vec3_t aimdir, trace_t tr, qboolean water,
+		vec3_t water_start, int damage, int kick, int te_impact, int mod)
+{
+	vec3_t dir;
 
 	/* send gun puff / flash */
 	if (!((tr.surface) && (tr.surface->flags & SURF_SKY)))
@@ -318,6 +292,95 @@ fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick,
 	}
 }
 
+/*
+ * This is an internal support routine
+ * used for bullet/pellet based weapons.
+ * All the pellets of one shot are traced
+ * together, they start at the same place
+ * and mostly end up close together.
+ */
+void
+fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick,
+		int te_impact, int hspread, int vspread, int count, int mod)
+{
+	trace_t tr;
+	trace_t traces[MAX_PELLETS];
+	vec3_t starts[MAX_PELLETS], ends[MAX_PELLETS];
+	vec3_t dir;
+	vec3_t forward, right, up;
+	float r;
+	float u;
+	vec3_t water_start;
+	qboolean startwater, water;
+	int content_mask = MASK_SHOT | MASK_WATER;
+	int i, n;
+
+	if (!self)
+	{
+		return;
+	}
+
+	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+
+	if (tr.fraction < 1.0)
+	{
+		/* the muzzle is in a wall, every pellet hits it */
+		for (i = 0; i < count; i++)
+		{
+			fire_lead_impact(self, aimdir, tr, false, NULL, damage, kick,
+					te_impact, mod);
+		}
+
+		return;
+	}
+
+	vectoangles(aimdir, dir);
+	AngleVectors(dir, forward, right, up);
+
+	startwater = false;
+
+	if (gi.pointcontents(start) & MASK_WATER)
+	{
+		startwater = true;
+		content_mask &= ~MASK_WATER;
+	}
+
+	for ( ; count > 0; count -= n)
+	{
+		n = count < MAX_PELLETS ? count : MAX_PELLETS;
+
+		for (i = 0; i < n; i++)
+		{
+			r = crandom() * hspread;
+			u = crandom() * vspread;
+			VectorCopy(start, starts[i]);
+			VectorMA(start, 8192, forward, ends[i]);
+			VectorMA(ends[i], r, right, ends[i]);
+			VectorMA(ends[i], u, up, ends[i]);
+		}
+
+		G_TraceBatch(self, n, starts, ends, NULL, NULL, self,
+				content_mask, traces);
+
+		for (i = 0; i < n; i++)
+		{
+			water = startwater;
+			VectorCopy(start, water_start);
+
+			/* see if we hit water */
+			if (traces[i].contents & MASK_WATER)
+			{
+				water = true;
+				fire_lead_water(self, start, ends[i], hspread, vspread,
+						&traces[i], water_start);
+			}
+
+			fire_lead_impact(self, aimdir, traces[i], water, water_start,
+					damage, kick, te_impact, mod);
+		}
+	}
+}
+
 /*
  * Fires a single round.  Used for machinegun and
  * chaingun.  Would be fine for pistols, rifles, etc....
@@ -332,7 +395,7 @@ fire_bullet(edict_t *self, vec3_t start, vec3_t aimdir, int damage,
 	}
 
 	fire_lead(self, start, aimdir, damage, kick, TE_GUNSHOT, hspread,
-			vspread, mod);
+			vspread, 1, mod);
 }
 
 /*
@@ -343,18 +406,13 @@ void
 fire_shotgun(edict_t *self, vec3_t start, vec3_t aimdir, int damage,
 		int kick, int hspread, int vspread, int count, int mod)
 {
-	int i;
-
 	if (!self)
 	{
 		return;
 	}
 
-	for (i = 0; i < count; i++)
-	{
-		fire_lead(self, start, aimdir, damage, kick, TE_SHOTGUN,
-				hspread, vspread, mod);
-	}
+	fire_lead(self, start, aimdir, damage, kick, TE_SHOTGUN,
+			hspread, vspread, count, mod);
 }
 
 /*
@@ -876,7 +934,7 @@ fire_rail(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick)
 
 	while (ignore)
 	{
-		tr = gi.trace(from, NULL, NULL, end, ignore, mask);
+		tr = G_UnlaggedTrace(self, from, NULL, NULL, end, ignore, mask);
 
 		if (tr.contents & (CONTENTS_SLIME | CONTENTS_LAVA))
 		{
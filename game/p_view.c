@@ -1248,6 +1248,12 @@ ClientEndServerFrame(edict_t *ent)
 		current_client->ps.pmove.velocity[i] = ent->velocity[i] * 8.0;
 	}
 
+	/* the rest of the view only changes once per FRAMETIME */
+	if (subframe)
+	{
+		return;
+	}
+
 	/* If the end of unit layout is displayed, don't give
 	   the player any normal movement attributes */
 	if (level.intermissiontime)
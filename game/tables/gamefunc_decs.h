@@ -619,9 +619,11 @@ extern void fire_blaster ( edict_t * self , vec3_t start , vec3_t dir , int dama
 extern void blaster_touch ( edict_t * self , edict_t * other , cplane_t * plane , csurface_t * surf ) ;
 extern void fire_shotgun ( edict_t * self , vec3_t start , vec3_t aimdir , int damage , int kick , int hspread , int vspread , int count , int mod ) ;
 extern void fire_bullet ( edict_t * self , vec3_t start , vec3_t aimdir , int damage , int kick , int hspread , int vspread , int mod ) ;
-extern void fire_lead ( edict_t * self , vec3_t start , vec3_t aimdir , int damage , int kick , int te_impact , int hspread , int vspread , int mod ) ;
+extern void fire_lead ( edict_t * self , vec3_t start , vec3_t aimdir , int damage , int kick , int te_impact , int hspread , int vspread , int count , int mod ) ;
 extern qboolean fire_hit ( edict_t * self , vec3_t aim , int damage , int kick ) ;
 extern void check_dodge ( edict_t * self , vec3_t start , vec3_t dir , int speed ) ;
+extern void G_TraceBatch ( edict_t * shooter , int count , vec3_t * starts , vec3_t * ends , vec3_t mins , vec3_t maxs , edict_t * passent , int contentmask , trace_t * traces ) ;
+extern trace_t G_UnlaggedTrace ( edict_t * shooter , vec3_t start , vec3_t mins , vec3_t maxs , vec3_t end , edict_t * passent , int contentmask ) ;
 extern qboolean KillBox ( edict_t * ent ) ;
 extern void G_TouchSolids ( edict_t * ent ) ;
 extern void G_TouchTriggers ( edict_t * ent ) ;
@@ -622,6 +622,8 @@
 {"fire_lead", (byte *)fire_lead},
 {"fire_hit", (byte *)fire_hit},
 {"check_dodge", (byte *)check_dodge},
+{"G_TraceBatch", (byte *)G_TraceBatch},
+{"G_UnlaggedTrace", (byte *)G_UnlaggedTrace},
 {"KillBox", (byte *)KillBox},
 {"G_TouchSolids", (byte *)G_TouchSolids},
 {"G_TouchTriggers", (byte *)G_TouchTriggers},
@@ -1,4 +1,7 @@
 // net_bsd.c
+#ifdef __linux__
+#define _GNU_SOURCE		// recvmmsg, sendmmsg
+#endif
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -9,6 +12,10 @@
 
 #include "qcommon.h"
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define USE_MMSG		// batched receive and send, one syscall for many packets
+#endif
+
 
 #define	MAX_LOOPBACK	4
 typedef struct
@@ -25,11 +32,50 @@ typedef struct
 cvar_t		*net_shownet;
 static cvar_t	*noudp;
 static cvar_t	*noipx;
+#ifdef USE_MMSG
+static cvar_t	*net_mmsg;
+#endif
 
 loopback_t	loopbacks[2];
 int			ip_sockets[2];
 int			ipx_sockets[2];
 
+// set by the dedicated server loop in sys_linux.c, which does the
+// waiting itself so it can wake up on a microsecond deadline
+qboolean	net_deferredsleep;
+int			net_sleepmsec = -1;		// what the last NET_Sleep asked for
+
+#ifdef USE_MMSG
+#define	MMSG_RECV		16		// packets pulled in per recvmmsg
+#define	MMSG_SEND		64		// datagrams queued before a sendmmsg
+#define	MMSG_SENDBYTES	0x20000
+
+typedef struct
+{
+	byte				data[MMSG_RECV][MAX_MSGLEN];
+	struct sockaddr_in	from[MMSG_RECV];
+	struct mmsghdr		msgs[MMSG_RECV];
+	struct iovec		iov[MMSG_RECV];
+	int					count, next;
+} recvbatch_t;
+
+typedef struct
+{
+	qboolean			active;		// between NET_BeginBatch and NET_FlushBatch
+	int					count, bytes;
+	int					sockets[MMSG_SEND];
+	netadr_t			to[MMSG_SEND];
+	struct sockaddr		addr[MMSG_SEND];
+	struct mmsghdr		msgs[MMSG_SEND];
+	struct iovec		iov[MMSG_SEND];
+	byte				data[MMSG_SENDBYTES];
+} sendbatch_t;
+
+recvbatch_t	recvbatch[2];
+sendbatch_t	sendbatch[2];
+qboolean	mmsg_broken;	// ENOSYS, stay on recvfrom and sendto
+#endif
+
 //=============================================================================
 
 void NetadrToSockadr (netadr_t *a, struct sockaddr *s)
@@ -236,6 +282,62 @@ void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
 
 //=============================================================================
 
+#ifdef USE_MMSG
+/*
+====================
+NET_RecvBatched
+
+Hands out the packets of the last recvmmsg, reading a new batch
+once they have all been used.  Returns the same as recvfrom.
+====================
+*/
+int NET_RecvBatched (netsrc_t sock, struct sockaddr *from, socklen_t *fromlen, byte *data, int maxsize)
+{
+	recvbatch_t	*b;
+	int			i, ret;
+
+	b = &recvbatch[sock];
+	if (b->next >= b->count)
+	{
+		b->count = b->next = 0;
+		memset (b->msgs, 0, sizeof(b->msgs));
+		for (i=0 ; i<MMSG_RECV ; i++)
+		{
+			b->iov[i].iov_base = b->data[i];
+			b->iov[i].iov_len = MAX_MSGLEN;
+			b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+			b->msgs[i].msg_hdr.msg_iovlen = 1;
+			b->msgs[i].msg_hdr.msg_name = &b->from[i];
+			b->msgs[i].msg_hdr.msg_namelen = sizeof(b->from[i]);
+		}
+
+		ret = recvmmsg (ip_sockets[sock], b->msgs, MMSG_RECV, MSG_DONTWAIT, NULL);
+		if (ret == -1 && errno == ENOSYS)
+		{	// old kernel, go back to one packet at a time for good
+			mmsg_broken = true;
+			return recvfrom (ip_sockets[sock], (char *)data, maxsize, 0, from, fromlen);
+		}
+		if (ret <= 0)
+		{
+			if (!ret)
+				errno = EWOULDBLOCK;
+			return -1;
+		}
+		b->count = ret;
+	}
+
+	i = b->next++;
+	ret = b->msgs[i].msg_len;
+	if (ret > maxsize)
+		ret = maxsize;	// recvfrom truncates the same way
+
+	memset (from, 0, *fromlen);
+	memcpy (from, &b->from[i], sizeof(b->from[i]));
+	memcpy (data, b->data[i], ret);
+	return ret;
+}
+#endif
+
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
 	int 	ret;
@@ -249,6 +351,11 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 	if (!net_socket)
 		return false;
 	fromlen = sizeof(from);
+#ifdef USE_MMSG
+	if (!mmsg_broken && net_mmsg->intValue)
+		ret = NET_RecvBatched (sock, &from, &fromlen, net_message->data, net_message->maxsize);
+	else
+#endif
 	ret = recvfrom (net_socket, (char *)net_message->data, net_message->maxsize, 0,
 			(struct sockaddr *)&from, &fromlen);
 	if (ret == -1)
@@ -274,6 +381,135 @@ qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_messag
 
 //=============================================================================
 
+void NET_SendError (netadr_t to)
+{
+	int err = errno;
+
+	// wouldblock is silent
+	if (err == EWOULDBLOCK)
+		return;
+
+	// some PPP links dont allow broadcasts
+	if ((err == EADDRNOTAVAIL) && ((to.type == NA_BROADCAST) || (to.type == NA_BROADCAST_IPX)))
+		return;
+	if (dedicated->intValue)	// let dedicated servers continue after errors
+	{
+		Com_Printf ("NET_SendPacket ERROR: %s\n", NET_ErrorString());
+	}
+	else
+	{
+		if (err == EADDRNOTAVAIL)
+		{
+			Com_DPrintf (DEVELOPER_MSG_NET, "NET_SendPacket Warning: %s : %s\n", NET_ErrorString(), NET_AdrToString (to));
+		}
+		else
+		{
+			Com_Error (ERR_DROP, "NET_SendPacket ERROR: %s\n", NET_ErrorString());
+		}
+	}
+}
+
+#ifdef USE_MMSG
+/*
+====================
+NET_SendQueued
+
+Sends everything queued on sock, one sendmmsg per run of
+datagrams going out the same socket
+====================
+*/
+void NET_SendQueued (netsrc_t sock)
+{
+	sendbatch_t	*b;
+	int			start, n, ret;
+
+	b = &sendbatch[sock];
+	for (start=0 ; start<b->count ; )
+	{
+		for (n=1 ; start+n < b->count && b->sockets[start+n] == b->sockets[start] ; n++)
+			;
+
+		if (mmsg_broken)
+			ret = -1;
+		else
+		{
+			ret = sendmmsg (b->sockets[start], &b->msgs[start], n, 0);
+			if (ret == -1 && errno == ENOSYS)
+				mmsg_broken = true;
+		}
+
+		if (mmsg_broken)
+		{	// old kernel, send them one by one
+			ret = sendto (b->sockets[start], b->iov[start].iov_base, b->iov[start].iov_len, 0,
+					&b->addr[start], sizeof(b->addr[start]));
+			if (ret != -1)
+				ret = 1;
+		}
+
+		if (ret == -1)
+		{	// the first one failed, report it and carry on after it
+			NET_SendError (b->to[start]);
+			ret = 1;
+		}
+		start += ret;
+	}
+
+	b->count = 0;
+	b->bytes = 0;
+}
+
+void NET_QueuePacket (netsrc_t sock, int net_socket, int length, void *data, netadr_t *to, struct sockaddr *addr)
+{
+	sendbatch_t	*b;
+	int			i;
+
+	b = &sendbatch[sock];
+	if (b->count == MMSG_SEND || b->bytes + length > MMSG_SENDBYTES)
+		NET_SendQueued (sock);
+
+	i = b->count++;
+	b->sockets[i] = net_socket;
+	b->to[i] = *to;
+	b->addr[i] = *addr;
+
+	memcpy (b->data + b->bytes, data, length);
+	b->iov[i].iov_base = b->data + b->bytes;
+	b->iov[i].iov_len = length;
+	b->bytes += length;
+
+	memset (&b->msgs[i], 0, sizeof(b->msgs[i]));
+	b->msgs[i].msg_hdr.msg_name = &b->addr[i];
+	b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+	b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+	b->msgs[i].msg_hdr.msg_iovlen = 1;
+}
+#endif
+
+/*
+====================
+NET_BeginBatch
+
+Datagrams sent on sock are held back until NET_FlushBatch,
+then handed to the kernel in as few calls as possible
+====================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+#ifdef USE_MMSG
+	// anything left over from a frame that was cut short
+	NET_SendQueued (sock);
+	sendbatch[sock].active = true;
+#endif
+}
+
+void NET_FlushBatch (netsrc_t sock)
+{
+#ifdef USE_MMSG
+	sendbatch[sock].active = false;
+	NET_SendQueued (sock);
+#endif
+}
+
 void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 {
 	int		ret;
@@ -316,34 +552,17 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	}
 	NetadrToSockadr (&to, &addr);
 
-	ret = sendto (net_socket, (const char *)data, length, 0, &addr, sizeof(addr));
-	if (ret == -1)
+#ifdef USE_MMSG
+	if (sendbatch[sock].active && to.type == NA_IP && !mmsg_broken && net_mmsg->intValue)
 	{
-		int err = errno;
-
-		// wouldblock is silent
-		if (err == EWOULDBLOCK)
-			return;
-
-		// some PPP links dont allow broadcasts
-		if ((err == EADDRNOTAVAIL) && ((to.type == NA_BROADCAST) || (to.type == NA_BROADCAST_IPX)))
-			return;
-		if (dedicated->intValue)	// let dedicated servers continue after errors
-		{
-			Com_Printf ("NET_SendPacket ERROR: %s\n", NET_ErrorString());
-		}
-		else
-		{
-			if (err == EADDRNOTAVAIL)
-			{
-				Com_DPrintf (DEVELOPER_MSG_NET, "NET_SendPacket Warning: %s : %s\n", NET_ErrorString(), NET_AdrToString (to));
-			}
-			else
-			{
-				Com_Error (ERR_DROP, "NET_SendPacket ERROR: %s\n", NET_ErrorString());
-			}
-		}
+		NET_QueuePacket (sock, net_socket, length, data, &to, &addr);
+		return;
 	}
+#endif
+
+	ret = sendto (net_socket, (const char *)data, length, 0, &addr, sizeof(addr));
+	if (ret == -1)
+		NET_SendError (to);
 }
 
 //=============================================================================
@@ -494,6 +713,10 @@ void	NET_Config (qboolean multiplayer)
 				close (ip_sockets[i]);
 				ip_sockets[i] = 0;
 			}
+#ifdef USE_MMSG
+			recvbatch[i].count = recvbatch[i].next = 0;
+			sendbatch[i].count = sendbatch[i].bytes = 0;
+#endif
 		}
 	}
 	else
@@ -516,6 +739,11 @@ void NET_Init (void)
 	noipx = Cvar_Get ("noipx", "0", CVAR_NOSET);
 
 	net_shownet = Cvar_Get ("net_shownet", "0", 0);
+
+#ifdef USE_MMSG
+	net_mmsg = Cvar_Get ("net_mmsg", "1", 0);
+	Cvar_SetDescription ("net_mmsg", "Receive and send UDP packets in batches with recvmmsg and sendmmsg.");
+#endif
 }
 
 /*
@@ -549,6 +777,12 @@ void NET_Sleep(int msec)
 		return; // we're not a server, just run full speed
 	}
 
+	if (net_deferredsleep)
+	{
+		net_sleepmsec = msec;
+		return;
+	}
+
 	FD_ZERO(&fdset);
 	FD_SET(ip_sockets[NS_SERVER], &fdset); // network socket
 	timeout.tv_sec = (long)msec/1000;
@@ -10,6 +10,9 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdlib.h>
 
 #include <string.h>
 #include <ctype.h>
@@ -161,6 +164,27 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+unsigned Sys_Microseconds (void)
+{
+#ifdef __linux__
+	struct timespec ts;
+
+	// monotonic, so frame pacing doesn't jump when the clock is set
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (unsigned)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tp;
+
+	gettimeofday (&tp, NULL);
+	return (unsigned)tp.tv_sec * 1000000 + tp.tv_usec;
+#endif
+}
+
 //===============================================================================
 
 void Sys_Mkdir (char *path)
@@ -258,3 +282,147 @@ void Sys_FindClose (void)
 		closedir(fdir);
 	fdir = NULL;
 }
+
+//============================================
+
+/*
+================
+Sys_CreateThread
+
+pthreads backed threading primitives.  Semaphores are built from a
+mutex and a condition variable since OS X lacks unnamed semaphores.
+================
+*/
+typedef struct
+{
+	pthread_t	handle;
+	void		(*func) (void *parm);
+	void		*parm;
+} systhread_t;
+
+typedef struct
+{
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int				value;
+} syssem_t;
+
+static void *Sys_ThreadMain (void *arg)
+{
+	systhread_t	*t = (systhread_t *)arg;
+
+	t->func (t->parm);
+	return NULL;
+}
+
+void *Sys_CreateThread (void (*func) (void *parm), void *parm)
+{
+	systhread_t	*t;
+
+	t = malloc (sizeof(*t));
+	if (!t)
+		return NULL;
+	t->func = func;
+	t->parm = parm;
+	if (pthread_create (&t->handle, NULL, Sys_ThreadMain, t))
+	{
+		free (t);
+		return NULL;
+	}
+	return t;
+}
+
+void Sys_WaitThread (void *thread)
+{
+	systhread_t	*t = (systhread_t *)thread;
+
+	if (!t)
+		return;
+	pthread_join (t->handle, NULL);
+	free (t);
+}
+
+void *Sys_CreateMutex (void)
+{
+	pthread_mutex_t	*m;
+
+	m = malloc (sizeof(*m));
+	if (m)
+		pthread_mutex_init (m, NULL);
+	return m;
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+	if (!mutex)
+		return;
+	pthread_mutex_destroy ((pthread_mutex_t *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+	if (mutex)
+		pthread_mutex_lock ((pthread_mutex_t *)mutex);
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+	if (mutex)
+		pthread_mutex_unlock ((pthread_mutex_t *)mutex);
+}
+
+void *Sys_CreateSemaphore (int value)
+{
+	syssem_t	*s;
+
+	s = malloc (sizeof(*s));
+	if (!s)
+		return NULL;
+	pthread_mutex_init (&s->lock, NULL);
+	pthread_cond_init (&s->cond, NULL);
+	s->value = value;
+	return s;
+}
+
+void Sys_DestroySemaphore (void *sem)
+{
+	syssem_t	*s = (syssem_t *)sem;
+
+	if (!s)
+		return;
+	pthread_cond_destroy (&s->cond);
+	pthread_mutex_destroy (&s->lock);
+	free (s);
+}
+
+void Sys_SemaphorePost (void *sem)
+{
+	syssem_t	*s = (syssem_t *)sem;
+
+	pthread_mutex_lock (&s->lock);
+	s->value++;
+	pthread_cond_signal (&s->cond);
+	pthread_mutex_unlock (&s->lock);
+}
+
+void Sys_SemaphoreWait (void *sem)
+{
+	syssem_t	*s = (syssem_t *)sem;
+
+	pthread_mutex_lock (&s->lock);
+	while (s->value <= 0)
+		pthread_cond_wait (&s->cond, &s->lock);
+	s->value--;
+	pthread_mutex_unlock (&s->lock);
+}
+
+int Sys_NumProcessors (void)
+{
+	long	n;
+
+	n = sysconf (_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	return (int)n;
+}
@@ -13,6 +13,10 @@
 #ifdef __FreeBSD__
 #include <sys/sysctl.h>
 #endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 #include <dlfcn.h>
 
 #ifdef SDL_CLIENT
@@ -377,6 +381,207 @@ static void Init_PrefDir()
 
 //=======================================================================
 
+#ifdef __linux__
+/*
+=======================================================================
+
+DEDICATED SERVER EVENT LOOP
+
+Waits in epoll for the server socket, stdin or a timerfd set to the
+microsecond the next server frame is due, instead of a select with a
+millisecond timeout on top of an 8 msec nap.  Qcommon_Frame still
+gets whole milliseconds, the remainder is carried over so
+svs.realtime follows the microsecond clock without drifting.
+
+=======================================================================
+*/
+
+extern int		ip_sockets[2];
+extern qboolean	net_deferredsleep;
+extern int		net_sleepmsec;
+
+#define	JITTER_BUCKETS	7
+
+static const int jitter_limits[JITTER_BUCKETS-1] = {10, 50, 100, 250, 500, 1000};
+
+typedef struct
+{
+	int			count;
+	double		total;
+	int			max;
+	int			buckets[JITTER_BUCKETS];
+} jitter_t;
+
+static jitter_t	sys_jitter;
+
+static void Sys_RecordJitter (int late)
+{
+	int		i;
+
+	for (i=0 ; i<JITTER_BUCKETS-1 ; i++)
+	{
+		if (late < jitter_limits[i])
+			break;
+	}
+	sys_jitter.buckets[i]++;
+	sys_jitter.count++;
+	sys_jitter.total += late;
+	if (late > sys_jitter.max)
+		sys_jitter.max = late;
+}
+
+/*
+================
+Sys_Jitter_f
+
+How late the server frames started compared to when they were due
+================
+*/
+static void Sys_Jitter_f (void)
+{
+	int		i;
+
+	if (!sys_jitter.count)
+	{
+		Com_Printf ("No timed frame starts yet.\n");
+		return;
+	}
+
+	Com_Printf ("%i timed frame starts, late by %.1f usec average, %i usec max\n",
+		sys_jitter.count, sys_jitter.total / sys_jitter.count, sys_jitter.max);
+	for (i=0 ; i<JITTER_BUCKETS ; i++)
+	{
+		if (i < JITTER_BUCKETS-1)
+			Com_Printf ("  < %4i usec: ", jitter_limits[i]);
+		else
+			Com_Printf (" >= %4i usec: ", jitter_limits[i-1]);
+		Com_Printf ("%5.1f%%\n", 100.0 * sys_jitter.buckets[i] / sys_jitter.count);
+	}
+
+	if (Cmd_Argc() > 1 && !Q_stricmp (Cmd_Argv(1), "reset"))
+		memset (&sys_jitter, 0, sizeof(sys_jitter));
+}
+
+static void Sys_Watch (int epfd, int op, int fd)
+{
+	struct epoll_event	ev;
+
+	memset (&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl (epfd, op, fd, &ev);
+}
+
+/*
+================
+Sys_DedicatedLoop
+
+Only returns if epoll or timerfd can't be used
+================
+*/
+static void Sys_DedicatedLoop (void)
+{
+	int					epfd, timerfd;
+	int					watched;
+	qboolean			watchstdin;
+	struct epoll_event	events[4];
+	struct itimerspec	its;
+	unsigned			now, last, deadline;
+	int					elapsed, carry, msec, wait, i, n;
+	qboolean			timed;
+	byte				expirations[8];
+
+	epfd = epoll_create (4);
+	if (epfd == -1)
+		return;
+	timerfd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (timerfd == -1)
+	{
+		close (epfd);
+		return;
+	}
+
+	Sys_Watch (epfd, EPOLL_CTL_ADD, timerfd);
+	watchstdin = stdin_active;
+	if (watchstdin)
+		Sys_Watch (epfd, EPOLL_CTL_ADD, 0);
+	watched = 0;
+
+	net_deferredsleep = true;
+	Cmd_AddCommand ("sys_jitter", Sys_Jitter_f);
+
+	memset (&its, 0, sizeof(its));
+	timed = false;
+	deadline = 0;
+	carry = 0;
+	last = Sys_Microseconds ();
+
+	while (1)
+	{
+		now = Sys_Microseconds ();
+		elapsed = (int)(now - last) + carry;
+		last = now;
+		msec = elapsed / 1000;
+		carry = elapsed % 1000;
+
+		if (timed && (int)(now - deadline) >= 0)
+			Sys_RecordJitter ((int)(now - deadline));
+		timed = false;
+
+		if (msec < 1)
+		{	// not even a millisecond since the last frame
+			usleep (1000 - carry);
+			continue;
+		}
+
+		net_sleepmsec = -1;
+		Sys_Milliseconds ();	// keeps curtime current for the netchans
+		Qcommon_Frame (msec);
+
+		// NET_Config can close and reopen the server socket
+		if (ip_sockets[NS_SERVER] != watched)
+		{
+			if (watched)
+				Sys_Watch (epfd, EPOLL_CTL_DEL, watched);
+			watched = ip_sockets[NS_SERVER];
+			if (watched)
+				Sys_Watch (epfd, EPOLL_CTL_ADD, watched);
+		}
+		if (watchstdin && !stdin_active)
+		{	// eof, it would be readable forever
+			Sys_Watch (epfd, EPOLL_CTL_DEL, 0);
+			watchstdin = false;
+		}
+
+		// the time svs.realtime reaches sv.time
+		if (net_sleepmsec > 0)
+		{
+			deadline = last - carry + net_sleepmsec * 1000;
+			timed = true;
+		}
+		else if (Com_ServerState ())
+			deadline = last - carry + 1000;
+		else
+			deadline = last - carry + 8000;	// no map running
+
+		wait = (int)(deadline - Sys_Microseconds ());
+		if (wait <= 0)
+			continue;
+
+		its.it_value.tv_sec = wait / 1000000;
+		its.it_value.tv_nsec = (wait % 1000000) * 1000;
+		timerfd_settime (timerfd, 0, &its, NULL);
+
+		n = epoll_wait (epfd, events, 4, -1);
+		for (i=0 ; i<n ; i++)
+		{
+			if (events[i].data.fd == timerfd)
+				read (timerfd, expirations, sizeof(expirations));
+		}
+	}
+}
+#endif
+
 #ifdef SDL_CLIENT
 static void Sys_AtExit (void)
 {
@@ -403,6 +608,11 @@ int main (int argc, char **argv)
 	if (!nostdout->value)
 		fcntl(0, F_SETFL, fcntl (0, F_GETFL, 0) | FNDELAY);
 
+#ifdef __linux__
+	if (dedicated && dedicated->intValue)
+		Sys_DedicatedLoop ();
+#endif
+
 	oldtime = Sys_Milliseconds ();
 	while (1)
 	{
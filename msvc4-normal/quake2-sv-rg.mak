@@ -147,7 +147,9 @@ CLEAN :
 	-@erase "$(INTDIR)\sv_ents.obj"
 	-@erase "$(INTDIR)\sv_game.obj"
 	-@erase "$(INTDIR)\sv_init.obj"
+	-@erase "$(INTDIR)\sv_loadgen.obj"
 	-@erase "$(INTDIR)\sv_main.obj"
+	-@erase "$(INTDIR)\sv_relay.obj"
 	-@erase "$(INTDIR)\sv_send.obj"
 	-@erase "$(INTDIR)\sv_user.obj"
 	-@erase "$(INTDIR)\sv_world.obj"
@@ -200,7 +202,9 @@ LINK32_OBJS= \
 	"$(INTDIR)\sv_ents.obj" \
 	"$(INTDIR)\sv_game.obj" \
 	"$(INTDIR)\sv_init.obj" \
+	"$(INTDIR)\sv_loadgen.obj" \
 	"$(INTDIR)\sv_main.obj" \
+	"$(INTDIR)\sv_relay.obj" \
 	"$(INTDIR)\sv_send.obj" \
 	"$(INTDIR)\sv_user.obj" \
 	"$(INTDIR)\sv_world.obj" \
@@ -559,8 +563,12 @@ CLEAN :
 	-@erase "$(INTDIR)\sv_game.sbr"
 	-@erase "$(INTDIR)\sv_init.obj"
 	-@erase "$(INTDIR)\sv_init.sbr"
+	-@erase "$(INTDIR)\sv_loadgen.obj"
+	-@erase "$(INTDIR)\sv_loadgen.sbr"
 	-@erase "$(INTDIR)\sv_main.obj"
 	-@erase "$(INTDIR)\sv_main.sbr"
+	-@erase "$(INTDIR)\sv_relay.obj"
+	-@erase "$(INTDIR)\sv_relay.sbr"
 	-@erase "$(INTDIR)\sv_send.obj"
 	-@erase "$(INTDIR)\sv_send.sbr"
 	-@erase "$(INTDIR)\sv_user.obj"
@@ -621,7 +629,9 @@ BSC32_SBRS= \
 	"$(INTDIR)\sv_ents.sbr" \
 	"$(INTDIR)\sv_game.sbr" \
 	"$(INTDIR)\sv_init.sbr" \
+	"$(INTDIR)\sv_loadgen.sbr" \
 	"$(INTDIR)\sv_main.sbr" \
+	"$(INTDIR)\sv_relay.sbr" \
 	"$(INTDIR)\sv_send.sbr" \
 	"$(INTDIR)\sv_user.sbr" \
 	"$(INTDIR)\sv_world.sbr" \
@@ -764,7 +774,9 @@ LINK32_OBJS= \
 	"$(INTDIR)\sv_ents.obj" \
 	"$(INTDIR)\sv_game.obj" \
 	"$(INTDIR)\sv_init.obj" \
+	"$(INTDIR)\sv_loadgen.obj" \
 	"$(INTDIR)\sv_main.obj" \
+	"$(INTDIR)\sv_relay.obj" \
 	"$(INTDIR)\sv_send.obj" \
 	"$(INTDIR)\sv_user.obj" \
 	"$(INTDIR)\sv_world.obj" \
@@ -1451,6 +1463,24 @@ SOURCE=..\SERVER\sv_init.c
 	$(CPP) $(CPP_PROJ) $(SOURCE)
 
 
+!ENDIF 
+
+SOURCE=..\SERVER\sv_loadgen.c
+
+!IF  "$(CFG)" == "quake2 - Win32 Release"
+
+
+"$(INTDIR)\sv_loadgen.obj" : $(SOURCE) "$(INTDIR)"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
+!ELSEIF  "$(CFG)" == "quake2 - Win32 Debug"
+
+
+"$(INTDIR)\sv_loadgen.obj"	"$(INTDIR)\sv_loadgen.sbr" : $(SOURCE) "$(INTDIR)"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
 !ENDIF 
 
 SOURCE=..\SERVER\sv_main.c
@@ -1469,6 +1499,24 @@ SOURCE=..\SERVER\sv_main.c
 	$(CPP) $(CPP_PROJ) $(SOURCE)
 
 
+!ENDIF 
+
+SOURCE=..\SERVER\sv_relay.c
+
+!IF  "$(CFG)" == "quake2 - Win32 Release"
+
+
+"$(INTDIR)\sv_relay.obj" : $(SOURCE) "$(INTDIR)"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
+!ELSEIF  "$(CFG)" == "quake2 - Win32 Debug"
+
+
+"$(INTDIR)\sv_relay.obj"	"$(INTDIR)\sv_relay.sbr" : $(SOURCE) "$(INTDIR)"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
 !ENDIF 
 
 SOURCE=..\SERVER\sv_send.c
@@ -508,10 +508,18 @@ SOURCE=..\SERVER\sv_init.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\SERVER\sv_loadgen.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\SERVER\sv_main.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\SERVER\sv_relay.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\SERVER\sv_send.c
 # End Source File
 # Begin Source File
@@ -108,6 +108,11 @@ int		Sys_Milliseconds (void)
 	return 0;
 }
 
+unsigned	Sys_Microseconds (void)
+{
+	return 0;
+}
+
 void	Sys_Mkdir (char *path)
 {
 }
@@ -130,6 +135,54 @@ void Sys_Sleep (unsigned msec)
 {
 }
 
+void	*Sys_CreateThread (void (*func) (void *parm), void *parm)
+{
+	return NULL;
+}
+
+void	Sys_WaitThread (void *thread)
+{
+}
+
+void	*Sys_CreateMutex (void)
+{
+	return NULL;
+}
+
+void	Sys_DestroyMutex (void *mutex)
+{
+}
+
+void	Sys_LockMutex (void *mutex)
+{
+}
+
+void	Sys_UnlockMutex (void *mutex)
+{
+}
+
+void	*Sys_CreateSemaphore (int value)
+{
+	return NULL;
+}
+
+void	Sys_DestroySemaphore (void *sem)
+{
+}
+
+void	Sys_SemaphorePost (void *sem)
+{
+}
+
+void	Sys_SemaphoreWait (void *sem)
+{
+}
+
+int		Sys_NumProcessors (void)
+{
+	return 1;
+}
+
 void	Sys_Init (void)
 {
 }
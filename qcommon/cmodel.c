@@ -21,6 +21,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "qcommon.h"
 
+// brush sides are clipped four at a time where floats are SSE math
+// anyway, so the results are the same as one at a time
+#if (defined(__SSE__) && defined(__SSE_MATH__)) || defined(_M_X64)
+#define CM_SSE	1
+#include <xmmintrin.h>
+#endif
+
 typedef struct
 {
 	cplane_t	*plane;
@@ -47,7 +54,7 @@ typedef struct
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
-	int			checkcount;		// to avoid repeated testings
+	int			firstblock;		// into map_brushblocks
 } cbrush_t;
 
 typedef struct
@@ -58,8 +65,6 @@ typedef struct
 	int		floodvalid;
 } carea_t;
 
-int			checkcount;
-
 char		map_name[MAX_QPATH];
 
 int			numbrushsides;
@@ -87,6 +92,22 @@ cmodel_t	map_cmodels[MAX_MAP_MODELS];
 int			numbrushes;
 cbrush_t	map_brushes[MAX_MAP_BRUSHES];
 
+#ifdef CM_SSE
+// the planes of each brush's sides, four to a block, packed so
+// they load straight into registers.  The unused sides at the end
+// of a brush's last block face nowhere and are never crossed.
+typedef struct
+{
+	float		normal[3][4];
+	float		dist[4];
+} cbrushblock_t;
+
+#define	MAX_MAP_BRUSHBLOCKS	(MAX_MAP_BRUSHSIDES/4 + MAX_MAP_BRUSHES)
+
+int				numbrushblocks;
+cbrushblock_t	map_brushblocks[MAX_MAP_BRUSHBLOCKS];
+#endif
+
 int			numvisibility;
 byte		map_visibility[MAX_MAP_VISIBILITY];
 dvis_t		*map_vis = (dvis_t *)map_visibility;
@@ -110,9 +131,12 @@ qboolean	portalopen[MAX_MAP_AREAPORTALS];
 
 
 cvar_t		*map_noareas;
+cvar_t		*cm_viscache;
 
 void	CM_InitBoxHull (void);
 void	FloodAreaConnections (void);
+void	CMod_FreeVisRows (void);
+void	CMod_BuildVisRows (void);
 
 
 int		c_pointcontents;
@@ -441,6 +465,66 @@ void CMod_LoadBrushSides (lump_t *l)
 	}
 }
 
+#ifdef CM_SSE
+/*
+=================
+CM_PackBrush
+
+Copies the brush's side planes into its blocks
+=================
+*/
+void CM_PackBrush (cbrush_t *brush)
+{
+	cbrushblock_t	*block;
+	cplane_t		*plane;
+	int				i, j, lane;
+
+	block = &map_brushblocks[brush->firstblock];
+	for (i=0 ; i<(brush->numsides+3)/4*4 ; i++)
+	{
+		lane = i & 3;
+		if (i < brush->numsides)
+		{
+			plane = map_brushsides[brush->firstbrushside+i].plane;
+			for (j=0 ; j<3 ; j++)
+				block->normal[j][lane] = plane->normal[j];
+			block->dist[lane] = plane->dist;
+		}
+		else
+		{
+			for (j=0 ; j<3 ; j++)
+				block->normal[j][lane] = 0;
+			block->dist[lane] = 1e30f;
+		}
+		if (lane == 3)
+			block++;
+	}
+}
+
+/*
+=================
+CMod_PackBrushes
+
+Lays out the blocks for the loaded brushes and the box brush after them
+=================
+*/
+void CMod_PackBrushes (void)
+{
+	int			i;
+	cbrush_t	*brush;
+
+	numbrushblocks = 0;
+	for (i=0, brush=map_brushes ; i<=numbrushes ; i++, brush++)
+	{
+		if (numbrushblocks + (brush->numsides+3)/4 > MAX_MAP_BRUSHBLOCKS)
+			Com_Error (ERR_DROP, "Map has too many brush sides");
+		brush->firstblock = numbrushblocks;
+		numbrushblocks += (brush->numsides+3)/4;
+		CM_PackBrush (brush);
+	}
+}
+#endif
+
 /*
 =================
 CMod_LoadAreas
@@ -589,6 +673,144 @@ void CMod_LoadEntityString (lump_t *l, char *name)
 
 
 
+/*
+===============================================================================
+
+BACKGROUND MAP READING
+
+The file of the map most likely to come next is read and checksummed
+on a thread while the current one is played, CM_LoadMap picks it up
+if that is the map it gets asked for.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	char		name[MAX_QPATH];
+	char		gamedir[MAX_OSPATH];
+	FILE		*file;
+	byte		*buf;
+	int			length;
+	unsigned	checksum;
+	qboolean	failed;
+	void		*thread;
+	int			msec;			// how long the thread took
+} cmpreload_t;
+
+cmpreload_t	cm_preload;
+qboolean	cm_preloaded;		// the last CM_LoadMap found its file read already
+
+/*
+==================
+CM_PreloadThread
+==================
+*/
+void CM_PreloadThread (void *parm)
+{
+	cmpreload_t	*pl;
+	int			start, r, count;
+
+	pl = (cmpreload_t *)parm;
+	start = Sys_Milliseconds ();
+
+	// no FS_Read here, it can Com_Error
+	for (count = 0 ; count < pl->length ; count += r)
+	{
+		r = fread (pl->buf + count, 1, pl->length - count, pl->file);
+		if (r <= 0)
+		{
+			pl->failed = true;
+			break;
+		}
+	}
+	fclose (pl->file);
+	pl->file = NULL;
+
+	if (!pl->failed)
+		pl->checksum = LittleLong (Com_BlockChecksum (pl->buf, pl->length));
+
+	pl->msec = Sys_Milliseconds () - start;
+}
+
+/*
+==================
+CM_FinishPreload
+
+Waits for the thread and takes the file if it is the one named,
+otherwise throws it away.  Returns the buffer or NULL.
+==================
+*/
+byte *CM_FinishPreload (char *name, int *length, unsigned *checksum)
+{
+	byte	*buf;
+
+	if (!cm_preload.buf)
+		return NULL;
+
+	if (cm_preload.thread)
+	{
+		Sys_WaitThread (cm_preload.thread);
+		cm_preload.thread = NULL;
+	}
+
+	buf = cm_preload.buf;
+	cm_preload.buf = NULL;
+
+	if (!name || cm_preload.failed || strcmp (name, cm_preload.name)
+		|| strcmp (FS_Gamedir (), cm_preload.gamedir))
+	{
+		FS_FreeFile (buf);
+		return NULL;
+	}
+
+	*length = cm_preload.length;
+	*checksum = cm_preload.checksum;
+	return buf;
+}
+
+/*
+==================
+CM_PreloadMap
+
+Starts reading name in the background.  Does nothing on systems
+without threads, it would only move the stall.
+==================
+*/
+void CM_PreloadMap (char *name)
+{
+	int		length;
+
+	// drop anything read before
+	CM_FinishPreload (NULL, NULL, NULL);
+
+	if (!name || !name[0] || !strcmp (name, map_name))
+		return;
+
+	length = FS_FOpenFile (name, &cm_preload.file);
+	if (!cm_preload.file)
+		return;
+
+	Q_strncpyz (cm_preload.name, name, sizeof(cm_preload.name));
+	Q_strncpyz (cm_preload.gamedir, FS_Gamedir (), sizeof(cm_preload.gamedir));
+	cm_preload.length = length;
+	cm_preload.failed = false;
+	cm_preload.msec = 0;
+	cm_preload.buf = Z_Malloc (length);
+
+	cm_preload.thread = Sys_CreateThread (CM_PreloadThread, &cm_preload);
+	if (!cm_preload.thread)
+	{
+		fclose (cm_preload.file);
+		cm_preload.file = NULL;
+		FS_FreeFile (cm_preload.buf);
+		cm_preload.buf = NULL;
+		return;
+	}
+
+	Com_DPrintf (DEVELOPER_MSG_IO, "Reading %s in the background\n", name);
+}
+
 /*
 ==================
 CM_LoadMap
@@ -604,7 +826,10 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	int				length;
 	static unsigned	last_checksum;
 
+	cm_preloaded = false;
 	map_noareas = Cvar_Get ("map_noareas", "0", 0);
+	cm_viscache = Cvar_Get ("cm_viscache", "8192", 0);
+	Cvar_SetDescription ("cm_viscache", "KB of decompressed PVS and PHS rows to keep.  If every row of the map fits they are all decoded when the map loads, otherwise the most recent are kept.  0 decodes on every lookup.  Takes effect on the next map.");
 	/* FS: Check to see if entfile changed.  ->modified isn't working right, so I'll half ass this. */
 	if ((sv_entfile->intValue >= 1 && entToggle == false) || (sv_entfile->intValue == 0 && entToggle == true)) // Knightmare:  Logic adjustment
 		map_name[0] = 0;
@@ -635,6 +860,7 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	numentitychars = 0;
 	map_entitystring[0] = 0;
 	map_name[0] = 0;
+	CMod_FreeVisRows ();
 
 	if (!name || !name[0])
 	{
@@ -646,16 +872,21 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 	}
 
 	//
-	// load the file
+	// load the file, unless it was read in the background
 	//
-	length = FS_LoadFile (name, (void **)&buf);
+	buf = (unsigned *)CM_FinishPreload (name, &length, &last_checksum);
+	cm_preloaded = (buf != NULL);
 	if (!buf)
 	{
-		Com_Error (ERR_DROP, "Couldn't load %s", name);
-		return NULL;
-	}
+		length = FS_LoadFile (name, (void **)&buf);
+		if (!buf)
+		{
+			Com_Error (ERR_DROP, "Couldn't load %s", name);
+			return NULL;
+		}
 
-	last_checksum = LittleLong (Com_BlockChecksum (buf, length));
+		last_checksum = LittleLong (Com_BlockChecksum (buf, length));
+	}
 	*checksum = last_checksum;
 
 	header = *(dheader_t *)buf;
@@ -684,7 +915,12 @@ cmodel_t *CM_LoadMap (char *name, qboolean clientload, unsigned *checksum)
 
 	FS_FreeFile (buf);
 
+	CMod_BuildVisRows ();
+
 	CM_InitBoxHull ();
+#ifdef CM_SSE
+	CMod_PackBrushes ();
+#endif
 
 	memset (portalopen, 0, sizeof(portalopen));
 	FloodAreaConnections ();
@@ -856,6 +1092,9 @@ int	CM_HeadnodeForBox (vec3_t mins, vec3_t maxs)
 	box_planes[9].dist = -maxs[2];
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
+#ifdef CM_SSE
+	CM_PackBrush (box_brush);
+#endif
 
 	return box_headnode;
 }
@@ -888,8 +1127,6 @@ int CM_PointLeafnum_r (vec3_t p, int num)
 			num = node->children[0];
 	}
 
-	c_pointcontents++;		// optimize counter
-
 	return -1 - num;
 }
 
@@ -906,14 +1143,19 @@ int CM_PointLeafnum (vec3_t p)
 CM_BoxLeafnums
 
 Fills in a list of all the leafs touched
+The walk state lives on the caller's stack so the
+server can run this from several threads at once.
 =============
 */
-int		leaf_count, leaf_maxcount;
-int		*leaf_list;
-float	*leaf_mins, *leaf_maxs;
-int		leaf_topnode;
+typedef struct
+{
+	int		count, maxcount;
+	int		*list;
+	float	*mins, *maxs;
+	int		topnode;
+} leaflist_t;
 
-void CM_BoxLeafnums_r (int nodenum)
+void CM_BoxLeafnums_r (leaflist_t *ll, int nodenum)
 {
 	cplane_t	*plane;
 	cnode_t		*node;
@@ -923,28 +1165,28 @@ void CM_BoxLeafnums_r (int nodenum)
 	{
 		if (nodenum < 0)
 		{
-			if (leaf_count >= leaf_maxcount)
+			if (ll->count >= ll->maxcount)
 			{
 //				Com_Printf ("CM_BoxLeafnums_r: overflow\n");
 				return;
 			}
-			leaf_list[leaf_count++] = -1 - nodenum;
+			ll->list[ll->count++] = -1 - nodenum;
 			return;
 		}
 	
 		node = &map_nodes[nodenum];
 		plane = node->plane;
-//		s = BoxOnPlaneSide (leaf_mins, leaf_maxs, plane);
-		s = BOX_ON_PLANE_SIDE(leaf_mins, leaf_maxs, plane);
+//		s = BoxOnPlaneSide (ll->mins, ll->maxs, plane);
+		s = BOX_ON_PLANE_SIDE(ll->mins, ll->maxs, plane);
 		if (s == 1)
 			nodenum = node->children[0];
 		else if (s == 2)
 			nodenum = node->children[1];
 		else
 		{	// go down both
-			if (leaf_topnode == -1)
-				leaf_topnode = nodenum;
-			CM_BoxLeafnums_r (node->children[0]);
+			if (ll->topnode == -1)
+				ll->topnode = nodenum;
+			CM_BoxLeafnums_r (ll, node->children[0]);
 			nodenum = node->children[1];
 		}
 
@@ -953,20 +1195,22 @@ void CM_BoxLeafnums_r (int nodenum)
 
 int	CM_BoxLeafnums_headnode (vec3_t mins, vec3_t maxs, int *list, int listsize, int headnode, int *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	leaflist_t	ll;
+
+	ll.list = list;
+	ll.count = 0;
+	ll.maxcount = listsize;
+	ll.mins = mins;
+	ll.maxs = maxs;
 
-	leaf_topnode = -1;
+	ll.topnode = -1;
 
-	CM_BoxLeafnums_r (headnode);
+	CM_BoxLeafnums_r (&ll, headnode);
 
 	if (topnode)
-		*topnode = leaf_topnode;
+		*topnode = ll.topnode;
 
-	return leaf_count;
+	return ll.count;
 }
 
 int	CM_BoxLeafnums (vec3_t mins, vec3_t maxs, int *list, int listsize, int *topnode)
@@ -975,6 +1219,74 @@ int	CM_BoxLeafnums (vec3_t mins, vec3_t maxs, int *list, int listsize, int *topn
 		listsize, map_cmodels[0].headnode, topnode);
 }
 
+// 1/32 epsilon to keep floating point happy
+#define	DIST_EPSILON	(0.03125)
+
+/*
+==================
+CM_TopnodeForBox
+
+The first node under headnode that splits the box, or the leaf
+the box is in.  A trace that stays in the box, out to the extents
+of its mins and maxs, can start from there.
+
+Only steps down for a box strictly off the plane.  BoxOnPlaneSide
+puts a box touching an axial plane from behind on the back, but
+CM_RecursiveHullCheck sends a trace on the plane to the front.
+==================
+*/
+int CM_TopnodeForBox (vec3_t mins, vec3_t maxs, int headnode)
+{
+	cnode_t		*node;
+	cplane_t	*plane;
+	float		lo, hi;
+	int			i;
+
+	if (!numnodes)
+		return headnode;
+
+	while (headnode >= 0)
+	{
+		node = &map_nodes[headnode];
+		plane = node->plane;
+		if (plane->type < 3)
+		{
+			lo = mins[plane->type];
+			hi = maxs[plane->type];
+		}
+		else
+		{
+			// the near and far corners, with a margin
+			// for rounding apart from the hull check's
+			lo = hi = 0;
+			for (i=0 ; i<3 ; i++)
+			{
+				if (plane->normal[i] < 0)
+				{
+					lo += plane->normal[i]*maxs[i];
+					hi += plane->normal[i]*mins[i];
+				}
+				else
+				{
+					lo += plane->normal[i]*mins[i];
+					hi += plane->normal[i]*maxs[i];
+				}
+			}
+			lo -= DIST_EPSILON;
+			hi += DIST_EPSILON;
+		}
+
+		if (lo > plane->dist)
+			headnode = node->children[0];
+		else if (hi < plane->dist)
+			headnode = node->children[1];
+		else
+			break;
+	}
+
+	return headnode;
+}
+
 
 
 /*
@@ -991,6 +1303,7 @@ int CM_PointContents (vec3_t p, int headnode)
 		return 0;
 
 	l = CM_PointLeafnum_r (p, headnode);
+	c_pointcontents++;		// optimize counter, main thread only
 
 	return map_leafs[l].contents;
 }
@@ -1026,6 +1339,7 @@ int	CM_TransformedPointContents (vec3_t p, int headnode, vec3_t origin, vec3_t a
 	}
 
 	l = CM_PointLeafnum_r (p_l, headnode);
+	c_pointcontents++;
 
 	return map_leafs[l].contents;
 }
@@ -1039,23 +1353,157 @@ BOX TRACING
 ===============================================================================
 */
 
-// 1/32 epsilon to keep floating point happy
-#define	DIST_EPSILON	(0.03125)
+tracecontext_t	cm_trace;	// for CM_BoxTrace, main thread only
+
+#ifdef CM_SSE
+/*
+================
+CM_BrushBlockDists
+
+The distances of p1 and p2 in front of four of the brush's
+side planes, pushed out for mins/maxs the way CM_ClipBoxToBrush
+does it, in the same order so the sums round the same
+================
+*/
+static void CM_BrushBlockDists (cbrushblock_t *block, qboolean ispoint, vec3_t mins, vec3_t maxs,
+	vec3_t p1, vec3_t p2, __m128 *d1, __m128 *d2)
+{
+	__m128		n[3], dist, ofs, neg, t, zero;
+	int			j;
+
+	zero = _mm_setzero_ps ();
+	for (j=0 ; j<3 ; j++)
+		n[j] = _mm_loadu_ps (block->normal[j]);
+	dist = _mm_loadu_ps (block->dist);
+
+	if (!ispoint)
+	{	// general box case, the corner that meets each plane first
+		t = zero;
+		for (j=0 ; j<3 ; j++)
+		{
+			neg = _mm_cmplt_ps (n[j], zero);
+			ofs = _mm_or_ps (_mm_and_ps (neg, _mm_set1_ps (maxs[j])),
+				_mm_andnot_ps (neg, _mm_set1_ps (mins[j])));
+			t = j ? _mm_add_ps (t, _mm_mul_ps (ofs, n[j])) : _mm_mul_ps (ofs, n[j]);
+		}
+		dist = _mm_sub_ps (dist, t);
+	}
+
+	t = _mm_mul_ps (_mm_set1_ps (p1[0]), n[0]);
+	t = _mm_add_ps (t, _mm_mul_ps (_mm_set1_ps (p1[1]), n[1]));
+	t = _mm_add_ps (t, _mm_mul_ps (_mm_set1_ps (p1[2]), n[2]));
+	*d1 = _mm_sub_ps (t, dist);
+
+	if (!p2)
+		return;
+	t = _mm_mul_ps (_mm_set1_ps (p2[0]), n[0]);
+	t = _mm_add_ps (t, _mm_mul_ps (_mm_set1_ps (p2[1]), n[1]));
+	t = _mm_add_ps (t, _mm_mul_ps (_mm_set1_ps (p2[2]), n[2]));
+	*d2 = _mm_sub_ps (t, dist);
+}
+
+/*
+================
+CM_ClipBoxToBrushSSE
+
+CM_ClipBoxToBrush, four sides at a time
+================
+*/
+static void CM_ClipBoxToBrushSSE (tracecontext_t *tc, vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+					  trace_t *trace, cbrush_t *brush)
+{
+	cbrushblock_t	*block;
+	__m128		d1v, d2v;
+	float		d1s[4], d2s[4];
+	float		d1, d2, f;
+	float		enterfrac, leavefrac;
+	qboolean	getout, startout;
+	cplane_t	*clipplane;
+	cbrushside_t	*leadside;
+	int			i, lane, numlanes;
 
-vec3_t	trace_start, trace_end;
-vec3_t	trace_mins, trace_maxs;
-vec3_t	trace_extents;
+	enterfrac = -1;
+	leavefrac = 1;
+	clipplane = NULL;
+	getout = false;
+	startout = false;
+	leadside = NULL;
 
-trace_t	trace_trace;
-int		trace_contents;
-qboolean	trace_ispoint;		// optimized case
+	block = &map_brushblocks[brush->firstblock];
+	for (i=0 ; i<brush->numsides ; i+=4, block++)
+	{
+		CM_BrushBlockDists (block, tc->ispoint, mins, maxs, p1, p2, &d1v, &d2v);
+
+		// if completely in front of any face, no intersection
+		if (_mm_movemask_ps (_mm_and_ps (_mm_cmpgt_ps (d1v, _mm_setzero_ps ()),
+			_mm_cmpge_ps (d2v, d1v))))
+			return;
+
+		_mm_storeu_ps (d1s, d1v);
+		_mm_storeu_ps (d2s, d2v);
+		numlanes = brush->numsides - i < 4 ? brush->numsides - i : 4;
+
+		for (lane=0 ; lane<numlanes ; lane++)
+		{
+			d1 = d1s[lane];
+			d2 = d2s[lane];
+
+			if (d2 > 0)
+				getout = true;	// endpoint is not in solid
+			if (d1 > 0)
+				startout = true;
+
+			if (d1 <= 0 && d2 <= 0)
+				continue;
+
+			// crosses face
+			if (d1 > d2)
+			{	// enter
+				f = (d1-DIST_EPSILON) / (d1-d2);
+				if (f > enterfrac)
+				{
+					enterfrac = f;
+					leadside = &map_brushsides[brush->firstbrushside+i+lane];
+					clipplane = leadside->plane;
+				}
+			}
+			else
+			{	// leave
+				f = (d1+DIST_EPSILON) / (d1-d2);
+				if (f < leavefrac)
+					leavefrac = f;
+			}
+		}
+	}
+
+	if (!startout)
+	{	// original point was inside brush
+		trace->startsolid = true;
+		if (!getout)
+			trace->allsolid = true;
+		return;
+	}
+	if (enterfrac < leavefrac)
+	{
+		if (enterfrac > -1 && enterfrac < trace->fraction)
+		{
+			if (enterfrac < 0)
+				enterfrac = 0;
+			trace->fraction = enterfrac;
+			trace->plane = *clipplane;
+			trace->surface = &(leadside->surface->c);
+			trace->contents = brush->contents;
+		}
+	}
+}
+#endif
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
+void CM_ClipBoxToBrush (tracecontext_t *tc, vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 					  trace_t *trace, cbrush_t *brush)
 {
 	int			i, j;
@@ -1075,7 +1523,15 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 	if (!brush->numsides)
 		return;
 
-	c_brush_traces++;
+	tc->brushtraces++;
+
+#ifdef CM_SSE
+	if (!tc->scalar)
+	{
+		CM_ClipBoxToBrushSSE (tc, mins, maxs, p1, p2, trace, brush);
+		return;
+	}
+#endif
 
 	getout = false;
 	startout = false;
@@ -1088,7 +1544,7 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 
 		// FIXME: special case for axial
 
-		if (!trace_ispoint)
+		if (!tc->ispoint)
 		{	// general box case
 
 			// push the plane out apropriately for mins/maxs
@@ -1169,7 +1625,7 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 CM_TestBoxInBrush
 ================
 */
-void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
+void CM_TestBoxInBrush (tracecontext_t *tc, vec3_t mins, vec3_t maxs, vec3_t p1,
 					  trace_t *trace, cbrush_t *brush)
 {
 	int			i, j;
@@ -1182,6 +1638,29 @@ void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
 	if (!brush->numsides)
 		return;
 
+#ifdef CM_SSE
+	if (!tc->scalar)
+	{
+		cbrushblock_t	*block;
+		__m128			d1v;
+
+		block = &map_brushblocks[brush->firstblock];
+		for (i=0 ; i<brush->numsides ; i+=4, block++)
+		{
+			CM_BrushBlockDists (block, false, mins, maxs, p1, NULL, &d1v, NULL);
+			// if completely in front of any face, no intersection
+			if (_mm_movemask_ps (_mm_cmpgt_ps (d1v, _mm_setzero_ps ())))
+				return;
+		}
+
+		// inside this brush
+		trace->startsolid = trace->allsolid = true;
+		trace->fraction = 0;
+		trace->contents = brush->contents;
+		return;
+	}
+#endif
+
 	for (i=0 ; i<brush->numsides ; i++)
 	{
 		side = &map_brushsides[brush->firstbrushside+i];
@@ -1224,7 +1703,7 @@ void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
 CM_TraceToLeaf
 ================
 */
-void CM_TraceToLeaf (int leafnum)
+void CM_TraceToLeaf (tracecontext_t *tc, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1232,21 +1711,21 @@ void CM_TraceToLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & tc->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (tc->brushchecks[brushnum] == tc->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		tc->brushchecks[brushnum] = tc->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & tc->contents))
 			continue;
-		CM_ClipBoxToBrush (trace_mins, trace_maxs, trace_start, trace_end, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_ClipBoxToBrush (tc, tc->mins, tc->maxs, tc->start, tc->end, &tc->trace, b);
+		if (!tc->trace.fraction)
 			return;
 	}
 
@@ -1258,7 +1737,7 @@ void CM_TraceToLeaf (int leafnum)
 CM_TestInLeaf
 ================
 */
-void CM_TestInLeaf (int leafnum)
+void CM_TestInLeaf (tracecontext_t *tc, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1266,21 +1745,21 @@ void CM_TestInLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &map_leafs[leafnum];
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & tc->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = map_leafbrushes[leaf->firstleafbrush+k];
 		b = &map_brushes[brushnum];
-		if (b->checkcount == checkcount)
+		if (tc->brushchecks[brushnum] == tc->checkcount)
 			continue;	// already checked this brush in another leaf
-		b->checkcount = checkcount;
+		tc->brushchecks[brushnum] = tc->checkcount;
 
-		if ( !(b->contents & trace_contents))
+		if ( !(b->contents & tc->contents))
 			continue;
-		CM_TestBoxInBrush (trace_mins, trace_maxs, trace_start, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_TestBoxInBrush (tc, tc->mins, tc->maxs, tc->start, &tc->trace, b);
+		if (!tc->trace.fraction)
 			return;
 	}
 
@@ -1293,7 +1772,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+void CM_RecursiveHullCheck (tracecontext_t *tc, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
 	cnode_t		*node;
 	cplane_t	*plane;
@@ -1305,13 +1784,13 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	int			side;
 	float		midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (tc->trace.fraction <= p1f)
 		return;		// already hit something nearer
 
 	// if < 0, we are in a leaf node
 	if (num < 0)
 	{
-		CM_TraceToLeaf (-1-num);
+		CM_TraceToLeaf (tc, -1-num);
 		return;
 	}
 
@@ -1326,36 +1805,36 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = tc->extents[plane->type];
 	}
 	else
 	{
 		t1 = DotProduct (plane->normal, p1) - plane->dist;
 		t2 = DotProduct (plane->normal, p2) - plane->dist;
-		if (trace_ispoint)
+		if (tc->ispoint)
 			offset = 0;
 		else
-			offset = fabs(trace_extents[0]*plane->normal[0]) +
-				fabs(trace_extents[1]*plane->normal[1]) +
-				fabs(trace_extents[2]*plane->normal[2]);
+			offset = fabs(tc->extents[0]*plane->normal[0]) +
+				fabs(tc->extents[1]*plane->normal[1]) +
+				fabs(tc->extents[2]*plane->normal[2]);
 	}
 
 
 #if 0
-CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
-CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (tc, node->children[0], p1f, p2f, p1, p2);
+CM_RecursiveHullCheck (tc, node->children[1], p1f, p2f, p1, p2);
 return;
 #endif
 
 	// see which sides we need to consider
 	if (t1 >= offset && t2 >= offset)
 	{
-		CM_RecursiveHullCheck (node->children[0], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (tc, node->children[0], p1f, p2f, p1, p2);
 		return;
 	}
 	if (t1 < -offset && t2 < -offset)
 	{
-		CM_RecursiveHullCheck (node->children[1], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck (tc, node->children[1], p1f, p2f, p1, p2);
 		return;
 	}
 
@@ -1391,7 +1870,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck (tc, node->children[side], p1f, midf, p1, mid);
 
 
 	// go past the node
@@ -1404,7 +1883,7 @@ return;
 	for (i=0 ; i<3 ; i++)
 		mid[i] = p1[i] + frac2*(p2[i] - p1[i]);
 
-	CM_RecursiveHullCheck (node->children[side^1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck (tc, node->children[side^1], midf, p2f, mid, p2);
 }
 
 
@@ -1413,32 +1892,34 @@ return;
 
 /*
 ==================
-CM_BoxTrace
+CM_BoxTraceContext
+
+CM_BoxTrace with all its state in tc, so any number of
+threads can trace at once, each through its own context
 ==================
 */
-trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
+trace_t		CM_BoxTraceContext (tracecontext_t *tc, vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask)
 {
 	int		i;
 
-	checkcount++;		// for multi-check avoidance
-
-	c_traces++;			// for statistics, may be zeroed
+	tc->checkcount++;	// for multi-check avoidance
+	tc->brushtraces = 0;
 
 	// fill in a default trace
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	memset (&tc->trace, 0, sizeof(tc->trace));
+	tc->trace.fraction = 1;
+	tc->trace.surface = &(nullsurface.c);
 
 	if (!numnodes)	// map not loaded
-		return trace_trace;
+		return tc->trace;
 
-	trace_contents = brushmask;
-	VectorCopy (start, trace_start);
-	VectorCopy (end, trace_end);
-	VectorCopy (mins, trace_mins);
-	VectorCopy (maxs, trace_maxs);
+	tc->contents = brushmask;
+	VectorCopy (start, tc->start);
+	VectorCopy (end, tc->end);
+	VectorCopy (mins, tc->mins);
+	VectorCopy (maxs, tc->maxs);
 
 	//
 	// check for position test special case
@@ -1461,12 +1942,12 @@ trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
 		numleafs = CM_BoxLeafnums_headnode (c1, c2, leafs, 1024, headnode, &topnode);
 		for (i=0 ; i<numleafs ; i++)
 		{
-			CM_TestInLeaf (leafs[i]);
-			if (trace_trace.allsolid)
+			CM_TestInLeaf (tc, leafs[i]);
+			if (tc->trace.allsolid)
 				break;
 		}
-		VectorCopy (start, trace_trace.endpos);
-		return trace_trace;
+		VectorCopy (start, tc->trace.endpos);
+		return tc->trace;
 	}
 
 	//
@@ -1475,38 +1956,57 @@ trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
 	if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
 		&& maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0)
 	{
-		trace_ispoint = true;
-		VectorClear (trace_extents);
+		tc->ispoint = true;
+		VectorClear (tc->extents);
 	}
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		tc->ispoint = false;
+		tc->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		tc->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		tc->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
 	}
 
 	//
 	// general sweeping through world
 	//
-	CM_RecursiveHullCheck (headnode, 0, 1, start, end);
+	CM_RecursiveHullCheck (tc, headnode, 0, 1, start, end);
 
-	if (trace_trace.fraction == 1)
+	if (tc->trace.fraction == 1)
 	{
-		VectorCopy (end, trace_trace.endpos);
+		VectorCopy (end, tc->trace.endpos);
 	}
 	else
 	{
 		for (i=0 ; i<3 ; i++)
-			trace_trace.endpos[i] = start[i] + trace_trace.fraction * (end[i] - start[i]);
+			tc->trace.endpos[i] = start[i] + tc->trace.fraction * (end[i] - start[i]);
 	}
-	return trace_trace;
+	return tc->trace;
+}
+
+/*
+==================
+CM_BoxTrace
+==================
+*/
+trace_t		CM_BoxTrace (vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask)
+{
+	trace_t		trace;
+
+	trace = CM_BoxTraceContext (&cm_trace, start, end, mins, maxs, headnode, brushmask);
+
+	c_traces++;			// for statistics, may be zeroed
+	c_brush_traces += cm_trace.brushtraces;
+
+	return trace;
 }
 
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_TransformedBoxTraceContext
 
 Handles offseting and rotation of the end points for moving and
 rotating entities
@@ -1516,7 +2016,7 @@ rotating entities
 #pragma optimize( "", off )
 #endif
 
-trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+trace_t		CM_TransformedBoxTraceContext (tracecontext_t *tc, vec3_t start, vec3_t end,
 						  vec3_t mins, vec3_t maxs,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles)
@@ -1555,7 +2055,7 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 	}
 
 	// sweep the box through the model
-	trace = CM_BoxTrace (start_l, end_l, mins, maxs, headnode, brushmask);
+	trace = CM_BoxTraceContext (tc, start_l, end_l, mins, maxs, headnode, brushmask);
 
 	if (rotated && trace.fraction != 1.0)
 	{
@@ -1580,6 +2080,303 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 #pragma optimize( "", on )
 #endif
 
+/*
+==================
+CM_TransformedBoxTrace
+==================
+*/
+trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles)
+{
+	trace_t		trace;
+
+	trace = CM_TransformedBoxTraceContext (&cm_trace, start, end, mins, maxs,
+		headnode, brushmask, origin, angles);
+
+	c_traces++;
+	c_brush_traces += cm_trace.brushtraces;
+
+	return trace;
+}
+
+
+/*
+===============================================================================
+
+TRACE STRESS TEST
+
+===============================================================================
+*/
+
+typedef struct
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		origin, angles;
+	int			headnode;
+	qboolean	transformed;
+} tracetestcase_t;
+
+typedef struct
+{
+	tracecontext_t	*tc;
+	int			mismatches;
+	int			rounded;		// only off in the last bits
+	unsigned	usec;
+	void		*thread;
+} tracetestworker_t;
+
+#define	MAX_TRACETEST_THREADS	32
+
+#ifdef CM_SSE
+static const qboolean	cm_sse = true;
+#else
+static const qboolean	cm_sse = false;
+#endif
+
+tracetestcase_t	*tracetest_cases;
+trace_t			*tracetest_results;
+int				tracetest_count;
+
+/*
+==================
+CM_TraceTestRandom
+
+The same numbers on every system for the same seed, rand() isn't
+==================
+*/
+float CM_TraceTestRandom (unsigned *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 8) / 16777216.0f;
+}
+
+/*
+==================
+CM_TraceTestCase
+
+Somewhere in the world: points, player boxes, position
+tests, and now and then an inline model, moved and turned
+==================
+*/
+void CM_TraceTestCase (int index, tracetestcase_t *tt)
+{
+	static vec3_t	player_mins = {-16, -16, -24};
+	static vec3_t	player_maxs = {16, 16, 32};
+	cmodel_t	*world, *model;
+	unsigned	seed;
+	int			i;
+
+	memset (tt, 0, sizeof(*tt));
+	seed = index * 2654435761u + 1;
+	world = &map_cmodels[0];
+
+	for (i=0 ; i<3 ; i++)
+	{
+		tt->start[i] = world->mins[i] + CM_TraceTestRandom (&seed) * (world->maxs[i] - world->mins[i]);
+		tt->end[i] = world->mins[i] + CM_TraceTestRandom (&seed) * (world->maxs[i] - world->mins[i]);
+	}
+
+	switch (index & 7)
+	{
+	case 0:
+	case 1:		// shots
+		break;
+	case 2:		// position test
+		VectorCopy (player_mins, tt->mins);
+		VectorCopy (player_maxs, tt->maxs);
+		VectorCopy (tt->start, tt->end);
+		break;
+	case 3:		// a step
+		VectorCopy (player_mins, tt->mins);
+		VectorCopy (player_maxs, tt->maxs);
+		for (i=0 ; i<3 ; i++)
+			tt->end[i] = tt->start[i] + (CM_TraceTestRandom (&seed) - 0.5f) * 128;
+		break;
+	default:
+		VectorCopy (player_mins, tt->mins);
+		VectorCopy (player_maxs, tt->maxs);
+		break;
+	}
+
+	tt->headnode = world->headnode;
+	if (numcmodels > 1 && (index & 15) == 15)
+	{
+		model = &map_cmodels[1 + (int)(CM_TraceTestRandom (&seed) * (numcmodels - 1))];
+		tt->transformed = true;
+		tt->headnode = model->headnode;
+		for (i=0 ; i<3 ; i++)
+		{
+			tt->origin[i] = (CM_TraceTestRandom (&seed) - 0.5f) * 128;
+			tt->start[i] = model->mins[i] + tt->origin[i] + (CM_TraceTestRandom (&seed) - 0.5f) * 256;
+			tt->end[i] = model->maxs[i] + tt->origin[i] + (CM_TraceTestRandom (&seed) - 0.5f) * 256;
+		}
+		if (index & 16)
+			tt->angles[YAW] = CM_TraceTestRandom (&seed) * 360;
+	}
+}
+
+/*
+==================
+CM_TraceTestRun
+==================
+*/
+trace_t CM_TraceTestRun (tracecontext_t *tc, tracetestcase_t *tt)
+{
+	if (tt->transformed)
+		return CM_TransformedBoxTraceContext (tc, tt->start, tt->end, tt->mins, tt->maxs,
+			tt->headnode, MASK_PLAYERSOLID, tt->origin, tt->angles);
+	return CM_BoxTraceContext (tc, tt->start, tt->end, tt->mins, tt->maxs,
+		tt->headnode, MASK_PLAYERSOLID);
+}
+
+/*
+==================
+CM_CompareTraces
+
+0 if the traces are the same, 1 if only the fraction and
+end differ by a rounding, 2 if they hit something else.
+The compiler is free to sum the plane distances of the C
+brush clipping in another order than the SSE does.
+==================
+*/
+int CM_CompareTraces (trace_t *a, trace_t *b)
+{
+	int		i;
+
+	if (a->allsolid != b->allsolid || a->startsolid != b->startsolid
+		|| !VectorCompare (a->plane.normal, b->plane.normal) || a->plane.dist != b->plane.dist
+		|| a->surface != b->surface || a->contents != b->contents)
+		return 2;
+	if (a->fraction == b->fraction && VectorCompare (a->endpos, b->endpos))
+		return 0;
+	if (fabs (a->fraction - b->fraction) > 0.0001)
+		return 2;
+	for (i=0 ; i<3 ; i++)
+		if (fabs (a->endpos[i] - b->endpos[i]) > 0.125)
+			return 2;
+	return 1;
+}
+
+/*
+==================
+CM_TraceTestThread
+
+Runs every case through its own context and checks
+it came out the way it did on the main thread
+==================
+*/
+void CM_TraceTestThread (void *parm)
+{
+	tracetestworker_t	*w;
+	trace_t		trace;
+	unsigned	start;
+	int			i;
+
+	w = (tracetestworker_t *)parm;
+	start = Sys_Microseconds ();
+
+	for (i=0 ; i<tracetest_count ; i++)
+	{
+		trace = CM_TraceTestRun (w->tc, &tracetest_cases[i]);
+		switch (CM_CompareTraces (&trace, &tracetest_results[i]))
+		{
+		case 1:
+			w->rounded++;
+			break;
+		case 2:
+			w->mismatches++;
+			break;
+		}
+	}
+
+	w->usec = Sys_Microseconds () - start;
+}
+
+/*
+==================
+CM_TraceTest_f
+
+cm_tracetest [traces] [threads]
+
+Traces the same random set through the loaded map on the main
+thread with the plain C brush clipping, then on that many threads at
+once with whatever the build clips with, and counts any trace that
+didn't come out the same
+==================
+*/
+void CM_TraceTest_f (void)
+{
+	tracetestworker_t	workers[MAX_TRACETEST_THREADS];
+	tracecontext_t	*reference;
+	int			i, numthreads, mismatches, rounded;
+	unsigned	start, usec, slowest;
+
+	if (!numnodes || !numcmodels)
+	{
+		Com_Printf ("cm_tracetest: no map loaded\n");
+		return;
+	}
+
+	tracetest_count = Cmd_Argc() > 1 ? atoi (Cmd_Argv(1)) : 50000;
+	numthreads = Cmd_Argc() > 2 ? atoi (Cmd_Argv(2)) : Sys_NumProcessors ();
+	tracetest_count = max (1, min (tracetest_count, 1<<20));
+	numthreads = max (1, min (numthreads, MAX_TRACETEST_THREADS));
+
+	tracetest_cases = Z_Malloc (tracetest_count * sizeof(tracetest_cases[0]));
+	tracetest_results = Z_Malloc (tracetest_count * sizeof(tracetest_results[0]));
+	for (i=0 ; i<tracetest_count ; i++)
+		CM_TraceTestCase (i, &tracetest_cases[i]);
+
+	reference = Z_Malloc (sizeof(tracecontext_t));
+	reference->scalar = true;
+	start = Sys_Microseconds ();
+	for (i=0 ; i<tracetest_count ; i++)
+		tracetest_results[i] = CM_TraceTestRun (reference, &tracetest_cases[i]);
+	usec = Sys_Microseconds () - start;
+	Z_Free (reference);
+	Com_Printf ("%i traces on the main thread, scalar: %i msec\n", tracetest_count, usec / 1000);
+
+	memset (workers, 0, sizeof(workers));
+	start = Sys_Microseconds ();
+	for (i=0 ; i<numthreads ; i++)
+	{
+		workers[i].tc = Z_Malloc (sizeof(tracecontext_t));
+		workers[i].thread = Sys_CreateThread (CM_TraceTestThread, &workers[i]);
+		if (!workers[i].thread)
+			CM_TraceTestThread (&workers[i]);	// no threads, one after another
+	}
+
+	mismatches = rounded = 0;
+	slowest = 0;
+	for (i=0 ; i<numthreads ; i++)
+	{
+		if (workers[i].thread)
+			Sys_WaitThread (workers[i].thread);
+		mismatches += workers[i].mismatches;
+		rounded += workers[i].rounded;
+		slowest = max (slowest, workers[i].usec);
+		Z_Free (workers[i].tc);
+	}
+	usec = Sys_Microseconds () - start;
+
+	Com_Printf ("%i threads, %i traces each%s: %i msec, slowest thread %i msec\n",
+		numthreads, tracetest_count, cm_sse ? ", SSE" : "", usec / 1000, slowest / 1000);
+	if (mismatches)
+		Com_Printf ("cm_tracetest: %i traces came out different!\n", mismatches);
+	else if (rounded)
+		Com_Printf ("every trace matched, %i to the rounding\n", rounded);
+	else
+		Com_Printf ("every trace matched\n");
+
+	Z_Free (tracetest_cases);
+	Z_Free (tracetest_results);
+	tracetest_cases = NULL;
+	tracetest_results = NULL;
+}
+
 
 /*
 ===============================================================================
@@ -1638,23 +2435,218 @@ void CM_DecompressVis (byte *in, byte *out)
 
 byte	pvsrow[MAX_MAP_LEAFS/8];
 byte	phsrow[MAX_MAP_LEAFS/8];
+byte	nullrow[MAX_MAP_LEAFS/8];
+
+/*
+Decompressed rows, so the vis lumps aren't run-length decoded for
+every multicast and inPVS.  When both full matrices fit in
+cm_viscache they are decoded at load time and can be read from any
+thread.  Otherwise a direct mapped cache of rows is filled as
+clusters are asked for, from the main thread only.
+
+Rows are padded to whole ints so they can be ORed a long at a time.
+*/
+typedef struct
+{
+	int		rowbytes;		// (numclusters+31)>>5 ints
+	qboolean	full;		// rows[DVIS_PVS] and rows[DVIS_PHS] hold every cluster
+	int		numslots;		// rows in each cache when not full
+	byte	*rows[2];		// [numclusters or numslots][rowbytes]
+	int		*tags[2];		// [numslots] cluster held by each slot, -1 if none
+	int		hits, misses;
+} cvisrows_t;
+
+cvisrows_t	cm_visrows;
+
+/*
+===================
+CMod_FreeVisRows
+===================
+*/
+void CMod_FreeVisRows (void)
+{
+	if (cm_visrows.rows[0])
+		Z_Free (cm_visrows.rows[0]);
+	memset (&cm_visrows, 0, sizeof(cm_visrows));
+}
+
+/*
+===================
+CMod_BuildVisRows
+
+Called after the clusters and visibility are loaded
+===================
+*/
+void CMod_BuildVisRows (void)
+{
+	int		budget, rows, size, i;
+
+	CMod_FreeVisRows ();
+
+	cm_visrows.rowbytes = ((numclusters+31)>>5)<<2;
+	budget = cm_viscache->intValue * 1024;
+	if (budget <= 0)
+		return;
+
+	rows = budget / (2*cm_visrows.rowbytes);
+	if (rows >= numclusters)
+	{
+		cm_visrows.full = true;
+		rows = numclusters;
+		size = 2*rows*cm_visrows.rowbytes;
+	}
+	else if (rows > 0)
+		size = 2*rows*(cm_visrows.rowbytes + sizeof(int));
+	else
+		return;
+
+	cm_visrows.numslots = rows;
+	cm_visrows.rows[0] = Z_Malloc (size);
+	cm_visrows.rows[1] = cm_visrows.rows[0] + rows*cm_visrows.rowbytes;
+
+	if (cm_visrows.full)
+	{
+		for (i=0 ; i<numclusters ; i++)
+		{
+			CM_DecompressClusterPVS (i, cm_visrows.rows[DVIS_PVS] + i*cm_visrows.rowbytes);
+			CM_DecompressClusterPHS (i, cm_visrows.rows[DVIS_PHS] + i*cm_visrows.rowbytes);
+		}
+		Com_DPrintf (DEVELOPER_MSG_STANDARD, "%i clusters, %i KB of decompressed vis\n", numclusters, size>>10);
+		return;
+	}
 
-byte	*CM_ClusterPVS (int cluster)
+	cm_visrows.tags[0] = (int *)(cm_visrows.rows[1] + rows*cm_visrows.rowbytes);
+	cm_visrows.tags[1] = cm_visrows.tags[0] + rows;
+	for (i=0 ; i<2*rows ; i++)
+		cm_visrows.tags[0][i] = -1;
+	Com_DPrintf (DEVELOPER_MSG_STANDARD, "%i clusters, caching %i decompressed vis rows\n", numclusters, rows);
+}
+
+/*
+===================
+CM_DecompressClusterPVS
+
+Decompresses into a caller supplied row, for use
+where the shared pvsrow/phsrow can't be (threads)
+===================
+*/
+void	CM_DecompressClusterPVS (int cluster, byte *out)
 {
 	if (cluster == -1)
-		memset (pvsrow, 0, (numclusters+7)>>3);
+		memset (out, 0, (numclusters+7)>>3);
 	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PVS], pvsrow);
-	return pvsrow;
+		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PVS], out);
 }
 
-byte	*CM_ClusterPHS (int cluster)
+void	CM_DecompressClusterPHS (int cluster, byte *out)
 {
 	if (cluster == -1)
-		memset (phsrow, 0, (numclusters+7)>>3);
+		memset (out, 0, (numclusters+7)>>3);
+	else
+		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PHS], out);
+}
+
+/*
+===================
+CM_ClusterRow
+
+Returns a decompressed row, valid until the next call.
+Main thread only, it fills the cache.
+===================
+*/
+const byte *CM_ClusterRow (int cluster, int vis)
+{
+	byte	*row;
+	int		slot;
+
+	if (cluster < 0 || cluster >= numclusters)
+		return nullrow;
+
+	if (cm_visrows.full)
+		return cm_visrows.rows[vis] + cluster*cm_visrows.rowbytes;
+
+	if (!cm_visrows.numslots)
+	{
+		row = (vis == DVIS_PVS) ? pvsrow : phsrow;
+		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][vis], row);
+		return row;
+	}
+
+	slot = cluster % cm_visrows.numslots;
+	row = cm_visrows.rows[vis] + slot*cm_visrows.rowbytes;
+	if (cm_visrows.tags[vis][slot] != cluster)
+	{
+		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][vis], row);
+		cm_visrows.tags[vis][slot] = cluster;
+		cm_visrows.misses++;
+	}
 	else
-		CM_DecompressVis (map_visibility + map_vis->bitofs[cluster][DVIS_PHS], phsrow);
-	return phsrow;
+		cm_visrows.hits++;
+	return row;
+}
+
+const byte	*CM_ClusterPVS (int cluster)
+{
+	return CM_ClusterRow (cluster, DVIS_PVS);
+}
+
+const byte	*CM_ClusterPHS (int cluster)
+{
+	return CM_ClusterRow (cluster, DVIS_PHS);
+}
+
+/*
+===================
+CM_SharedClusterPVS
+
+Safe from any thread.  Returns the row out of the full
+matrix, or decompresses it into scratch and returns that.
+===================
+*/
+const byte	*CM_SharedClusterPVS (int cluster, byte *scratch)
+{
+	if (cm_visrows.full && cluster >= 0 && cluster < numclusters)
+		return cm_visrows.rows[DVIS_PVS] + cluster*cm_visrows.rowbytes;
+	CM_DecompressClusterPVS (cluster, scratch);
+	return scratch;
+}
+
+const byte	*CM_SharedClusterPHS (int cluster, byte *scratch)
+{
+	if (cm_visrows.full && cluster >= 0 && cluster < numclusters)
+		return cm_visrows.rows[DVIS_PHS] + cluster*cm_visrows.rowbytes;
+	CM_DecompressClusterPHS (cluster, scratch);
+	return scratch;
+}
+
+/*
+===================
+CM_VisStats_f
+===================
+*/
+void CM_VisStats_f (void)
+{
+	int		total;
+
+	if (!map_name[0])
+	{
+		Com_Printf ("no map loaded\n");
+		return;
+	}
+
+	if (cm_visrows.full)
+		Com_Printf ("%i clusters, all rows decompressed in %i KB\n", numclusters,
+			(2*numclusters*cm_visrows.rowbytes)>>10);
+	else if (cm_visrows.numslots)
+		Com_Printf ("%i clusters, %i of %i rows cached in %i KB\n", numclusters,
+			cm_visrows.numslots, numclusters, (2*cm_visrows.numslots*cm_visrows.rowbytes)>>10);
+	else
+		Com_Printf ("%i clusters, no rows cached\n", numclusters);
+
+	total = cm_visrows.hits + cm_visrows.misses;
+	if (total)
+		Com_Printf ("%i lookups since the last cm_visstats, %.1f%% hit\n", total, 100.0f*cm_visrows.hits/total);
+	cm_visrows.hits = cm_visrows.misses = 0;
 }
 
 
@@ -1812,7 +2804,7 @@ Returns true if any leaf under headnode has a cluster that
 is potentially visible
 =============
 */
-qboolean CM_HeadnodeVisible (int nodenum, byte *visbits)
+qboolean CM_HeadnodeVisible (int nodenum, const byte *visbits)
 {
 	int		leafnum;
 	int		cluster;
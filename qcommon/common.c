@@ -1375,6 +1375,164 @@ byte	COM_BlockSequenceCRCByte (byte *base, int length, int sequence)
 	return crc;
 }
 
+/*
+==============================================================================
+
+			MESSAGE COMPRESSION
+
+A small LZSS coder for svc_zpacket.  Each control byte says, low bit
+first, whether the next eight items are a literal byte or a two byte
+reference to 3 to 18 bytes that came up to 4096 bytes earlier.
+==============================================================================
+*/
+
+#define	LZ_WINDOW		4096
+#define	LZ_MINMATCH		3
+#define	LZ_MAXMATCH		18
+#define	LZ_HASHSIZE		4096
+#define	LZ_MAXCHAIN		32
+
+#define	LZ_HASH(p)		((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) & (LZ_HASHSIZE-1))
+
+static int	lz_head[LZ_HASHSIZE];
+static int	lz_prev[LZ_WINDOW];
+
+/*
+====================
+Com_Compress
+
+Returns the compressed length, or -1 if it doesn't fit in outsize
+====================
+*/
+int Com_Compress (byte *in, int inlen, byte *out, int outsize)
+{
+	int		i, h, pos, outlen, ctrl, bit;
+	int		len, bestlen, bestoff, cand, chain;
+
+	for (i=0 ; i<LZ_HASHSIZE ; i++)
+		lz_head[i] = -1;
+
+	outlen = 0;
+	ctrl = 0;
+	bit = 8;
+	pos = 0;
+	while (pos < inlen)
+	{
+		if (bit == 8)
+		{
+			if (outlen >= outsize)
+				return -1;
+			ctrl = outlen++;
+			out[ctrl] = 0;
+			bit = 0;
+		}
+
+		// find the longest match among the last few with the same hash
+		bestlen = 0;
+		bestoff = 0;
+		if (pos + LZ_MINMATCH <= inlen)
+		{
+			cand = lz_head[LZ_HASH(in + pos)];
+			for (chain=0 ; chain<LZ_MAXCHAIN && cand >= 0 && pos - cand <= LZ_WINDOW ; chain++)
+			{
+				for (len=0 ; len<LZ_MAXMATCH && pos + len < inlen && in[cand+len] == in[pos+len] ; len++)
+					;
+				if (len > bestlen)
+				{
+					bestlen = len;
+					bestoff = pos - cand;
+					if (len == LZ_MAXMATCH)
+						break;
+				}
+
+				// the slot may have been reused by a later position
+				h = lz_prev[cand & (LZ_WINDOW-1)];
+				if (h >= cand)
+					break;
+				cand = h;
+			}
+		}
+
+		if (bestlen >= LZ_MINMATCH)
+		{
+			if (outlen + 2 > outsize)
+				return -1;
+			out[ctrl] |= 1 << bit;
+			out[outlen++] = (bestoff - 1) & 255;
+			out[outlen++] = (((bestoff - 1) >> 8) << 4) | (bestlen - LZ_MINMATCH);
+		}
+		else
+		{
+			if (outlen >= outsize)
+				return -1;
+			out[outlen++] = in[pos];
+			bestlen = 1;
+		}
+		bit++;
+
+		for (i=0 ; i<bestlen ; i++, pos++)
+		{
+			if (pos + LZ_MINMATCH > inlen)
+				continue;
+			h = LZ_HASH(in + pos);
+			lz_prev[pos & (LZ_WINDOW-1)] = lz_head[h];
+			lz_head[h] = pos;
+		}
+	}
+
+	return outlen;
+}
+
+/*
+====================
+Com_Decompress
+
+Returns the decompressed length, or -1 if the data is bad or doesn't
+fit in outsize
+====================
+*/
+int Com_Decompress (byte *in, int inlen, byte *out, int outsize)
+{
+	int		inpos, outlen, ctrl, bit;
+	int		len, off;
+
+	inpos = 0;
+	outlen = 0;
+	ctrl = 0;
+	bit = 8;
+	while (inpos < inlen)
+	{
+		if (bit == 8)
+		{
+			ctrl = in[inpos++];
+			bit = 0;
+			continue;
+		}
+
+		if (ctrl & (1 << bit))
+		{
+			if (inpos + 2 > inlen)
+				return -1;
+			off = (in[inpos] | ((in[inpos+1] >> 4) << 8)) + 1;
+			len = (in[inpos+1] & 15) + LZ_MINMATCH;
+			inpos += 2;
+			if (off > outlen || outlen + len > outsize)
+				return -1;
+			for ( ; len ; len--, outlen++)
+				out[outlen] = out[outlen - off];
+		}
+		else
+		{
+			if (outlen >= outsize)
+				return -1;
+			out[outlen++] = in[inpos++];
+		}
+		bit++;
+	}
+
+	return outlen;
+}
+
 //========================================================
 
 float	frand(void)
@@ -1466,6 +1624,8 @@ void Qcommon_Init (int argc, char **argv)
 	//
     Cmd_AddCommand ("z_stats", Z_Stats_f);
     Cmd_AddCommand ("error", Com_Error_f);
+    Cmd_AddCommand ("cm_tracetest", CM_TraceTest_f);
+    Cmd_AddCommand ("cm_visstats", CM_VisStats_f);
 
 	host_speeds = Cvar_Get ("host_speeds", "0", 0);
 	log_stats = Cvar_Get ("log_stats", "0", 0);
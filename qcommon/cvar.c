@@ -151,6 +151,9 @@ cvar_t *Cvar_Get (char *var_name, char *var_value, int flags)
 {
 	cvar_t	*var;
 
+	if (flags & CVAR_SERVERINFO)
+		serverinfo_modified = true;
+
 	if (flags & (CVAR_USERINFO | CVAR_SERVERINFO))
 	{
 		if (!Cvar_InfoValidate (var_name))
@@ -290,6 +293,8 @@ cvar_t *Cvar_Set2 (char *var_name, char *value, qboolean force)
 
 	if (var->flags & CVAR_USERINFO)
 		userinfo_modified = true;	// transmit at next oportunity
+	if (var->flags & CVAR_SERVERINFO)
+		serverinfo_modified = true;
 
 	Z_Free (var->string);	// free the old value string
 
@@ -339,6 +344,8 @@ cvar_t *Cvar_FullSet (char *var_name, char *value, int flags)
 
 	if (var->flags & CVAR_USERINFO)
 		userinfo_modified = true;	// transmit at next oportunity
+	if (var->flags & CVAR_SERVERINFO)
+		serverinfo_modified = true;
 
 	Z_Free (var->string);	// free the old value string
 
@@ -645,6 +652,7 @@ void Cvar_List_f (void)
 
 
 qboolean userinfo_modified;
+qboolean serverinfo_modified;
 
 
 char	*Cvar_BitInfo (int bit)
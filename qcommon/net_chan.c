@@ -60,6 +60,13 @@ reliable acknowledgement numbers provides protection against malicious
 address spoofing.
 
 
+Packets over MAX_MSGLEN_MP are sent as several fragments when both
+ends said they can take them at connect time.  Fragments carry the
+packet's sequence with bit 30 set, and after the header a short with
+the fragment's offset in the packet, the top bit set if more follow.
+The receiver only sees the packet once all of it has arrived in
+order, a lost fragment loses the packet like any lost datagram.
+
 The qport field is a workaround for bad address translating routers that
 sometimes remap the client's source port on a packet during gameplay.
 
@@ -77,11 +84,18 @@ unacknowledged reliable
 cvar_t		*showpackets;
 cvar_t		*showdrop;
 cvar_t		*qport;
+cvar_t		*net_fragment;
+
+#define	FRAGMENT_BIT	(1<<30)
+#define	FRAGMENT_MORE	0x8000
+#define	FRAGMENT_SIZE	(MAX_MSGLEN_MP - 16)	// leave room for the headers
 
 netadr_t	net_from;
 sizebuf_t	net_message;
 byte		net_message_buffer[MAX_MSGLEN];
 
+void		(*net_fakesend) (netsrc_t sock, int length, void *data, netadr_t to);
+
 /*
 ===============
 Netchan_Init
@@ -101,6 +115,25 @@ void Netchan_Init (void)
 	showpackets = Cvar_Get ("showpackets", "0", 0);
 	showdrop = Cvar_Get ("showdrop", "0", 0);
 	qport = Cvar_Get ("qport", va("%i", port), CVAR_NOSET);
+	net_fragment = Cvar_Get ("net_fragment", "1", 0);
+	Cvar_SetDescription ("net_fragment", "Offer to split packets larger than 1400 bytes into fragments when connecting.");
+}
+
+/*
+===============
+Netchan_SendPacket
+
+0.x.x.x is never the source of a real packet, so the server's load
+generator uses those addresses for its fake clients and both ends of
+their connections go through net_fakesend instead of a socket
+===============
+*/
+void Netchan_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
+{
+	if (net_fakesend && to.type == NA_IP && !to.ip[0])
+		net_fakesend (sock, length, data, to);
+	else
+		NET_SendPacket (sock, length, data, to);
 }
 
 /*
@@ -122,7 +155,7 @@ void Netchan_OutOfBand (int net_socket, netadr_t adr, int length, byte *data)
 	SZ_Write (&send, data, length);
 
 // send the datagram
-	NET_SendPacket (net_socket, send.cursize, send.data, adr);
+	Netchan_SendPacket (net_socket, send.cursize, send.data, adr);
 }
 
 /*
@@ -160,6 +193,7 @@ void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int qport)
 	chan->sock = sock;
 	chan->remote_address = adr;
 	chan->qport = qport;
+	chan->toserver = (sock == NS_CLIENT);
 	chan->last_received = curtime;
 	chan->incoming_sequence = 0;
 	chan->outgoing_sequence = 1;
@@ -204,6 +238,40 @@ qboolean Netchan_NeedReliable (netchan_t *chan)
 	return send_reliable;
 }
 
+/*
+===============
+Netchan_TransmitFragments
+
+Sends a packet that is too big for one datagram in pieces.
+headerlen is the sequence, ack and qport at the start of it.
+================
+*/
+void Netchan_TransmitFragments (netchan_t *chan, sizebuf_t *packet, int headerlen)
+{
+	sizebuf_t	send;
+	byte		send_buf[MAX_MSGLEN_MP];
+	int			offset, length, more;
+
+	for (offset = headerlen ; offset < packet->cursize ; offset += length)
+	{
+		length = packet->cursize - offset;
+		more = 0;
+		if (length > FRAGMENT_SIZE)
+		{
+			length = FRAGMENT_SIZE;
+			more = FRAGMENT_MORE;
+		}
+
+		SZ_Init (&send, send_buf, sizeof(send_buf));
+		SZ_Write (&send, packet->data, headerlen);
+		send_buf[3] |= FRAGMENT_BIT >> 24;	// little endian sequence
+		MSG_WriteShort (&send, (offset - headerlen) | more);
+		SZ_Write (&send, packet->data + offset, length);
+
+		Netchan_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
+	}
+}
+
 /*
 ===============
 Netchan_Transmit
@@ -252,8 +320,8 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	MSG_WriteLong (&send, w1);
 	MSG_WriteLong (&send, w2);
 
-	// send the qport if we are a client
-	if (chan->sock == NS_CLIENT)
+	// send the qport if we are talking to a server
+	if (chan->toserver)
 		MSG_WriteShort (&send, qport->value);
 
 // copy the reliable message to the packet first
@@ -270,7 +338,10 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 		Com_Printf ("Netchan_Transmit: dumped unreliable\n");
 
 // send the datagram
-	NET_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
+	if (chan->fragment && send.cursize > MAX_MSGLEN_MP)
+		Netchan_TransmitFragments (chan, &send, chan->toserver ? 10 : 8);
+	else
+		Netchan_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
 
 	if (showpackets->intValue)
 	{
@@ -290,6 +361,55 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	}
 }
 
+/*
+=================
+Netchan_Reassemble
+
+Adds a fragment to the packet being put back together.  Returns true
+when that was the last one, msg then holds the whole packet.
+=================
+*/
+qboolean Netchan_Reassemble (netchan_t *chan, sizebuf_t *msg, int sequence)
+{
+	int		offset, length, more;
+
+	offset = MSG_ReadShort (msg) & 0xffff;
+	more = offset & FRAGMENT_MORE;
+	offset &= ~FRAGMENT_MORE;
+	length = msg->cursize - msg->readcount;
+
+	if (sequence != chan->fragment_sequence)
+	{	// a new packet, whatever was left of the last one is lost
+		chan->fragment_sequence = sequence;
+		chan->fragment_length = 0;
+	}
+
+	if (offset != chan->fragment_length || length < 0
+		|| chan->fragment_length + length > sizeof(chan->fragment_buf)
+		|| msg->readcount - 2 + chan->fragment_length + length > msg->maxsize)
+	{
+		if (showdrop->intValue)
+			Com_Printf ("%s:Dropped fragment of %i at %i\n"
+				, NET_AdrToString (chan->remote_address)
+				, sequence
+				, offset);
+		chan->fragment_length = 0;
+		return false;
+	}
+
+	memcpy (chan->fragment_buf + chan->fragment_length, msg->data + msg->readcount, length);
+	chan->fragment_length += length;
+	if (more)
+		return false;
+
+	// hand on the whole packet in place of the last fragment
+	msg->readcount -= 2;
+	memcpy (msg->data + msg->readcount, chan->fragment_buf, chan->fragment_length);
+	msg->cursize = msg->readcount + chan->fragment_length;
+	chan->fragment_length = 0;
+	return true;
+}
+
 /*
 =================
 Netchan_Process
@@ -314,11 +434,18 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 //		qport = MSG_ReadShort (msg);
 
 	/* read the qport if we are a server */
-	if (chan->sock == NS_SERVER) /* FS: From yamagi q2 */
+	if (!chan->toserver) /* FS: From yamagi q2 */
 	{
 		(void)MSG_ReadShort(msg);
 	}
 
+	if (chan->fragment && (sequence & FRAGMENT_BIT))
+	{
+		if (!Netchan_Reassemble (chan, msg, sequence & ~FRAGMENT_BIT))
+			return false;
+		sequence &= ~FRAGMENT_BIT;
+	}
+
 	reliable_message = sequence >> 31;
 	reliable_ack = sequence_ack >> 31;
 
@@ -215,10 +215,15 @@ PROTOCOL
 
 //=========================================
 
-#define	UPDATE_BACKUP	16	// copies of entity_state_t to keep buffered
+#define	UPDATE_BACKUP	64	// copies of entity_state_t to keep buffered
 							// must be power of two
 #define	UPDATE_MASK		(UPDATE_BACKUP-1)
 
+// a delta can reach back UPDATE_WINDOW frames of 10 Hz, or 1.6 seconds.
+// A client taking every frame at sv_fps 40 gets four times as many,
+// which is what UPDATE_BACKUP holds.  Older clients keep only 16
+#define	UPDATE_WINDOW	16
+
 
 
 //==================
@@ -254,7 +259,12 @@ enum svc_ops_e
 	svc_playerinfo,				// variable
 	svc_packetentities,			// [...]
 	svc_deltapacketentities,	// [...]
-	svc_frame
+	svc_frame,
+	svc_zpacket,				// [short] compressed size [short] size [compressed messages]
+	svc_dlchunk,				// [long] offset [short] size [byte] percent [size bytes]
+	svc_multicast,				// [byte] to [pos] origin [short] size [size bytes], only to relays
+	svc_tickrate,				// [byte] msec per server frame, after svc_serverdata
+	svc_projectiles				// [byte] count [...], right after svc_packetentities
 };
 
 //==============================================
@@ -357,6 +367,18 @@ enum clc_ops_e
 #define	U_SOUND		(1<<26)
 #define	U_SOLID		(1<<27)
 
+// svc_projectiles carries the frame's projectiles after its packetentities,
+// each one a [byte] number (0x80 means [byte] number>>7 follows) and a
+// [byte] of these, delta'd from the frame's delta frame or from nothing.
+// Projectiles missing from it are gone
+#define	PR_ORIGIN		(1<<0)		// [pos]
+#define	PR_MOVE			(1<<1)		// [char] x 3, whole units from the old origin
+#define	PR_ANGLES		(1<<2)		// [angle] x 3
+#define	PR_MODEL		(1<<3)		// [byte]
+#define	PR_EFFECTS		(1<<4)		// [long]
+#define	PR_SOUND		(1<<5)		// [byte]
+#define	PR_OLDORIGIN	(1<<6)		// [pos], only for new projectiles
+
 
 /*
 ==============================================================
@@ -549,6 +571,9 @@ extern	qboolean	userinfo_modified;
 // this is set each time a CVAR_USERINFO variable is changed
 // so that the client knows to send it to the server
 
+extern	qboolean	serverinfo_modified;
+// likewise for CVAR_SERVERINFO, the server rebuilds its status reply
+
 /*
 ==============================================================
 
@@ -563,6 +588,15 @@ NET
 
 #define	MAX_MSGLEN		32000		// max length of a message
 #define MAX_MSGLEN_MP	1400		/* FS: For sending configstrings and baselines.  Much faster start-ups */
+#define	MAX_MSGLEN_FRAG	4096		// what a fragmenting netchan may send to a remote client
+
+// what a client can handle, sent after the userinfo when connecting
+#define	NETCAPS_FRAGMENT	1		// puts split packets back together
+#define	NETCAPS_ZPACKET		2		// understands svc_zpacket
+#define	NETCAPS_DLWINDOW	4		// takes svc_dlchunk and acks with nextdl <offset>
+#define	NETCAPS_RELAY		8		// wants the whole world and every multicast, to serve spectators
+#define	NETCAPS_TICKRATE	16		// takes svc_tickrate and a frame every server frame
+#define	NETCAPS_PROJECTILES	32		// takes a frame's projectiles in svc_projectiles
 #define	PACKET_HEADER	10			// two ints and a short
 
 typedef enum {NA_LOOPBACK, NA_BROADCAST, NA_IP, NA_IPX, NA_BROADCAST_IPX} netadrtype_t;
@@ -588,6 +622,8 @@ void		NET_Config (qboolean multiplayer);
 
 qboolean	NET_GetPacket (netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message);
 void		NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
+void		NET_BeginBatch (netsrc_t sock);	// hold datagrams until NET_FlushBatch
+void		NET_FlushBatch (netsrc_t sock);
 
 qboolean	NET_CompareAdr (netadr_t a, netadr_t b);
 qboolean	NET_CompareBaseAdr (netadr_t a, netadr_t b);
@@ -607,6 +643,7 @@ typedef struct
 	qboolean	fatal_error;
 
 	netsrc_t	sock;
+	qboolean	toserver;			// remote end is a server, whichever socket we use
 
 	int			dropped;			// between last packet and previous
 
@@ -634,6 +671,12 @@ typedef struct
 // message is copied to this buffer when it is first transfered
 	int			reliable_length;
 	byte		reliable_buf[MAX_MSGLEN-16];	// unacked reliable message
+
+// packets bigger than MAX_MSGLEN_MP are split up, if both ends agreed to it
+	qboolean	fragment;
+	int			fragment_sequence;			// packet being put back together
+	int			fragment_length;
+	byte		fragment_buf[MAX_MSGLEN-16];
 } netchan_t;
 
 extern	netadr_t	net_from;
@@ -652,6 +695,11 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg);
 
 qboolean Netchan_CanReliable (netchan_t *chan);
 
+extern	cvar_t	*net_fragment;
+
+// set while the server's load generator runs, see Netchan_SendPacket
+extern	void	(*net_fakesend) (netsrc_t sock, int length, void *data, netadr_t to);
+
 
 /*
 ==============================================================
@@ -665,6 +713,8 @@ CMODEL
 #include "../qcommon/qfiles.h"
 
 cmodel_t	*CM_LoadMap (char *name, qboolean clientload, unsigned *checksum);
+void		CM_PreloadMap (char *name);
+extern	qboolean	cm_preloaded;
 cmodel_t	*CM_InlineModel (char *name);	// *1, *2, etc
 
 int			CM_NumClusters (void);
@@ -687,8 +737,42 @@ trace_t		CM_TransformedBoxTrace (vec3_t start, vec3_t end,
 						  int headnode, int brushmask,
 						  vec3_t origin, vec3_t angles);
 
-byte		*CM_ClusterPVS (int cluster);
-byte		*CM_ClusterPHS (int cluster);
+// everything one trace works with.  Traces through different
+// contexts can run on different threads at once; CM_BoxTrace and
+// CM_TransformedBoxTrace use one of their own and are main thread
+// only, as is CM_HeadnodeForBox.  Big, so Z_Malloc it, zeroed.
+typedef struct
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		extents;
+	trace_t		trace;
+	int			contents;
+	qboolean	ispoint;		// optimized case
+	qboolean	scalar;			// no SIMD brush clipping, to check it against
+	int			brushtraces;	// for statistics
+	int			checkcount;		// to avoid repeated testings
+	int			brushchecks[MAX_MAP_BRUSHES];
+} tracecontext_t;
+
+trace_t		CM_BoxTraceContext (tracecontext_t *tc, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask);
+trace_t		CM_TransformedBoxTraceContext (tracecontext_t *tc, vec3_t start, vec3_t end,
+						  vec3_t mins, vec3_t maxs,
+						  int headnode, int brushmask,
+						  vec3_t origin, vec3_t angles);
+void		CM_TraceTest_f (void);
+
+// the row stays valid until the next call, main thread only
+const byte	*CM_ClusterPVS (int cluster);
+const byte	*CM_ClusterPHS (int cluster);
+// any thread, returns a shared row or decompresses into scratch
+const byte	*CM_SharedClusterPVS (int cluster, byte *scratch);
+const byte	*CM_SharedClusterPHS (int cluster, byte *scratch);
+void		CM_DecompressClusterPVS (int cluster, byte *out);
+void		CM_DecompressClusterPHS (int cluster, byte *out);
+void		CM_VisStats_f (void);
 
 int			CM_PointLeafnum (vec3_t p);
 
@@ -696,6 +780,7 @@ int			CM_PointLeafnum (vec3_t p);
 // set to the first node that splits the box
 int			CM_BoxLeafnums (vec3_t mins, vec3_t maxs, int *list,
 							int listsize, int *topnode);
+int			CM_TopnodeForBox (vec3_t mins, vec3_t maxs, int headnode);
 
 int			CM_LeafContents (int leafnum);
 int			CM_LeafCluster (int leafnum);
@@ -705,7 +790,7 @@ void		CM_SetAreaPortalState (int portalnum, qboolean open);
 qboolean	CM_AreasConnected (int area1, int area2);
 
 int			CM_WriteAreaBits (byte *buffer, int area);
-qboolean	CM_HeadnodeVisible (int headnode, byte *visbits);
+qboolean	CM_HeadnodeVisible (int headnode, const byte *visbits);
 
 void		CM_WritePortalState (FILE *f);
 void		CM_ReadPortalState (FILE *f);
@@ -805,6 +890,9 @@ void		Com_SetServerState (int state);
 unsigned	Com_BlockChecksum (void *buffer, int length);
 byte		COM_BlockSequenceCRCByte (byte *base, int length, int sequence);
 
+int			Com_Compress (byte *in, int inlen, byte *out, int outsize);
+int			Com_Decompress (byte *in, int inlen, byte *out, int outsize);
+
 float	frand(void);	// 0 ti 1
 float	crand(void);	// -1 to 1
 
@@ -867,8 +955,26 @@ void	Sys_Quit (void) __attribute__((__noreturn__));
 char	*Sys_GetClipboardData( void );
 void	Sys_CopyProtect (void);
 
+// microsecond clock; it wraps, so only the difference
+// between two calls is meaningful
+unsigned	Sys_Microseconds (void);
+
 void	Sys_Sleep (unsigned msec);	// Knightmare added
 
+// threads are optional: Sys_CreateThread returns NULL on systems
+// without them (DOS) and the caller must do the work itself
+void	*Sys_CreateThread (void (*func) (void *parm), void *parm);
+void	Sys_WaitThread (void *thread);	// joins and frees the handle
+void	*Sys_CreateMutex (void);
+void	Sys_DestroyMutex (void *mutex);
+void	Sys_LockMutex (void *mutex);
+void	Sys_UnlockMutex (void *mutex);
+void	*Sys_CreateSemaphore (int value);
+void	Sys_DestroySemaphore (void *sem);
+void	Sys_SemaphorePost (void *sem);
+void	Sys_SemaphoreWait (void *sem);
+int		Sys_NumProcessors (void);
+
 #ifdef __DJGPP__
 void Sys_InitDXE3 (void);
 void *Sys_dlopen (const char *filename, qboolean globalmode);
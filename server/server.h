@@ -40,6 +40,31 @@ typedef enum {
 // some qc commands are only valid before the server has finished
 // initializing (precache commands, static sounds / objects, etc)
 
+// SV_FindIndex looks model, sound and image names up in these
+// instead of running through the configstrings
+#define	INDEX_HASH_SIZE		512		// twice MAX_MODELS, MAX_SOUNDS and MAX_IMAGES
+
+typedef enum {INDEX_MODELS, INDEX_SOUNDS, INDEX_IMAGES, NUM_INDEXES} indextable_t;
+
+typedef struct
+{
+	qboolean	valid;						// rebuilt from the configstrings when false
+	int			count;						// first empty slot after 0
+	short		slots[INDEX_HASH_SIZE];		// configstring offsets, 0 is empty
+} csindex_t;
+
+// where each client's box was in the last ANTILAG_FRAMES game frames,
+// for tracing hitscan shots against what the shooter saw
+#define	ANTILAG_FRAMES		32		// must be power of two
+
+typedef struct
+{
+	qboolean	solid;
+	int			svflags;
+	vec3_t		origin;
+	vec3_t		mins, maxs;
+} antilag_t;
+
 typedef struct
 {
 	server_state_t	state;			// precache commands are only valid during load
@@ -47,14 +72,19 @@ typedef struct
 	qboolean	attractloop;		// running cinematics and demos for the local system only
 	qboolean	loadgame;			// client begins should reuse existing entity
 
-	unsigned	time;				// always sv.framenum * 100 msec
+	unsigned	time;				// always sv.framenum * sv.frametime msec
 	int			framenum;
+	int			framediv;			// game frames per 100 msec, svs.framediv while in a game
+	int			frametime;			// msec per game frame
 
 	char		name[MAX_QPATH];			// map name, or cinematic name
 	struct cmodel_s		*models[MAX_MODELS];
 
 	char		configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
+	csindex_t	indexes[NUM_INDEXES];
 	entity_state_t	baselines[MAX_EDICTS];
+	byte		events[MAX_EDICTS];		// from game frames the 10 Hz clients skipped
+	int			antilag_frames[ANTILAG_FRAMES];	// sv.framenum each svs.antilag row was taken, 0 if none
 
 	// the multicast buffer is used to send a message to a set of clients
 	// it is only used to marshall data until SV_Multicast is called
@@ -66,6 +96,14 @@ typedef struct
 	qboolean	timedemo;		// don't time sync
 } server_t;
 
+// g_features bits, set by the game in its Init
+#define	GMF_VARIABLE_FPS	1		// runs its world at the sv_fps rate
+
+// sv_features bits, set for the game before its Init.  Imports past
+// the end of the original game_import_t are only there if their bit is
+#define	SVFEAT_UNLAGGED_TRACE	1		// gi.unlagged_trace
+#define	SVFEAT_TRACE_BATCH		2		// gi.trace_batch
+
 #define EDICT_NUM(n) ((edict_t *)((byte *)ge->edicts + ge->edict_size*(n)))
 #define NUM_FOR_EDICT(e) ( ((byte *)(e)-(byte *)ge->edicts ) / ge->edict_size)
 
@@ -86,11 +124,16 @@ typedef struct
 	player_state_t		ps;
 	int					num_entities;
 	int					first_entity;		// into the circular sv_packet_entities[]
+	int					num_projectiles;	// sent in svc_projectiles instead
+	int					first_projectile;
 	int					senttime;			// for ping calculations
 } client_frame_t;
 
+#define	MAX_FRAME_PROJECTILES	128		// any more go in the packetentities
+
 #define	LATENCY_COUNTS	16
-#define	RATE_MESSAGES	10
+#define	RATE_BURST		200		// msec worth of rate a client can save up
+#define	SV_FATPVS_ROW	(MAX_MAP_LEAFS/8)
 
 typedef struct client_s
 {
@@ -107,7 +150,10 @@ typedef struct client_s
 	int				frame_latency[LATENCY_COUNTS];
 	int				ping;
 
-	int				message_size[RATE_MESSAGES];	// used to rate drop packets
+	int				rate_tokens;		// bytes that may still be sent, the rate refills it
+	int				rate_time;			// svs.realtime of the last refill
+	byte			deferred[MAX_EDICTS];	// frames each entity's update was held back
+	qboolean		culled;				// something in deferred is set
 	int				rate;
 	int				surpressCount;		// number of messages rate supressed
 
@@ -125,16 +171,52 @@ typedef struct client_s
 	byte			*download;			// file being downloaded
 	int				downloadsize;		// total bytes (can't use EOF because of paks)
 	int				downloadcount;		// bytes sent
+	int				downloadacked;		// bytes the client has, for windowed downloads
+	int				downloadtime;		// svs.realtime the ack last moved
+	qboolean		dlwindow;			// can take svc_dlchunk
+	qboolean		compress;			// can take svc_zpacket
 
 	int				lastmessage;		// sv.framenum when packet was last received
 	int				lastconnect;
 
 	int				idletime;			/* FS: From R1Q2.  Kick excessive idlers. */
+	qboolean		relay;				// a relay server, gets the whole world and every multicast
+	qboolean		tickrate;			// gets every frame, not just one each 100 msec
+	qboolean		projectiles;		// gets projectiles in svc_projectiles
+	int				projsaved;			// bytes svc_projectiles saved this frame, for sv_profile
+	int				fatclusters[64];	// sorted clusters fatpvs was built from
+	int				numfatclusters;
+	int				fatspawncount;		// svs.spawncount it was built on
+	byte			fatpvs[SV_FATPVS_ROW];	// last fat PVS, see SV_FatPVS
 	int				challenge;			// challenge of this user, randomly generated
 
 	netchan_t		netchan;
+
+	struct client_s	*adrnext;			// next in svs.adrhash chain
+	struct client_s	*ipnext;			// next in svs.iphash chain
 } client_t;
 
+// encoded entity deltas, shared by all the clients written on one thread.
+// entries are matched on the full from and to states, so they never go
+// stale and simply get replaced as the entities change
+#define	DELTA_CACHE_WAYS	4
+#define	DELTA_CACHE_BYTES	64
+
+typedef struct
+{
+	qboolean		force, newentity;
+	entity_state_t	from, to;
+	int				length;
+	byte			data[DELTA_CACHE_BYTES];
+} deltaentry_t;
+
+typedef struct
+{
+	int				hits, misses;
+	byte			next[MAX_EDICTS];		// way to replace next
+	deltaentry_t	entries[MAX_EDICTS][DELTA_CACHE_WAYS];
+} deltacache_t;
+
 // a client can leave the server in one of four ways:
 // dropping properly by quiting or disconnecting
 // timing out if no valid messages are received for timeout.value seconds
@@ -148,6 +230,10 @@ typedef struct client_s
 // out before legitimate users connected
 #define	MAX_CHALLENGES	1024
 
+// clients are hashed by address so packets find them without
+// a scan of every slot
+#define	CLIENT_HASH_SIZE	256
+
 typedef struct
 {
 	netadr_t	adr;
@@ -155,6 +241,31 @@ typedef struct
 	int			time;
 } challenge_t;
 
+// serverrecord messages go through a ring to a writer thread, so a
+// slow disk costs recorded frames instead of server frames
+#define	DEMO_KEYFRAME	100		// server frames between full frames with sv_demodelta
+
+typedef struct
+{
+	void		*thread;					// NULL writes straight to the file
+	void		*lock;
+	void		*wake;
+	byte		*ring;
+	unsigned	size;						// a power of two
+	unsigned	head, tail;					// bytes queued and written, they only grow
+	qboolean	shutdown;
+	qboolean	failed;						// a write came up short
+	int			frames, dropped;
+
+	// delta compression against the last frame that made it in
+	qboolean	delta;
+	int			lastframe;					// -1 when the next has to be full
+	int			keyframe;
+	int			numstates;
+	entity_state_t	*states;				// [MAX_EDICTS]
+	entity_state_t	*newstates;				// [MAX_EDICTS]
+} demowriter_t;
+
 
 typedef struct
 {
@@ -166,19 +277,26 @@ typedef struct
 	int			spawncount;					// incremented each server start
 											// used to check late spawns
 
+	int			framediv;					// game frames per 100 msec, from sv_fps
+
 	client_t	*clients;					// [maxclients->value];
-	int			num_client_entities;		// maxclients->value*UPDATE_BACKUP*MAX_PACKET_ENTITIES
+	int			num_client_entities;		// maxclients->value*UPDATE_WINDOW*framediv*MAX_PACKET_ENTITIES
 	int			next_client_entities;		// next client_entity to use
 	entity_state_t	*client_entities;		// [num_client_entities]
+	antilag_t	*antilag;					// [ANTILAG_FRAMES][maxclients->value]
 
 	int			last_heartbeat;
 
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 
+	client_t	*adrhash[CLIENT_HASH_SIZE];	// by base address and qport
+	client_t	*iphash[CLIENT_HASH_SIZE];	// by base address
+
 	// serverrecord values
 	FILE		*demofile;
 	sizebuf_t	demo_multicast;
 	byte		demo_multicast_buf[MAX_MSGLEN];
+	demowriter_t	demowriter;
 } server_static_t;
 
 //=============================================================================
@@ -205,6 +323,23 @@ extern	cvar_t		*sv_allow_download_maps_in_paks; /* FS: Allow bsp downloads from
 extern	cvar_t		*sv_filter_wallfly_rcon_request;
 extern	cvar_t		*sv_filter_wallfly_ip;
 
+extern	cvar_t		*sv_threads;			// worker threads for building client frames
+extern	cvar_t		*sv_deltacache;
+extern	cvar_t		*sv_ratecull;
+extern	cvar_t		*sv_compress;
+extern	cvar_t		*sv_download_window;
+extern	cvar_t		*sv_oob_limit;
+extern	cvar_t		*sv_preload;
+extern	cvar_t		*sv_demobuffer;
+extern	cvar_t		*sv_demodelta;
+extern	cvar_t		*sv_relay_password;
+extern	cvar_t		*sv_maxrelays;
+extern	cvar_t		*sv_fps;
+extern	cvar_t		*sv_antilag;
+extern	cvar_t		*sv_projectiles;
+extern	cvar_t		*sv_areatree;
+extern	cvar_t		*sv_profile;
+
 extern	client_t	*sv_client;
 extern	edict_t		*sv_player;
 
@@ -228,6 +363,14 @@ void SV_WriteClientdataToMessage (client_t *client, sizebuf_t *msg);
 void SV_ExecuteUserCommand (char *s);
 void SV_InitOperatorCommands (void);
 
+unsigned SV_AdrHash (netadr_t *adr);
+void SV_LinkClientAdr (client_t *cl);
+void SV_UnlinkClientAdr (client_t *cl);
+client_t *SV_FindClient (netadr_t *adr, int qport);
+
+void SV_InvalidateStatus (void);
+void SV_OOBStats_f (void);
+
 void SV_SendServerinfo (client_t *client);
 void SV_UserinfoChanged (client_t *cl);
 
@@ -235,12 +378,24 @@ void SV_UserinfoChanged (client_t *cl);
 void Master_Heartbeat (void);
 void Master_Packet (void);
 void SV_GetUptime (void); /* FS: Uptime for /info */
+void SV_ProfileReset (void);
+void SV_ProfileSummary (void);
+
+//
+// sv_loadgen.c
+//
+void SV_RunLoadgen (void);
+qboolean SV_LoadgenPacket (netadr_t *from, sizebuf_t *msg);
+void SV_ShutdownLoadgen (void);
+void SV_Loadgen_f (void);
 
 //
 // sv_init.c
 //
 void SV_InitGame (void);
 void SV_Map (qboolean attractloop, char *levelstring, qboolean loadgame);
+void SV_InvalidateIndexes (int index);
+void SV_IndexBench_f (void);
 
 
 //
@@ -257,11 +412,18 @@ typedef enum {RD_NONE, RD_CLIENT, RD_PACKET} redirect_t;
 extern	char	sv_outputbuf[SV_OUTPUTBUF_LENGTH];
 
 void SV_FlushRedirect (int sv_redirected, char *outputbuf);
+void SV_Profile_f (void);
 
 void SV_DemoCompleted (void);
 void SV_SendClientMessages (void);
+void SV_ShutdownWorkers (void);
+int SV_DatagramLimit (client_t *client);
+int SV_FrameBudget (client_t *client);
+deltacache_t *SV_DeltaCache (int worker);
+void SV_SendBench_f (void);
 
 void SV_Multicast (vec3_t origin, multicast_t to);
+void SV_WriteRelayMulticast (sizebuf_t *buf, vec3_t origin, multicast_t to);
 void SV_StartSound (vec3_t origin, edict_t *entity, int channel,
 					int soundindex, float volume,
 					float attenuation, float timeofs);
@@ -274,6 +436,8 @@ void SV_BroadcastCommand (const char *fmt, ...) __attribute__((__format__(__prin
 //
 void SV_Nextserver (void);
 void SV_ExecuteClientMessage (client_t *cl);
+void SV_WriteDownloadWindow (client_t *cl, sizebuf_t *msg);
+void SV_CloseDownload (client_t *cl);
 
 //
 // sv_ccmds.c
@@ -284,9 +448,18 @@ void SV_Status_f (void);
 //
 // sv_ents.c
 //
-void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg);
+int SV_ClientFramenum (client_t *client);
+qboolean SV_ClientFrameDue (client_t *client);
+void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg, deltacache_t *cache);
 void SV_RecordDemoMessage (void);
+qboolean SV_OpenDemo (char *name);
+qboolean SV_WriteDemoMessage (byte *data, int length);
+void SV_CloseDemo (void);
 void SV_BuildClientFrame (client_t *client);
+const byte *SV_FatPVS (client_t *client, vec3_t org, byte *scratch);
+int SV_SelectFrameEntities (client_t *client, byte *pvsrow, byte *phsrow, short *list);
+void SV_BuildEntityIndex (void);
+void SV_StoreFrameEntities (client_t *client, short *list, int count);
 
 //
 // sv_game.c
@@ -296,6 +469,20 @@ extern	game_export_t	*ge;
 void SV_InitGameProgs (void);
 void SV_ShutdownGameProgs (void);
 void SV_InitEdict (edict_t *e);
+void PF_Configstring (int index, char *val);
+
+// From Q2Pro
+// Some mods actually exploit CS_STATUSBAR to take space up to CS_AIRACCEL
+#define CS_SIZE(cs) ((cs) >= CS_STATUSBAR && (cs) < CS_AIRACCEL ? MAX_QPATH * (CS_AIRACCEL - (cs)) : MAX_QPATH)
+
+//
+// sv_relay.c
+//
+qboolean SV_RelayActive (void);
+game_export_t *SV_GetRelayAPI (void);
+void SV_RunRelay (void);
+qboolean SV_RelayPacket (void);
+void SV_Relay_f (void);
 
 
 
@@ -327,6 +514,18 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int a
 // returns the number of pointers filled in
 // ??? does this always return the world?
 
+typedef struct
+{
+	int		queries;
+	int		candidates;		// edicts looked at
+	int		returned;
+} areastats_t;
+
+extern	areastats_t	sv_areastats;
+
+void SV_AreaStats_f (void);
+void SV_AreaBench_f (void);
+
 //===================================================================
 
 //
@@ -348,3 +547,15 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+trace_t SV_UnlaggedTrace (edict_t *shooter, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask);
+// SV_Trace with the clients back where they were in the last frame
+// the shooter had, at most sv_antilag msec ago
+
+void SV_TraceBatch (edict_t *shooter, int count, vec3_t *starts, vec3_t *ends, vec3_t mins, vec3_t maxs, edict_t *passedict, int contentmask, trace_t *traces);
+// SV_UnlaggedTrace for each start/end pair, sharing the rest
+
+void SV_TraceBench_f (void);
+
+void SV_RecordAntilag (void);
+// stores the client boxes of the frame just run
+
@@ -329,6 +329,7 @@ void SV_ReadLevelFile (void)
 		return;
 	}
 	FS_Read (sv.configstrings, sizeof(sv.configstrings), f);
+	SV_InvalidateIndexes (-1);
 	CM_ReadPortalState (f);
 	fclose (f);
 
@@ -1022,7 +1023,6 @@ void SV_ServerRecord_f (void)
 	char	name[MAX_OSPATH];
 	byte buf_data[32768];
 	sizebuf_t	buf;
-	int		len;
 	int		i;
 
 	if (Cmd_Argc() != 2)
@@ -1056,9 +1056,7 @@ void SV_ServerRecord_f (void)
 	Com_sprintf (name, sizeof(name), "%s/demos/%s.dm2", FS_Gamedir(), Cmd_Argv(1));
 
 	Com_Printf ("recording to %s.\n", name);
-	FS_CreatePath (name);
-	svs.demofile = fopen (name, "wb");
-	if (!svs.demofile)
+	if (!SV_OpenDemo (name))
 	{
 		Com_Printf ("ERROR: couldn't open.\n");
 		return;
@@ -1080,8 +1078,8 @@ void SV_ServerRecord_f (void)
 	MSG_WriteByte (&buf, svc_serverdata);
 	MSG_WriteLong (&buf, PROTOCOL_VERSION);
 	MSG_WriteLong (&buf, svs.spawncount);
-	// 2 means server demo
-	MSG_WriteByte (&buf, 2);	// demos are always attract loops
+	// 2 means server demo, 3 one with sv_demodelta frames
+	MSG_WriteByte (&buf, svs.demowriter.delta ? 3 : 2);	// demos are always attract loops
 	MSG_WriteString(&buf, (char *)Cvar_VariableString("gamedir"));
 	MSG_WriteShort (&buf, -1);
 	// send full levelname
@@ -1098,8 +1096,7 @@ void SV_ServerRecord_f (void)
 			if (buf.cursize + 67 >= buf.maxsize)
 			{
 				Com_Printf("not enough buffer space available.\n");
-				fclose(svs.demofile);
-				svs.demofile = NULL;
+				SV_CloseDemo ();
 				return;
 			}
 		}
@@ -1107,9 +1104,7 @@ void SV_ServerRecord_f (void)
 
 	// write it to the demo file
 	Com_DPrintf(DEVELOPER_MSG_NET, "signon message length: %i\n", buf.cursize);
-	len = LittleLong (buf.cursize);
-	fwrite (&len, 4, 1, svs.demofile);
-	fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	SV_WriteDemoMessage (buf.data, buf.cursize);
 
 	// the rest of the demo file will be individual frames
 }
@@ -1129,9 +1124,11 @@ void SV_ServerStop_f (void)
 		Com_Printf ("Not doing a serverrecord.\n");
 		return;
 	}
-	fclose (svs.demofile);
-	svs.demofile = NULL;
-	Com_Printf ("Recording completed.\n");
+	SV_CloseDemo ();
+	Com_Printf ("Recording completed, %i frames", svs.demowriter.frames - 1);
+	if (svs.demowriter.dropped)
+		Com_Printf (", %i dropped because the disk fell behind", svs.demowriter.dropped);
+	Com_Printf (".\n");
 }
 
 
@@ -1248,5 +1245,14 @@ void SV_InitOperatorCommands (void)
 
 	Cmd_AddCommand ("sv", SV_ServerCommand_f);
 	Cmd_AddCommand ("sv_dumpentities", SV_DumpEntities_f); /* FS */
+	Cmd_AddCommand ("sv_sendbench", SV_SendBench_f);
+	Cmd_AddCommand ("sv_indexbench", SV_IndexBench_f);
+	Cmd_AddCommand ("sv_tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("sv_areastats", SV_AreaStats_f);
+	Cmd_AddCommand ("sv_areabench", SV_AreaBench_f);
+	Cmd_AddCommand ("sv_profilereport", SV_Profile_f);
+	Cmd_AddCommand ("sv_oobstats", SV_OOBStats_f);
+	Cmd_AddCommand ("sv_loadgen", SV_Loadgen_f);
+	Cmd_AddCommand ("relay", SV_Relay_f);
 }
 
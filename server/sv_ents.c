@@ -28,25 +28,222 @@ Encode a client frame onto the network channel
 =============================================================================
 */
 
-byte		fatpvs[65536/8];	// 32767 is MAX_MAP_LEAFS
+/*
+=============
+SV_WriteDeltaEntity
+
+MSG_WriteDeltaEntity, reusing the bytes if another client already
+needed the same delta.  cache may be NULL.
+=============
+*/
+void SV_WriteDeltaEntity (deltacache_t *cache, entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+{
+	int				i, start;
+	deltaentry_t	*entry;
+
+	if (!cache || to->number <= 0 || to->number >= MAX_EDICTS)
+	{
+		MSG_WriteDeltaEntity (from, to, msg, force, newentity);
+		return;
+	}
+
+	entry = cache->entries[to->number];
+	for (i=0 ; i<DELTA_CACHE_WAYS ; i++, entry++)
+	{
+		if (entry->force != force || entry->newentity != newentity)
+			continue;
+		if (memcmp (&entry->to, to, sizeof(*to)) || memcmp (&entry->from, from, sizeof(*from)))
+			continue;
+
+		cache->hits++;
+		if (entry->length)
+			SZ_Write (msg, entry->data, entry->length);
+		return;
+	}
+
+	cache->misses++;
+	start = msg->cursize;
+	MSG_WriteDeltaEntity (from, to, msg, force, newentity);
+	if (msg->overflowed || msg->cursize - start > DELTA_CACHE_BYTES)
+		return;
+
+	i = cache->next[to->number];
+	cache->next[to->number] = (i+1) % DELTA_CACHE_WAYS;
+
+	entry = &cache->entries[to->number][i];
+	entry->force = force;
+	entry->newentity = newentity;
+	entry->from = *from;
+	entry->to = *to;
+	entry->length = msg->cursize - start;
+	memcpy (entry->data, msg->data + start, entry->length);
+}
+
+// one entry per entity number that shows up in either frame
+typedef struct
+{
+	short	number;
+	short	newindex;		// in the to frame, -1 if it's being removed
+	short	oldindex;		// in the from frame, -1 if it's new
+	short	length;			// bytes it took in the message
+	int		offset;
+} entityop_t;
+
+typedef struct
+{
+	int		score;
+	int		op;
+} entityrank_t;
+
+#define	PROJECTILE_EFFECTS	(EF_BLASTER|EF_ROCKET|EF_GRENADE|EF_HYPERBLASTER|EF_BFG| \
+							 EF_IONRIPPER|EF_BLUEHYPERBLASTER|EF_PLASMA|EF_TRACKER)
 
+int SV_RankCompare (const void *a, const void *b)
+{
+	return ((const entityrank_t *)b)->score - ((const entityrank_t *)a)->score;
+}
+
+/*
+=============
+SV_CompactProjectile
+
+True if everything the client needs of the state fits in
+svc_projectiles: its origin, angles, model, effects and sound.
+The solid bits are dropped, nothing predicts against projectiles.
+=============
+*/
+qboolean SV_CompactProjectile (entity_state_t *state)
+{
+	return (state->effects & PROJECTILE_EFFECTS)
+		&& !state->modelindex2 && !state->modelindex3 && !state->modelindex4
+		&& !state->frame && !state->skinnum && !state->renderfx && !state->event;
+}
+
+/*
+=============
+SV_CullPacketEntities
+
+The packetentities written for the frame don't fit in the client's
+budget.  Keeps the most important updates and holds the rest back:
+removals and the client's own entity always go, then players,
+projectiles and events, nearer entities before farther ones, and
+anything that has already waited moves up the list.
+
+The to frame is rewritten to what the client will actually have,
+the old state for a held back update and nothing for a held back
+new entity, so the next delta picks up whatever was missed.
+=============
+*/
+void SV_CullPacketEntities (client_t *client, client_frame_t *from, client_frame_t *to,
+	sizebuf_t *msg, entityop_t *ops, int numops, int start, int budget)
+{
+	entityrank_t	ranks[MAX_EDICTS];
+	byte			keep[MAX_EDICTS];
+	entity_state_t	*state, *oldstate;
+	entityop_t		*op;
+	vec3_t			org, delta;
+	int				i, n, own, used, write, w;
+
+	for (i=0 ; i<3 ; i++)
+		org[i] = to->ps.pmove.origin[i]*0.125 + to->ps.viewoffset[i];
+
+	own = -1;
+	if (client >= svs.clients && client < svs.clients + maxclients->intValue)
+		own = client - svs.clients + 1;
+
+	used = start + 2;	// and the end of packetentities
+	n = 0;
+	for (i=0, op=ops ; i<numops ; i++, op++)
+	{
+		keep[i] = true;
+		if (!op->length || op->newindex < 0 || op->number == own)
+		{	// unchanged, removed or the client itself
+			used += op->length;
+			continue;
+		}
+
+		state = &svs.client_entities[(to->first_entity + op->newindex) % svs.num_client_entities];
+		VectorSubtract (org, state->origin, delta);
+
+		ranks[n].op = i;
+		ranks[n].score = -(int)VectorLength (delta);
+		if (op->number <= maxclients->intValue)
+			ranks[n].score += 8192;
+		if (state->effects & PROJECTILE_EFFECTS)
+			ranks[n].score += 4096;
+		if (state->event)
+			ranks[n].score += 4096;
+		ranks[n].score += client->deferred[op->number] * 256;
+		n++;
+	}
+
+	qsort (ranks, n, sizeof(ranks[0]), SV_RankCompare);
+	for (i=0 ; i<n ; i++)
+	{
+		op = &ops[ranks[i].op];
+		if (used + op->length <= budget)
+			used += op->length;
+		else
+			keep[ranks[i].op] = false;
+	}
+
+	// squeeze out the bytes of the held back updates,
+	// and make the to frame match what is left
+	write = start;
+	w = 0;
+	for (i=0, op=ops ; i<numops ; i++, op++)
+	{
+		if (keep[i])
+		{
+			memmove (msg->data + write, msg->data + op->offset, op->length);
+			write += op->length;
+			client->deferred[op->number] = 0;
+		}
+		else if (client->deferred[op->number] < 255)
+			client->deferred[op->number]++;
+
+		if (op->newindex < 0)
+			continue;	// removed
+
+		state = &svs.client_entities[(to->first_entity + w) % svs.num_client_entities];
+		if (keep[i])
+			*state = svs.client_entities[(to->first_entity + op->newindex) % svs.num_client_entities];
+		else if (op->oldindex >= 0)
+		{
+			oldstate = &svs.client_entities[(from->first_entity + op->oldindex) % svs.num_client_entities];
+			*state = *oldstate;
+		}
+		else
+			continue;	// new, the client doesn't get it yet
+		w++;
+	}
+
+	to->num_entities = w;
+	msg->cursize = write;
+}
 
 /*
 =============
 SV_EmitPacketEntities
 
 Writes a delta update of an entity_state_t list to the message.
+If it comes to more than budget bytes, SV_CullPacketEntities
+trims it.  A budget of -1 means no limit.
 =============
 */
-void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+void SV_EmitPacketEntities (client_t *client, client_frame_t *from, client_frame_t *to, sizebuf_t *msg, deltacache_t *cache, int budget)
 {
 	entity_state_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
 	int		from_num_entities;
 	int		bits;
+	entityop_t	ops[MAX_EDICTS];
+	entityop_t	*op;
+	int		numops, start;
 
 		MSG_WriteByte (msg, svc_packetentities);
+	start = msg->cursize;
 
 	if (!from)
 	{
@@ -61,6 +258,7 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 	oldindex = 0;
 	newent = NULL;
 	oldent = NULL;
+	numops = 0;
 	while (newindex < to->num_entities || oldindex < from_num_entities)
 	{
 		if (msg->cursize > MAX_MSGLEN - 150)
@@ -89,14 +287,21 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 			oldnum = oldent->number;
 		}
 
+		op = &ops[numops++];
+		op->offset = msg->cursize;
+
 		if (newnum == oldnum)
 		{	// delta update from old position
 			// because the force parm is false, this will not result
 			// in any bytes being emited if the entity has not changed at all
 			// note that players are always 'newentities', this updates their oldorigin always
 			// and prevents warping
-			MSG_WriteDeltaEntity(oldent, newent, msg,
+			SV_WriteDeltaEntity (cache, oldent, newent, msg,
 					false, newent->number <= maxclients->value);
+			op->number = newnum;
+			op->newindex = newindex;
+			op->oldindex = oldindex;
+			op->length = msg->cursize - op->offset;
 			oldindex++;
 			newindex++;
 			continue;
@@ -104,7 +309,11 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 
 		if (newnum < oldnum)
 		{	// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (&sv.baselines[newnum], newent, msg, true, true);
+			SV_WriteDeltaEntity (cache, &sv.baselines[newnum], newent, msg, true, true);
+			op->number = newnum;
+			op->newindex = newindex;
+			op->oldindex = -1;
+			op->length = msg->cursize - op->offset;
 			newindex++;
 			continue;
 		}
@@ -132,15 +341,188 @@ void SV_EmitPacketEntities (client_frame_t *from, client_frame_t *to, sizebuf_t
 				MSG_WriteByte (msg, oldnum);
 			}
 
+			op->number = oldnum;
+			op->newindex = -1;
+			op->oldindex = oldindex;
+			op->length = msg->cursize - op->offset;
 			oldindex++;
 			continue;
 		}
 	}
 
+	if (budget >= 0 && !msg->overflowed && msg->cursize + 2 > budget)
+	{
+		SV_CullPacketEntities (client, from, to, msg, ops, numops, start, budget);
+		client->culled = true;
+	}
+	else if (client->culled)
+	{	// everything went out
+		memset (client->deferred, 0, sizeof(client->deferred));
+		client->culled = false;
+	}
+
 	MSG_WriteShort (msg, 0);	// end of packetentities
 
 }
 
+/*
+=============
+SV_EmitProjectiles
+
+Writes the to frame's projectiles as an svc_projectiles, delta'd from
+the from frame's.  A projectile that keeps flying costs a number, a
+bits byte and three bytes of movement, where its entity delta would
+have been about twice that, and one that is gone costs nothing.
+
+Origins sent as movement are stored the way the client rebuilds them,
+so the rounding never adds up.  With sv_profile on, the bytes saved
+against the entity deltas are added up in client->projsaved.
+=============
+*/
+void SV_EmitProjectiles (client_t *client, client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+{
+	static entity_state_t	nullstate;
+	entity_state_t	*oldent, *newent, *base;
+	int				oldindex, newindex, from_num;
+	int				i, bits, countofs, count, start, move[3];
+	byte			scratch_buf[128];	// more than any one entity delta
+	sizebuf_t		scratch;
+	qboolean		measure;
+
+	measure = (sv_profile->intValue != 0);
+	SZ_Init (&scratch, scratch_buf, sizeof(scratch_buf));
+	scratch.allowoverflow = true;
+
+	from_num = from ? from->num_projectiles : 0;
+	start = msg->cursize;
+
+	MSG_WriteByte (msg, svc_projectiles);
+	countofs = msg->cursize;
+	MSG_WriteByte (msg, 0);		// filled in below
+
+	oldindex = 0;
+	count = 0;
+	for (newindex=0 ; newindex<to->num_projectiles ; newindex++)
+	{
+		if (msg->cursize > msg->maxsize - 32)
+			break;
+
+		newent = &svs.client_entities[(to->first_projectile + newindex) % svs.num_client_entities];
+
+		// projectiles that are gone just aren't mentioned
+		oldent = &nullstate;
+		while (oldindex < from_num)
+		{
+			base = &svs.client_entities[(from->first_projectile + oldindex) % svs.num_client_entities];
+			if (base->number > newent->number)
+				break;
+			oldindex++;
+			if (base->number == newent->number)
+			{
+				oldent = base;
+				break;
+			}
+			if (measure)
+				client->projsaved += base->number >= 256 ? 4 : 2;	// the U_REMOVE
+		}
+
+		if (measure)
+		{
+			SZ_Clear (&scratch);
+			if (oldent == &nullstate)
+				MSG_WriteDeltaEntity (&sv.baselines[newent->number], newent, &scratch, true, true);
+			else
+				MSG_WriteDeltaEntity (oldent, newent, &scratch, false, newent->number <= maxclients->intValue);
+			client->projsaved += scratch.cursize;
+			client->projsaved += msg->cursize;
+		}
+
+		bits = 0;
+		if (oldent == &nullstate)
+			bits |= PR_ORIGIN;
+		else if (!VectorCompare (newent->origin, oldent->origin))
+		{
+			for (i=0 ; i<3 ; i++)
+			{
+				move[i] = (int)floor (newent->origin[i] - oldent->origin[i] + 0.5f);
+				if (move[i] < -128 || move[i] > 127)
+					bits |= PR_ORIGIN;
+				else if (move[i])
+					bits |= PR_MOVE;
+			}
+			if (bits & PR_ORIGIN)
+				bits &= ~PR_MOVE;
+			else if (!bits)		// less than the rounding, the client stays put
+				VectorCopy (oldent->origin, newent->origin);
+		}
+		if (oldent == &nullstate && !VectorCompare (newent->old_origin, newent->origin))
+			bits |= PR_OLDORIGIN;
+		if (!VectorCompare (newent->angles, oldent->angles))
+			bits |= PR_ANGLES;
+		if (newent->modelindex != oldent->modelindex)
+			bits |= PR_MODEL;
+		if (newent->effects != oldent->effects)
+			bits |= PR_EFFECTS;
+		if (newent->sound != oldent->sound)
+			bits |= PR_SOUND;
+
+		if (newent->number < 128)
+			MSG_WriteByte (msg, newent->number);
+		else
+		{
+			MSG_WriteByte (msg, (newent->number & 127) | 128);
+			MSG_WriteByte (msg, newent->number >> 7);
+		}
+		MSG_WriteByte (msg, bits);
+
+		if (bits & PR_ORIGIN)
+		{
+			MSG_WritePos (msg, newent->origin);
+			for (i=0 ; i<3 ; i++)
+				newent->origin[i] = (int)(newent->origin[i]*8) * 0.125f;
+		}
+		else if (bits & PR_MOVE)
+		{
+			for (i=0 ; i<3 ; i++)
+			{
+				MSG_WriteChar (msg, move[i]);
+				newent->origin[i] = oldent->origin[i] + move[i];
+			}
+		}
+		if (bits & PR_OLDORIGIN)
+			MSG_WritePos (msg, newent->old_origin);
+		if (bits & PR_ANGLES)
+		{
+			for (i=0 ; i<3 ; i++)
+				MSG_WriteAngle (msg, newent->angles[i]);
+		}
+		if (bits & PR_MODEL)
+			MSG_WriteByte (msg, newent->modelindex);
+		if (bits & PR_EFFECTS)
+			MSG_WriteLong (msg, newent->effects);
+		if (bits & PR_SOUND)
+			MSG_WriteByte (msg, newent->sound);
+
+		if (measure)
+			client->projsaved -= msg->cursize;
+		count++;
+	}
+
+	if (measure)
+	{
+		for ( ; oldindex < from_num ; oldindex++)
+		{
+			base = &svs.client_entities[(from->first_projectile + oldindex) % svs.num_client_entities];
+			client->projsaved += base->number >= 256 ? 4 : 2;
+		}
+		client->projsaved -= countofs + 1 - start;
+	}
+
+	// whatever didn't fit isn't in the frame the client will have
+	to->num_projectiles = count;
+	msg->data[countofs] = count;
+}
+
 
 
 /*
@@ -383,27 +765,58 @@ void SV_WritePlayerstateToClient (client_frame_t *from, client_frame_t *to, size
 }
 	}
 }
+/*
+==================
+SV_ClientFramenum
+
+The number the client knows the frame being built by.  A client
+that can't take more than 10 frames a second only gets every
+sv.framediv'th one, numbered as if the server ran at 10 Hz.
+==================
+*/
+int SV_ClientFramenum (client_t *client)
+{
+	if (client->tickrate)
+		return sv.framenum;
+	return sv.framenum / sv.framediv;
+}
+
+/*
+==================
+SV_ClientFrameDue
+
+True if the client is sent a frame this server frame
+==================
+*/
+qboolean SV_ClientFrameDue (client_t *client)
+{
+	return client->tickrate || !(sv.framenum % sv.framediv);
+}
+
 /*
 ==================
 SV_WriteFrameToClient
 ==================
 */
-void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
+void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg, deltacache_t *cache)
 {
 	client_frame_t		*frame, *oldframe;
-	int					lastframe;
+	int					framenum, lastframe, budget;
+	byte				projbuf[MAX_MSGLEN_FRAG];
+	sizebuf_t			proj;
 
 //Com_Printf ("%i -> %i\n", client->lastframe, sv.framenum);
 	// this is the frame we are creating
-	frame = &client->frames[sv.framenum & UPDATE_MASK];
+	framenum = SV_ClientFramenum (client);
+	frame = &client->frames[framenum & UPDATE_MASK];
 
 	if (client->lastframe <= 0)
 	{	// client is asking for a retransmit
 		oldframe = NULL;
 		lastframe = -1;
 	}
-	else if (sv.framenum - client->lastframe >= (UPDATE_BACKUP - 3) )
-	{	// client hasn't gotten a good message through in a long time
+	else if (framenum - client->lastframe >= (UPDATE_WINDOW - 3) * (client->tickrate ? sv.framediv : 1))
+	{	// client hasn't gotten a good message through in 1.3 seconds
 //		Com_Printf ("%s: Delta request from out-of-date packet.\n", client->name);
 		oldframe = NULL;
 		lastframe = -1;
@@ -415,7 +828,7 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 	}
 
 	MSG_WriteByte (msg, svc_frame);
-	MSG_WriteLong (msg, sv.framenum);
+	MSG_WriteLong (msg, framenum);
 	MSG_WriteLong (msg, lastframe);	// what we are delta'ing from
 	MSG_WriteByte (msg, client->surpressCount);	// rate dropped packets
 	client->surpressCount = 0;
@@ -427,8 +840,21 @@ void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg)
 	// delta encode the playerstate
 	SV_WritePlayerstateToClient (oldframe, frame, msg);
 
-	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	// the projectiles come out of the same budget as the entities
+	budget = SV_FrameBudget (client);
+	SZ_Init (&proj, projbuf, sizeof(projbuf));
+	if (frame->num_projectiles)
+	{
+		SV_EmitProjectiles (client, oldframe, frame, &proj);
+		if (budget >= 0)
+			budget = max (budget - proj.cursize, 0);
+	}
+
+	// delta encode the entities, fitting them in what the client can take
+	SV_EmitPacketEntities (client, oldframe, frame, msg, cache, budget);
+
+	if (proj.cursize)
+		SZ_Write (msg, proj.data, proj.cursize);
 }
 
 
@@ -445,15 +871,23 @@ Build a client frame structure
 SV_FatPVS
 
 The client will interpolate the view position,
-so we can't use a single PVS point
+so we can't use a single PVS point.
+
+The row is kept in the client and only rebuilt when the clusters
+around org change, scratch is used for rows that have to be
+decompressed.  Only touches the client's own row, so clients
+can be done on different threads, and clients that aren't in
+svs.clients, like sv_sendbench's, work the same.
 ===========
 */
-void SV_FatPVS (vec3_t org)
+const byte *SV_FatPVS (client_t *client, vec3_t org, byte *scratch)
 {
 	int		leafs[64];
-	int		i, j, count;
+	int		clusters[64];
+	int		i, j, c, count, numclusters;
 	int		longs;
-	byte	*src;
+	const byte	*src;
+	byte	*pvs;
 	vec3_t	mins, maxs;
 
 	for (i=0 ; i<3 ; i++)
@@ -467,68 +901,98 @@ void SV_FatPVS (vec3_t org)
 	{
 		Com_Error (ERR_FATAL, "SV_FatPVS: count < 1");
 	}
-	longs = (CM_NumClusters()+31)>>5;
 
-	// convert leafs to clusters
+	// convert leafs to clusters, sorted without duplicates
+	numclusters = 0;
 	for (i=0 ; i<count ; i++)
 	{
-		leafs[i] = CM_LeafCluster(leafs[i]);
-	}
-
-	memcpy (fatpvs, CM_ClusterPVS(leafs[0]), longs<<2);
-	// or in all the other leaf bits
-	for (i=1 ; i<count ; i++)
-	{
-		for (j=0 ; j<i ; j++)
-		{
-			if (leafs[i] == leafs[j])
-			{
-				break;
-			}
-		}
-		if (j != i)
+		c = CM_LeafCluster(leafs[i]);
+		for (j=numclusters ; j>0 && clusters[j-1] > c ; j--)
+			;
+		if (j > 0 && clusters[j-1] == c)
 		{
 			continue;		// already have the cluster we want
 		}
-		src = CM_ClusterPVS(leafs[i]);
+		memmove (clusters+j+1, clusters+j, (numclusters-j)*sizeof(int));
+		clusters[j] = c;
+		numclusters++;
+	}
+
+	pvs = client->fatpvs;
+	if (client->fatspawncount == svs.spawncount && client->numfatclusters == numclusters
+		&& !memcmp (client->fatclusters, clusters, numclusters*sizeof(int)))
+	{
+		return pvs;
+	}
+
+	longs = (CM_NumClusters()+31)>>5;
+	src = CM_SharedClusterPVS (clusters[0], scratch);
+	memcpy (pvs, src, longs*4);
+	// or in all the other cluster bits
+	for (i=1 ; i<numclusters ; i++)
+	{
+		src = CM_SharedClusterPVS (clusters[i], scratch);
 		for (j=0 ; j<longs ; j++)
 		{
-			((long *)fatpvs)[j] |= ((long *)src)[j];
+			((int *)pvs)[j] |= ((const int *)src)[j];
 		}
 	}
+
+	memcpy (client->fatclusters, clusters, numclusters*sizeof(int));
+	client->numfatclusters = numclusters;
+	client->fatspawncount = svs.spawncount;
+	return pvs;
 }
 
+typedef struct
+{
+	int		numclusters, maxclusters;
+	int		*firstent;		// [numclusters+1] offsets into ents
+	short	ents[MAX_EDICTS*MAX_ENT_CLUSTERS];
+	short	loose[MAX_EDICTS];	// beams and headnode entities
+	int		numloose;
+	byte	sendable[MAX_EDICTS/8];
+} entindex_t;
+
+entindex_t	sv_entindex;
+
 /*
 =============
-SV_BuildClientFrame
+SV_SelectFrameEntities
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+copies off the playerstate and areabits.  The chosen edict numbers
+go into list, the return value is how many there are.
+
+Candidates come from sv_entindex, so SV_BuildEntityIndex must have
+been run this frame.
+
+Only reads shared state and the client's own fat PVS, so given
+private scratch rows this can be run for several clients at once by
+the worker threads.
+
+Relays are given every sendable entity.
 =============
 */
-void SV_BuildClientFrame (client_t *client)
+int SV_SelectFrameEntities (client_t *client, byte *pvsrow, byte *phsrow, short *list)
 {
+	const byte	*pvs, *phs;
 	int		e, i;
 	vec3_t	org;
 	edict_t	*ent;
 	edict_t	*clent;
 	client_frame_t	*frame;
-	entity_state_t	*state;
 	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	int		c_fullsend;
-	byte	*clientphs;
-	byte	*bitvector;
+	int		count;
+	int		k, rowbytes;
+	byte	visible[MAX_EDICTS/8];
 
 	clent = client->edict;
-	if (!clent->client)
-	{
-		return;		// not in game yet
-	}
 
 	// this is the frame we are creating
-	frame = &client->frames[sv.framenum & UPDATE_MASK];
+	frame = &client->frames[SV_ClientFramenum (client) & UPDATE_MASK];
 
 	frame->senttime = svs.realtime; // save it for ping calc later
 
@@ -549,33 +1013,88 @@ void SV_BuildClientFrame (client_t *client)
 	// grab the current player_state_t
 	frame->ps = clent->client->ps;
 
-	SV_FatPVS (org);
-	clientphs = CM_ClusterPHS (clientcluster);
+	// a relay culls for its own spectators, it gets everything there is
+	if (client->relay)
+	{
+		count = 0;
+		for (e=1 ; e<ge->num_edicts ; e++)
+		{
+			if (sv_entindex.sendable[e >> 3] & (1 << (e&7)))
+				list[count++] = e;
+		}
+		return count;
+	}
 
-	// build up the list of visible entities
-	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
+	pvs = SV_FatPVS (client, org, pvsrow);
+	phs = CM_SharedClusterPHS (clientcluster, phsrow);
 
-	c_fullsend = 0;
+	// entities touching a cluster in the fat PVS
+	memset (visible, 0, sizeof(visible));
+	rowbytes = (sv_entindex.numclusters+7)>>3;
+	for (i=0 ; i<rowbytes ; i++)
+	{
+		if (!pvs[i])
+			continue;
+		for (l=i<<3 ; l<(i<<3)+8 && l<sv_entindex.numclusters ; l++)
+		{
+			if (!(pvs[l >> 3] & (1 << (l&7) )))
+				continue;
+			for (k=sv_entindex.firstent[l] ; k<sv_entindex.firstent[l+1] ; k++)
+			{
+				e = sv_entindex.ents[k];
+				visible[e >> 3] |= 1 << (e&7);
+			}
+		}
+	}
 
-	for (e=1 ; e<ge->num_edicts ; e++)
+	// beams and big entities are tested one by one
+	for (k=0 ; k<sv_entindex.numloose ; k++)
 	{
+		e = sv_entindex.loose[k];
 		ent = EDICT_NUM(e);
 
-		// ignore ents without visible models
-		if (ent->svflags & SVF_NOCLIENT)
+		// beams just check one point for PHS
+		if (ent->s.renderfx & RF_BEAM)
 		{
+			l = ent->clusternums[0];
+			if ( !(phs[l >> 3] & (1 << (l&7) )) )
+			{
+				continue;
+			}
+		}
+		else if (!CM_HeadnodeVisible (ent->headnode, pvs))
+		{	// too many leafs for individual check, go by headnode
 			continue;
 		}
 
-		// ignore ents without visible models unless they have an effect
-		if (!ent->s.modelindex && !ent->s.effects && 
-			!ent->s.sound && !ent->s.event)
+		visible[e >> 3] |= 1 << (e&7);
+	}
+
+	// the client always gets itself
+	e = NUM_FOR_EDICT(clent);
+	if (e > 0 && e < ge->num_edicts && EDICT_NUM(e) == clent &&
+		(sv_entindex.sendable[e >> 3] & (1 << (e&7))))
+	{
+		visible[e >> 3] |= 1 << (e&7);
+	}
+
+	// build up the list of visible entities, in edict order
+	count = 0;
+
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		if (!visible[e >> 3])
+		{
+			e |= 7;
+			continue;
+		}
+		if (!(visible[e >> 3] & (1 << (e&7))))
 		{
 			continue;
 		}
 
-		// ignore if not touching a PV leaf
+		ent = EDICT_NUM(e);
+
 		if (ent != clent)
 		{
 			// check area
@@ -589,68 +1108,168 @@ void SV_BuildClientFrame (client_t *client)
 				}
 			}
 
-			// beams just check one point for PHS
-			if (ent->s.renderfx & RF_BEAM)
-			{
-				l = ent->clusternums[0];
-				if ( !(clientphs[l >> 3] & (1 << (l&7) )) )
+			if (!ent->s.modelindex && !(ent->s.renderfx & RF_BEAM))
+			{	// don't send sounds if they will be attenuated away
+				vec3_t	delta;
+				float	len;
+
+				VectorSubtract (org, ent->s.origin, delta);
+				len = VectorLength (delta);
+				if (len > 400)
 				{
 					continue;
 				}
 			}
-			else
-			{
-				bitvector = fatpvs;
-
-				if (ent->num_clusters == -1)
-				{	// too many leafs for individual check, go by headnode
-					if (!CM_HeadnodeVisible (ent->headnode, bitvector))
-					{
-						continue;
-					}
-					c_fullsend++;
-				}
-				else
-				{	// check individual leafs
-					for (i=0 ; i < ent->num_clusters ; i++)
-					{
-						l = ent->clusternums[i];
-						if (bitvector[l >> 3] & (1 << (l&7) ))
-						{
-							break;
-						}
-					}
-					if (i == ent->num_clusters)
-					{
-						continue;		// not visible
-					}
-				}
-
-				if (!ent->s.modelindex)
-				{	// don't send sounds if they will be attenuated away
-					vec3_t	delta;
-					float	len;
-
-					VectorSubtract (org, ent->s.origin, delta);
-					len = VectorLength (delta);
-					if (len > 400)
-					{
-						continue;
-					}
-				}
-			}
 		}
 
-		// add it to the circular client_entities array
-		state = &svs.client_entities[svs.next_client_entities %
-				svs.num_client_entities];
+		list[count++] = e;
+	}
+
+	return count;
+}
+
+/*
+=============
+SV_BuildEntityIndex
+
+Run once a frame before any client frames are built.  Files every
+entity that could be sent under the clusters it touches, so each
+client only looks at the clusters in its PVS instead of testing
+every edict.  Also makes sure those edicts carry their own number,
+so the frame building itself never writes to an edict.
+=============
+*/
+void SV_BuildEntityIndex (void)
+{
+	int		e, i, l;
+	int		numclusters;
+	edict_t	*ent;
+
+	numclusters = CM_NumClusters ();
+	if (numclusters > sv_entindex.maxclusters)
+	{
+		if (sv_entindex.firstent)
+			Z_Free (sv_entindex.firstent);
+		sv_entindex.firstent = Z_Malloc ((numclusters+1) * sizeof(int));
+		sv_entindex.maxclusters = numclusters;
+	}
+	sv_entindex.numclusters = numclusters;
+	sv_entindex.numloose = 0;
+	memset (sv_entindex.firstent, 0, (numclusters+1) * sizeof(int));
+	memset (sv_entindex.sendable, 0, sizeof(sv_entindex.sendable));
+
+	// count the entities in each cluster
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		ent = EDICT_NUM(e);
+
+		// ignore ents without visible models
+		if (ent->svflags & SVF_NOCLIENT)
+			continue;
+
+		// ignore ents without visible models unless they have an effect
+		if (!ent->s.modelindex && !ent->s.effects && 
+			!ent->s.sound && !ent->s.event)
+			continue;
+
 		if (ent->s.number != e)
 		{
 			Com_DPrintf(DEVELOPER_MSG_ENTITY, "FIXING ENT->S.NUMBER!!!\n");
 			ent->s.number = e;
 		}
+
+		sv_entindex.sendable[e >> 3] |= 1 << (e&7);
+
+		if ((ent->s.renderfx & RF_BEAM) || ent->num_clusters == -1)
+		{
+			sv_entindex.loose[sv_entindex.numloose++] = e;
+			continue;
+		}
+
+		for (i=0 ; i<ent->num_clusters ; i++)
+			sv_entindex.firstent[ent->clusternums[i]+1]++;
+	}
+
+	for (l=0 ; l<numclusters ; l++)
+		sv_entindex.firstent[l+1] += sv_entindex.firstent[l];
+
+	// file them, using firstent as the fill pointer
+	for (e=1 ; e<ge->num_edicts ; e++)
+	{
+		if (!(sv_entindex.sendable[e >> 3] & (1 << (e&7))))
+			continue;
+		ent = EDICT_NUM(e);
+		if ((ent->s.renderfx & RF_BEAM) || ent->num_clusters == -1)
+			continue;
+
+		for (i=0 ; i<ent->num_clusters ; i++)
+			sv_entindex.ents[sv_entindex.firstent[ent->clusternums[i]]++] = e;
+	}
+
+	// the fill pointers now hold the end of each cluster, shift back
+	for (l=numclusters ; l>0 ; l--)
+		sv_entindex.firstent[l] = sv_entindex.firstent[l-1];
+	sv_entindex.firstent[0] = 0;
+}
+
+/*
+=============
+SV_StoreFrameEntities
+
+Claims space in the circular client_entities array for the
+frame and copies the selected entity states into it
+=============
+*/
+void SV_StoreFrameEntities (client_t *client, short *list, int count)
+{
+	int		i, numprojectiles;
+	edict_t	*ent;
+	client_frame_t	*frame;
+	entity_state_t	*state;
+	short	projectiles[MAX_FRAME_PROJECTILES];
+
+	frame = &client->frames[SV_ClientFramenum (client) & UPDATE_MASK];
+
+	// pull out what can go in svc_projectiles, keeping the edict order.
+	// svc_projectiles has no event, so an entity the held event below
+	// will be merged into stays in the packetentities
+	numprojectiles = 0;
+	if (client->projectiles)
+	{
+		int		j;
+
+		for (i=j=0 ; i<count ; i++)
+		{
+			if (numprojectiles < MAX_FRAME_PROJECTILES
+				&& (client->tickrate || !sv.events[list[i]])
+				&& SV_CompactProjectile (&EDICT_NUM(list[i])->s))
+				projectiles[numprojectiles++] = list[i];
+			else
+				list[j++] = list[i];
+		}
+		count = j;
+	}
+
+	frame->num_entities = count;
+	frame->first_entity = svs.next_client_entities;
+	frame->num_projectiles = numprojectiles;
+	frame->first_projectile = svs.next_client_entities + count;
+	memcpy (list + count, projectiles, numprojectiles * sizeof(list[0]));
+	count += numprojectiles;
+
+	for (i=0 ; i<count ; i++)
+	{
+		ent = EDICT_NUM(list[i]);
+
+		// add it to the circular client_entities array
+		state = &svs.client_entities[svs.next_client_entities %
+				svs.num_client_entities];
 		*state = ent->s;
 
+		// an event from a frame the client skipped still gets to it
+		if (!state->event && !client->tickrate)
+			state->event = sv.events[list[i]];
+
 		// don't mark players missiles as solid
 		if (ent->owner == client->edict)
 		{
@@ -658,10 +1277,232 @@ void SV_BuildClientFrame (client_t *client)
 		}
 
 		svs.next_client_entities++;
-		frame->num_entities++;
 	}
 }
 
+/*
+=============
+SV_BuildClientFrame
+
+Decides which entities are going to be visible to the client, and
+copies off the playerstat and areabits.
+=============
+*/
+void SV_BuildClientFrame (client_t *client)
+{
+	static byte		pvs[65536/8];	// 32767 is MAX_MAP_LEAFS
+	static byte		phs[MAX_MAP_LEAFS/8];
+	static short	list[MAX_EDICTS];
+	int				count;
+
+	if (!client->edict->client)
+	{
+		return;		// not in game yet
+	}
+
+	count = SV_SelectFrameEntities (client, pvs, phs, list);
+	SV_StoreFrameEntities (client, list, count);
+}
+
+
+/*
+==============================================================================
+
+SERVER DEMO WRITER
+
+==============================================================================
+*/
+
+/*
+==================
+SV_DemoWriterThread
+
+Writes out whatever is in the ring until told to stop, the server
+only waits on the lock to move head or tail
+==================
+*/
+void SV_DemoWriterThread (void *parm)
+{
+	demowriter_t	*dw;
+	unsigned		head, tail, ofs, len;
+	qboolean		shutdown;
+
+	dw = (demowriter_t *)parm;
+	do
+	{
+		Sys_SemaphoreWait (dw->wake);
+
+		Sys_LockMutex (dw->lock);
+		head = dw->head;
+		tail = dw->tail;
+		shutdown = dw->shutdown;
+		Sys_UnlockMutex (dw->lock);
+
+		while (tail != head)
+		{
+			ofs = tail & (dw->size - 1);
+			len = head - tail;
+			if (len > dw->size - ofs)
+				len = dw->size - ofs;
+			if (!dw->failed && fwrite (dw->ring + ofs, 1, len, svs.demofile) != len)
+				dw->failed = true;
+			tail += len;
+
+			Sys_LockMutex (dw->lock);
+			dw->tail = tail;
+			Sys_UnlockMutex (dw->lock);
+		}
+	} while (!shutdown);
+}
+
+/*
+==================
+SV_OpenDemo
+
+Opens the file and starts the writer, sv_demobuffer is read here
+==================
+*/
+qboolean SV_OpenDemo (char *name)
+{
+	demowriter_t	*dw;
+	unsigned		want;
+
+	FS_CreatePath (name);
+	svs.demofile = fopen (name, "wb");
+	if (!svs.demofile)
+		return false;
+
+	dw = &svs.demowriter;
+	memset (dw, 0, sizeof(*dw));
+	dw->delta = (sv_demodelta->intValue != 0);
+	dw->lastframe = -1;
+	dw->states = Z_Malloc (MAX_EDICTS * sizeof(entity_state_t));
+	dw->newstates = Z_Malloc (MAX_EDICTS * sizeof(entity_state_t));
+
+	want = (sv_demobuffer->intValue > 0) ? sv_demobuffer->intValue * 1024 : 0;
+	for (dw->size = 0x10000 ; dw->size < want && dw->size < 0x10000000 ; dw->size <<= 1)
+		;
+
+	dw->lock = Sys_CreateMutex ();
+	dw->wake = Sys_CreateSemaphore (0);
+	if (dw->lock && dw->wake)
+	{
+		dw->ring = Z_Malloc (dw->size);
+		dw->thread = Sys_CreateThread (SV_DemoWriterThread, dw);
+	}
+	if (!dw->thread)
+	{	// no threads here, write as it comes
+		if (dw->ring)
+			Z_Free (dw->ring);
+		dw->ring = NULL;
+	}
+
+	return true;
+}
+
+/*
+==================
+SV_WriteDemoMessage
+
+Queues a length prefixed message, or drops all of it when the writer
+has fallen too far behind
+==================
+*/
+qboolean SV_WriteDemoMessage (byte *data, int length)
+{
+	demowriter_t	*dw;
+	unsigned		head, tail, ofs, len;
+	int				prefix;
+	byte			*src;
+
+	dw = &svs.demowriter;
+	prefix = LittleLong (length);
+
+	if (!dw->thread)
+	{
+		fwrite (&prefix, 4, 1, svs.demofile);
+		fwrite (data, length, 1, svs.demofile);
+		dw->frames++;
+		return true;
+	}
+
+	Sys_LockMutex (dw->lock);
+	head = dw->head;
+	tail = dw->tail;
+	Sys_UnlockMutex (dw->lock);
+
+	if (dw->size - (head - tail) < length + 4)
+	{
+		dw->dropped++;
+		return false;
+	}
+
+	// the writer never looks past head, so this needs no lock
+	for (src = (byte *)&prefix, len = 4 ; len ; len--)
+		dw->ring[head++ & (dw->size - 1)] = *src++;
+	while (length > 0)
+	{
+		ofs = head & (dw->size - 1);
+		len = dw->size - ofs;
+		if (len > length)
+			len = length;
+		memcpy (dw->ring + ofs, data, len);
+		data += len;
+		length -= len;
+		head += len;
+	}
+
+	Sys_LockMutex (dw->lock);
+	dw->head = head;
+	Sys_UnlockMutex (dw->lock);
+	Sys_SemaphorePost (dw->wake);
+
+	dw->frames++;
+	return true;
+}
+
+/*
+==================
+SV_CloseDemo
+
+Lets the writer finish what is queued and closes the file
+==================
+*/
+void SV_CloseDemo (void)
+{
+	demowriter_t	*dw;
+
+	if (!svs.demofile)
+		return;
+
+	dw = &svs.demowriter;
+	if (dw->thread)
+	{
+		Sys_LockMutex (dw->lock);
+		dw->shutdown = true;
+		Sys_UnlockMutex (dw->lock);
+		Sys_SemaphorePost (dw->wake);
+		Sys_WaitThread (dw->thread);
+		dw->thread = NULL;
+	}
+	if (dw->failed)
+		Com_Printf ("SV_CloseDemo: the demo was cut short, couldn't write it all\n");
+
+	fclose (svs.demofile);
+	svs.demofile = NULL;
+
+	if (dw->ring)
+		Z_Free (dw->ring);
+	if (dw->lock)
+		Sys_DestroyMutex (dw->lock);
+	if (dw->wake)
+		Sys_DestroySemaphore (dw->wake);
+	Z_Free (dw->states);
+	Z_Free (dw->newstates);
+	dw->ring = NULL;
+	dw->lock = dw->wake = NULL;
+	dw->states = dw->newstates = NULL;
+}
 
 /*
 ==================
@@ -669,31 +1510,48 @@ SV_RecordDemoMessage
 
 Save everything in the world out without deltas.
 Used for recording footage for merged or assembled demos
+
+With sv_demodelta the frame number is followed by the one the
+entities are delta compressed from, -1 for a full frame.  There is
+a full frame every DEMO_KEYFRAME frames and after any dropped one.
+
+Demos are kept at 10 frames a second whatever sv_fps is.
 ==================
 */
 void SV_RecordDemoMessage (void)
 {
 	int			e;
 	edict_t		*ent;
-	entity_state_t	nostate;
+	entity_state_t	nostate, *oldent, *newent, *swap;
 	sizebuf_t	buf;
 	byte		buf_data[32768];
-	int			len;
+	demowriter_t	*dw;
+	int			numnew, oldindex, newindex, oldnum, newnum, numold;
+	int			bits, framenum;
 
-	if (!svs.demofile)
+	if (!svs.demofile || sv.framenum % sv.framediv)
 	{
 		return;
 	}
 
+	dw = &svs.demowriter;
+	framenum = sv.framenum / sv.framediv;
 	memset (&nostate, 0, sizeof(nostate));
 	SZ_Init (&buf, buf_data, sizeof(buf_data));
 
+	numold = dw->numstates;
+	if (!dw->delta || dw->lastframe < 0 || framenum - dw->keyframe >= DEMO_KEYFRAME)
+		numold = 0;
+
 	// write a frame message that doesn't contain a player_state_t
 	MSG_WriteByte (&buf, svc_frame);
-	MSG_WriteLong (&buf, sv.framenum);
+	MSG_WriteLong (&buf, framenum);
+	if (dw->delta)
+		MSG_WriteLong (&buf, numold ? dw->lastframe : -1);
 
 	MSG_WriteByte (&buf, svc_packetentities);
 
+	numnew = 0;
 	e = 1;
 	ent = EDICT_NUM(e);
 	while (e < ge->num_edicts) 
@@ -703,22 +1561,71 @@ void SV_RecordDemoMessage (void)
 			(ent->s.modelindex || ent->s.effects || ent->s.sound ||
 			 ent->s.event) && !(ent->svflags & SVF_NOCLIENT))
 		{
-			MSG_WriteDeltaEntity(&nostate, &ent->s, &buf, false, true);
+			dw->newstates[numnew] = ent->s;
+			if (!ent->s.event)
+				dw->newstates[numnew].event = sv.events[e];
+			numnew++;
 		}
 
 		e++;
 		ent = EDICT_NUM(e);
 	}
 
+	// same walk as SV_EmitPacketEntities, from nothing for a full frame
+	oldindex = newindex = 0;
+	while (newindex < numnew || oldindex < numold)
+	{
+		newent = &dw->newstates[newindex];
+		oldent = &dw->states[oldindex];
+		newnum = (newindex < numnew) ? newent->number : 9999;
+		oldnum = (oldindex < numold) ? oldent->number : 9999;
+
+		if (newnum == oldnum)
+		{
+			MSG_WriteDeltaEntity (oldent, newent, &buf, false, newnum <= maxclients->intValue);
+			oldindex++;
+			newindex++;
+		}
+		else if (newnum < oldnum)
+		{
+			MSG_WriteDeltaEntity (&nostate, newent, &buf, dw->delta, true);
+			newindex++;
+		}
+		else
+		{	// gone since the last frame
+			bits = U_REMOVE;
+			if (oldnum >= 256)
+				bits |= U_NUMBER16 | U_MOREBITS1;
+			MSG_WriteByte (&buf, bits&255);
+			if (bits & 0x0000ff00)
+				MSG_WriteByte (&buf, (bits>>8)&255);
+			if (bits & U_NUMBER16)
+				MSG_WriteShort (&buf, oldnum);
+			else
+				MSG_WriteByte (&buf, oldnum);
+			oldindex++;
+		}
+	}
+
 	MSG_WriteShort (&buf, 0);		// end of packetentities
 
 	// now add the accumulated multicast information
 	SZ_Write (&buf, svs.demo_multicast.data, svs.demo_multicast.cursize);
 	SZ_Clear (&svs.demo_multicast);
 
-	// now write the entire message to the file, prefixed by the length
-	len = LittleLong (buf.cursize);
-	fwrite (&len, 4, 1, svs.demofile);
-	fwrite (buf.data, buf.cursize, 1, svs.demofile);
+	// hand the message to the writer, prefixed by the length
+	if (!SV_WriteDemoMessage (buf.data, buf.cursize))
+	{
+		dw->lastframe = -1;		// nothing can be based on it
+		return;
+	}
+
+	if (!numold)
+		dw->keyframe = framenum;
+	dw->lastframe = framenum;
+	dw->numstates = numnew;
+	swap = dw->states;
+	dw->states = dw->newstates;
+	dw->newstates = swap;
 }
 
@@ -245,10 +245,6 @@ PF_Configstring
 
 ===============
 */
-// From Q2Pro
-// Some mods actually exploit CS_STATUSBAR to take space up to CS_AIRACCEL
-#define CS_SIZE(cs) ((cs) >= CS_STATUSBAR && (cs) < CS_AIRACCEL ? MAX_QPATH * (CS_AIRACCEL - (cs)) : MAX_QPATH)
-
 void PF_Configstring (int index, char *val)
 {
 	size_t	len, maxlen;
@@ -284,6 +280,7 @@ void PF_Configstring (int index, char *val)
 	dest = sv.configstrings[index];
 	memcpy(dest, val, len);
 	dest[len] = 0;
+	SV_InvalidateIndexes (index);
 
 	if (sv.state != ss_loading)
 	{	// send the update to everyone
@@ -321,7 +318,7 @@ qboolean PF_inPVS (vec3_t p1, vec3_t p2)
 	int		leafnum;
 	int		cluster;
 	int		area1, area2;
-	byte	*mask;
+	const byte	*mask;
 
 	leafnum = CM_PointLeafnum (p1);
 	cluster = CM_LeafCluster (leafnum);
@@ -355,7 +352,7 @@ qboolean PF_inPHS (vec3_t p1, vec3_t p2)
 	int		leafnum;
 	int		cluster;
 	int		area1, area2;
-	byte	*mask;
+	const byte	*mask;
 
 	leafnum = CM_PointLeafnum (p1);
 	cluster = CM_LeafCluster (leafnum);
@@ -443,6 +440,8 @@ void SV_InitGameProgs (void)
 	import.unlinkentity = SV_UnlinkEdict;
 	import.BoxEdicts = SV_AreaEdicts;
 	import.trace = SV_Trace;
+	import.unlagged_trace = SV_UnlaggedTrace;
+	import.trace_batch = SV_TraceBatch;
 	import.pointcontents = SV_PointContents;
 	import.setmodel = PF_setmodel;
 	import.inPVS = PF_inPVS;
@@ -487,7 +486,10 @@ void SV_InitGameProgs (void)
 	import.SetAreaPortalState = CM_SetAreaPortalState;
 	import.AreasConnected = CM_AreasConnected;
 
-	ge = (game_export_t *)Sys_GetGameAPI (&import);
+	if (SV_RelayActive ())
+		ge = SV_GetRelayAPI ();		// the world comes from another server
+	else
+		ge = (game_export_t *)Sys_GetGameAPI (&import);
 
 	if (!ge)
 	{
@@ -499,6 +501,10 @@ void SV_InitGameProgs (void)
 		GAME_API_VERSION);
 	}
 
+	// the game sets its GMF_ bits while it starts up
+	Cvar_ForceSet ("g_features", "0");
+	Cvar_Get ("sv_features", "0", CVAR_NOSET);
+	Cvar_ForceSet ("sv_features", va("%i", SVFEAT_UNLAGGED_TRACE | SVFEAT_TRACE_BATCH));
 	ge->Init ();
 	
 	Com_Printf("------------------------------------\n\n");
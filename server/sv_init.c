@@ -27,6 +27,137 @@ server_t		sv;					// local server
 
 extern int num_sz_getspace_overflows;
 
+/*
+================
+SV_IndexTable
+
+The hash kept for a range of configstrings, NULL if there isn't one
+================
+*/
+csindex_t *SV_IndexTable (int start)
+{
+	if (start == CS_MODELS)
+		return &sv.indexes[INDEX_MODELS];
+	if (start == CS_SOUNDS)
+		return &sv.indexes[INDEX_SOUNDS];
+	if (start == CS_IMAGES)
+		return &sv.indexes[INDEX_IMAGES];
+	return NULL;
+}
+
+/*
+================
+SV_InvalidateIndexes
+
+Configstrings were written without going through SV_FindIndex
+================
+*/
+void SV_InvalidateIndexes (int index)
+{
+	if (index < 0 || (index >= CS_MODELS && index < CS_MODELS+MAX_MODELS))
+		sv.indexes[INDEX_MODELS].valid = false;
+	if (index < 0 || (index >= CS_SOUNDS && index < CS_SOUNDS+MAX_SOUNDS))
+		sv.indexes[INDEX_SOUNDS].valid = false;
+	if (index < 0 || (index >= CS_IMAGES && index < CS_IMAGES+MAX_IMAGES))
+		sv.indexes[INDEX_IMAGES].valid = false;
+}
+
+/*
+================
+SV_IndexHash
+================
+*/
+int SV_IndexHash (char *name)
+{
+	unsigned	h;
+
+	for (h = 0 ; *name ; name++)
+		h = h*33 + *(byte *)name;
+	return (h ^ (h >> 11)) & (INDEX_HASH_SIZE-1);
+}
+
+/*
+================
+SV_IndexInsert
+================
+*/
+void SV_IndexInsert (csindex_t *table, int start, int i)
+{
+	int		h;
+
+	for (h = SV_IndexHash (sv.configstrings[start+i]) ; table->slots[h] ; h = (h+1) & (INDEX_HASH_SIZE-1))
+		;
+	table->slots[h] = i;
+}
+
+/*
+================
+SV_BuildIndex
+
+Hashes the names up to the first empty configstring, which is as far
+as a scan would look
+================
+*/
+void SV_BuildIndex (csindex_t *table, int start, int max)
+{
+	int		i;
+
+	memset (table->slots, 0, sizeof(table->slots));
+	for (i=1 ; i<max && sv.configstrings[start+i][0] ; i++)
+		SV_IndexInsert (table, start, i);
+	table->count = i;
+	table->valid = true;
+}
+
+/*
+================
+SV_ScanIndex
+
+The old way, for ranges without a hash and the benchmark
+================
+*/
+int SV_ScanIndex (char *name, int start, int max, int *count)
+{
+	int		i;
+
+	for (i=1 ; i<max && sv.configstrings[start+i][0] ; i++)
+		if (!strcmp(sv.configstrings[start+i], name))
+			return i;
+
+	*count = i;
+	return 0;
+}
+
+/*
+================
+SV_LookupIndex
+
+Returns the index of name or 0, and the first empty slot in *count
+================
+*/
+int SV_LookupIndex (char *name, int start, int max, int *count)
+{
+	csindex_t	*table;
+	int			h, i;
+
+	table = SV_IndexTable (start);
+	if (!table)
+		return SV_ScanIndex (name, start, max, count);
+
+	if (!table->valid)
+		SV_BuildIndex (table, start, max);
+
+	for (h = SV_IndexHash (name) ; table->slots[h] ; h = (h+1) & (INDEX_HASH_SIZE-1))
+	{
+		i = table->slots[h];
+		if (!strcmp (sv.configstrings[start+i], name))
+			return i;
+	}
+
+	*count = table->count;
+	return 0;
+}
+
 /*
 ================
 SV_FindIndex
@@ -35,18 +166,21 @@ SV_FindIndex
 */
 int SV_FindIndex (char *name, int start, int max, qboolean create)
 {
-	int		i;
+	int		i, count;
+	csindex_t	*table;
 	
 	if (!name || !name[0])
 		return 0;
 
-	for (i=1 ; i<max && sv.configstrings[start+i][0] ; i++)
-		if (!strcmp(sv.configstrings[start+i], name))
-			return i;
+	i = SV_LookupIndex (name, start, max, &count);
+	if (i)
+		return i;
 
 	if (!create)
 		return 0;
 
+	i = count;
+
 	// Knightmare- Output a more useful error message to tell user what overflowed.
 	// And don't bomb out, either- instead, return last possible index.
 	if (i == max)
@@ -64,6 +198,17 @@ int SV_FindIndex (char *name, int start, int max, qboolean create)
 
 	strncpy (sv.configstrings[start+i], name, sizeof(sv.configstrings[i]));
 
+	table = SV_IndexTable (start);
+	if (table && table->valid)
+	{
+		SV_IndexInsert (table, start, i);
+		// a scan would now run on into whatever follows
+		if (i+1 < max && sv.configstrings[start+i+1][0])
+			table->valid = false;
+		else
+			table->count = i+1;
+	}
+
 	if (sv.state != ss_loading)
 	{	// send the update to everyone
 		SZ_Clear (&sv.multicast);
@@ -92,6 +237,71 @@ int SV_ImageIndex (char *name)
 	return SV_FindIndex (name, CS_IMAGES, MAX_IMAGES, true);
 }
 
+/*
+================
+SV_IndexBench_f
+
+sv_indexbench [lookups]
+
+Times scanned against hashed lookups over a full model table.  The
+real model configstrings are put back afterwards.
+================
+*/
+void SV_IndexBench_f (void)
+{
+	int			lookups;
+	int			i, count, found;
+	unsigned	start, scanned, hashed;
+	char		(*save)[MAX_QPATH];
+	csindex_t	save_index;
+	char		names[8][MAX_QPATH];
+	char		*name;
+
+	lookups = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 100000;
+	if (lookups < 1)
+		lookups = 1;
+
+	save = Z_Malloc (MAX_MODELS * sizeof(*save));
+	memcpy (save, sv.configstrings[CS_MODELS], MAX_MODELS * sizeof(*save));
+	save_index = sv.indexes[INDEX_MODELS];
+
+	for (i=1 ; i<MAX_MODELS ; i++)
+		Com_sprintf (sv.configstrings[CS_MODELS+i], sizeof(sv.configstrings[CS_MODELS+i]),
+			"models/bench/%03i/tris.md2", i);
+	sv.indexes[INDEX_MODELS].valid = false;
+
+	// mostly late entries, which is where precaching in a running game lands,
+	// and one miss
+	for (i=0 ; i<7 ; i++)
+		Q_strncpyz (names[i], sv.configstrings[CS_MODELS+MAX_MODELS-1-i*16], sizeof(names[i]));
+	Q_strncpyz (names[7], "models/bench/none/tris.md2", sizeof(names[7]));
+
+	found = 0;
+	start = Sys_Microseconds ();
+	for (i=0 ; i<lookups ; i++)
+	{
+		name = names[i&7];
+		found += SV_ScanIndex (name, CS_MODELS, MAX_MODELS, &count);
+	}
+	scanned = Sys_Microseconds () - start;
+
+	start = Sys_Microseconds ();
+	for (i=0 ; i<lookups ; i++)
+	{
+		name = names[i&7];
+		found -= SV_LookupIndex (name, CS_MODELS, MAX_MODELS, &count);
+	}
+	hashed = Sys_Microseconds () - start;
+
+	memcpy (sv.configstrings[CS_MODELS], save, MAX_MODELS * sizeof(*save));
+	sv.indexes[INDEX_MODELS] = save_index;
+	Z_Free (save);
+
+	Com_Printf ("%i lookups in %i models%s\n", lookups, MAX_MODELS-1, found ? " (MISMATCH)" : "");
+	Com_Printf ("scanned: %6i usec, %.3f usec/lookup\n", scanned, (float)scanned / lookups);
+	Com_Printf ("hashed:  %6i usec, %.3f usec/lookup\n", hashed, (float)hashed / lookups);
+}
+
 
 /*
 ================
@@ -165,7 +375,7 @@ void SV_CheckForSavegame (void)
 
 		previousState = sv.state;				// PGM
 		sv.state = ss_loading;					// PGM
-		for (i=0 ; i<100 ; i++)
+		for (i=0 ; i<100*sv.framediv ; i++)
 			ge->RunFrame ();
 
 		sv.state = previousState;				// PGM
@@ -173,6 +383,53 @@ void SV_CheckForSavegame (void)
 }
 
 
+/*
+================
+SV_PreloadNextMap
+
+Guesses the map that comes after this one and has it read in the
+background: the nextmap cvar if a mod sets it, otherwise the entry
+after this map in sv_maplist
+================
+*/
+void SV_PreloadNextMap (void)
+{
+	char	list[MAX_TOKEN_CHARS];
+	char	*s, *first, *next;
+	qboolean	found;
+
+	if (!sv_preload->intValue || sv.state != ss_game || sv.attractloop)
+		return;
+
+	next = NULL;
+	s = Cvar_VariableString ("nextmap");
+	if (s[0] && !strchr (s, ' '))
+		next = s;
+	else
+	{
+		Q_strncpyz (list, Cvar_VariableString ("sv_maplist"), sizeof(list));
+		first = NULL;
+		found = false;
+		for (s = strtok (list, " ,\n\r") ; s ; s = strtok (NULL, " ,\n\r"))
+		{
+			if (!first)
+				first = s;
+			if (found)
+			{
+				next = s;
+				break;
+			}
+			if (!Q_stricmp (s, sv.name))
+				found = true;
+		}
+		if (found && !next)
+			next = first;	// wraps around
+	}
+
+	if (next && Q_stricmp (next, sv.name))
+		CM_PreloadMap (va("maps/%s.bsp", next));
+}
+
 /*
 ================
 SV_SpawnServer
@@ -186,6 +443,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 {
 	int			i;
 	unsigned	checksum;
+	int			start, loaded, spawned;
 
 	if (attractloop)
 		Cvar_Set ("paused", "0");
@@ -206,6 +464,8 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	svs.realtime = 0;
 	sv.loadgame = loadgame;
 	sv.attractloop = attractloop;
+	sv.framediv = (serverstate == ss_game && svs.framediv > 1) ? svs.framediv : 1;
+	sv.frametime = 100 / sv.framediv;
 	num_sz_getspace_overflows = 0; /* FS: Bullshit coop hack. */
 
 	// save name for levels that don't set message
@@ -244,6 +504,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	Q_strncpyz (sv.name, server, sizeof(sv.name));
 	Q_strncpyz (sv.configstrings[CS_NAME], server, sizeof(sv.configstrings[CS_NAME]));
 
+	start = Sys_Milliseconds ();
 	if (serverstate != ss_game)
 	{
 		sv.models[1] = CM_LoadMap ("", false, &checksum);	// no real map
@@ -256,6 +517,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	}
 	Com_sprintf (sv.configstrings[CS_MAPCHECKSUM],sizeof(sv.configstrings[CS_MAPCHECKSUM]),
 		"%i", checksum);
+	loaded = Sys_Milliseconds ();
 
 	//
 	// clear physics interaction links
@@ -268,6 +530,7 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 			"*%i", i);
 		sv.models[i+1] = CM_InlineModel (sv.configstrings[CS_MODELS+1+i]);
 	}
+	SV_InvalidateIndexes (-1);
 
 	//
 	// spawn the rest of the entities on the map
@@ -282,8 +545,9 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	ge->SpawnEntities ( sv.name, CM_EntityString(), spawnpoint );
 
 	// run two frames to allow everything to settle
-	ge->RunFrame ();
-	ge->RunFrame ();
+	for (i=0 ; i<2*sv.framediv ; i++)
+		ge->RunFrame ();
+	spawned = Sys_Milliseconds ();
 
 	// all precaches are complete
 	sv.state = serverstate;
@@ -298,9 +562,43 @@ void SV_SpawnServer (char *server, char *spawnpoint, server_state_t serverstate,
 	// set serverinfo variable
 	Cvar_FullSet ("mapname", sv.name, CVAR_SERVERINFO | CVAR_NOSET);
 
+	if (serverstate == ss_game)
+		Com_Printf ("%s took %i msec: %i loading%s, %i spawning\n", sv.name,
+			Sys_Milliseconds () - start, loaded - start,
+			cm_preloaded ? " (read ahead)" : "", spawned - loaded);
+
+	// get the file for the next one off the disk while this one runs
+	SV_PreloadNextMap ();
+
 	Com_Printf ("-------------------------------------\n");
 }
 
+/*
+==============
+SV_CheckFpsCvar
+
+sv_fps has to split the 100 msec frame into whole msecs, and
+a 10 Hz client gets one frame out of every few
+==============
+*/
+void SV_CheckFpsCvar (void)
+{
+	int		fps;
+
+	if (sv_fps->intValue >= 40)
+		fps = 40;
+	else if (sv_fps->intValue >= 20)
+		fps = 20;
+	else
+		fps = 10;
+
+	if (fps != sv_fps->intValue)
+	{
+		Com_Printf ("sv_fps can be 10, 20 or 40, using %i.\n", fps);
+		Cvar_FullSet ("sv_fps", va("%i", fps), CVAR_LATCH);
+	}
+}
+
 /*
 ==============
 SV_InitGame
@@ -338,6 +636,7 @@ void SV_InitGame (void)
 	}
 
 	SV_CheckSkillCvar(); /* FS: Valid skill values are 0, 1, 2, and 3. */
+	SV_CheckFpsCvar ();
 
 	// dedicated servers are can't be single player and are usually DM
 	// so unless they explicity set coop, force it to deathmatch
@@ -377,8 +676,9 @@ void SV_InitGame (void)
 
 	svs.spawncount = rand();
 	svs.clients = Z_Malloc (sizeof(client_t)*maxclients->intValue);
-	svs.num_client_entities = maxclients->value*UPDATE_BACKUP*64;
-	svs.client_entities = Z_Malloc (sizeof(entity_state_t)*svs.num_client_entities);
+	memset (svs.adrhash, 0, sizeof(svs.adrhash));
+	memset (svs.iphash, 0, sizeof(svs.iphash));
+	svs.antilag = Z_Malloc (sizeof(antilag_t)*ANTILAG_FRAMES*maxclients->intValue);
 
 	// init network stuff
 	NET_Config ( (maxclients->intValue > 1) );
@@ -390,6 +690,22 @@ void SV_InitGame (void)
 
 	// init game
 	SV_InitGameProgs ();
+
+	// a game that still counts in 10 Hz frames can't be run any faster
+	svs.framediv = sv_fps->intValue / 10;
+	if (svs.framediv > 1 && !(Cvar_VariableValueInt ("g_features") & GMF_VARIABLE_FPS))
+	{
+		Com_Printf ("The game can't run at sv_fps %i, running it at 10.\n", sv_fps->intValue);
+		svs.framediv = 1;
+	}
+
+	// enough for a delta window of frames, which tickrate clients
+	// get svs.framediv of each 100 msec
+	svs.num_client_entities = maxclients->value*UPDATE_WINDOW*svs.framediv*64;
+	if (sv_maxrelays->intValue > 0)	// relays get the whole world, at 10 Hz
+		svs.num_client_entities += min(sv_maxrelays->intValue, maxclients->intValue)*UPDATE_WINDOW*MAX_EDICTS;
+	svs.client_entities = Z_Malloc (sizeof(entity_state_t)*svs.num_client_entities);
+
 	for (i=0 ; i<maxclients->intValue; i++)
 	{
 		ent = EDICT_NUM(i+1);
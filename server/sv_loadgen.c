@@ -0,0 +1,714 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "server.h"
+
+/*
+==============================================================================
+
+LOAD GENERATOR
+
+sv_loadgen connects made up clients that go through the real protocol:
+getchallenge, connect, new, configstrings, baselines and begin, then a
+stream of randomized moves at a fixed rate.  Their packets never touch
+a socket.  Netchan_SendPacket hands everything addressed to 0.0.x.x to
+SV_LoadgenSend, the fake clients read what the server sent them at the
+start of SV_ReadPackets and what they sent is read after the socket.
+They only look at enough of the server's messages to answer its
+stufftexts and ack frames, so the deltas stay realistic.
+
+Frame times come from the server profile, which is switched on and
+reset once every client is in the game.
+
+==============================================================================
+*/
+
+#define	LOADGEN_PORT		27901
+#define	LOADGEN_SETTLE		10000		// msec to wait for everyone to get in before measuring anyway
+#define	LOADGEN_TIMEOUT		10000		// msec without a packet before starting over
+
+typedef enum {LG_CHALLENGE, LG_CONNECTING, LG_CONNECTED, LG_SPAWNED} lgstate_t;
+
+typedef struct
+{
+	lgstate_t	state;
+	netadr_t	adr;
+	netchan_t	netchan;
+	int			sendtime;			// curtime of the next resend or move
+	int			serverframe;		// last svc_frame seen, -1 for none
+	usercmd_t	cmds[4];			// by outgoing_sequence, each move carries three
+	int			turn;				// yaw change per move
+	unsigned	seed;
+	qboolean	refused;			// the server's reason was printed once
+} lgclient_t;
+
+typedef struct
+{
+	int			length;
+	netadr_t	adr;				// to or from the fake client
+} lgpacket_t;						// followed by the data, padded to 4 bytes
+
+typedef struct
+{
+	byte		*data;
+	int			size;
+	int			used, read;
+	int			dropped;			// didn't fit, lost like any datagram
+} lgqueue_t;
+
+typedef struct
+{
+	qboolean	pending;			// waiting for a map
+	qboolean	active;
+	qboolean	measuring;
+	qboolean	quit;
+	int			numclients;
+	lgclient_t	*clients;
+	lgqueue_t	toserver;
+	lgqueue_t	toclients;
+	int			cmdmsec;
+	int			seconds;
+	int			starttime, endtime;
+	clock_t		startclock;
+	int			bytesup, bytesdown;	// from and to the fake clients
+	char		oldprofile[16];
+} loadgen_t;
+
+loadgen_t	sv_loadgen;
+
+/*
+==================
+SV_LoadgenQueue
+==================
+*/
+void SV_LoadgenQueue (lgqueue_t *q, netadr_t adr, int length, void *data)
+{
+	lgpacket_t	*p;
+	int			size;
+
+	size = sizeof(lgpacket_t) + ((length + 3) & ~3);
+	if (q->used + size > q->size)
+	{
+		q->dropped++;
+		return;
+	}
+
+	p = (lgpacket_t *)(q->data + q->used);
+	p->length = length;
+	p->adr = adr;
+	memcpy (p + 1, data, length);
+	q->used += size;
+}
+
+/*
+==================
+SV_LoadgenDequeue
+
+Packets are only added while the queue isn't being read, so it empties
+out completely before anything new goes in
+==================
+*/
+lgpacket_t *SV_LoadgenDequeue (lgqueue_t *q)
+{
+	lgpacket_t	*p;
+
+	if (q->read >= q->used)
+	{
+		q->read = q->used = 0;
+		return NULL;
+	}
+
+	p = (lgpacket_t *)(q->data + q->read);
+	q->read += sizeof(lgpacket_t) + ((p->length + 3) & ~3);
+	return p;
+}
+
+/*
+==================
+SV_LoadgenSend
+
+net_fakesend.  A fake client's netchan has its own address as the
+remote address, so NS_CLIENT packets are from it and NS_SERVER ones
+are to it.
+==================
+*/
+void SV_LoadgenSend (netsrc_t sock, int length, void *data, netadr_t to)
+{
+	if (!sv_loadgen.active)
+		return;		// zombies still get their last packets after a stop
+
+	if (sock == NS_CLIENT)
+	{
+		SV_LoadgenQueue (&sv_loadgen.toserver, to, length, data);
+		sv_loadgen.bytesup += length;
+	}
+	else
+	{
+		SV_LoadgenQueue (&sv_loadgen.toclients, to, length, data);
+		sv_loadgen.bytesdown += length;
+	}
+}
+
+/*
+==================
+SV_LoadgenClient
+==================
+*/
+lgclient_t *SV_LoadgenClient (netadr_t *adr)
+{
+	int		i;
+
+	i = ((adr->ip[2] << 8) | adr->ip[3]) - 1;
+	if (adr->ip[1] || i < 0 || i >= sv_loadgen.numclients)
+		return NULL;
+	return &sv_loadgen.clients[i];
+}
+
+/*
+==================
+SV_LoadgenRand
+==================
+*/
+int SV_LoadgenRand (lgclient_t *lc)
+{
+	lc->seed = lc->seed * 1103515245 + 12345;
+	return (lc->seed >> 16) & 0x7fff;
+}
+
+/*
+==================
+SV_LoadgenStringCmd
+==================
+*/
+void SV_LoadgenStringCmd (lgclient_t *lc, char *s)
+{
+	MSG_WriteByte (&lc->netchan.message, clc_stringcmd);
+	MSG_WriteString (&lc->netchan.message, s);
+}
+
+/*
+==================
+SV_LoadgenConnectionless
+==================
+*/
+void SV_LoadgenConnectionless (lgclient_t *lc, char *s)
+{
+	char	userinfo[MAX_INFO_STRING];
+
+	if (!strncmp (s, "challenge ", 10) && lc->state == LG_CHALLENGE)
+	{
+		Com_sprintf (userinfo, sizeof(userinfo), "\\name\\loadgen%i\\skin\\male/grunt\\rate\\25000\\msg\\1\\hand\\2",
+			(int)(lc - sv_loadgen.clients) + 1);
+		Netchan_OutOfBandPrint (NS_CLIENT, lc->adr, "connect %i %i %i \"%s\" %i\n",
+			PROTOCOL_VERSION, (int)Cvar_VariableValue ("qport"), atoi (s + 10), userinfo,
+			(net_fragment->intValue ? NETCAPS_FRAGMENT : 0) | NETCAPS_PROJECTILES);
+		lc->state = LG_CONNECTING;
+	}
+	else if (!strncmp (s, "client_connect", 14) && lc->state == LG_CONNECTING)
+	{
+		Netchan_Setup (NS_CLIENT, &lc->netchan, lc->adr, (int)Cvar_VariableValue ("qport"));
+		lc->netchan.fragment = (strstr (s, " fragment=1") && net_fragment->intValue);
+		SV_LoadgenStringCmd (lc, "new");
+		lc->state = LG_CONNECTED;
+		lc->serverframe = -1;
+		lc->sendtime = curtime;
+	}
+	else if (!strncmp (s, "print\n", 6) && !lc->refused)
+	{
+		Com_Printf ("loadgen%i: %s", (int)(lc - sv_loadgen.clients) + 1, s + 6);
+		lc->refused = true;
+	}
+}
+
+/*
+==================
+SV_LoadgenParse
+
+Picks the stufftexts the connection depends on out of a message
+without parsing the rest of it
+==================
+*/
+void SV_LoadgenParse (lgclient_t *lc, sizebuf_t *msg)
+{
+	byte	*p, *end;
+	char	line[64];
+	int		i;
+
+	if (msg->readcount < msg->cursize && msg->data[msg->readcount] == svc_frame)
+	{
+		MSG_ReadByte (msg);
+		lc->serverframe = MSG_ReadLong (msg);
+	}
+
+	end = msg->data + msg->cursize;
+	for (p = msg->data + msg->readcount ; p < end - 1 ; p++)
+	{
+		if (*p != svc_stufftext)
+			continue;
+
+		for (i=0 ; i<sizeof(line)-1 && p+1+i < end && p[1+i] && p[1+i] != '\n' ; i++)
+			line[i] = p[1+i];
+		line[i] = 0;
+
+		if (!strncmp (line, "cmd configstrings ", 18) || !strncmp (line, "cmd baselines ", 14))
+			SV_LoadgenStringCmd (lc, line + 4);
+		else if (!strncmp (line, "precache ", 9))
+		{
+			SV_LoadgenStringCmd (lc, va("begin %i\n", atoi (line + 9)));
+			lc->state = LG_SPAWNED;
+		}
+		else if (!strcmp (line, "reconnect"))
+		{
+			SV_LoadgenStringCmd (lc, "new");
+			lc->state = LG_CONNECTED;
+			lc->serverframe = -1;
+		}
+	}
+}
+
+/*
+==================
+SV_LoadgenReceive
+==================
+*/
+void SV_LoadgenReceive (lgclient_t *lc, byte *data, int length)
+{
+	static byte	buf[MAX_MSGLEN];
+	sizebuf_t	msg;
+
+	if (length >= sizeof(buf))
+		return;
+	memcpy (buf, data, length);
+	buf[length] = 0;
+	SZ_Init (&msg, buf, sizeof(buf));
+	msg.cursize = length;
+
+	if (*(int *)buf == -1)
+	{
+		SV_LoadgenConnectionless (lc, (char *)buf + 4);
+		return;
+	}
+
+	if (lc->state < LG_CONNECTED)
+		return;
+	if (Netchan_Process (&lc->netchan, &msg))
+		SV_LoadgenParse (lc, &msg);
+}
+
+/*
+==================
+SV_LoadgenMove
+
+Makes up the next command the way someone running around shooting
+might, and sends it with the two before it like CL_SendCmd
+==================
+*/
+void SV_LoadgenMove (lgclient_t *lc)
+{
+	byte		data[128];
+	sizebuf_t	buf;
+	usercmd_t	nullcmd, *cmd, *oldcmd;
+	int			i, checksumIndex;
+
+	cmd = &lc->cmds[lc->netchan.outgoing_sequence & 3];
+	*cmd = lc->cmds[(lc->netchan.outgoing_sequence-1) & 3];
+
+	if (!(SV_LoadgenRand (lc) & 31))
+		lc->turn = (SV_LoadgenRand (lc) & 1023) - 512;
+	cmd->msec = sv_loadgen.cmdmsec;
+	cmd->angles[YAW] = (short)(cmd->angles[YAW] + lc->turn);
+	cmd->angles[PITCH] = (short)((SV_LoadgenRand (lc) & 1023) - 512);
+	if (!(SV_LoadgenRand (lc) & 15))
+		cmd->forwardmove = (SV_LoadgenRand (lc) & 3) ? 400 : -200;
+	if (!(SV_LoadgenRand (lc) & 15))
+		cmd->sidemove = ((SV_LoadgenRand (lc) % 3) - 1) * 200;
+	cmd->upmove = (SV_LoadgenRand (lc) & 63) ? 0 : 200;
+	cmd->buttons = (SV_LoadgenRand (lc) & 7) ? 0 : BUTTON_ATTACK;
+	cmd->lightlevel = 128;
+
+	SZ_Init (&buf, data, sizeof(data));
+	MSG_WriteByte (&buf, clc_move);
+	checksumIndex = buf.cursize;
+	MSG_WriteByte (&buf, 0);
+	MSG_WriteLong (&buf, lc->serverframe);
+
+	memset (&nullcmd, 0, sizeof(nullcmd));
+	oldcmd = &nullcmd;
+	for (i=2 ; i>=0 ; i--)
+	{
+		cmd = &lc->cmds[(lc->netchan.outgoing_sequence - i) & 3];
+		MSG_WriteDeltaUsercmd (&buf, oldcmd, cmd);
+		oldcmd = cmd;
+	}
+
+	buf.data[checksumIndex] = COM_BlockSequenceCRCByte (
+		buf.data + checksumIndex + 1, buf.cursize - checksumIndex - 1,
+		lc->netchan.outgoing_sequence);
+
+	Netchan_Transmit (&lc->netchan, buf.cursize, buf.data);
+}
+
+/*
+==================
+SV_LoadgenThink
+==================
+*/
+void SV_LoadgenThink (lgclient_t *lc)
+{
+	int		i;
+
+	if (lc->state >= LG_CONNECTED && curtime - lc->netchan.last_received > LOADGEN_TIMEOUT)
+	{
+		lc->state = LG_CHALLENGE;
+		lc->sendtime = curtime;
+	}
+
+	switch (lc->state)
+	{
+	case LG_CHALLENGE:
+	case LG_CONNECTING:
+		if (curtime < lc->sendtime)
+			break;
+		// no reply, start over like CL_CheckForResend
+		lc->state = LG_CHALLENGE;
+		Netchan_OutOfBandPrint (NS_CLIENT, lc->adr, "getchallenge\n");
+		lc->sendtime = curtime + 3000;
+		break;
+
+	case LG_CONNECTED:
+		if (curtime < lc->sendtime)
+			break;
+		Netchan_Transmit (&lc->netchan, 0, NULL);
+		lc->sendtime = curtime + 100;
+		break;
+
+	case LG_SPAWNED:
+		for (i=0 ; i<4 && curtime >= lc->sendtime ; i++)
+		{
+			SV_LoadgenMove (lc);
+			lc->sendtime += sv_loadgen.cmdmsec;
+		}
+		if (curtime >= lc->sendtime)
+			lc->sendtime = curtime + sv_loadgen.cmdmsec;	// fell behind
+		break;
+	}
+}
+
+/*
+==================
+SV_LoadgenReport
+==================
+*/
+void SV_LoadgenReport (void)
+{
+	int		i, spawned;
+	float	seconds, cpu;
+
+	seconds = (Sys_Milliseconds () - sv_loadgen.starttime) * 0.001f;
+	if (seconds <= 0)
+		seconds = 0.001f;
+	cpu = (float)(clock () - sv_loadgen.startclock) / CLOCKS_PER_SEC;
+
+	for (i=0, spawned=0 ; i<sv_loadgen.numclients ; i++)
+	{
+		if (sv_loadgen.clients[i].state == LG_SPAWNED)
+			spawned++;
+	}
+
+	Com_Printf ("loadgen: %i of %i clients in the game, %.1f seconds on %s\n",
+		spawned, sv_loadgen.numclients, seconds, sv.name);
+	SV_ProfileSummary ();
+	Com_Printf ("bytes/client/sec: %.0f to the clients, %.0f from them\n",
+		sv_loadgen.bytesdown / seconds / sv_loadgen.numclients,
+		sv_loadgen.bytesup / seconds / sv_loadgen.numclients);
+	Com_Printf ("cpu: %.2f seconds, %.1f%% of one core\n", cpu, cpu * 100 / seconds);
+	if (sv_loadgen.toserver.dropped || sv_loadgen.toclients.dropped)
+		Com_Printf ("%i packets to the server and %i to the clients didn't fit the queues\n",
+			sv_loadgen.toserver.dropped, sv_loadgen.toclients.dropped);
+}
+
+/*
+==================
+SV_LoadgenMeasure
+
+Starts the clock once everyone is in, so the connection bursts don't
+count
+==================
+*/
+void SV_LoadgenMeasure (int spawned)
+{
+	Com_Printf ("loadgen: %i of %i clients in the game, measuring", spawned, sv_loadgen.numclients);
+	if (sv_loadgen.seconds)
+		Com_Printf (" for %i seconds", sv_loadgen.seconds);
+	Com_Printf ("\n");
+
+	SV_ProfileReset ();
+	sv_loadgen.measuring = true;
+	sv_loadgen.bytesup = sv_loadgen.bytesdown = 0;
+	sv_loadgen.toserver.dropped = sv_loadgen.toclients.dropped = 0;
+	sv_loadgen.starttime = Sys_Milliseconds ();
+	sv_loadgen.startclock = clock ();
+	if (sv_loadgen.seconds)
+		sv_loadgen.endtime = sv_loadgen.starttime + sv_loadgen.seconds * 1000;
+}
+
+/*
+==================
+SV_FreeLoadgen
+==================
+*/
+void SV_FreeLoadgen (void)
+{
+	if (sv_loadgen.clients)
+		Z_Free (sv_loadgen.clients);
+	if (sv_loadgen.toserver.data)
+		Z_Free (sv_loadgen.toserver.data);
+	if (sv_loadgen.toclients.data)
+		Z_Free (sv_loadgen.toclients.data);
+	memset (&sv_loadgen, 0, sizeof(sv_loadgen));
+}
+
+/*
+==================
+SV_StopLoadgen
+
+The fake clients say goodbye like CL_Disconnect, their packets are
+read by the next SV_ReadPackets and then everything is freed
+==================
+*/
+void SV_StopLoadgen (void)
+{
+	byte		final[32];
+	lgclient_t	*lc;
+	int			i;
+
+	final[0] = clc_stringcmd;
+	strcpy ((char *)final+1, "disconnect");
+	for (i=0, lc=sv_loadgen.clients ; i<sv_loadgen.numclients ; i++, lc++)
+	{
+		if (lc->state < LG_CONNECTED)
+			continue;
+		Netchan_Transmit (&lc->netchan, strlen((char *)final), final);
+		Netchan_Transmit (&lc->netchan, strlen((char *)final), final);
+		Netchan_Transmit (&lc->netchan, strlen((char *)final), final);
+	}
+
+	SV_LoadgenReport ();
+	Cvar_ForceSet ("sv_profile", sv_loadgen.oldprofile);
+	sv_loadgen.active = false;
+
+	if (sv_loadgen.quit)
+		Cbuf_AddText ("quit\n");
+}
+
+/*
+==================
+SV_ShutdownLoadgen
+==================
+*/
+void SV_ShutdownLoadgen (void)
+{
+	if (sv_loadgen.pending)
+		return;		// for the map that's coming
+	if (sv_loadgen.active)
+		SV_StopLoadgen ();
+	SV_FreeLoadgen ();
+}
+
+/*
+==================
+SV_StartLoadgen
+==================
+*/
+void SV_StartLoadgen (void)
+{
+	int			i, count;
+	lgclient_t	*lc;
+
+	count = sv_loadgen.numclients;
+	if (count > maxclients->intValue)
+	{
+		Com_Printf ("Only %i clients fit, raise maxclients.\n", maxclients->intValue);
+		count = sv_loadgen.numclients = maxclients->intValue;
+	}
+
+	sv_loadgen.clients = Z_Malloc (count * sizeof(lgclient_t));
+	sv_loadgen.toserver.size = 0x40000 + count * 0x1000;
+	sv_loadgen.toserver.data = Z_Malloc (sv_loadgen.toserver.size);
+	sv_loadgen.toclients.size = 0x40000 + count * 0x4000;
+	sv_loadgen.toclients.data = Z_Malloc (sv_loadgen.toclients.size);
+
+	for (i=0, lc=sv_loadgen.clients ; i<count ; i++, lc++)
+	{
+		lc->adr.type = NA_IP;
+		lc->adr.ip[2] = (i+1) >> 8;
+		lc->adr.ip[3] = (i+1) & 255;
+		lc->adr.port = BigShort (LOADGEN_PORT);
+		lc->state = LG_CHALLENGE;
+		lc->sendtime = curtime + i*5;	// not quite all at once
+		lc->seed = i+1;
+	}
+
+	Q_strncpyz (sv_loadgen.oldprofile, sv_profile->string, sizeof(sv_loadgen.oldprofile));
+	Cvar_ForceSet ("sv_profile", "1");
+
+	sv_loadgen.pending = false;
+	sv_loadgen.active = true;
+	sv_loadgen.starttime = Sys_Milliseconds ();
+	net_fakesend = SV_LoadgenSend;	// left set, drops packets while idle
+
+	Com_Printf ("loadgen: connecting %i clients at %i moves a second\n", count, 1000 / sv_loadgen.cmdmsec);
+}
+
+/*
+==================
+SV_RunLoadgen
+
+The fake clients read what the server sent them and send whatever is
+due, called before the server reads its packets
+==================
+*/
+void SV_RunLoadgen (void)
+{
+	lgpacket_t	*p;
+	lgclient_t	*lc;
+	int			i, spawned;
+
+	if (sv_loadgen.pending && sv.state == ss_game)
+		SV_StartLoadgen ();
+	if (!sv_loadgen.active)
+		return;
+
+	while ((p = SV_LoadgenDequeue (&sv_loadgen.toclients)) != NULL)
+	{
+		lc = SV_LoadgenClient (&p->adr);
+		if (lc)
+			SV_LoadgenReceive (lc, (byte *)(p + 1), p->length);
+	}
+
+	spawned = 0;
+	for (i=0, lc=sv_loadgen.clients ; i<sv_loadgen.numclients ; i++, lc++)
+	{
+		SV_LoadgenThink (lc);
+		if (lc->state == LG_SPAWNED)
+			spawned++;
+	}
+
+	if (!sv_loadgen.measuring)
+	{
+		if (spawned == sv_loadgen.numclients || Sys_Milliseconds () - sv_loadgen.starttime > LOADGEN_SETTLE)
+			SV_LoadgenMeasure (spawned);
+	}
+	else if (sv_loadgen.endtime && Sys_Milliseconds () >= sv_loadgen.endtime)
+		SV_StopLoadgen ();
+}
+
+/*
+==================
+SV_LoadgenPacket
+
+Hands SV_ReadPackets what the fake clients sent, once the socket is
+empty
+==================
+*/
+qboolean SV_LoadgenPacket (netadr_t *from, sizebuf_t *msg)
+{
+	lgpacket_t	*p;
+
+	if (!sv_loadgen.toserver.data)
+		return false;
+
+	p = SV_LoadgenDequeue (&sv_loadgen.toserver);
+	if (!p)
+	{
+		if (!sv_loadgen.active)
+			SV_FreeLoadgen ();	// the goodbyes have been read
+		return false;
+	}
+
+	memcpy (msg->data, p + 1, p->length);
+	msg->cursize = p->length;
+	msg->readcount = 0;
+	*from = p->adr;
+	return true;
+}
+
+/*
+==================
+SV_Loadgen_f
+
+sv_loadgen <clients> [seconds] [cmdrate] [quit]
+sv_loadgen stop
+
+Seconds are counted once everyone is in, 0 runs until stopped.  With
+quit the server exits after the report.  Given before a map it starts
+once the map is up, so a whole run fits on the command line:
+q2ded +sv_loadgen 32 60 30 quit +map q2dm1
+==================
+*/
+void SV_Loadgen_f (void)
+{
+	int			i;
+
+	if (Cmd_Argc() < 2)
+	{
+		Com_Printf ("usage: sv_loadgen <clients> [seconds] [cmdrate] [quit]\n"
+					"       sv_loadgen stop\n");
+		if (sv_loadgen.active)
+			SV_LoadgenReport ();
+		return;
+	}
+
+	if (!Q_stricmp (Cmd_Argv(1), "stop"))
+	{
+		if (sv_loadgen.active)
+			SV_StopLoadgen ();
+		else if (sv_loadgen.pending)
+			memset (&sv_loadgen, 0, sizeof(sv_loadgen));
+		else
+			Com_Printf ("The load generator isn't running.\n");
+		return;
+	}
+
+	if (sv_loadgen.pending || sv_loadgen.clients)
+	{
+		Com_Printf ("The load generator is already running.\n");
+		return;
+	}
+
+	sv_loadgen.numclients = atoi (Cmd_Argv(1));
+	if (sv_loadgen.numclients < 1)
+		sv_loadgen.numclients = 1;
+	sv_loadgen.seconds = (Cmd_Argc() > 2) ? atoi (Cmd_Argv(2)) : 60;
+	if (sv_loadgen.seconds < 0)
+		sv_loadgen.seconds = 0;
+	i = (Cmd_Argc() > 3) ? atoi (Cmd_Argv(3)) : 30;
+	i = (i < 5) ? 5 : (i > 125) ? 125 : i;
+	sv_loadgen.cmdmsec = 1000 / i;
+	sv_loadgen.quit = (Cmd_Argc() > 4 && !Q_stricmp (Cmd_Argv(4), "quit"));
+
+	if (sv.state == ss_game)
+		SV_StartLoadgen ();
+	else
+	{
+		sv_loadgen.pending = true;
+		Com_Printf ("loadgen: waiting for a map\n");
+	}
+}
@@ -67,6 +67,25 @@ cvar_t		*sv_filter_wallfly_ip;
 
 cvar_t		*sv_getspace_overflow_hack; /* FS: Bullshit hack for coop mod. */
 
+cvar_t		*sv_threads;
+cvar_t		*sv_profile;
+cvar_t		*sv_profile_csv;
+cvar_t		*sv_profile_interval;
+cvar_t		*sv_deltacache;
+cvar_t		*sv_ratecull;
+cvar_t		*sv_compress;
+cvar_t		*sv_download_window;
+cvar_t		*sv_oob_limit;
+cvar_t		*sv_preload;
+cvar_t		*sv_demobuffer;
+cvar_t		*sv_demodelta;
+cvar_t		*sv_relay_password;
+cvar_t		*sv_maxrelays;
+cvar_t		*sv_fps;
+cvar_t		*sv_antilag;
+cvar_t		*sv_projectiles;
+cvar_t		*sv_areatree;
+
 extern	int num_sz_getspace_overflows;
 
 void Master_Shutdown (void);
@@ -89,18 +108,14 @@ void SV_DropClient (client_t *drop)
 	// add the disconnect
 	MSG_WriteByte (&drop->netchan.message, svc_disconnect);
 
-	if (drop->state == cs_spawned)
+	if (drop->state == cs_spawned && !drop->relay)
 	{
 		// call the prog function for removing a client
 		// this will remove the body, among other things
 		ge->ClientDisconnect (drop->edict);
 	}
 
-	if (drop->download)
-	{
-		FS_FreeFile (drop->download);
-		drop->download = NULL;
-	}
+	SV_CloseDownload (drop);
 
 	// r1ch: fix for mods that don't clean score
 	if (drop->edict && drop->edict->client)
@@ -108,8 +123,114 @@ void SV_DropClient (client_t *drop)
 
 	drop->state = cs_zombie;                // become free in a few seconds
 	drop->name[0] = 0;
+	SV_InvalidateStatus ();
+}
+
+
+/*
+=====================
+SV_AdrHash
+
+Hashes the base address, the port can change under a client.
+Callers mask it down to their table size.
+=====================
+*/
+unsigned SV_AdrHash (netadr_t *adr)
+{
+	unsigned	h;
+	int			i;
+
+	h = 0;
+	if (adr->type == NA_IP)
+	{
+		for (i=0 ; i<4 ; i++)
+			h = h*31 + adr->ip[i];
+	}
+	else if (adr->type == NA_IPX)
+	{
+		for (i=0 ; i<10 ; i++)
+			h = h*31 + adr->ipx[i];
+	}
+
+	return h ^ (h >> 8) ^ (h >> 16);
+}
+
+/*
+=====================
+SV_LinkClientAdr
+
+Adds a client to the address hashes, once its netchan is set up
+=====================
+*/
+void SV_LinkClientAdr (client_t *cl)
+{
+	int		h;
+
+	h = SV_AdrHash (&cl->netchan.remote_address) & (CLIENT_HASH_SIZE-1);
+	cl->ipnext = svs.iphash[h];
+	svs.iphash[h] = cl;
+
+	h = (h ^ cl->netchan.qport) & (CLIENT_HASH_SIZE-1);
+	cl->adrnext = svs.adrhash[h];
+	svs.adrhash[h] = cl;
+}
+
+/*
+=====================
+SV_UnlinkClientAdr
+
+Takes a client out of the address hashes before its slot is reused
+=====================
+*/
+void SV_UnlinkClientAdr (client_t *cl)
+{
+	client_t	**link;
+	int			h;
+
+	h = SV_AdrHash (&cl->netchan.remote_address) & (CLIENT_HASH_SIZE-1);
+	for (link = &svs.iphash[h] ; *link ; link = &(*link)->ipnext)
+	{
+		if (*link == cl)
+		{
+			*link = cl->ipnext;
+			break;
+		}
+	}
+
+	h = (h ^ cl->netchan.qport) & (CLIENT_HASH_SIZE-1);
+	for (link = &svs.adrhash[h] ; *link ; link = &(*link)->adrnext)
+	{
+		if (*link == cl)
+		{
+			*link = cl->adrnext;
+			break;
+		}
+	}
+
+	cl->ipnext = cl->adrnext = NULL;
 }
 
+/*
+=====================
+SV_FindClient
+
+The client a sequenced packet from adr with qport belongs to
+=====================
+*/
+client_t *SV_FindClient (netadr_t *adr, int qport)
+{
+	client_t	*cl;
+
+	for (cl = svs.adrhash[(SV_AdrHash (adr) ^ qport) & (CLIENT_HASH_SIZE-1)] ; cl ; cl = cl->adrnext)
+	{
+		if (cl->state == cs_free)
+			continue;
+		if (cl->netchan.qport == qport && NET_CompareBaseAdr (*adr, cl->netchan.remote_address))
+			return cl;
+	}
+
+	return NULL;
+}
 
 //Knightmare added
 /*
@@ -121,20 +242,16 @@ Given an netadr_t, returns the matching client.
 */
 client_t *GetClientFromAdr (netadr_t address)
 {
-	client_t        *cl = NULL; /* FS: Compiler warning */
-	int                     i;
-	qboolean        found = false;
+	client_t        *cl;
 
-	for (i = 0; i < maxclients->value; i++)
+	for (cl = svs.iphash[SV_AdrHash (&address) & (CLIENT_HASH_SIZE-1)] ; cl ; cl = cl->ipnext)
 	{
-		cl = &svs.clients[i];
-		if (NET_CompareBaseAdr(cl->netchan.remote_address, address)) {
-			found = true; break; }
+		if (NET_CompareBaseAdr(cl->netchan.remote_address, address))
+			return cl;
 	}
-	if (found)
-		return cl;
-	else // don't return non-matching client
-		return NULL;
+
+	// don't return non-matching client
+	return NULL;
 }
 
 
@@ -187,11 +304,217 @@ r1ch: this does the final cleaning up of a client after zombie state.
 */
 void SV_CleanClient (client_t *drop)
 {
-	if (drop->download)
+	SV_CloseDownload (drop);
+}
+
+/*
+==============================================================================
+
+CONNECTIONLESS COMMANDS
+
+==============================================================================
+*/
+
+/*
+==============================================================================
+
+CONNECTIONLESS FLOOD PROTECTION
+
+Each source address gets a token bucket per class of command, and
+each class has a cap for all addresses together.  Addresses live in
+a small set associative table, the least recently seen one in a set
+makes room for a new one.
+
+==============================================================================
+*/
+
+typedef enum
+{
+	OOB_PING,			// ping, ack
+	OOB_STATUS,			// status, info
+	OOB_CONNECT,		// getchallenge, connect
+	OOB_RCON,
+	OOB_OTHER,			// anything we don't know
+
+	OOB_NUMCLASSES
+} oobclass_t;
+
+typedef struct
+{
+	char	*name;
+	int		rate;				// packets a second from one address
+	int		burst;
+	int		globalrate;			// packets a second from everyone
+} oobrule_t;
+
+static const oobrule_t	sv_oobrules[OOB_NUMCLASSES] =
+{
+	{"ping",	4,	8,	400},
+	{"status",	2,	6,	200},
+	{"connect",	2,	6,	100},
+	{"rcon",	2,	4,	50},
+	{"other",	1,	4,	50}
+};
+
+#define	OOB_SETS		512
+#define	OOB_WAYS		4
+
+typedef struct
+{
+	netadr_t	adr;
+	int			time;						// svs.realtime the tokens were topped up
+	int			tokens[OOB_NUMCLASSES];		// 1000 per packet
+} oobsource_t;
+
+typedef struct
+{
+	oobsource_t	sources[OOB_SETS][OOB_WAYS];
+	int			globaltime;
+	int			globaltokens[OOB_NUMCLASSES];
+	int			passed[OOB_NUMCLASSES];
+	int			dropped[OOB_NUMCLASSES];		// over the address's budget
+	int			capped[OOB_NUMCLASSES];			// over the global budget
+	int			evictions;
+} oobfilter_t;
+
+oobfilter_t	sv_oob;
+
+/*
+=================
+SV_OOBSource
+
+Finds or makes the table entry for an address
+=================
+*/
+oobsource_t *SV_OOBSource (netadr_t *adr)
+{
+	oobsource_t	*set, *oldest;
+	int			i;
+
+	set = sv_oob.sources[SV_AdrHash (adr) & (OOB_SETS-1)];
+	oldest = set;
+	for (i=0 ; i<OOB_WAYS ; i++)
+	{
+		if (set[i].time && NET_CompareBaseAdr (*adr, set[i].adr))
+			return &set[i];
+		if (set[i].time < oldest->time)
+			oldest = &set[i];
+	}
+
+	if (oldest->time)
+		sv_oob.evictions++;
+
+	// a new address starts with full buckets
+	oldest->adr = *adr;
+	oldest->time = svs.realtime ? svs.realtime : 1;
+	for (i=0 ; i<OOB_NUMCLASSES ; i++)
+		oldest->tokens[i] = sv_oobrules[i].burst * 1000;
+	return oldest;
+}
+
+/*
+=================
+SV_OOBRefill
+
+Tops up a set of buckets for the time since the last refill
+=================
+*/
+void SV_OOBRefill (int *tokens, int *time, qboolean global)
+{
+	int		i, msec, limit;
+
+	msec = svs.realtime - *time;
+	if (msec < 0 || msec > 10000)
+		msec = 10000;
+	*time = svs.realtime ? svs.realtime : 1;
+
+	for (i=0 ; i<OOB_NUMCLASSES ; i++)
+	{
+		if (global)
+		{
+			tokens[i] += sv_oobrules[i].globalrate * msec;
+			limit = sv_oobrules[i].globalrate * 1000;
+		}
+		else
+		{
+			tokens[i] += sv_oobrules[i].rate * msec;
+			limit = sv_oobrules[i].burst * 1000;
+		}
+		if (tokens[i] > limit)
+			tokens[i] = limit;
+	}
+}
+
+/*
+=================
+SV_AllowConnectionless
+
+Takes a packet's worth from the sender's and the global bucket for
+the class, returns false if either was empty
+=================
+*/
+qboolean SV_AllowConnectionless (oobclass_t c)
+{
+	oobsource_t	*src;
+
+	if (!sv_oob_limit->intValue || NET_IsLocalAddress (net_from))
 	{
-		Z_Free (drop->download);
-		drop->download = NULL;
+		sv_oob.passed[c]++;
+		return true;
 	}
+
+	src = SV_OOBSource (&net_from);
+	SV_OOBRefill (src->tokens, &src->time, false);
+	if (src->tokens[c] < 1000)
+	{
+		sv_oob.dropped[c]++;
+		return false;
+	}
+
+	SV_OOBRefill (sv_oob.globaltokens, &sv_oob.globaltime, true);
+	if (sv_oob.globaltokens[c] < 1000)
+	{
+		sv_oob.capped[c]++;
+		return false;
+	}
+
+	src->tokens[c] -= 1000;
+	sv_oob.globaltokens[c] -= 1000;
+	sv_oob.passed[c]++;
+	return true;
+}
+
+/*
+=================
+SV_OOBStats_f
+
+Shows what the connectionless flood protection let through
+=================
+*/
+void SV_OOBStats_f (void)
+{
+	int		i;
+
+	if (Cmd_Argc() > 1 && !Q_stricmp (Cmd_Argv(1), "reset"))
+	{
+		memset (sv_oob.passed, 0, sizeof(sv_oob.passed));
+		memset (sv_oob.dropped, 0, sizeof(sv_oob.dropped));
+		memset (sv_oob.capped, 0, sizeof(sv_oob.capped));
+		sv_oob.evictions = 0;
+		return;
+	}
+
+	Com_Printf ("class      passed  dropped   capped  rate/burst/global\n");
+	Com_Printf ("-------- -------- -------- --------  -----------------\n");
+	for (i=0 ; i<OOB_NUMCLASSES ; i++)
+	{
+		Com_Printf ("%-8s %8i %8i %8i  %i/%i/%i\n", sv_oobrules[i].name,
+			sv_oob.passed[i], sv_oob.dropped[i], sv_oob.capped[i],
+			sv_oobrules[i].rate, sv_oobrules[i].burst, sv_oobrules[i].globalrate);
+	}
+	Com_Printf ("%i addresses pushed out of the table\n", sv_oob.evictions);
+	if (!sv_oob_limit->intValue)
+		Com_Printf ("sv_oob_limit is 0, nothing is being dropped\n");
 }
 
 /*
@@ -202,17 +525,36 @@ CONNECTIONLESS COMMANDS
 ==============================================================================
 */
 
+#define	STATUS_CACHE_MSEC	1000	// frags and pings may be this old
+
+char	sv_statuscache[MAX_MSGLEN - 16];
+int		sv_statustime;				// svs.realtime it was built, 0 when stale
+char	sv_infocache[64];
+qboolean	sv_infovalid;
+
 /*
 ===============
-SV_StatusString
+SV_InvalidateStatus
 
-Builds the string that is sent as heartbeats and status replies
+Something in the status and info replies changed
 ===============
 */
-char	*SV_StatusString (void)
+void SV_InvalidateStatus (void)
+{
+	sv_statustime = 0;
+	sv_infovalid = false;
+}
+
+/*
+===============
+SV_BuildStatusString
+
+Builds the serverinfo and player list
+===============
+*/
+void SV_BuildStatusString (char *status, int size)
 {
 	char	player[1024];
-	static char	status[MAX_MSGLEN - 16];
 	int		i;
 	client_t	*cl;
 	int		statusLength;
@@ -220,34 +562,57 @@ char	*SV_StatusString (void)
 
 //	strncpy (status, Cvar_Serverinfo());
 //	strncat (status, "\n");
-	Q_strncpyz (status, Cvar_Serverinfo(), sizeof(status));
+	Q_strncpyz (status, Cvar_Serverinfo(), size);
 
 	/* FS: Output uptime to info packets */
-	Q_strncatz (status, "\\uptime\\", sizeof(status));
+	Q_strncatz (status, "\\uptime\\", size);
 	SV_GetUptime();
-	Q_strncatz (status, uptime_infostring, sizeof(status));
+	Q_strncatz (status, uptime_infostring, size);
 	/* FS: End */
 
-	Q_strncatz (status, "\n", sizeof(status));
+	Q_strncatz (status, "\n", size);
 	statusLength = strlen(status);
 
 	for (i=0 ; i<maxclients->value ; i++)
 	{
 		cl = &svs.clients[i];
-		if (cl->state == cs_connected || cl->state == cs_spawned )
+		if ((cl->state == cs_connected || cl->state == cs_spawned) && !cl->relay)
 		{
 			Com_sprintf (player, sizeof(player), "%i %i \"%s\"\n", 
 				cl->edict->client->ps.stats[STAT_FRAGS], cl->ping, cl->name);
 			playerLength = strlen(player);
-			if (statusLength + playerLength >= sizeof(status) )
+			if (statusLength + playerLength >= size )
 				break;		// can't hold any more
 		//	strncpy (status + statusLength, player);
-			Q_strncpyz (status + statusLength, player, sizeof(status));
+			Q_strncpyz (status + statusLength, player, size - statusLength);
 			statusLength += playerLength;
 		}
 	}
+}
+
+/*
+===============
+SV_StatusString
+
+Returns the string that is sent as heartbeats and status replies,
+rebuilding it if it has gone stale
+===============
+*/
+char	*SV_StatusString (void)
+{
+	if (serverinfo_modified)
+	{
+		serverinfo_modified = false;
+		SV_InvalidateStatus ();
+	}
+
+	if (!sv_statustime || svs.realtime - sv_statustime >= STATUS_CACHE_MSEC || svs.realtime < sv_statustime)
+	{
+		SV_BuildStatusString (sv_statuscache, sizeof(sv_statuscache));
+		sv_statustime = svs.realtime ? svs.realtime : 1;
+	}
 
-	return status;
+	return sv_statuscache;
 }
 
 /*
@@ -288,7 +653,6 @@ The second parameter should be the current protocol version number.
 */
 void SVC_Info (void)
 {
-	char	string[64];
 	char	hostname_string[17];
 	char	mapname_string[9];
 	int		i, count;
@@ -304,22 +668,30 @@ void SVC_Info (void)
 	//	Com_sprintf (string, sizeof(string), "%s: wrong version\n", hostname->string, sizeof(string));
 		return;
 	}
-	else
+
+	if (serverinfo_modified)
+	{
+		serverinfo_modified = false;
+		SV_InvalidateStatus ();
+	}
+
+	if (!sv_infovalid)
 	{
 		count = 0;
 		for (i=0 ; i<maxclients->value ; i++)
-			if (svs.clients[i].state >= cs_connected)
+			if (svs.clients[i].state >= cs_connected && !svs.clients[i].relay)
 				count++;
 
 		/* FS: This can overflow if the hostname or mapname is long and makes string go over 64 chars.  So copy it and truncate it */
-		strncpy(hostname_string, hostname->string, sizeof(hostname_string)-1);
+		Q_strncpyz(hostname_string, hostname->string, sizeof(hostname_string));
 
-		strncpy(mapname_string, sv.name, sizeof(mapname_string)-1);
+		Q_strncpyz(mapname_string, sv.name, sizeof(mapname_string));
 
-		Com_sprintf (string, sizeof(string), "%16s %8s %2i/%2i\n", hostname_string, mapname_string, count, (int)maxclients->value);
+		Com_sprintf (sv_infocache, sizeof(sv_infocache), "%16s %8s %2i/%2i\n", hostname_string, mapname_string, count, (int)maxclients->value);
+		sv_infovalid = true;
 	}
 
-	Netchan_OutOfBandPrint (NS_SERVER, net_from, "info\n%s", string);
+	Netchan_OutOfBandPrint (NS_SERVER, net_from, "info\n%s", sv_infocache);
 }
 
 /*
@@ -400,6 +772,11 @@ void SVC_DirectConnect (void)
 	int			qport;
 	int			challenge;
 	int			previousclients;	// rich: connection limit per IP
+	int			caps;
+	qboolean	fragment;
+	qboolean	relay;
+	int			relays;
+	char		reply[MAX_INFO_STRING];
 
 	adr = net_from;
 
@@ -419,7 +796,7 @@ void SVC_DirectConnect (void)
 
 	// r1ch: limit connections from a single IP
 	previousclients = 0;
-	for (i=0,cl=svs.clients; i<(int)maxclients->value; i++,cl++)
+	for (cl = svs.iphash[SV_AdrHash (&adr) & (CLIENT_HASH_SIZE-1)] ; cl ; cl = cl->ipnext)
 	{
 		if (cl->state == cs_free)
 			continue;
@@ -477,11 +854,38 @@ void SVC_DirectConnect (void)
 		}
 	}
 
+	// relays are let in on a password and never reach the game
+	caps = (Cmd_Argc() > 5) ? atoi(Cmd_Argv(5)) : 0;
+	relay = ((caps & NETCAPS_RELAY) != 0);
+	if (relay)
+	{
+		if (!sv_relay_password->string[0] || strcmp (Info_ValueForKey (userinfo, "relay"), sv_relay_password->string)
+			|| !(caps & NETCAPS_FRAGMENT))
+		{
+			Netchan_OutOfBandPrint (NS_SERVER, adr, "print\nRelay refused.\n");
+			Com_DPrintf(DEVELOPER_MSG_SERVER, "    bad relay password\n");
+			return;
+		}
+		Info_RemoveKey (userinfo, "relay");
+
+		relays = 0;
+		for (i=0,cl=svs.clients ; i<maxclients->intValue ; i++,cl++)
+		{
+			if (cl->state != cs_free && cl->relay && !NET_CompareAdr (adr, cl->netchan.remote_address))
+				relays++;
+		}
+		if (relays >= sv_maxrelays->intValue)
+		{
+			Netchan_OutOfBandPrint (NS_SERVER, adr, "print\nNo relay slots.\n");
+			return;
+		}
+	}
+
 	newcl = &temp;
 	memset (newcl, 0, sizeof(client_t));
 
 	// if there is already a slot for this ip, reuse it
-	for (i=0,cl=svs.clients ; i<maxclients->value ; i++,cl++)
+	for (cl = svs.iphash[SV_AdrHash (&adr) & (CLIENT_HASH_SIZE-1)] ; cl ; cl = cl->ipnext)
 	{
 		if (cl->state == cs_free)
 			continue;
@@ -534,15 +938,17 @@ gotnewcl:
 	// build a new connection
 	// accept the new client
 	// this is the only place a client_t is ever initialized
+	SV_UnlinkClientAdr (newcl);
 	*newcl = temp;
 	sv_client = newcl;
 	edictnum = (newcl-svs.clients)+1;
 	ent = EDICT_NUM(edictnum);
 	newcl->edict = ent;
 	newcl->challenge = challenge; // save challenge for checksumming
+	newcl->relay = relay;
 
 	// get the game a chance to reject this connection or modify the userinfo
-	if (!(ge->ClientConnect (ent, userinfo)))
+	if (!relay && !(ge->ClientConnect (ent, userinfo)))
 	{
 		if (*Info_ValueForKey (userinfo, "rejmsg")) 
 			Netchan_OutOfBandPrint (NS_SERVER, adr, "print\n%s\nConnection refused.\n",  
@@ -557,20 +963,33 @@ gotnewcl:
 	strncpy (newcl->userinfo, userinfo, sizeof(newcl->userinfo)-1);
 	SV_UserinfoChanged (newcl);
 
+	// only split or compress packets for clients that said they can take them,
+	// a whole world doesn't fit in one packet so relays always get them split
+	fragment = ((caps & NETCAPS_FRAGMENT) && (net_fragment->intValue || relay));
+	newcl->compress = ((caps & NETCAPS_ZPACKET) && sv_compress->intValue);
+	newcl->dlwindow = ((caps & NETCAPS_DLWINDOW) && sv_download_window->intValue > 0);
+	newcl->tickrate = ((caps & NETCAPS_TICKRATE) != 0);
+	newcl->projectiles = ((caps & NETCAPS_PROJECTILES) && sv_projectiles->intValue);
+
 	// r1: note we could ideally send this twice but it prints unsightly message on original client.
+	Q_strncpyz (reply, "client_connect", sizeof(reply));
 	if (sv_downloadserver->string[0])
-		Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect dlserver=%s", sv_downloadserver->string);
-	else
-		Netchan_OutOfBandPrint (NS_SERVER, adr, "client_connect");
+		Q_strncatz (reply, va(" dlserver=%s", sv_downloadserver->string), sizeof(reply));
+	if (fragment)
+		Q_strncatz (reply, " fragment=1", sizeof(reply));
+	Netchan_OutOfBandPrint (NS_SERVER, adr, "%s", reply);
 
 	Netchan_Setup (NS_SERVER, &newcl->netchan , adr, qport);
+	SV_LinkClientAdr (newcl);
+	newcl->netchan.fragment = fragment;
 
 	newcl->state = cs_connected;
+	SV_InvalidateStatus ();
 
 	SZ_Init (&newcl->datagram, newcl->datagram_buf, sizeof(newcl->datagram_buf) );
 	if ((maxclients->intValue > 1) && !(newcl->netchan.remote_address.type == NA_LOOPBACK)) /* FS: Enforce a 1400 MTU size for datagram packets. */
 	{
-		newcl->datagram.maxsize = MAX_MSGLEN_MP; /* FS: MAX_MSGLEN is now for single player */
+		newcl->datagram.maxsize = SV_DatagramLimit (newcl); /* FS: MAX_MSGLEN is now for single player */
 	}
 	newcl->datagram.allowoverflow = true;
 	newcl->lastmessage = svs.realtime;	// don't timeout
@@ -723,20 +1142,41 @@ void SV_ConnectionlessPacket (void)
 	Com_DPrintf(DEVELOPER_MSG_SERVER, "Packet %s : %s\n", NET_AdrToString(net_from), c);
 
 	if (!strcmp(c, "ping"))
-		SVC_Ping ();
+	{
+		if (SV_AllowConnectionless (OOB_PING))
+			SVC_Ping ();
+	}
 	else if (!strcmp(c, "ack"))
-		SVC_Ack ();
+	{
+		if (SV_AllowConnectionless (OOB_PING))
+			SVC_Ack ();
+	}
 	else if (!strcmp(c,"status"))
-		SVC_Status ();
+	{
+		if (SV_AllowConnectionless (OOB_STATUS))
+			SVC_Status ();
+	}
 	else if (!strcmp(c,"info"))
-		SVC_Info ();
+	{
+		if (SV_AllowConnectionless (OOB_STATUS))
+			SVC_Info ();
+	}
 	else if (!strcmp(c,"getchallenge"))
-		SVC_GetChallenge ();
+	{
+		if (SV_AllowConnectionless (OOB_CONNECT))
+			SVC_GetChallenge ();
+	}
 	else if (!strcmp(c,"connect"))
-		SVC_DirectConnect ();
+	{
+		if (SV_AllowConnectionless (OOB_CONNECT))
+			SVC_DirectConnect ();
+	}
 	else if (!strcmp(c, "rcon"))
-		SVC_RemoteCommand ();
-	else
+	{
+		if (SV_AllowConnectionless (OOB_RCON))
+			SVC_RemoteCommand ();
+	}
+	else if (SV_AllowConnectionless (OOB_OTHER))
 		Com_Printf ("bad connectionless packet from %s:\n%s\n"
 		, NET_AdrToString (net_from), s);
 }
@@ -808,7 +1248,7 @@ void SV_GiveMsec (void)
 	int			i;
 	client_t	*cl;
 
-	if (sv.framenum & 15)
+	if (sv.framenum % (16*sv.framediv))
 		return;
 
 	for (i=0 ; i<maxclients->value ; i++)
@@ -829,12 +1269,18 @@ SV_ReadPackets
 */
 void SV_ReadPackets (void)
 {
-	int			i;
 	client_t	*cl;
 	int			qport;
 
-	while (NET_GetPacket (NS_SERVER, &net_from, &net_message))
+	SV_RunLoadgen ();
+
+	while (NET_GetPacket (NS_SERVER, &net_from, &net_message)
+		|| SV_LoadgenPacket (&net_from, &net_message))
 	{
+		// the server a relay is fed from isn't a client
+		if (SV_RelayPacket ())
+			continue;
+
 		// check for connectionless packet (0xffffffff) first
 		if (*(int *)net_message.data == -1)
 		{
@@ -850,14 +1296,9 @@ void SV_ReadPackets (void)
 		qport = MSG_ReadShort (&net_message) & 0xffff;
 
 		// check for packets from connected clients
-		for (i=0, cl=svs.clients ; i<maxclients->value ; i++,cl++)
+		cl = SV_FindClient (&net_from, qport);
+		if (cl)
 		{
-			if (cl->state == cs_free)
-				continue;
-			if (!NET_CompareBaseAdr (net_from, cl->netchan.remote_address))
-				continue;
-			if (cl->netchan.qport != qport)
-				continue;
 			if (cl->netchan.remote_address.port != net_from.port)
 			{
 				Com_Printf ("SV_ReadPackets: fixing up a translated port\n");
@@ -872,11 +1313,7 @@ void SV_ReadPackets (void)
 					SV_ExecuteClientMessage (cl);
 				}
 			}
-			break;
 		}
-		
-		if (i != maxclients->intValue)
-			continue;
 	}
 }
 
@@ -918,7 +1355,7 @@ void SV_CheckTimeouts (void)
 		}
 
 		/* FS: From R1Q2.  Kick excessive idlers */
-		if (cl->state == cs_spawned && dedicated->intValue)
+		if (cl->state == cs_spawned && dedicated->intValue && !cl->relay)
 		{
 			if ((Q_stricmp(cl->name, "WallFly[BZZZ]") != 0) && (Q_stricmp(sv_filter_wallfly_ip->string, NET_AdrToString(cl->netchan.remote_address)) != 0))
 			{
@@ -953,16 +1390,31 @@ SV_PrepWorldFrame
 
 This has to be done before the world logic, because
 player processing happens outside RunWorldFrame
+
+Events are held in sv.events for the 10 Hz clients until
+the frame they are sent.  They go out with the entity, so one
+whose entity isn't sent to a client in that frame, because it
+is out of view or has gone, is dropped for that client just
+as it always was.  A freed slot loses its held event here, a
+slot spawned again loses it on its first SV_LinkEdict.
 ================
 */
 void SV_PrepWorldFrame (void)
 {
 	edict_t	*ent;
 	int		i;
+	qboolean	sent;
+
+	sent = !(sv.framenum % sv.framediv);
 
 	for (i=0 ; i<ge->num_edicts ; i++, ent++)
 	{
 		ent = EDICT_NUM(i);
+		if (sent || !ent->inuse)
+			sv.events[i] = 0;
+		else if (ent->s.event)
+			sv.events[i] = ent->s.event;
+
 		// events only last for a single message
 		ent->s.event = 0;
 	}
@@ -985,12 +1437,13 @@ void SV_RunGameFrame (void)
 	// compression can get confused when a client
 	// has the "current" frame
 	sv.framenum++;
-	sv.time = sv.framenum*100;
+	sv.time = sv.framenum*sv.frametime;
 
 	// don't run if paused
 	if (!sv_paused->intValue || maxclients->intValue > 1)
 	{
 		ge->RunFrame ();
+		SV_RecordAntilag ();
 
 		// never get more than one tic behind
 		if (sv.time < svs.realtime)
@@ -1005,6 +1458,285 @@ void SV_RunGameFrame (void)
 		time_after_game = Sys_Milliseconds ();
 }
 
+/*
+==============================================================================
+
+SERVER FRAME PROFILING
+
+Microsecond timings of the phases of SV_Frame, kept for the last
+PROF_SAMPLES server frames.  Time spent in the SV_Frame calls that
+only read packets while waiting for the next frame is added to the
+frame that follows.
+
+==============================================================================
+*/
+
+typedef enum
+{
+	PROF_CHECKTIMEOUTS,
+	PROF_READPACKETS,
+	PROF_CALCPINGS,
+	PROF_RUNGAMEFRAME,
+	PROF_SENDCLIENTMESSAGES,
+	PROF_RECORDDEMOMESSAGE,
+	PROF_MASTERHEARTBEAT,
+	PROF_FRAME,					// all of the above and the rest of SV_Frame
+	PROF_NUMPHASES
+} profphase_t;
+
+#define	PROF_SAMPLES	1024
+
+static const char *prof_names[PROF_NUMPHASES] =
+{
+	"checktimeouts",
+	"readpackets",
+	"calcpings",
+	"rungameframe",
+	"sendclientmessages",
+	"recorddemomessage",
+	"masterheartbeat",
+	"frame"
+};
+
+typedef struct
+{
+	int		pending[PROF_NUMPHASES];	// usec since the last server frame
+	int		samples[PROF_NUMPHASES][PROF_SAMPLES];
+	int		projsaved[PROF_SAMPLES];	// bytes svc_projectiles saved each frame
+	int		count;						// frames recorded, the ring wraps
+	int		nextcsv;					// svs.realtime of the next csv line
+} svprofile_t;
+
+svprofile_t	sv_prof;
+
+/*
+==================
+SV_ProfilePhase
+
+Charges the time since *mark to phase and moves the mark on
+==================
+*/
+void SV_ProfilePhase (profphase_t phase, unsigned *mark)
+{
+	unsigned	now;
+
+	if (!sv_profile->intValue)
+		return;
+
+	now = Sys_Microseconds ();
+	sv_prof.pending[phase] += (int)(now - *mark);
+	*mark = now;
+}
+
+int SV_ProfileCompare (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+==================
+SV_ProfileSamplePercentiles
+
+Fills out p50, p95, p99 and max of a sample ring, returns the sample count
+==================
+*/
+int SV_ProfileSamplePercentiles (int *samples, int *out)
+{
+	static int	sorted[PROF_SAMPLES];
+	int			n;
+
+	n = sv_prof.count < PROF_SAMPLES ? sv_prof.count : PROF_SAMPLES;
+	if (!n)
+	{
+		out[0] = out[1] = out[2] = out[3] = 0;
+		return 0;
+	}
+
+	memcpy (sorted, samples, n * sizeof(int));
+	qsort (sorted, n, sizeof(int), SV_ProfileCompare);
+
+	out[0] = sorted[(n-1)*50/100];
+	out[1] = sorted[(n-1)*95/100];
+	out[2] = sorted[(n-1)*99/100];
+	out[3] = sorted[n-1];
+	return n;
+}
+
+/*
+==================
+SV_ProfilePercentiles
+
+Fills out p50, p95, p99 and max for a phase, returns the sample count
+==================
+*/
+int SV_ProfilePercentiles (profphase_t phase, int *out)
+{
+	return SV_ProfileSamplePercentiles (sv_prof.samples[phase], out);
+}
+
+/*
+==================
+SV_ProfileReset
+==================
+*/
+void SV_ProfileReset (void)
+{
+	memset (&sv_prof, 0, sizeof(sv_prof));
+}
+
+/*
+==================
+SV_ProfileSummary
+
+The frame, game and send percentiles and the svc_projectiles
+savings, for sv_loadgen's report
+==================
+*/
+void SV_ProfileSummary (void)
+{
+	int		n, p[4];
+
+	n = SV_ProfilePercentiles (PROF_FRAME, p);
+	Com_Printf ("usec over the last %i server frames   p50     p95     p99     max\n", n);
+	Com_Printf ("%-18s                 %6i  %6i  %6i  %6i\n", prof_names[PROF_FRAME], p[0], p[1], p[2], p[3]);
+	SV_ProfilePercentiles (PROF_RUNGAMEFRAME, p);
+	Com_Printf ("%-18s                 %6i  %6i  %6i  %6i\n", prof_names[PROF_RUNGAMEFRAME], p[0], p[1], p[2], p[3]);
+	SV_ProfilePercentiles (PROF_SENDCLIENTMESSAGES, p);
+	Com_Printf ("%-18s                 %6i  %6i  %6i  %6i\n", prof_names[PROF_SENDCLIENTMESSAGES], p[0], p[1], p[2], p[3]);
+	SV_ProfileSamplePercentiles (sv_prof.projsaved, p);
+	Com_Printf ("%-18s                 %6i  %6i  %6i  %6i\n", "projectile saved", p[0], p[1], p[2], p[3]);
+}
+
+/*
+==================
+SV_ProfileWriteCSV
+
+Appends one line per phase to sv_profile_csv in the game directory
+==================
+*/
+void SV_ProfileWriteCSV (void)
+{
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i, n, p[4];
+	int		clients;
+	client_t	*cl;
+
+	// it can be set over rcon, so keep it to a plain file in the game directory
+	if (strstr(sv_profile_csv->string, "..") || strchr(sv_profile_csv->string, '/') ||
+		strchr(sv_profile_csv->string, '\\') || strchr(sv_profile_csv->string, ':'))
+	{
+		Com_Printf ("SV_ProfileWriteCSV: illegal filename %s\n", sv_profile_csv->string);
+		Cvar_Set ("sv_profile_csv", "");
+		return;
+	}
+
+	Com_sprintf (name, sizeof(name), "%s/%s", FS_Gamedir(), sv_profile_csv->string);
+	f = fopen (name, "a");
+	if (!f)
+	{
+		Com_Printf ("SV_ProfileWriteCSV: couldn't open %s\n", name);
+		Cvar_Set ("sv_profile_csv", "");
+		return;
+	}
+
+	clients = 0;
+	for (i=0, cl=svs.clients ; i<maxclients->intValue ; i++, cl++)
+	{
+		if (cl->state >= cs_connected)
+			clients++;
+	}
+
+	fseek (f, 0, SEEK_END);
+	if (!ftell (f))
+		fprintf (f, "time,map,clients,phase,frames,p50,p95,p99,max\n");
+
+	for (i=0 ; i<PROF_NUMPHASES ; i++)
+	{
+		n = SV_ProfilePercentiles (i, p);
+		fprintf (f, "%i,%s,%i,%s,%i,%i,%i,%i,%i\n", (int)time(NULL), sv.name,
+			clients, prof_names[i], n, p[0], p[1], p[2], p[3]);
+	}
+	fclose (f);
+}
+
+/*
+==================
+SV_ProfileEndFrame
+
+Files the pending times as one server frame
+==================
+*/
+void SV_ProfileEndFrame (void)
+{
+	int		i, slot;
+	client_t	*cl;
+
+	if (!sv_profile->intValue)
+		return;
+
+	slot = sv_prof.count % PROF_SAMPLES;
+	for (i=0 ; i<PROF_NUMPHASES ; i++)
+	{
+		sv_prof.samples[i][slot] = sv_prof.pending[i];
+		sv_prof.pending[i] = 0;
+	}
+
+	sv_prof.projsaved[slot] = 0;
+	for (i=0, cl=svs.clients ; i<maxclients->intValue ; i++, cl++)
+	{
+		sv_prof.projsaved[slot] += cl->projsaved;
+		cl->projsaved = 0;
+	}
+	sv_prof.count++;
+
+	if (sv_profile_csv->string[0] && svs.realtime >= sv_prof.nextcsv)
+	{
+		if (sv_prof.nextcsv)
+			SV_ProfileWriteCSV ();
+		sv_prof.nextcsv = svs.realtime + (int)(sv_profile_interval->value * 1000);
+	}
+}
+
+/*
+==================
+SV_Profile_f
+
+sv_profilereport [reset]
+Goes through rcon like any other server command.
+==================
+*/
+void SV_Profile_f (void)
+{
+	int		i, n, p[4];
+
+	if (!sv_profile->intValue)
+	{
+		Com_Printf ("Server profiling is off, set sv_profile 1.\n");
+		return;
+	}
+
+	n = SV_ProfilePercentiles (PROF_FRAME, p);
+	Com_Printf ("usec over the last %i server frames\n", n);
+	Com_Printf ("phase                   p50     p95     p99     max\n");
+	for (i=0 ; i<PROF_NUMPHASES ; i++)
+	{
+		SV_ProfilePercentiles (i, p);
+		Com_Printf ("%-18s  %6i  %6i  %6i  %6i\n", prof_names[i], p[0], p[1], p[2], p[3]);
+	}
+	SV_ProfileSamplePercentiles (sv_prof.projsaved, p);
+	Com_Printf ("bytes a frame svc_projectiles saved\n");
+	Com_Printf ("%-18s  %6i  %6i  %6i  %6i\n", "projectiles", p[0], p[1], p[2], p[3]);
+
+	if (Cmd_Argc() > 1 && !Q_stricmp (Cmd_Argv(1), "reset"))
+	{
+		SV_ProfileReset ();
+		Com_Printf ("Profile reset.\n");
+	}
+}
+
+//============================================================================
+
 /*
 ==================
 SV_Frame
@@ -1013,12 +1745,19 @@ SV_Frame
 */
 void SV_Frame (int msec)
 {
+	unsigned	start, mark;
+
 	time_before_game = time_after_game = 0;
 
+	// a relay keeps its server connection going even without a map
+	SV_RunRelay ();
+
 	// if server is not active, do nothing
 	if (!svs.initialized)
 		return;
 
+	start = mark = Sys_Microseconds ();
+
     svs.realtime += msec;
 
 	// keep the random time dependent
@@ -1026,46 +1765,58 @@ void SV_Frame (int msec)
 
 	// check timeouts
 	SV_CheckTimeouts ();
+	SV_ProfilePhase (PROF_CHECKTIMEOUTS, &mark);
 
 	// get packets from clients
 	SV_ReadPackets ();
+	SV_ProfilePhase (PROF_READPACKETS, &mark);
 
 	// move autonomous things around if enough time has passed
 	if ((!sv_timedemo->intValue && svs.realtime < sv.time) ||
 		(sv.state != ss_demo && svs.realtime < sv.time) ) /* FS: timedemo only in demos, please */
 	{
 		// never let the time get too far off
-		if (sv.time - svs.realtime > 100)
+		if (sv.time - svs.realtime > sv.frametime)
 		{
 			if (sv_showclamp->intValue)
 				Com_Printf ("sv lowclamp\n");
-			svs.realtime = sv.time - 100;
+			svs.realtime = sv.time - sv.frametime;
 		}
+		SV_ProfilePhase (PROF_FRAME, &start);
 		NET_Sleep(sv.time - svs.realtime);
 		return;
 	}
 
 	// update ping based on the last known frame from all clients
 	SV_CalcPings ();
+	SV_ProfilePhase (PROF_CALCPINGS, &mark);
 
 	// give the clients some timeslices
 	SV_GiveMsec ();
 
 	// let everything in the world think and move
+	mark = Sys_Microseconds ();
 	SV_RunGameFrame ();
+	SV_ProfilePhase (PROF_RUNGAMEFRAME, &mark);
 
 	// send messages back to the clients that had packets read this frame
 	SV_SendClientMessages ();
+	SV_ProfilePhase (PROF_SENDCLIENTMESSAGES, &mark);
 
 	// save the entire world state if recording a serverdemo
 	SV_RecordDemoMessage ();
+	SV_ProfilePhase (PROF_RECORDDEMOMESSAGE, &mark);
 
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
+	SV_ProfilePhase (PROF_MASTERHEARTBEAT, &mark);
 
 	// clear teleport flags, etc for next frame
 	SV_PrepWorldFrame ();
 
+	SV_ProfilePhase (PROF_FRAME, &start);
+	SV_ProfileEndFrame ();
+
 	if (sv_getspace_overflow_hack->intValue && num_sz_getspace_overflows >= 1000)
 	{
 		num_sz_getspace_overflows = 0;
@@ -1165,7 +1916,9 @@ void SV_UserinfoChanged (client_t *cl)
 	int		i;
 
 	// call prog code to allow overrides
-	ge->ClientUserinfoChanged (cl->edict, cl->userinfo);
+	if (!cl->relay)
+		ge->ClientUserinfoChanged (cl->edict, cl->userinfo);
+	SV_InvalidateStatus ();
 	
 	// name for C code
 	strncpy (cl->name, Info_ValueForKey (cl->userinfo, "name"), sizeof(cl->name)-1);
@@ -1267,6 +2020,51 @@ void SV_Init (void)
 	sv_getspace_overflow_hack = Cvar_Get("sv_getspace_overflow_hack", "0", 0);
 	Cvar_SetDescription("sv_getspace_overflow_hack", "Reset map if stuck in SZ_GetSpace() overflow loop.  Resets after 1000 overflowed packets.\n");
 
+	sv_threads = Cvar_Get ("sv_threads", "0", 0);
+	Cvar_SetDescription("sv_threads", "Number of worker threads used to build and delta compress client frames.  Set to 0 to build them on the main thread.");
+
+	sv_deltacache = Cvar_Get ("sv_deltacache", "1", 0);
+	Cvar_SetDescription("sv_deltacache", "Reuse entity deltas encoded for one client when another client needs the same one.");
+
+	sv_ratecull = Cvar_Get ("sv_ratecull", "1", 0);
+	Cvar_SetDescription("sv_ratecull", "Fit each frame into the client's rate by holding back the least important entity updates, instead of skipping whole frames.");
+
+	sv_compress = Cvar_Get ("sv_compress", "1", 0);
+	Cvar_SetDescription("sv_compress", "Compress configstrings, baselines and downloads for clients that support it.");
+
+	sv_download_window = Cvar_Get ("sv_download_window", "16384", 0);
+	Cvar_SetDescription("sv_download_window", "Bytes of a download that may be in flight to clients that ack them as they arrive.  Set to 0 to send one piece per request.");
+
+	sv_oob_limit = Cvar_Get ("sv_oob_limit", "1", 0);
+	Cvar_SetDescription("sv_oob_limit", "Ration ping, status, connect and rcon packets per source address and overall.  See sv_oobstats.");
+
+	sv_preload = Cvar_Get ("sv_preload", "1", 0);
+	Cvar_SetDescription("sv_preload", "Read the next map in sv_maplist (or nextmap) in the background so map changes don't wait on the disk.");
+	sv_demobuffer = Cvar_Get ("sv_demobuffer", "1024", 0);
+	Cvar_SetDescription("sv_demobuffer", "Kilobytes of serverrecord frames that may wait for the disk before frames are dropped.");
+	sv_demodelta = Cvar_Get ("sv_demodelta", "0", 0);
+	Cvar_SetDescription("sv_demodelta", "Delta compress serverrecord frames against the previous one.  Frames then carry the frame they are based on, and readers have to understand that.");
+
+	sv_relay_password = Cvar_Get ("sv_relay_password", "", 0);
+	Cvar_SetDescription("sv_relay_password", "Password a relay server has to give to be sent the whole world.  Empty refuses all relays.");
+	sv_maxrelays = Cvar_Get ("sv_maxrelays", "0", CVAR_LATCH);
+	Cvar_SetDescription("sv_maxrelays", "Client slots that may be taken by relay servers.  Each one reserves the entity memory for a full world stream.");
+	sv_fps = Cvar_Get ("sv_fps", "10", CVAR_LATCH);
+	Cvar_SetDescription("sv_fps", "Game frames per second, 10, 20 or 40.  Only used if the game supports it, older clients still get 10 frames a second.");
+	sv_projectiles = Cvar_Get ("sv_projectiles", "1", 0);
+	Cvar_SetDescription("sv_projectiles", "Send rockets, grenades, blaster bolts and the like in the compact svc_projectiles to clients that take it, instead of as full entity deltas.  Only read when a client connects.");
+	sv_areatree = Cvar_Get ("sv_areatree", "1", 0);
+	Cvar_SetDescription("sv_areatree", "Keep the solid and trigger entities in balanced bounding box trees instead of the fixed areanode grid, for finding what a trace or a touch may hit.  Takes effect on the next map.");
+	sv_antilag = Cvar_Get ("sv_antilag", "200", 0);
+	Cvar_SetDescription("sv_antilag", "Furthest back in msec a hitscan shot is traced against where the other players were when the shooter saw them.  0 traces every shot against the present.");
+
+	sv_profile = Cvar_Get ("sv_profile", "0", 0);
+	Cvar_SetDescription("sv_profile", "Time the phases of each server frame.  See sv_profilereport.");
+	sv_profile_csv = Cvar_Get ("sv_profile_csv", "", 0);
+	Cvar_SetDescription("sv_profile_csv", "File in the game directory to append server frame profile snapshots to, as CSV, while sv_profile is on.  A plain file name, no paths.  Empty to disable.");
+	sv_profile_interval = Cvar_Get ("sv_profile_interval", "60", 0);
+	Cvar_SetDescription("sv_profile_interval", "Seconds between sv_profile_csv snapshots.");
+
 	sv_noreload = Cvar_Get ("sv_noreload", "0", 0);
 
 	sv_airaccelerate = Cvar_Get("sv_airaccelerate", "0", CVAR_LATCH);
@@ -1330,10 +2128,15 @@ before Sys_Quit or Sys_Error
 */
 void SV_Shutdown (char *finalmsg, qboolean reconnect)
 {
+	// don't leave a frame's datagrams behind if it was cut short
+	NET_FlushBatch (NS_SERVER);
+
 	if (svs.clients)
 		SV_FinalMessage (finalmsg, reconnect);
 
 	Master_Shutdown ();
+	SV_ShutdownWorkers ();
+	SV_ShutdownLoadgen ();
 	SV_ShutdownGameProgs ();
 
 	// free current level
@@ -1347,8 +2150,9 @@ void SV_Shutdown (char *finalmsg, qboolean reconnect)
 		Z_Free (svs.clients);
 	if (svs.client_entities)
 		Z_Free (svs.client_entities);
-	if (svs.demofile)
-		fclose (svs.demofile);
+	if (svs.antilag)
+		Z_Free (svs.antilag);
+	SV_CloseDemo ();
 	memset (&svs, 0, sizeof(svs));
 }
 
@@ -0,0 +1,1423 @@
+/*
+Copyright (C) 1997-2001 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_game.c -- interface to the game dll
+
+#include "server.h"
+
+/*
+==============================================================================
+
+RELAY
+
+"relay <address> [password]" turns this server into a relay.  It
+connects to the game server as a relay client, which is sent every
+entity in the world and every multicast, and rebuilds the world from
+that stream.  The built in game module below then serves it to
+spectators like any other map, so each one gets its own PVS culling
+and deltas from this server and none of them cost the game server
+anything.
+
+Upstream entity n becomes edict n + maxclients here, so the
+spectators keep edicts 1..maxclients.  Entity numbers inside the
+forwarded sounds, muzzleflashes and temp entities are moved the
+same way.  The map itself has to be present on the relay.
+
+==============================================================================
+*/
+
+#define	RELAY_BACKUP		UPDATE_WINDOW	// frames kept, the upstream sends 10 a second
+#define	RELAY_MASK			(RELAY_BACKUP-1)
+#define	RELAY_ENTITIES		(RELAY_BACKUP*MAX_EDICTS)	// entity states kept for deltas
+#define	RELAY_TIMEOUT		15000		// msec without a packet before starting over
+#define	RELAY_QUEUE			(MAX_MSGLEN*2)
+
+typedef enum {RL_OFF, RL_CHALLENGE, RL_CONNECTING, RL_CONNECTED, RL_ACTIVE} rlstate_t;
+
+typedef struct
+{
+	qboolean	valid;
+	int			serverframe;
+	int			first_entity;		// in relay.entities
+	int			num_entities;
+} rlframe_t;
+
+typedef struct
+{
+	int			to;
+	vec3_t		origin;
+	int			length;
+} rlmulticast_t;					// followed by the data, padded to 4 bytes
+
+typedef struct
+{
+	rlstate_t	state;
+	netadr_t	adr;
+	char		password[MAX_QPATH];
+	netchan_t	netchan;
+	int			sendtime;			// curtime of the next resend or move
+	qboolean	refused;			// the server's reason was printed once
+
+	int			spawncount;
+	char		configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
+	entity_state_t	baselines[MAX_EDICTS];
+
+	rlframe_t	frames[RELAY_BACKUP];
+	int			serverframe;		// latest valid frame, -1 for none
+	entity_state_t	*entities;		// [RELAY_ENTITIES]
+	int			next_entity;
+
+	qboolean	spawnpending;		// the upstream map is in, start it here
+	int			applied;			// last serverframe put into the world
+	int			offset;				// added to upstream entity numbers
+	qboolean	warned;				// about entities that don't fit
+
+	byte		queue[RELAY_QUEUE];	// multicasts waiting for the next frame
+	int			queued;
+
+	vec3_t		spawn_origin, spawn_angles;
+	edict_t		*edicts;
+	gclient_t	*clients;
+} relay_t;
+
+relay_t		sv_relay;
+game_export_t	sv_relayexport;
+
+/*
+==================
+SV_RelayActive
+==================
+*/
+qboolean SV_RelayActive (void)
+{
+	return sv_relay.state != RL_OFF;
+}
+
+/*
+==================
+SV_RelayStringCmd
+==================
+*/
+void SV_RelayStringCmd (char *s)
+{
+	MSG_WriteByte (&sv_relay.netchan.message, clc_stringcmd);
+	MSG_WriteString (&sv_relay.netchan.message, s);
+}
+
+/*
+==================
+SV_RelayRestart
+
+Goes back to asking for a challenge, like after a timeout
+==================
+*/
+void SV_RelayRestart (void)
+{
+	sv_relay.state = RL_CHALLENGE;
+	sv_relay.sendtime = curtime;
+	sv_relay.serverframe = -1;
+	sv_relay.spawnpending = false;
+}
+
+/*
+==================
+SV_RelayEntityBits
+
+Same as CL_ParseEntityBits
+==================
+*/
+int SV_RelayEntityBits (sizebuf_t *msg, unsigned *bits)
+{
+	unsigned	total;
+
+	total = MSG_ReadByte (msg);
+	if (total & U_MOREBITS1)
+		total |= MSG_ReadByte (msg) << 8;
+	if (total & U_MOREBITS2)
+		total |= MSG_ReadByte (msg) << 16;
+	if (total & U_MOREBITS3)
+		total |= MSG_ReadByte (msg) << 24;
+
+	*bits = total;
+
+	if (total & U_NUMBER16)
+		return MSG_ReadShort (msg);
+	return MSG_ReadByte (msg);
+}
+
+/*
+==================
+SV_RelayParseDelta
+
+Same as CL_ParseDelta
+==================
+*/
+void SV_RelayParseDelta (sizebuf_t *msg, entity_state_t *from, entity_state_t *to, int number, int bits)
+{
+	*to = *from;
+
+	VectorCopy (from->origin, to->old_origin);
+	to->number = number;
+
+	if (bits & U_MODEL)
+		to->modelindex = MSG_ReadByte (msg);
+	if (bits & U_MODEL2)
+		to->modelindex2 = MSG_ReadByte (msg);
+	if (bits & U_MODEL3)
+		to->modelindex3 = MSG_ReadByte (msg);
+	if (bits & U_MODEL4)
+		to->modelindex4 = MSG_ReadByte (msg);
+
+	if (bits & U_FRAME8)
+		to->frame = MSG_ReadByte (msg);
+	if (bits & U_FRAME16)
+		to->frame = MSG_ReadShort (msg);
+
+	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
+		to->skinnum = MSG_ReadLong (msg);
+	else if (bits & U_SKIN8)
+		to->skinnum = MSG_ReadByte (msg);
+	else if (bits & U_SKIN16)
+		to->skinnum = MSG_ReadShort (msg);
+
+	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
+		to->effects = MSG_ReadLong (msg);
+	else if (bits & U_EFFECTS8)
+		to->effects = MSG_ReadByte (msg);
+	else if (bits & U_EFFECTS16)
+		to->effects = MSG_ReadShort (msg);
+
+	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
+		to->renderfx = MSG_ReadLong (msg);
+	else if (bits & U_RENDERFX8)
+		to->renderfx = MSG_ReadByte (msg);
+	else if (bits & U_RENDERFX16)
+		to->renderfx = MSG_ReadShort (msg);
+
+	if (bits & U_ORIGIN1)
+		to->origin[0] = MSG_ReadCoord (msg);
+	if (bits & U_ORIGIN2)
+		to->origin[1] = MSG_ReadCoord (msg);
+	if (bits & U_ORIGIN3)
+		to->origin[2] = MSG_ReadCoord (msg);
+
+	if (bits & U_ANGLE1)
+		to->angles[0] = MSG_ReadAngle (msg);
+	if (bits & U_ANGLE2)
+		to->angles[1] = MSG_ReadAngle (msg);
+	if (bits & U_ANGLE3)
+		to->angles[2] = MSG_ReadAngle (msg);
+
+	if (bits & U_OLDORIGIN)
+		MSG_ReadPos (msg, to->old_origin);
+
+	if (bits & U_SOUND)
+		to->sound = MSG_ReadByte (msg);
+
+	if (bits & U_EVENT)
+		to->event = MSG_ReadByte (msg);
+	else
+		to->event = 0;
+
+	if (bits & U_SOLID)
+		to->solid = MSG_ReadShort (msg);
+}
+
+/*
+==================
+SV_RelayDeltaEntity
+==================
+*/
+void SV_RelayDeltaEntity (sizebuf_t *msg, rlframe_t *frame, int newnum, entity_state_t *old, int bits)
+{
+	entity_state_t	*state;
+
+	state = &sv_relay.entities[sv_relay.next_entity & (RELAY_ENTITIES-1)];
+	sv_relay.next_entity++;
+	frame->num_entities++;
+
+	SV_RelayParseDelta (msg, old, state, newnum, bits);
+}
+
+/*
+==================
+SV_RelayOldState
+
+The oldindex'th entity of oldframe, NULL past the end
+==================
+*/
+entity_state_t *SV_RelayOldState (rlframe_t *oldframe, int oldindex)
+{
+	if (!oldframe || oldindex >= oldframe->num_entities)
+		return NULL;
+	return &sv_relay.entities[(oldframe->first_entity + oldindex) & (RELAY_ENTITIES-1)];
+}
+
+/*
+==================
+SV_RelayParsePacketEntities
+
+Same as CL_ParsePacketEntities
+==================
+*/
+qboolean SV_RelayParsePacketEntities (sizebuf_t *msg, rlframe_t *oldframe, rlframe_t *newframe)
+{
+	int			newnum, oldnum, oldindex;
+	unsigned	bits;
+	entity_state_t	*oldstate;
+
+	newframe->first_entity = sv_relay.next_entity;
+	newframe->num_entities = 0;
+
+	oldindex = 0;
+	oldstate = SV_RelayOldState (oldframe, oldindex);
+	oldnum = oldstate ? oldstate->number : 99999;
+
+	while (1)
+	{
+		newnum = SV_RelayEntityBits (msg, &bits);
+		if (newnum < 0 || newnum >= MAX_EDICTS || msg->readcount > msg->cursize)
+		{
+			Com_Printf ("relay: bad packetentities\n");
+			return false;
+		}
+
+		if (!newnum)
+			break;
+
+		while (oldnum < newnum)
+		{	// one or more entities from the old packet are unchanged
+			SV_RelayDeltaEntity (msg, newframe, oldnum, oldstate, 0);
+			oldstate = SV_RelayOldState (oldframe, ++oldindex);
+			oldnum = oldstate ? oldstate->number : 99999;
+		}
+
+		if (bits & U_REMOVE)
+		{	// the entity present in oldframe is not in the current frame
+			if (oldnum == newnum)
+			{
+				oldstate = SV_RelayOldState (oldframe, ++oldindex);
+				oldnum = oldstate ? oldstate->number : 99999;
+			}
+			continue;
+		}
+
+		if (oldnum == newnum)
+		{	// delta from previous state
+			SV_RelayDeltaEntity (msg, newframe, newnum, oldstate, bits);
+			oldstate = SV_RelayOldState (oldframe, ++oldindex);
+			oldnum = oldstate ? oldstate->number : 99999;
+			continue;
+		}
+
+		// delta from baseline
+		SV_RelayDeltaEntity (msg, newframe, newnum, &sv_relay.baselines[newnum], bits);
+	}
+
+	// any remaining entities in the old frame are copied over
+	while (oldnum != 99999)
+	{
+		SV_RelayDeltaEntity (msg, newframe, oldnum, oldstate, 0);
+		oldstate = SV_RelayOldState (oldframe, ++oldindex);
+		oldnum = oldstate ? oldstate->number : 99999;
+	}
+
+	return true;
+}
+
+/*
+==================
+SV_RelaySkipPlayerstate
+
+The relay's own playerstate is of no use, only its size matters
+==================
+*/
+void SV_RelaySkipPlayerstate (sizebuf_t *msg)
+{
+	static const int	sizes[15][2] = {
+		{PS_M_TYPE, 1}, {PS_M_ORIGIN, 6}, {PS_M_VELOCITY, 6}, {PS_M_TIME, 1},
+		{PS_M_FLAGS, 1}, {PS_M_GRAVITY, 2}, {PS_M_DELTA_ANGLES, 6}, {PS_VIEWOFFSET, 3},
+		{PS_VIEWANGLES, 6}, {PS_KICKANGLES, 3}, {PS_WEAPONINDEX, 1}, {PS_WEAPONFRAME, 7},
+		{PS_BLEND, 4}, {PS_FOV, 1}, {PS_RDFLAGS, 1}
+	};
+	int		flags, statbits, i;
+
+	flags = MSG_ReadShort (msg);
+	for (i=0 ; i<15 ; i++)
+	{
+		if (flags & sizes[i][0])
+			msg->readcount += sizes[i][1];
+	}
+
+	statbits = MSG_ReadLong (msg);
+	for (i=0 ; i<MAX_STATS ; i++)
+	{
+		if (statbits & (1<<i))
+			msg->readcount += 2;
+	}
+}
+
+/*
+==================
+SV_RelayParseFrame
+
+Same as CL_ParseFrame, without the playerstate
+==================
+*/
+qboolean SV_RelayParseFrame (sizebuf_t *msg)
+{
+	rlframe_t	frame, *old;
+	byte		areabits[MAX_MAP_AREAS/8];
+	int			len;
+
+	memset (&frame, 0, sizeof(frame));
+	frame.serverframe = MSG_ReadLong (msg);
+	len = MSG_ReadLong (msg);		// deltaframe
+	MSG_ReadByte (msg);				// surpressCount
+
+	if (len <= 0)
+	{
+		frame.valid = true;		// uncompressed frame
+		old = NULL;
+	}
+	else
+	{
+		old = &sv_relay.frames[len & RELAY_MASK];
+		if (old->valid && old->serverframe == len
+			&& sv_relay.next_entity - old->first_entity <= RELAY_ENTITIES - MAX_EDICTS)
+			frame.valid = true;
+	}
+
+	len = MSG_ReadByte (msg);
+	if (len > sizeof(areabits))
+		return false;
+	MSG_ReadData (msg, areabits, len);
+
+	if (MSG_ReadByte (msg) != svc_playerinfo)
+	{
+		Com_Printf ("relay: frame without playerinfo\n");
+		return false;
+	}
+	SV_RelaySkipPlayerstate (msg);
+
+	if (MSG_ReadByte (msg) != svc_packetentities)
+	{
+		Com_Printf ("relay: frame without packetentities\n");
+		return false;
+	}
+	if (!SV_RelayParsePacketEntities (msg, old, &frame))
+		return false;
+
+	sv_relay.frames[frame.serverframe & RELAY_MASK] = frame;
+	if (frame.valid)
+		sv_relay.serverframe = frame.serverframe;
+	return true;
+}
+
+/*
+==================
+SV_RelayConfigstring
+
+Keeps the upstream configstrings and passes changes on once the
+relay's own map is up
+==================
+*/
+void SV_RelayConfigstring (int index, char *s)
+{
+	if (index < 0 || index >= MAX_CONFIGSTRINGS)
+		return;
+
+	Q_strncpyz (sv_relay.configstrings[index], s, CS_SIZE(index));
+
+	if (sv.state == ss_game && !sv_relay.spawnpending
+		&& index != CS_MAPCHECKSUM && index != CS_MAXCLIENTS)
+		PF_Configstring (index, s);
+}
+
+/*
+==================
+SV_RelayStufftext
+==================
+*/
+void SV_RelayStufftext (char *s)
+{
+	char	line[64];
+	int		i;
+
+	for (i=0 ; i<sizeof(line)-1 && s[i] && s[i] != '\n' ; i++)
+		line[i] = s[i];
+	line[i] = 0;
+
+	if (!strncmp (line, "cmd configstrings ", 18) || !strncmp (line, "cmd baselines ", 14))
+		SV_RelayStringCmd (line + 4);
+	else if (!strncmp (line, "precache ", 9))
+	{
+		SV_RelayStringCmd (va("begin %i\n", atoi (line + 9)));
+		sv_relay.state = RL_ACTIVE;
+		sv_relay.spawnpending = true;
+		sv_relay.sendtime = curtime;
+	}
+	else if (!strcmp (line, "reconnect"))
+	{
+		SV_RelayStringCmd ("new");
+		sv_relay.state = RL_CONNECTED;
+		sv_relay.serverframe = -1;
+		sv_relay.spawnpending = false;
+	}
+	// "changing" is left alone, the spectators keep watching the old
+	// map until the new one has come in
+}
+
+/*
+==================
+SV_RelayServerData
+==================
+*/
+qboolean SV_RelayServerData (sizebuf_t *msg)
+{
+	char	*gamedir;
+	int		i;
+
+	i = MSG_ReadLong (msg);
+	if (i != PROTOCOL_VERSION)
+	{
+		Com_Printf ("relay: server is protocol %i, not %i\n", i, PROTOCOL_VERSION);
+		return false;
+	}
+	sv_relay.spawncount = MSG_ReadLong (msg);
+	MSG_ReadByte (msg);			// attractloop
+	gamedir = MSG_ReadString (msg);
+	if (Q_stricmp (gamedir[0] ? gamedir : BASEDIRNAME, Cvar_VariableString ("gamedir")[0] ? Cvar_VariableString ("gamedir") : BASEDIRNAME))
+		Com_Printf ("relay: the server runs game %s\n", gamedir[0] ? gamedir : BASEDIRNAME);
+	MSG_ReadShort (msg);		// playernum
+	MSG_ReadString (msg);		// levelname
+
+	memset (sv_relay.configstrings, 0, sizeof(sv_relay.configstrings));
+	memset (sv_relay.baselines, 0, sizeof(sv_relay.baselines));
+	memset (sv_relay.frames, 0, sizeof(sv_relay.frames));
+	sv_relay.serverframe = -1;
+	sv_relay.spawnpending = false;
+	sv_relay.state = RL_CONNECTED;
+	return true;
+}
+
+/*
+==================
+SV_RelayMulticast
+
+Configstring changes and commands are dealt with here, everything
+else waits for the frame it goes with
+==================
+*/
+void SV_RelayMulticast (sizebuf_t *msg)
+{
+	rlmulticast_t	*m;
+	sizebuf_t	inner;
+	int			to, length, size, cmd;
+	vec3_t		origin;
+
+	to = MSG_ReadByte (msg);
+	VectorClear (origin);
+	if (to != MULTICAST_ALL_R && to != MULTICAST_ALL)
+		MSG_ReadPos (msg, origin);
+	length = MSG_ReadShort (msg);
+	if (length <= 0 || msg->readcount + length > msg->cursize)
+	{
+		msg->readcount = msg->cursize + 1;
+		return;
+	}
+
+	SZ_Init (&inner, msg->data + msg->readcount, length);
+	inner.cursize = length;
+	msg->readcount += length;
+
+	cmd = MSG_ReadByte (&inner);
+	if (cmd == svc_configstring)
+	{
+		cmd = MSG_ReadShort (&inner);
+		SV_RelayConfigstring (cmd, MSG_ReadString (&inner));
+		return;
+	}
+	if (cmd == svc_stufftext)
+	{
+		SV_RelayStufftext (MSG_ReadString (&inner));
+		return;
+	}
+
+	size = sizeof(rlmulticast_t) + ((length + 3) & ~3);
+	if (sv_relay.queued + size > RELAY_QUEUE)
+		return;		// lost like any datagram
+	m = (rlmulticast_t *)(sv_relay.queue + sv_relay.queued);
+	m->to = to;
+	VectorCopy (origin, m->origin);
+	m->length = length;
+	memcpy (m + 1, inner.data, length);
+	sv_relay.queued += size;
+}
+
+/*
+==================
+SV_RelayParse
+==================
+*/
+void SV_RelayParse (sizebuf_t *msg)
+{
+	int		cmd, i;
+	char	*s;
+
+	while (1)
+	{
+		if (msg->readcount > msg->cursize)
+		{
+			Com_Printf ("relay: bad server message\n");
+			return;
+		}
+
+		cmd = MSG_ReadByte (msg);
+		if (cmd == -1)
+			return;
+
+		switch (cmd)
+		{
+		case svc_nop:
+			break;
+
+		case svc_disconnect:
+			Com_Printf ("relay: the server disconnected\n");
+			SV_RelayRestart ();
+			sv_relay.sendtime = curtime + 3000;
+			return;
+
+		case svc_reconnect:
+			// the server restarted, the old connection is gone
+			Com_Printf ("relay: the server restarted\n");
+			SV_RelayRestart ();
+			return;
+
+		case svc_print:
+			i = MSG_ReadByte (msg);
+			s = MSG_ReadString (msg);
+			if (sv.state == ss_game)
+				SV_BroadcastPrintf (i, "%s", s);
+			break;
+
+		case svc_centerprint:
+		case svc_layout:
+			MSG_ReadString (msg);
+			break;
+
+		case svc_inventory:
+			msg->readcount += MAX_ITEMS * 2;
+			break;
+
+		case svc_stufftext:
+			SV_RelayStufftext (MSG_ReadString (msg));
+			break;
+
+		case svc_serverdata:
+			if (!SV_RelayServerData (msg))
+				return;
+			break;
+
+		case svc_configstring:
+			i = MSG_ReadShort (msg);
+			SV_RelayConfigstring (i, MSG_ReadString (msg));
+			break;
+
+		case svc_spawnbaseline:
+		{
+			entity_state_t	nullstate;
+			unsigned		bits;
+
+			memset (&nullstate, 0, sizeof(nullstate));
+			i = SV_RelayEntityBits (msg, &bits);
+			if (i < 0 || i >= MAX_EDICTS)
+				return;
+			SV_RelayParseDelta (msg, &nullstate, &sv_relay.baselines[i], i, bits);
+			break;
+		}
+
+		case svc_frame:
+			if (!SV_RelayParseFrame (msg))
+				return;
+			break;
+
+		case svc_multicast:
+			SV_RelayMulticast (msg);
+			break;
+
+		default:
+			Com_Printf ("relay: can't handle svc %i\n", cmd);
+			return;
+		}
+	}
+}
+
+/*
+==================
+SV_RelayConnectionless
+==================
+*/
+void SV_RelayConnectionless (char *s)
+{
+	char	userinfo[MAX_INFO_STRING];
+
+	if (!strncmp (s, "challenge ", 10) && sv_relay.state == RL_CHALLENGE)
+	{
+		Com_sprintf (userinfo, sizeof(userinfo), "\\name\\relay\\rate\\25000\\relay\\%s", sv_relay.password);
+		Netchan_OutOfBandPrint (NS_SERVER, sv_relay.adr, "connect %i %i %i \"%s\" %i\n",
+			PROTOCOL_VERSION, (int)Cvar_VariableValue ("qport"), atoi (s + 10), userinfo,
+			NETCAPS_FRAGMENT | NETCAPS_RELAY);
+		sv_relay.state = RL_CONNECTING;
+	}
+	else if (!strncmp (s, "client_connect", 14) && sv_relay.state == RL_CONNECTING)
+	{
+		Netchan_Setup (NS_SERVER, &sv_relay.netchan, sv_relay.adr, (int)Cvar_VariableValue ("qport"));
+		sv_relay.netchan.toserver = true;
+		sv_relay.netchan.fragment = (strstr (s, " fragment=1") != NULL);
+		SV_RelayStringCmd ("new");
+		sv_relay.state = RL_CONNECTED;
+		sv_relay.serverframe = -1;
+		sv_relay.sendtime = curtime;
+		sv_relay.refused = false;
+		Com_Printf ("relay: connected to %s\n", NET_AdrToString (sv_relay.adr));
+	}
+	else if (!strcmp (s, "print") && !sv_relay.refused)
+	{
+		Com_Printf ("relay: %s", MSG_ReadString (&net_message));
+		sv_relay.refused = true;
+	}
+}
+
+/*
+==================
+SV_RelayPacket
+
+Takes net_message if it came from the relay's server
+==================
+*/
+qboolean SV_RelayPacket (void)
+{
+	if (sv_relay.state == RL_OFF || !NET_CompareAdr (net_from, sv_relay.adr))
+		return false;
+
+	if (*(int *)net_message.data == -1)
+	{
+		MSG_BeginReading (&net_message);
+		MSG_ReadLong (&net_message);
+		SV_RelayConnectionless (MSG_ReadStringLine (&net_message));
+		return true;
+	}
+
+	if (sv_relay.state < RL_CONNECTED)
+		return true;
+	if (Netchan_Process (&sv_relay.netchan, &net_message))
+		SV_RelayParse (&net_message);
+	return true;
+}
+
+/*
+==================
+SV_RelayMove
+
+An empty command that acks the last good frame, so the server keeps
+sending deltas
+==================
+*/
+void SV_RelayMove (void)
+{
+	byte		data[64];
+	sizebuf_t	buf;
+	usercmd_t	nullcmd;
+	int			i, checksumIndex;
+
+	SZ_Init (&buf, data, sizeof(data));
+	MSG_WriteByte (&buf, clc_move);
+	checksumIndex = buf.cursize;
+	MSG_WriteByte (&buf, 0);
+	MSG_WriteLong (&buf, sv_relay.serverframe);
+
+	memset (&nullcmd, 0, sizeof(nullcmd));
+	for (i=0 ; i<3 ; i++)
+		MSG_WriteDeltaUsercmd (&buf, &nullcmd, &nullcmd);
+
+	buf.data[checksumIndex] = COM_BlockSequenceCRCByte (
+		buf.data + checksumIndex + 1, buf.cursize - checksumIndex - 1,
+		sv_relay.netchan.outgoing_sequence);
+
+	Netchan_Transmit (&sv_relay.netchan, buf.cursize, buf.data);
+}
+
+/*
+==================
+SV_RunRelay
+
+Called at the start of every server frame, whether a map is up or not
+==================
+*/
+void SV_RunRelay (void)
+{
+	char	map[MAX_QPATH];
+	char	*s;
+	int		l;
+
+	if (sv_relay.state == RL_OFF)
+		return;
+
+	// nothing else reads the socket until the map is up
+	if (!svs.initialized)
+	{
+		while (NET_GetPacket (NS_SERVER, &net_from, &net_message))
+			SV_RelayPacket ();
+	}
+
+	if (sv_relay.state >= RL_CONNECTED && curtime - sv_relay.netchan.last_received > RELAY_TIMEOUT)
+	{
+		Com_Printf ("relay: %s timed out\n", NET_AdrToString (sv_relay.adr));
+		SV_RelayRestart ();
+	}
+
+	switch (sv_relay.state)
+	{
+	case RL_CHALLENGE:
+	case RL_CONNECTING:
+		if (curtime < sv_relay.sendtime)
+			break;
+		sv_relay.state = RL_CHALLENGE;
+		Netchan_OutOfBandPrint (NS_SERVER, sv_relay.adr, "getchallenge\n");
+		sv_relay.sendtime = curtime + 3000;
+		break;
+
+	case RL_CONNECTED:
+		if (curtime < sv_relay.sendtime && !sv_relay.netchan.message.cursize)
+			break;
+		Netchan_Transmit (&sv_relay.netchan, 0, NULL);
+		sv_relay.sendtime = curtime + 100;
+		break;
+
+	case RL_ACTIVE:
+		if (curtime < sv_relay.sendtime)
+			break;
+		SV_RelayMove ();
+		sv_relay.sendtime = curtime + 50;
+		break;
+
+	default:
+		break;
+	}
+
+	// bring the map up once there is a world to put in it
+	if (!sv_relay.spawnpending || sv_relay.serverframe < 0)
+		return;
+	sv_relay.spawnpending = false;
+
+	s = sv_relay.configstrings[CS_MODELS+1];
+	if (strncmp (s, "maps/", 5))
+	{
+		Com_Printf ("relay: the server isn't running a map\n");
+		return;
+	}
+	Q_strncpyz (map, s + 5, sizeof(map));
+	l = strlen (map);
+	if (l > 4 && !Q_stricmp (map + l - 4, ".bsp"))
+		map[l-4] = 0;
+
+	SV_Map (false, map, false);
+}
+
+/*
+==================
+SV_Relay_f
+
+relay <address> [password]
+relay stop
+==================
+*/
+void SV_Relay_f (void)
+{
+	netadr_t	adr;
+	int			i, spectators;
+
+	if (Cmd_Argc() < 2)
+	{
+		Com_Printf ("usage: relay <address> [password]\n"
+					"       relay stop\n");
+		if (sv_relay.state == RL_OFF)
+			return;
+
+		spectators = 0;
+		for (i=0 ; svs.initialized && i<maxclients->intValue ; i++)
+		{
+			if (svs.clients[i].state == cs_spawned)
+				spectators++;
+		}
+		Com_Printf ("relaying %s: %s, frame %i, %i entities, %i spectators\n",
+			NET_AdrToString (sv_relay.adr),
+			sv_relay.state == RL_ACTIVE ? "active" : sv_relay.state == RL_CONNECTED ? "connected" : "connecting",
+			sv_relay.serverframe,
+			sv_relay.serverframe < 0 ? 0 : sv_relay.frames[sv_relay.serverframe & RELAY_MASK].num_entities,
+			spectators);
+		return;
+	}
+
+	if (!Q_stricmp (Cmd_Argv(1), "stop"))
+	{
+		if (sv_relay.state == RL_OFF)
+		{
+			Com_Printf ("Not relaying.\n");
+			return;
+		}
+		if (sv_relay.state >= RL_CONNECTED)
+		{
+			for (i=0 ; i<3 ; i++)
+			{
+				SV_RelayStringCmd ("disconnect");
+				Netchan_Transmit (&sv_relay.netchan, 0, NULL);
+			}
+		}
+		if (svs.initialized)
+			SV_Shutdown ("Relay stopped.\n", false);
+		if (sv_relay.entities)
+			Z_Free (sv_relay.entities);
+		memset (&sv_relay, 0, sizeof(sv_relay));
+		return;
+	}
+
+	if (!NET_StringToAdr (Cmd_Argv(1), &adr))
+	{
+		Com_Printf ("Bad address: %s\n", Cmd_Argv(1));
+		return;
+	}
+	if (!adr.port)
+		adr.port = BigShort (PORT_SERVER);
+
+	if (sv_relay.state != RL_OFF)
+	{
+		Com_Printf ("Already relaying %s, relay stop first.\n", NET_AdrToString (sv_relay.adr));
+		return;
+	}
+
+	if (svs.initialized)
+		SV_Shutdown ("Server is becoming a relay.\n", false);
+
+	// spectators need somewhere to connect to
+	if (!Cvar_VariableValue ("deathmatch") && !Cvar_VariableValue ("coop"))
+		Cvar_Set ("deathmatch", "1");
+	NET_Config (true);
+
+	memset (&sv_relay, 0, sizeof(sv_relay));
+	sv_relay.adr = adr;
+	Q_strncpyz (sv_relay.password, Cmd_Argc() > 2 ? Cmd_Argv(2) : "", sizeof(sv_relay.password));
+	sv_relay.entities = Z_Malloc (RELAY_ENTITIES * sizeof(entity_state_t));
+	SV_RelayRestart ();
+	Com_Printf ("relay: connecting to %s\n", NET_AdrToString (adr));
+}
+
+/*
+==============================================================================
+
+The relay's game module
+
+==============================================================================
+*/
+
+/*
+==================
+SV_RelayPMTrace
+==================
+*/
+trace_t SV_RelayPMTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	return SV_Trace (start, mins, maxs, end, NULL, MASK_PLAYERSOLID);
+}
+
+/*
+==================
+SV_RelayRenumber
+
+Moves the entity numbers in a forwarded message past the
+spectators.  False if one doesn't fit.
+==================
+*/
+qboolean SV_RelayRenumber (byte *data, int length)
+{
+	int		ofs[2];
+	int		i, p, n, chan;
+
+	ofs[0] = ofs[1] = 0;
+	chan = 0;
+
+	switch (data[0])
+	{
+	case svc_muzzleflash:
+	case svc_muzzleflash2:
+		ofs[0] = 1;
+		break;
+
+	case svc_temp_entity:
+		if (length < 2)
+			return true;
+		switch (data[1])
+		{
+		case TE_PARASITE_ATTACK:
+		case TE_MEDIC_CABLE_ATTACK:
+		case TE_GRAPPLE_CABLE:
+		case TE_HEATBEAM:
+		case TE_MONSTER_HEATBEAM:
+			ofs[0] = 2;
+			break;
+		case TE_LIGHTNING:
+			ofs[0] = 2;
+			ofs[1] = 4;
+			break;
+		case TE_FLASHLIGHT:
+			ofs[0] = 8;
+			break;
+		}
+		break;
+
+	case svc_sound:
+		if (length < 2 || !(data[1] & SND_ENT))
+			return true;
+		ofs[0] = 3;
+		if (data[1] & SND_VOLUME)
+			ofs[0]++;
+		if (data[1] & SND_ATTENUATION)
+			ofs[0]++;
+		if (data[1] & SND_OFFSET)
+			ofs[0]++;
+		chan = 3;		// entity and channel share the short
+		break;
+	}
+
+	for (i=0 ; i<2 && ofs[i] ; i++)
+	{
+		p = ofs[i];
+		if (p + 2 > length)
+			return false;
+		n = data[p] | (data[p+1] << 8);
+		if (!(n >> chan))
+			continue;		// the world stays put
+		n += sv_relay.offset << chan;
+		if ((n >> chan) >= MAX_EDICTS)
+			return false;
+		data[p] = n & 255;
+		data[p+1] = (n >> 8) & 255;
+	}
+	return true;
+}
+
+/*
+==================
+SV_RelayFlushMulticasts
+==================
+*/
+void SV_RelayFlushMulticasts (void)
+{
+	rlmulticast_t	*m;
+	int		read;
+
+	for (read = 0 ; read < sv_relay.queued ; read += sizeof(rlmulticast_t) + ((m->length + 3) & ~3))
+	{
+		m = (rlmulticast_t *)(sv_relay.queue + read);
+		if (sv.state != ss_game)
+			continue;
+
+		SZ_Clear (&sv.multicast);
+		SZ_Write (&sv.multicast, m + 1, m->length);
+		if (SV_RelayRenumber (sv.multicast.data, sv.multicast.cursize))
+			SV_Multicast (m->origin, m->to);
+		SZ_Clear (&sv.multicast);
+	}
+	sv_relay.queued = 0;
+}
+
+/*
+==================
+SV_RelaySetBounds
+
+Undoes the solid encoding of SV_LinkEdict
+==================
+*/
+void SV_RelaySetBounds (edict_t *ent)
+{
+	cmodel_t	*mod;
+	int			s, x, zd, zu;
+	char		*name;
+
+	s = ent->s.solid;
+	if (s == 31)
+	{
+		ent->solid = SOLID_BSP;
+		name = sv.configstrings[CS_MODELS + ent->s.modelindex];
+		if (name[0] == '*')
+		{
+			mod = CM_InlineModel (name);
+			VectorCopy (mod->mins, ent->mins);
+			VectorCopy (mod->maxs, ent->maxs);
+		}
+		return;
+	}
+
+	if (!s)
+	{
+		ent->solid = SOLID_NOT;
+		VectorClear (ent->mins);
+		VectorClear (ent->maxs);
+		return;
+	}
+
+	ent->solid = SOLID_BBOX;
+	x = 8*(s & 31);
+	zd = 8*((s>>5) & 31);
+	zu = 8*((s>>10) & 63) - 32;
+	VectorSet (ent->mins, -x, -x, -zd);
+	VectorSet (ent->maxs, x, x, zu);
+}
+
+/*
+==================
+SV_RelayRunFrame
+
+Puts the newest upstream frame into the world, with the events of
+any frames that were skipped
+==================
+*/
+void SV_RelayRunFrame (void)
+{
+	static byte	events[MAX_EDICTS];
+	static byte	seen[MAX_EDICTS];
+	rlframe_t	*frame, *f;
+	entity_state_t	*state;
+	edict_t		*ent;
+	int			i, n, num;
+
+	if (sv_relay.state != RL_ACTIVE || sv_relay.spawnpending || sv_relay.serverframe < 0
+		|| sv_relay.serverframe == sv_relay.applied)
+	{
+		SV_RelayFlushMulticasts ();
+		return;
+	}
+
+	frame = &sv_relay.frames[sv_relay.serverframe & RELAY_MASK];
+
+	memset (events, 0, sizeof(events));
+	n = sv_relay.applied + 1;
+	if (sv_relay.applied <= 0 || sv_relay.serverframe - n >= RELAY_BACKUP)
+		n = sv_relay.serverframe;
+	for ( ; n < sv_relay.serverframe ; n++)
+	{
+		f = &sv_relay.frames[n & RELAY_MASK];
+		if (!f->valid || f->serverframe != n)
+			continue;
+		for (i=0 ; i<f->num_entities ; i++)
+		{
+			state = &sv_relay.entities[(f->first_entity + i) & (RELAY_ENTITIES-1)];
+			if (state->event)
+				events[state->number] = state->event;
+		}
+	}
+	sv_relay.applied = sv_relay.serverframe;
+
+	memset (seen, 0, sizeof(seen));
+	for (i=0 ; i<frame->num_entities ; i++)
+	{
+		state = &sv_relay.entities[(frame->first_entity + i) & (RELAY_ENTITIES-1)];
+		num = state->number + sv_relay.offset;
+		if (num >= MAX_EDICTS)
+		{
+			if (!sv_relay.warned)
+				Com_Printf ("relay: entity %i doesn't fit past %i spectators\n", state->number, sv_relay.offset);
+			sv_relay.warned = true;
+			continue;
+		}
+
+		ent = EDICT_NUM(num);
+		seen[num] = 1;
+		ent->s = *state;
+		ent->s.number = num;
+		if (!ent->s.event)
+			ent->s.event = events[state->number];
+		ent->inuse = true;
+		ent->svflags = 0;
+		SV_RelaySetBounds (ent);
+		SV_LinkEdict (ent);
+
+		if (num >= sv_relayexport.num_edicts)
+			sv_relayexport.num_edicts = num + 1;
+	}
+
+	// whatever wasn't in the frame is gone
+	for (num = sv_relay.offset + 1 ; num < sv_relayexport.num_edicts ; num++)
+	{
+		ent = EDICT_NUM(num);
+		if (seen[num] || !ent->inuse)
+			continue;
+		SV_UnlinkEdict (ent);
+		memset (ent, 0, sizeof(*ent));
+		ent->s.number = num;
+	}
+
+	SV_RelayFlushMulticasts ();
+}
+
+/*
+==================
+SV_RelaySpawnEntities
+
+Takes the upstream configstrings and finds somewhere to put the
+spectators, the entities come with the frames
+==================
+*/
+void SV_RelaySpawnEntities (char *mapname, char *entities, char *spawnpoint)
+{
+	char	*com_token;
+	char	key[MAX_QPATH];
+	vec3_t	origin, angles;
+	int		i, best, rank;
+
+	memset (sv_relay.edicts, 0, MAX_EDICTS * sizeof(edict_t));
+	memset (sv_relay.clients, 0, maxclients->intValue * sizeof(gclient_t));
+	for (i=0 ; i<MAX_EDICTS ; i++)
+		sv_relay.edicts[i].s.number = i;
+	for (i=0 ; i<maxclients->intValue ; i++)
+		sv_relay.edicts[i+1].client = &sv_relay.clients[i];
+	sv_relay.edicts[0].inuse = true;	// the world
+	sv_relayexport.num_edicts = maxclients->intValue + 1;
+	sv_relay.offset = maxclients->intValue;
+	sv_relay.applied = -1;
+	sv_relay.warned = false;
+	sv_relay.queued = 0;
+
+	for (i=0 ; i<MAX_CONFIGSTRINGS ; i++)
+	{
+		if (i == CS_MODELS+1 || i == CS_MAPCHECKSUM || i == CS_MAXCLIENTS)
+			continue;
+		if (sv_relay.configstrings[i][0])
+			PF_Configstring (i, sv_relay.configstrings[i]);
+	}
+
+	// intermission spots look over the level, take one of those first
+	VectorClear (sv_relay.spawn_origin);
+	VectorClear (sv_relay.spawn_angles);
+	best = 0;
+	while (1)
+	{
+		com_token = COM_Parse (&entities);
+		if (!entities || com_token[0] != '{')
+			break;
+
+		rank = 0;
+		VectorClear (origin);
+		VectorClear (angles);
+		while (1)
+		{
+			com_token = COM_Parse (&entities);
+			if (!entities || com_token[0] == '}')
+				break;
+			Q_strncpyz (key, com_token, sizeof(key));
+			com_token = COM_Parse (&entities);
+			if (!entities)
+				break;
+
+			if (!strcmp (key, "origin"))
+				sscanf (com_token, "%f %f %f", &origin[0], &origin[1], &origin[2]);
+			else if (!strcmp (key, "angle"))
+				angles[YAW] = atof (com_token);
+			else if (!strcmp (key, "angles"))
+				sscanf (com_token, "%f %f %f", &angles[0], &angles[1], &angles[2]);
+			else if (!strcmp (key, "classname"))
+				rank = !strcmp (com_token, "info_player_intermission") ? 3 :
+					!strcmp (com_token, "info_player_deathmatch") ? 2 :
+					!strcmp (com_token, "info_player_start") ? 1 : 0;
+		}
+
+		if (rank > best)
+		{
+			best = rank;
+			VectorCopy (origin, sv_relay.spawn_origin);
+			VectorCopy (angles, sv_relay.spawn_angles);
+		}
+	}
+}
+
+/*
+==================
+SV_RelayClientBegin
+
+Spectators fly around freely from the spawn point
+==================
+*/
+void SV_RelayClientBegin (edict_t *ent)
+{
+	gclient_t	*client;
+	int			i;
+
+	client = ent->client;
+	memset (client, 0, sizeof(*client));
+
+	ent->inuse = true;
+	ent->svflags = SVF_NOCLIENT;
+	ent->solid = SOLID_NOT;
+	VectorCopy (sv_relay.spawn_origin, ent->s.origin);
+
+	client->ps.pmove.pm_type = PM_SPECTATOR;
+	for (i=0 ; i<3 ; i++)
+	{
+		client->ps.pmove.origin[i] = (short)(sv_relay.spawn_origin[i]*8);
+		client->ps.pmove.delta_angles[i] = ANGLE2SHORT(sv_relay.spawn_angles[i]);
+		client->ps.viewangles[i] = sv_relay.spawn_angles[i];
+	}
+	client->ps.viewoffset[2] = 22;
+	client->ps.fov = 90;
+	client->ps.stats[STAT_SPECTATOR] = 1;
+}
+
+/*
+==================
+SV_RelayClientThink
+==================
+*/
+void SV_RelayClientThink (edict_t *ent, usercmd_t *ucmd)
+{
+	gclient_t	*client;
+	pmove_t		pm;
+	int			i;
+
+	client = ent->client;
+
+	memset (&pm, 0, sizeof(pm));
+	pm.s = client->ps.pmove;
+	pm.cmd = *ucmd;
+	pm.trace = SV_RelayPMTrace;
+	pm.pointcontents = SV_PointContents;
+	Pmove (&pm);
+
+	client->ps.pmove = pm.s;
+	for (i=0 ; i<3 ; i++)
+	{
+		client->ps.viewangles[i] = pm.viewangles[i];
+		ent->s.origin[i] = pm.s.origin[i]*0.125;	// for multicasts
+	}
+	client->ps.viewoffset[2] = pm.viewheight;
+}
+
+/*
+==================
+SV_RelayClientDisconnect
+==================
+*/
+void SV_RelayClientDisconnect (edict_t *ent)
+{
+	ent->inuse = false;
+}
+
+/*
+==================
+SV_RelayClientConnect
+==================
+*/
+qboolean SV_RelayClientConnect (edict_t *ent, char *userinfo)
+{
+	return true;
+}
+
+/*
+==================
+SV_RelayInit
+==================
+*/
+void SV_RelayInit (void)
+{
+	sv_relay.edicts = Z_Malloc (MAX_EDICTS * sizeof(edict_t));
+	sv_relay.clients = Z_Malloc (maxclients->intValue * sizeof(gclient_t));
+	sv_relayexport.edicts = sv_relay.edicts;
+	sv_relayexport.num_edicts = maxclients->intValue + 1;
+}
+
+/*
+==================
+SV_RelayShutdown
+==================
+*/
+void SV_RelayShutdown (void)
+{
+	Z_Free (sv_relay.edicts);
+	Z_Free (sv_relay.clients);
+	sv_relay.edicts = NULL;
+	sv_relay.clients = NULL;
+}
+
+/*
+==================
+SV_RelayNop
+
+Saving, client commands and the rest have nothing to do on a relay
+==================
+*/
+void SV_RelayNop (void)
+{
+}
+
+void SV_RelayNopString (char *s)
+{
+}
+
+void SV_RelayNopGame (char *s, qboolean autosave)
+{
+}
+
+void SV_RelayNopEdict (edict_t *ent)
+{
+}
+
+void SV_RelayNopUserinfo (edict_t *ent, char *userinfo)
+{
+}
+
+/*
+==================
+SV_GetRelayAPI
+
+Stands in for the game dll while relaying
+==================
+*/
+game_export_t *SV_GetRelayAPI (void)
+{
+	memset (&sv_relayexport, 0, sizeof(sv_relayexport));
+	sv_relayexport.apiversion = GAME_API_VERSION;
+	sv_relayexport.Init = SV_RelayInit;
+	sv_relayexport.Shutdown = SV_RelayShutdown;
+	sv_relayexport.SpawnEntities = SV_RelaySpawnEntities;
+	sv_relayexport.WriteGame = SV_RelayNopGame;
+	sv_relayexport.ReadGame = SV_RelayNopString;
+	sv_relayexport.WriteLevel = SV_RelayNopString;
+	sv_relayexport.ReadLevel = SV_RelayNopString;
+	sv_relayexport.ClientConnect = SV_RelayClientConnect;
+	sv_relayexport.ClientBegin = SV_RelayClientBegin;
+	sv_relayexport.ClientUserinfoChanged = SV_RelayNopUserinfo;
+	sv_relayexport.ClientDisconnect = SV_RelayClientDisconnect;
+	sv_relayexport.ClientCommand = SV_RelayNopEdict;
+	sv_relayexport.ClientThink = SV_RelayClientThink;
+	sv_relayexport.RunFrame = SV_RelayRunFrame;
+	sv_relayexport.ServerCommand = SV_RelayNop;
+	sv_relayexport.edict_size = sizeof(edict_t);
+	sv_relayexport.max_edicts = MAX_EDICTS;
+	return &sv_relayexport;
+}
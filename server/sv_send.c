@@ -21,6 +21,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "server.h"
 
+extern	int num_sz_getspace_overflows;
+
 /*
 =============================================================================
 
@@ -164,7 +166,7 @@ MULTICAST_PHS	send to clients potentially hearable from org
 void SV_Multicast (vec3_t origin, multicast_t to)
 {
 	client_t	*client;
-	byte		*mask;
+	const byte	*mask;
 	int			leafnum, cluster;
 	int			j;
 	qboolean	reliable;
@@ -225,6 +227,13 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 		if (client->state != cs_spawned && !reliable)
 			continue;
 
+		// relays get everything along with where it goes, and cull for their own clients
+		if (client->relay)
+		{
+			SV_WriteRelayMulticast (reliable ? &client->netchan.message : &client->datagram, origin, to);
+			continue;
+		}
+
 		if (mask)
 		{
 			leafnum = CM_PointLeafnum (client->edict->s.origin);
@@ -246,6 +255,30 @@ void SV_Multicast (vec3_t origin, multicast_t to)
 }
 
 
+/*
+=================
+SV_WriteRelayMulticast
+
+Wraps the multicast in svc_multicast for a relay
+=================
+*/
+void SV_WriteRelayMulticast (sizebuf_t *buf, vec3_t origin, multicast_t to)
+{
+	if (buf->cursize + sv.multicast.cursize + 10 > buf->maxsize)
+	{
+		buf->overflowed = true;
+		return;
+	}
+
+	MSG_WriteByte (buf, svc_multicast);
+	MSG_WriteByte (buf, to);
+	if (to != MULTICAST_ALL_R && to != MULTICAST_ALL)
+		MSG_WritePos (buf, origin);
+	MSG_WriteShort (buf, sv.multicast.cursize);
+	SZ_Write (buf, sv.multicast.data, sv.multicast.cursize);
+}
+
+
 /*  
 ==================
 SV_StartSound
@@ -394,29 +427,82 @@ FRAME UPDATES
 
 /*
 =======================
-SV_SendClientDatagram
+SV_DatagramLimit
+
+Largest datagram the client may be sent in one frame
 =======================
 */
-qboolean SV_SendClientDatagram (client_t *client)
+int SV_DatagramLimit (client_t *client)
 {
-	byte		msg_buf[MAX_MSGLEN];
-	sizebuf_t	msg;
-
-	SV_BuildClientFrame (client);
-
-	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+	if (client->relay)
+		return MAX_MSGLEN/2;	// leaves the rest of a packet for the reliable message
 
 	if ((maxclients->intValue > 1) && !(client->netchan.remote_address.type == NA_LOOPBACK))
 	{
-		msg.maxsize = MAX_MSGLEN_MP; /* FS: MAX_MSGLEN is now for single player */
+		return client->netchan.fragment ? MAX_MSGLEN_FRAG : MAX_MSGLEN_MP; /* FS: MAX_MSGLEN is now for single player */
 	}
 
-	msg.allowoverflow = true;
+	return MAX_MSGLEN;
+}
 
-	// send over all the relevant entity_state_t
-	// and the player_state_t
-	SV_WriteFrameToClient (client, &msg);
+/*
+=======================
+SV_FrameBudget
+
+Bytes the next frame written for the client may take, what
+is left of its rate or the datagram limit, whichever is less.
+-1 if frames aren't trimmed to fit.
+=======================
+*/
+int SV_FrameBudget (client_t *client)
+{
+	int		budget;
+
+	if (!sv_ratecull->intValue)
+		return -1;
+
+	budget = SV_DatagramLimit (client);
+	if (client->netchan.remote_address.type != NA_LOOPBACK && !client->relay && client->rate_tokens < budget)
+		budget = client->rate_tokens;
 
+	// the multicast datagram goes in after the frame
+	if (!client->datagram.overflowed)
+		budget -= client->datagram.cursize;
+
+	return budget < 0 ? 0 : budget;
+}
+
+/*
+=======================
+SV_ClampDatagram
+
+Frames are written into a full size buffer, anything that went
+past the datagram limit is an overflow, same as if it had
+run out of room while writing
+=======================
+*/
+void SV_ClampDatagram (client_t *client, sizebuf_t *msg)
+{
+	msg->maxsize = SV_DatagramLimit (client);
+	if (msg->cursize > msg->maxsize)
+	{
+		Com_Printf ("SZ_GetSpace: overflow\n");
+		SZ_Clear (msg);
+		msg->overflowed = true;
+		num_sz_getspace_overflows++;
+	}
+}
+
+/*
+=======================
+SV_FinishClientDatagram
+
+Appends the accumulated multicast datagram to a
+written frame and sends it off
+=======================
+*/
+void SV_FinishClientDatagram (client_t *client, sizebuf_t *msg)
+{
 	// copy the accumulated multicast datagram
 	// for this client out to the message
 	// it is necessary for this to be after the WriteEntities
@@ -424,24 +510,401 @@ qboolean SV_SendClientDatagram (client_t *client)
 	if (client->datagram.overflowed)
 		Com_DPrintf (DEVELOPER_MSG_SERVER, "WARNING: datagram overflowed for %s [Cur: %d] [Max: %d]\n", client->name, client->datagram.cursize, client->datagram.maxsize);
 	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
 	SZ_Clear (&client->datagram);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{	// must have room left for the packet header
-		Com_DPrintf (DEVELOPER_MSG_SERVER, "WARNING: msg overflowed for %s [Cur: %d] [Max: %d]\n", client->name, msg.cursize, msg.maxsize);
-		SZ_Clear (&msg);
+		Com_DPrintf (DEVELOPER_MSG_SERVER, "WARNING: msg overflowed for %s [Cur: %d] [Max: %d]\n", client->name, msg->cursize, msg->maxsize);
+		SZ_Clear (msg);
 	}
 
+	// fill the rest with the client's download
+	SV_WriteDownloadWindow (client, msg);
+
 	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, msg.data);
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
+
+	// take it out of the rate bucket
+	client->rate_tokens -= msg->cursize;
+}
+
+/*
+=======================
+SV_SendDownloadDatagram
+
+Keeps a windowed download going to a client that isn't in the game
+yet, with as many packets a frame as its rate allows
+=======================
+*/
+#define	MAX_DOWNLOAD_PACKETS	8
+
+void SV_SendDownloadDatagram (client_t *client)
+{
+	byte		msg_buf[MAX_MSGLEN];
+	sizebuf_t	msg;
+	int			i, count;
+
+	for (i=0 ; i<MAX_DOWNLOAD_PACKETS ; i++)
+	{
+		SZ_Init (&msg, msg_buf, SV_DatagramLimit (client));
+		count = client->downloadcount;
+		SV_FinishClientDatagram (client, &msg);
+		if (!client->download || client->downloadcount == count || client->rate_tokens <= 0)
+			break;
+	}
+}
+
+/*
+=======================
+SV_SendClientDatagram
+=======================
+*/
+qboolean SV_SendClientDatagram (client_t *client)
+{
+	byte		msg_buf[MAX_MSGLEN];
+	sizebuf_t	msg;
+
+	SV_BuildClientFrame (client);
+
+	SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+	msg.allowoverflow = true;
+
+	// send over all the relevant entity_state_t
+	// and the player_state_t
+	SV_WriteFrameToClient (client, &msg, SV_DeltaCache (0));
+	SV_ClampDatagram (client, &msg);
+
+	SV_FinishClientDatagram (client, &msg);
+
+	return true;
+}
+
+
+/*
+===============================================================================
+
+WORKER THREADS
+
+With sv_threads set, picking the visible entities and delta encoding
+the frames of all spawned clients is spread over a pool of threads.
+Claiming space in svs.client_entities and Netchan_Transmit stay on
+the main thread, so the packets that go out are the same as when
+the clients are done one after another.
+
+===============================================================================
+*/
+
+#define	MAX_SV_THREADS	32
+
+typedef struct
+{
+	client_t	*client;
+	int			count;				// selected entities, -1 if not in game
+	short		list[MAX_EDICTS];
+	sizebuf_t	msg;
+	byte		msg_buf[MAX_MSGLEN];
+} sv_job_t;
+
+typedef struct
+{
+	int			requested;			// sv_threads value the pool was made for
+	int			numthreads;			// running threads, the main thread is extra
+	void		*threads[MAX_SV_THREADS];
+	void		*wake[MAX_SV_THREADS];
+	int			ids[MAX_SV_THREADS+1];
+	void		*done;
+	void		*lock;
+	qboolean	quit;
+
+	void		(*func) (sv_job_t *job, int worker);
+	sv_job_t	*jobs;
+	int			numjobs, maxjobs;
+	int			nextjob;
+
+	byte		*pvs;				// a private row per worker
+	byte		*phs;
+	deltacache_t	*caches[MAX_SV_THREADS+1];
+} sv_workers_t;
+
+#define	SV_PVS_ROW	(65536/8)
+#define	SV_PHS_ROW	(MAX_MAP_LEAFS/8)
+
+static sv_workers_t	sv_workers;
+
+/*
+=================
+SV_WorkerJobs
+
+Runs jobs until there are none left, on any thread
+=================
+*/
+void SV_WorkerJobs (int worker)
+{
+	int		j;
+
+	while (1)
+	{
+		Sys_LockMutex (sv_workers.lock);
+		j = sv_workers.nextjob++;
+		Sys_UnlockMutex (sv_workers.lock);
+
+		if (j >= sv_workers.numjobs)
+			break;
+		sv_workers.func (&sv_workers.jobs[j], worker);
+	}
+}
+
+void SV_WorkerThread (void *parm)
+{
+	int		worker = *(int *)parm;
+
+	while (1)
+	{
+		Sys_SemaphoreWait (sv_workers.wake[worker-1]);
+		if (sv_workers.quit)
+			break;
+		SV_WorkerJobs (worker);
+		Sys_SemaphorePost (sv_workers.done);
+	}
+}
+
+/*
+=================
+SV_RunJobs
+
+Calls func for every queued job and returns when all are done
+=================
+*/
+void SV_RunJobs (void (*func) (sv_job_t *job, int worker))
+{
+	int		i;
+
+	sv_workers.func = func;
+	sv_workers.nextjob = 0;
+
+	for (i=0 ; i<sv_workers.numthreads ; i++)
+		Sys_SemaphorePost (sv_workers.wake[i]);
+
+	SV_WorkerJobs (0);
+
+	for (i=0 ; i<sv_workers.numthreads ; i++)
+		Sys_SemaphoreWait (sv_workers.done);
+}
+
+/*
+=================
+SV_ShutdownWorkers
+=================
+*/
+void SV_ShutdownWorkers (void)
+{
+	int		i;
+
+	sv_workers.quit = true;
+	for (i=0 ; i<sv_workers.numthreads ; i++)
+		Sys_SemaphorePost (sv_workers.wake[i]);
+	for (i=0 ; i<sv_workers.numthreads ; i++)
+	{
+		Sys_WaitThread (sv_workers.threads[i]);
+		Sys_DestroySemaphore (sv_workers.wake[i]);
+	}
+
+	if (sv_workers.done)
+		Sys_DestroySemaphore (sv_workers.done);
+	if (sv_workers.lock)
+		Sys_DestroyMutex (sv_workers.lock);
+
+	if (sv_workers.jobs)
+		Z_Free (sv_workers.jobs);
+	for (i=0 ; i<=MAX_SV_THREADS ; i++)
+	{
+		if (sv_workers.caches[i])
+			Z_Free (sv_workers.caches[i]);
+	}
+	if (sv_workers.pvs)
+		Z_Free (sv_workers.pvs);
+	if (sv_workers.phs)
+		Z_Free (sv_workers.phs);
 
-	// record the size for rate estimation
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	memset (&sv_workers, 0, sizeof(sv_workers));
+}
+
+/*
+=================
+SV_CheckWorkers
+
+(Re)starts the pool when sv_threads changes.
+Returns true if frames should be built on the workers.
+=================
+*/
+qboolean SV_CheckWorkers (void)
+{
+	int		i, n;
+
+	n = sv_threads->intValue;
+	if (n < 0)
+		n = 0;
+	if (n > MAX_SV_THREADS)
+		n = MAX_SV_THREADS;
+
+	if (n == sv_workers.requested)
+		return sv_workers.numthreads > 0;
+
+	SV_ShutdownWorkers ();
+	sv_workers.requested = n;
+	if (!n)
+		return false;
+
+	sv_workers.lock = Sys_CreateMutex ();
+	sv_workers.done = Sys_CreateSemaphore (0);
+	if (!sv_workers.lock || !sv_workers.done)
+	{
+		Com_Printf ("sv_threads: no thread support, building frames serially\n");
+		SV_ShutdownWorkers ();
+		sv_workers.requested = n;
+		return false;
+	}
+
+	for (i=0 ; i<n ; i++)
+	{
+		sv_workers.ids[i+1] = i+1;
+		sv_workers.wake[i] = Sys_CreateSemaphore (0);
+		if (!sv_workers.wake[i])
+			break;
+		sv_workers.threads[i] = Sys_CreateThread (SV_WorkerThread, &sv_workers.ids[i+1]);
+		if (!sv_workers.threads[i])
+		{
+			Sys_DestroySemaphore (sv_workers.wake[i]);
+			break;
+		}
+		sv_workers.numthreads++;
+	}
+
+	if (!sv_workers.numthreads)
+	{
+		Com_Printf ("sv_threads: couldn't start any threads, building frames serially\n");
+		SV_ShutdownWorkers ();
+		sv_workers.requested = n;
+		return false;
+	}
 
+	sv_workers.pvs = Z_Malloc ((sv_workers.numthreads+1) * SV_PVS_ROW);
+	sv_workers.phs = Z_Malloc ((sv_workers.numthreads+1) * SV_PHS_ROW);
+
+	Com_Printf ("Building client frames on %i worker threads\n", sv_workers.numthreads);
 	return true;
 }
 
+/*
+=================
+SV_DeltaCache
+
+Returns the entity delta cache used by a worker, or NULL if
+sv_deltacache is off.  Must be called on the main thread first.
+=================
+*/
+deltacache_t *SV_DeltaCache (int worker)
+{
+	if (!sv_deltacache->intValue)
+		return NULL;
+
+	if (!sv_workers.caches[worker])
+		sv_workers.caches[worker] = Z_Malloc (sizeof(deltacache_t));
+	return sv_workers.caches[worker];
+}
+
+/*
+=================
+SV_ReserveJobs
+=================
+*/
+void SV_ReserveJobs (int count)
+{
+	sv_workers.numjobs = 0;
+	if (count <= sv_workers.maxjobs)
+		return;
+
+	if (sv_workers.jobs)
+		Z_Free (sv_workers.jobs);
+	sv_workers.jobs = Z_Malloc (count * sizeof(sv_job_t));
+	sv_workers.maxjobs = count;
+}
+
+void SV_AddJob (client_t *client)
+{
+	sv_workers.jobs[sv_workers.numjobs++].client = client;
+}
+
+void SV_SelectJob (sv_job_t *job, int worker)
+{
+	if (!job->client->edict->client)
+	{
+		job->count = -1;	// not in game yet
+		return;
+	}
+
+	job->count = SV_SelectFrameEntities (job->client,
+		sv_workers.pvs + worker*SV_PVS_ROW,
+		sv_workers.phs + worker*SV_PHS_ROW, job->list);
+}
+
+void SV_WriteJob (sv_job_t *job, int worker)
+{
+	// write into the full buffer, the datagram limit is applied
+	// on the main thread so an overflow never prints from here
+	SZ_Init (&job->msg, job->msg_buf, sizeof(job->msg_buf));
+	job->msg.allowoverflow = true;
+
+	SV_WriteFrameToClient (job->client, &job->msg,
+		sv_deltacache->intValue ? sv_workers.caches[worker] : NULL);
+}
+
+/*
+=================
+SV_WriteJobFrames
+
+Builds and delta encodes the frames of all queued jobs
+=================
+*/
+void SV_WriteJobFrames (void)
+{
+	int			j;
+	sv_job_t	*job;
+
+	SV_RunJobs (SV_SelectJob);
+
+	// the circular client_entities array is handed out in client order
+	for (j=0, job=sv_workers.jobs ; j<sv_workers.numjobs ; j++, job++)
+	{
+		if (job->count >= 0)
+			SV_StoreFrameEntities (job->client, job->list, job->count);
+	}
+
+	// the caches are only allocated from the main thread
+	for (j=0 ; j<=sv_workers.numthreads ; j++)
+		SV_DeltaCache (j);
+
+	SV_RunJobs (SV_WriteJob);
+}
+
+/*
+=================
+SV_TransmitJobs
+=================
+*/
+void SV_TransmitJobs (void)
+{
+	int			j;
+	sv_job_t	*job;
+
+	for (j=0, job=sv_workers.jobs ; j<sv_workers.numjobs ; j++, job++)
+	{
+		SV_ClampDatagram (job->client, &job->msg);
+		SV_FinishClientDatagram (job->client, &job->msg);
+	}
+}
+
 
 /*
 ==================
@@ -469,24 +932,25 @@ bandwidth estimation and should not be sent another packet
 */
 qboolean SV_RateDrop (client_t *c)
 {
-	int		total;
-	int		i;
+	int		msec;
 
-	// never drop over the loopback
-	if (c->netchan.remote_address.type == NA_LOOPBACK)
+	// never drop over the loopback, or to a relay that has spectators waiting on it
+	if (c->netchan.remote_address.type == NA_LOOPBACK || c->relay)
 		return false;
 
-	total = 0;
+	// refill the bucket, it holds at most RATE_BURST msec worth
+	msec = svs.realtime - c->rate_time;
+	if (msec < 0 || msec > RATE_BURST)
+		msec = RATE_BURST;
+	c->rate_time = svs.realtime;
 
-	for (i = 0 ; i < RATE_MESSAGES ; i++)
-	{
-		total += c->message_size[i];
-	}
+	c->rate_tokens += c->rate * msec / 1000;
+	if (c->rate_tokens > c->rate * RATE_BURST / 1000)
+		c->rate_tokens = c->rate * RATE_BURST / 1000;
 
-	if (total > c->rate)
+	if (c->rate_tokens <= 0)
 	{
 		c->surpressCount++;
-		c->message_size[sv.framenum % RATE_MESSAGES] = 0;
 		return true;
 	}
 
@@ -505,6 +969,7 @@ void SV_SendClientMessages (void)
 	int			msglen;
 	byte		msgbuf[MAX_MSGLEN];
 	int			r;
+	qboolean	parallel;
 
 	msglen = 0;
 
@@ -539,6 +1004,19 @@ void SV_SendClientMessages (void)
 		}
 	}
 
+	// all the datagrams go to the kernel together at the end
+	NET_BeginBatch (NS_SERVER);
+
+	parallel = false;
+	if (sv.state == ss_game)
+	{
+		SV_BuildEntityIndex ();
+
+		parallel = SV_CheckWorkers ();
+		if (parallel)
+			SV_ReserveJobs (maxclients->intValue);
+	}
+
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i<maxclients->value; i++, c++)
 	{
@@ -552,6 +1030,10 @@ void SV_SendClientMessages (void)
 			SZ_Clear (&c->datagram);
 			SV_BroadcastPrintf (PRINT_HIGH, "%s overflowed\n", c->name);
 			SV_DropClient (c);
+
+			// the game may have removed the body
+			if (sv.state == ss_game)
+				SV_BuildEntityIndex ();
 		}
 
 		if (sv.state == ss_cinematic 
@@ -561,12 +1043,21 @@ void SV_SendClientMessages (void)
 			Netchan_Transmit (&c->netchan, msglen, msgbuf);
 		else if (c->state == cs_spawned)
 		{
+			// 10 Hz clients sit out the frames in between
+			if (!SV_ClientFrameDue (c))
+				continue;
+
 			// don't overrun bandwidth
 			if (SV_RateDrop (c))
 				continue;
 
-			SV_SendClientDatagram (c);
+			if (parallel)
+				SV_AddJob (c);
+			else
+				SV_SendClientDatagram (c);
 		}
+		else if (c->download && c->dlwindow && !SV_RateDrop (c))
+			SV_SendDownloadDatagram (c);
 		else
 		{
 	// just update reliable	if needed
@@ -574,5 +1065,185 @@ void SV_SendClientMessages (void)
 				Netchan_Transmit (&c->netchan, 0, NULL);
 		}
 	}
+
+	if (parallel && sv_workers.numjobs)
+	{
+		SV_WriteJobFrames ();
+		SV_TransmitJobs ();
+	}
+
+	NET_FlushBatch (NS_SERVER);
+}
+
+
+
+/*
+==================
+SV_BenchFrames
+
+Builds and encodes frames for count viewers, returns usec taken
+and adds the bytes written to *bytes
+==================
+*/
+unsigned SV_BenchFrames (client_t *viewers, int count, int frames, qboolean parallel, deltacache_t *cache, int *bytes)
+{
+	int			f, i;
+	unsigned	start;
+	byte		msg_buf[MAX_MSGLEN];
+	sizebuf_t	msg;
+
+	start = Sys_Microseconds ();
+	for (f=0 ; f<frames ; f++)
+	{
+		sv.framenum++;
+		for (i=0 ; i<count ; i++)
+			viewers[i].lastframe = f ? sv.framenum - 1 : -1;
+
+		if (parallel)
+		{
+			SV_ReserveJobs (count);
+			for (i=0 ; i<count ; i++)
+				SV_AddJob (&viewers[i]);
+			SV_WriteJobFrames ();
+			for (i=0 ; i<count ; i++)
+				*bytes += sv_workers.jobs[i].msg.cursize;
+			continue;
+		}
+
+		for (i=0 ; i<count ; i++)
+		{
+			SV_BuildClientFrame (&viewers[i]);
+			SZ_Init (&msg, msg_buf, sizeof(msg_buf));
+			msg.allowoverflow = true;
+			SV_WriteFrameToClient (&viewers[i], &msg, cache);
+			*bytes += msg.cursize;
+		}
+	}
+
+	return Sys_Microseconds () - start;
 }
 
+/*
+==================
+SV_SendBench_f
+
+sv_sendbench [frames] [viewers]
+
+Times frame building for made up viewers standing at the positions
+of the map's entities: serially without and with the delta cache,
+and on the sv_threads workers
+==================
+*/
+void SV_SendBench_f (void)
+{
+	int				frames, maxviewers;
+	int				i, e, count, bytes;
+	unsigned		plain, cached, threaded;
+	float			hitrate;
+	client_t		*viewers;
+	edict_t			*bodies;
+	gclient_t		*players;
+	edict_t			*ent = NULL;
+	entity_state_t	*save_entities;
+	int				save_num, save_next, save_framenum;
+	deltacache_t	*cache;
+	qboolean		parallel;
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf ("No map running.\n");
+		return;
+	}
+
+	frames = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 100;
+	maxviewers = (Cmd_Argc() > 2) ? atoi(Cmd_Argv(2)) : 64;
+	if (frames < 1)
+		frames = 1;
+	if (maxviewers < 1)
+		maxviewers = 1;
+
+	parallel = SV_CheckWorkers ();
+	SV_BuildEntityIndex ();
+
+	viewers = Z_Malloc (maxviewers * sizeof(*viewers));
+	bodies = Z_Malloc (maxviewers * sizeof(*bodies));
+	players = Z_Malloc (maxviewers * sizeof(*players));
+	cache = Z_Malloc (sizeof(*cache));
+
+	// spread the viewers over whatever has a model
+	for (i=0, e=1 ; i<maxviewers ; i++)
+	{
+		for (count=0 ; count<ge->num_edicts ; count++, e++)
+		{
+			if (e >= ge->num_edicts)
+				e = 1;
+			ent = EDICT_NUM(e);
+			if (ent->inuse && ent->s.modelindex)
+				break;
+		}
+
+		bodies[i].client = &players[i];
+		if (count < ge->num_edicts)
+		{
+			for (count=0 ; count<3 ; count++)
+				players[i].ps.pmove.origin[count] = (short)(ent->s.origin[count] * 8);
+		}
+		e++;
+
+		viewers[i].state = cs_spawned;
+		viewers[i].tickrate = true;		// a frame each sv.framenum
+		viewers[i].edict = &bodies[i];
+	}
+
+	// keep the real clients' deltas intact
+	save_entities = svs.client_entities;
+	save_num = svs.num_client_entities;
+	save_next = svs.next_client_entities;
+	save_framenum = sv.framenum;
+
+	svs.num_client_entities = maxviewers*UPDATE_WINDOW*sv.framediv*64;
+	svs.client_entities = Z_Malloc (svs.num_client_entities * sizeof(entity_state_t));
+	svs.next_client_entities = 0;
+
+	Com_Printf ("%i frames, %i worker threads\n", frames, parallel ? sv_workers.numthreads : 0);
+	Com_Printf ("viewers   ms/frame  cached  hit%%   KB/s at 10Hz  threaded\n");
+	for (count=1 ; ; count*=2)
+	{
+		if (count > maxviewers)
+			count = maxviewers;
+
+		bytes = 0;
+		plain = SV_BenchFrames (viewers, count, frames, false, NULL, &bytes);
+
+		cache->hits = cache->misses = 0;
+		cached = SV_BenchFrames (viewers, count, frames, false, cache, &bytes);
+		hitrate = cache->hits + cache->misses;
+		if (hitrate)
+			hitrate = 100.0f * cache->hits / hitrate;
+
+		Com_Printf ("%7i  %9.3f  %6.3f  %4.1f  %12.1f", count, (float)plain/(frames*1000),
+			(float)cached/(frames*1000), hitrate, (float)bytes*10/(2*frames*1024));
+
+		if (parallel)
+		{
+			threaded = SV_BenchFrames (viewers, count, frames, true, NULL, &bytes);
+			Com_Printf ("  %8.3f\n", (float)threaded/(frames*1000));
+		}
+		else
+			Com_Printf ("  %8s\n", "-");
+
+		if (count == maxviewers)
+			break;
+	}
+
+	Z_Free (svs.client_entities);
+	svs.client_entities = save_entities;
+	svs.num_client_entities = save_num;
+	svs.next_client_entities = save_next;
+	sv.framenum = save_framenum;
+
+	Z_Free (cache);
+	Z_Free (players);
+	Z_Free (bodies);
+	Z_Free (viewers);
+}
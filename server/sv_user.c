@@ -47,6 +47,65 @@ void SV_BeginDemoserver (void)
 		Com_Error (ERR_DROP, "Couldn't open %s\n", name);
 }
 
+/*
+==================
+SV_BeginBurst
+
+Returns where a run of configstrings or baselines should be written.
+Clients that take svc_zpacket get a scratch buffer with twice the room,
+SV_EndBurst compresses it into their reliable message.
+==================
+*/
+sizebuf_t *SV_BeginBurst (sizebuf_t *burst, byte *data, int size, int *max_packet_len)
+{
+	if (!sv_client->compress || sv_client->netchan.remote_address.type == NA_LOOPBACK)
+		return &sv_client->netchan.message;
+
+	SZ_Init (burst, data, size);
+	*max_packet_len = *max_packet_len * 2 - sv_client->netchan.message.cursize;
+	return burst;
+}
+
+/*
+==================
+SV_WriteZPacket
+
+Compresses raw into an svc_zpacket on the reliable message if it comes
+out smaller and fits in maxsize.  Returns false if nothing was written.
+==================
+*/
+qboolean SV_WriteZPacket (sizebuf_t *raw, int maxsize)
+{
+	byte	zbuf[MAX_MSGLEN];
+	int		zlen;
+
+	if (maxsize > raw->cursize)
+		maxsize = raw->cursize;
+	zlen = Com_Compress (raw->data, raw->cursize, zbuf, maxsize - 5);
+	if (zlen < 0)
+		return false;
+
+	MSG_WriteByte (&sv_client->netchan.message, svc_zpacket);
+	MSG_WriteShort (&sv_client->netchan.message, zlen);
+	MSG_WriteShort (&sv_client->netchan.message, raw->cursize);
+	SZ_Write (&sv_client->netchan.message, zbuf, zlen);
+	return true;
+}
+
+/*
+==================
+SV_EndBurst
+==================
+*/
+void SV_EndBurst (sizebuf_t *msg)
+{
+	if (msg == &sv_client->netchan.message)
+		return;
+
+	if (!SV_WriteZPacket (msg, msg->cursize))
+		SZ_Write (&sv_client->netchan.message, msg->data, msg->cursize);
+}
+
 /*
 ================
 SV_New_f
@@ -109,6 +168,13 @@ void SV_New_f (void)
 		sv_client->edict = ent;
 		memset (&sv_client->lastcmd, 0, sizeof(sv_client->lastcmd));
 
+		// a client that gets every frame needs to know how long they are
+		if (sv_client->tickrate && sv.framediv > 1)
+		{
+			MSG_WriteByte (&sv_client->netchan.message, svc_tickrate);
+			MSG_WriteByte (&sv_client->netchan.message, sv.frametime);
+		}
+
 		// begin fetching configstrings
 		MSG_WriteByte (&sv_client->netchan.message, svc_stufftext);
 		MSG_WriteString (&sv_client->netchan.message, va("cmd configstrings %i 0\n",svs.spawncount) );
@@ -125,6 +191,8 @@ void SV_Configstrings_f (void)
 {
 	int	startPos, start;
 	int	max_packet_len; /* FS: Added */
+	sizebuf_t	burst, *msg;
+	byte		burst_buf[MAX_MSGLEN];
 
 	Com_DPrintf(DEVELOPER_MSG_SERVER, "Configstrings() from %s\n", sv_client->name);
 
@@ -158,21 +226,23 @@ void SV_Configstrings_f (void)
 	}
 	else
 	{
-		max_packet_len = MAX_MSGLEN_MP / 2;
+		max_packet_len = (sv_client->netchan.fragment ? MAX_MSGLEN_FRAG : MAX_MSGLEN_MP) / 2;
 	}
 
 	// write a packet full of data
-	while ( sv_client->netchan.message.cursize < max_packet_len 
+	msg = SV_BeginBurst (&burst, burst_buf, sizeof(burst_buf), &max_packet_len);
+	while ( msg->cursize < max_packet_len 
 		&& start < MAX_CONFIGSTRINGS)
 	{
 		if (sv.configstrings[start][0])
 		{
-			MSG_WriteByte (&sv_client->netchan.message, svc_configstring);
-			MSG_WriteShort (&sv_client->netchan.message, start);
-			MSG_WriteString (&sv_client->netchan.message, sv.configstrings[start]);
+			MSG_WriteByte (msg, svc_configstring);
+			MSG_WriteShort (msg, start);
+			MSG_WriteString (msg, sv.configstrings[start]);
 		}
 		start++;
 	}
+	SV_EndBurst (msg);
 
 	// send next command
 
@@ -197,6 +267,8 @@ void SV_Baselines_f (void)
 {
 	int	startPos, start;
 	int	max_packet_len; /* FS: Added */
+	sizebuf_t	burst, *msg;
+	byte		burst_buf[MAX_MSGLEN];
 	entity_state_t	nullstate;
 	entity_state_t	*base;
 
@@ -232,24 +304,25 @@ void SV_Baselines_f (void)
 	}
 	else
 	{
-		max_packet_len = MAX_MSGLEN_MP / 2;
+		max_packet_len = (sv_client->netchan.fragment ? MAX_MSGLEN_FRAG : MAX_MSGLEN_MP) / 2;
 	}
 
 	memset (&nullstate, 0, sizeof(nullstate));
 
 	// write a packet full of data
-
-	while ( sv_client->netchan.message.cursize <  max_packet_len
+	msg = SV_BeginBurst (&burst, burst_buf, sizeof(burst_buf), &max_packet_len);
+	while ( msg->cursize <  max_packet_len
 		&& start < MAX_EDICTS)
 	{
 		base = &sv.baselines[start];
 		if (base->modelindex || base->sound || base->effects)
 		{
-			MSG_WriteByte (&sv_client->netchan.message, svc_spawnbaseline);
-			MSG_WriteDeltaEntity (&nullstate, base, &sv_client->netchan.message, true, true);
+			MSG_WriteByte (msg, svc_spawnbaseline);
+			MSG_WriteDeltaEntity (&nullstate, base, msg, true, true);
 		}
 		start++;
 	}
+	SV_EndBurst (msg);
 
 	// send next command
 
@@ -292,49 +365,273 @@ void SV_Begin_f (void)
 
 	sv_client->state = cs_spawned;
 	
-	// call the game begin function
-	ge->ClientBegin (sv_player);
+	// call the game begin function, relays never enter the game
+	if (!sv_client->relay)
+		ge->ClientBegin (sv_player);
 
 	Cbuf_InsertFromDefer ();
 }
 
 //=============================================================================
 
+#define	DOWNLOAD_ZCHUNK		4096		// biggest piece tried compressed
+#define	MAX_DOWNLOAD_FILES	16			// different files shared between downloaders
+
+// clients pulling the same file share one copy of it
+typedef struct
+{
+	char		name[MAX_QPATH];
+	byte		*data;
+	int			size;
+	qboolean	frompak;
+	int			refcount;
+} dlfile_t;
+
+dlfile_t	sv_dlfiles[MAX_DOWNLOAD_FILES];
+
 /*
 ==================
-SV_NextDownload_f
+SV_OpenDownload
+
+Sets the client's download to the named file, loading it only if
+no other client is downloading it.  Returns false if it isn't there.
 ==================
 */
-void SV_NextDownload_f (void)
+qboolean SV_OpenDownload (client_t *cl, char *name, qboolean *frompak)
+{
+	extern	int		file_from_pak;
+	dlfile_t	*dl, *unused;
+	int			i;
+
+	SV_CloseDownload (cl);
+
+	unused = NULL;
+	for (i=0, dl=sv_dlfiles ; i<MAX_DOWNLOAD_FILES ; i++, dl++)
+	{
+		if (!dl->refcount)
+		{
+			if (!unused)
+				unused = dl;
+			continue;
+		}
+		if (!Q_stricmp (dl->name, name))
+		{
+			dl->refcount++;
+			cl->download = dl->data;
+			cl->downloadsize = dl->size;
+			*frompak = dl->frompak;
+			return true;
+		}
+	}
+
+	cl->downloadsize = FS_LoadFile (name, (void **)&cl->download);
+	*frompak = file_from_pak;
+	if (!cl->download)
+		return false;
+
+	// with no free slot it is just this client's copy
+	if (unused)
+	{
+		Q_strncpyz (unused->name, name, sizeof(unused->name));
+		unused->data = cl->download;
+		unused->size = cl->downloadsize;
+		unused->frompak = *frompak;
+		unused->refcount = 1;
+	}
+	return true;
+}
+
+/*
+==================
+SV_CloseDownload
+
+Lets go of the client's download, the file is freed with the last one
+==================
+*/
+void SV_CloseDownload (client_t *cl)
+{
+	dlfile_t	*dl;
+	int			i;
+
+	if (!cl->download)
+		return;
+
+	for (i=0, dl=sv_dlfiles ; i<MAX_DOWNLOAD_FILES ; i++, dl++)
+	{
+		if (dl->refcount && dl->data == cl->download)
+			break;
+	}
+
+	if (i == MAX_DOWNLOAD_FILES)
+		FS_FreeFile (cl->download);
+	else if (!--dl->refcount)
+	{
+		FS_FreeFile (dl->data);
+		dl->data = NULL;
+	}
+	cl->download = NULL;
+}
+
+/*
+==================
+SV_WriteDownloadWindow
+
+Adds as much of a windowed download to msg as fits in the datagram
+and the client's rate, and as the window allows.  If nothing was
+acked for a second the unacked part is sent again.
+==================
+*/
+void SV_WriteDownloadWindow (client_t *cl, sizebuf_t *msg)
+{
+	int		room, r, size, percent;
+
+	if (!cl->download || !cl->dlwindow)
+		return;
+
+	if (cl->downloadcount > cl->downloadacked && svs.realtime - cl->downloadtime > 1000)
+	{
+		cl->downloadcount = cl->downloadacked;
+		cl->downloadtime = svs.realtime;
+	}
+
+	room = SV_DatagramLimit (cl) - cl->netchan.message.cursize;
+	if (cl->netchan.remote_address.type != NA_LOOPBACK && cl->rate_tokens < room)
+		room = cl->rate_tokens;
+	room -= msg->cursize;
+
+	size = cl->downloadsize;
+	if (!size)
+		size = 1;
+
+	while (cl->downloadcount < cl->downloadsize
+		&& cl->downloadcount < cl->downloadacked + sv_download_window->intValue)
+	{
+		r = cl->downloadsize - cl->downloadcount;
+		if (r > 1024)
+			r = 1024;
+		if (r + 8 > room)
+			break;
+		room -= r + 8;
+
+		percent = (cl->downloadcount + r)*100/size;
+		MSG_WriteByte (msg, svc_dlchunk);
+		MSG_WriteLong (msg, cl->downloadcount);
+		MSG_WriteShort (msg, r);
+		MSG_WriteByte (msg, percent);
+		SZ_Write (msg, cl->download + cl->downloadcount, r);
+		cl->downloadcount += r;
+	}
+}
+
+/*
+==================
+SV_AckDownload
+
+nextdl <offset> from a windowed download.  The offset repeated means
+the client missed what came after it.
+==================
+*/
+void SV_AckDownload (int offset)
+{
+	if (offset < 0 || offset > sv_client->downloadcount)
+		return;
+
+	if (offset > sv_client->downloadacked)
+	{
+		sv_client->downloadacked = offset;
+		sv_client->downloadtime = svs.realtime;
+	}
+	else if (offset == sv_client->downloadacked)
+	{
+		sv_client->downloadcount = offset;
+		sv_client->downloadtime = svs.realtime;
+	}
+
+	if (sv_client->downloadacked == sv_client->downloadsize)
+		SV_CloseDownload (sv_client);
+}
+
+/*
+==================
+SV_WriteDownloadChunk
+
+Writes the next r bytes of the download, leaves downloadcount alone
+==================
+*/
+void SV_WriteDownloadChunk (sizebuf_t *msg, int r)
 {
-	int		r;
 	int		percent;
 	int		size;
 
-	if (!sv_client->download)
-		return;
+	size = sv_client->downloadsize;
+	if (!size)
+		size = 1;
+	percent = (sv_client->downloadcount + r)*100/size;
+
+	MSG_WriteByte (msg, svc_download);
+	MSG_WriteShort (msg, r);
+	MSG_WriteByte (msg, percent);
+	SZ_Write (msg, sv_client->download + sv_client->downloadcount, r);
+}
+
+/*
+==================
+SV_SendDownload
+
+Sends the next piece of the download on the reliable message
+==================
+*/
+void SV_SendDownload (void)
+{
+	int			r, z;
+	sizebuf_t	chunk;
+	byte		chunk_buf[DOWNLOAD_ZCHUNK + 4];
 
 	r = sv_client->downloadsize - sv_client->downloadcount;
 	if (r > 1024)
 		r = 1024;
 
-	MSG_WriteByte (&sv_client->netchan.message, svc_download);
-	MSG_WriteShort (&sv_client->netchan.message, r);
+	// send a bigger piece if it compresses into the packet a plain one would take
+	z = 0;
+	if (sv_client->compress && sv_client->netchan.remote_address.type != NA_LOOPBACK)
+	{
+		for (z = DOWNLOAD_ZCHUNK ; z > r ; z /= 2)
+		{
+			if (z > sv_client->downloadsize - sv_client->downloadcount)
+				continue;
+			SZ_Init (&chunk, chunk_buf, sizeof(chunk_buf));
+			SV_WriteDownloadChunk (&chunk, z);
+			if (SV_WriteZPacket (&chunk, r + 4))
+				break;
+		}
+	}
 
+	if (z > r)
+		r = z;
+	else
+		SV_WriteDownloadChunk (&sv_client->netchan.message, r);
 	sv_client->downloadcount += r;
-	size = sv_client->downloadsize;
-	if (!size)
-		size = 1;
-	percent = sv_client->downloadcount*100/size;
-	MSG_WriteByte (&sv_client->netchan.message, percent);
-	SZ_Write (&sv_client->netchan.message,
-		sv_client->download + sv_client->downloadcount - r, r);
 
 	if (sv_client->downloadcount != sv_client->downloadsize)
 		return;
 
-	FS_FreeFile (sv_client->download);
-	sv_client->download = NULL;
+	SV_CloseDownload (sv_client);
+}
+
+/*
+==================
+SV_NextDownload_f
+==================
+*/
+void SV_NextDownload_f (void)
+{
+	if (!sv_client->download)
+		return;
+
+	if (sv_client->dlwindow && Cmd_Argc() > 1)
+		SV_AckDownload (atoi(Cmd_Argv(1)));
+	else
+		SV_SendDownload ();
 }
 
 /*
@@ -352,7 +649,7 @@ void SV_BeginDownload_f (void)
 	extern	cvar_t *allow_download_maps;
 	size_t		length;
 	qboolean	valid;
-	extern	int		file_from_pak; // ZOID did file come from pak?
+	qboolean	file_from_pak; // ZOID did file come from pak?
 	int offset = 0;
 
 	name = Cmd_Argv(1);
@@ -453,10 +750,7 @@ void SV_BeginDownload_f (void)
 		return;
 	}
 
-	if (sv_client->download)
-		FS_FreeFile (sv_client->download);
-
-	sv_client->downloadsize = FS_LoadFile (name, (void **)&sv_client->download);
+	SV_OpenDownload (sv_client, name, &file_from_pak);
 	sv_client->downloadcount = offset;
 
 	if (offset > sv_client->downloadsize)
@@ -468,10 +762,7 @@ void SV_BeginDownload_f (void)
 		|| (strncmp(name, "maps/", 5) == 0 && file_from_pak && !sv_allow_download_maps_in_paks->intValue)) /* FS: Allow bsp downloads from a pak file if we want to. */
 	{
 		Com_DPrintf(DEVELOPER_MSG_SERVER, "Couldn't download %s to %s\n", name, sv_client->name);
-		if (sv_client->download) {
-			FS_FreeFile (sv_client->download);
-			sv_client->download = NULL;
-		}
+		SV_CloseDownload (sv_client);
 
 		MSG_WriteByte (&sv_client->netchan.message, svc_download);
 		MSG_WriteShort (&sv_client->netchan.message, -1);
@@ -479,7 +770,11 @@ void SV_BeginDownload_f (void)
 		return;
 	}
 
-	SV_NextDownload_f ();
+	// windowed downloads are sent along with the datagrams
+	sv_client->downloadacked = sv_client->downloadcount;
+	sv_client->downloadtime = svs.realtime;
+	if (!sv_client->dlwindow || sv_client->downloadcount == sv_client->downloadsize)
+		SV_SendDownload ();
 	Com_DPrintf(DEVELOPER_MSG_SERVER, "Downloading %s to %s\n", name, sv_client->name);
 }
 
@@ -646,7 +941,7 @@ void SV_ExecuteUserCommand (char *s)
 	/* FS: From R1Q2.  Reset idle time. */
 	sv_client->idletime = 0;
 
-	if (!u->name && sv.state == ss_game)
+	if (!u->name && sv.state == ss_game && !sv_client->relay)
 		ge->ClientCommand (sv_player);
 
 //	SV_EndRedirect ();
@@ -673,7 +968,8 @@ void SV_ClientThink (client_t *cl, usercmd_t *cmd)
 		return;
 	}
 
-	ge->ClientThink (cl->edict, cmd);
+	if (!cl->relay)
+		ge->ClientThink (cl->edict, cmd);
 }
 
 
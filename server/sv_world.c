@@ -58,6 +58,7 @@ int		area_count, area_maxcount;
 int		area_type;
 
 int SV_HullForEntity (edict_t *ent);
+static antilag_t *SV_AntilagFrame (edict_t *shooter);
 
 
 // ClearLink is used for new headnodes
@@ -80,6 +81,475 @@ void InsertLinkBefore (link_t *l, link_t *before)
 	l->next->prev = l;
 }
 
+/*
+===============================================================================
+
+AABB TREES
+
+With sv_areatree on, solid and trigger edicts each go in a dynamic
+bounding volume tree instead of the fixed areanodes.  Every linked
+edict is a leaf whose box is its absmin/absmax fattened by
+AABB_MARGIN, so an edict that moves a little stays where it is, and
+one that moves out of its box is taken out and put back in.  Inserts
+go down to the sibling that grows the tree's surface the least and
+rotations keep it balanced, so no edict sits in a big list at the top
+of the world the way one straddling an areanode split does.
+===============================================================================
+*/
+
+#define	AABB_MARGIN		8
+#define	AABB_NODES		(MAX_EDICTS*2)
+#define	AABB_NULL		-1
+
+typedef struct
+{
+	vec3_t		mins, maxs;
+	int			parent;			// or the next free node
+	int			children[2];	// AABB_NULL for leaves
+	int			height;			// 0 for leaves
+	int			edict;			// leaves only
+} aabbnode_t;
+
+typedef struct
+{
+	aabbnode_t	nodes[AABB_NODES];
+	int			root;
+	int			freelist;
+	int			numleafs;
+} aabbtree_t;
+
+aabbtree_t	sv_aabbtrees[2];		// AREA_SOLID, AREA_TRIGGERS
+qboolean	sv_aabbactive;			// sv_areatree as of the last SV_ClearWorld
+
+// the leaf and tree of each linked edict
+int			sv_aabbleaf[MAX_EDICTS];
+byte		sv_aabbtree[MAX_EDICTS];
+
+areastats_t	sv_areastats;
+
+/*
+===============
+SV_ClearAABBTree
+===============
+*/
+void SV_ClearAABBTree (aabbtree_t *tree)
+{
+	int		i;
+
+	tree->root = AABB_NULL;
+	tree->numleafs = 0;
+	for (i=0 ; i<AABB_NODES-1 ; i++)
+	{
+		tree->nodes[i].parent = i+1;
+		tree->nodes[i].height = -1;
+	}
+	tree->nodes[AABB_NODES-1].parent = AABB_NULL;
+	tree->nodes[AABB_NODES-1].height = -1;
+	tree->freelist = 0;
+}
+
+int SV_AllocAABBNode (aabbtree_t *tree)
+{
+	int			n;
+	aabbnode_t	*node;
+
+	n = tree->freelist;
+	if (n == AABB_NULL)
+		Com_Error (ERR_DROP, "SV_AllocAABBNode: no free nodes");
+
+	node = &tree->nodes[n];
+	tree->freelist = node->parent;
+	node->parent = AABB_NULL;
+	node->children[0] = node->children[1] = AABB_NULL;
+	node->height = 0;
+	node->edict = 0;
+	return n;
+}
+
+void SV_FreeAABBNode (aabbtree_t *tree, int n)
+{
+	tree->nodes[n].parent = tree->freelist;
+	tree->nodes[n].height = -1;
+	tree->freelist = n;
+}
+
+/*
+===============
+SV_AABBUnion
+===============
+*/
+void SV_AABBUnion (vec3_t mins1, vec3_t maxs1, vec3_t mins2, vec3_t maxs2, vec3_t mins, vec3_t maxs)
+{
+	int		i;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		mins[i] = mins1[i] < mins2[i] ? mins1[i] : mins2[i];
+		maxs[i] = maxs1[i] > maxs2[i] ? maxs1[i] : maxs2[i];
+	}
+}
+
+/*
+===============
+SV_AABBArea
+
+Half the surface area, what a box costs the queries that cross it
+===============
+*/
+float SV_AABBArea (vec3_t mins, vec3_t maxs)
+{
+	float	x, y, z;
+
+	x = maxs[0] - mins[0];
+	y = maxs[1] - mins[1];
+	z = maxs[2] - mins[2];
+	return x*y + y*z + z*x;
+}
+
+/*
+===============
+SV_RefitAABBNode
+===============
+*/
+void SV_RefitAABBNode (aabbtree_t *tree, int n)
+{
+	aabbnode_t	*node, *a, *b;
+
+	node = &tree->nodes[n];
+	a = &tree->nodes[node->children[0]];
+	b = &tree->nodes[node->children[1]];
+	SV_AABBUnion (a->mins, a->maxs, b->mins, b->maxs, node->mins, node->maxs);
+	node->height = 1 + (a->height > b->height ? a->height : b->height);
+}
+
+/*
+===============
+SV_BalanceAABBNode
+
+If one child of n is more than one level taller than the other,
+rotates it up into n's place.  Returns the node now where n was.
+===============
+*/
+int SV_BalanceAABBNode (aabbtree_t *tree, int n)
+{
+	aabbnode_t	*a, *up, *parent;
+	int			tall, shortside, i, grand[2], keep, give;
+
+	a = &tree->nodes[n];
+	if (a->height < 2)
+		return n;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		tall = a->children[i];
+		shortside = a->children[i^1];
+		if (tree->nodes[tall].height - tree->nodes[shortside].height <= 1)
+			continue;
+
+		// tall comes up in n's place, n goes under it
+		up = &tree->nodes[tall];
+		grand[0] = up->children[0];
+		grand[1] = up->children[1];
+
+		up->parent = a->parent;
+		a->parent = tall;
+		if (up->parent != AABB_NULL)
+		{
+			parent = &tree->nodes[up->parent];
+			if (parent->children[0] == n)
+				parent->children[0] = tall;
+			else
+				parent->children[1] = tall;
+		}
+		else
+			tree->root = tall;
+
+		// up keeps its taller child, n takes the other one
+		if (tree->nodes[grand[0]].height > tree->nodes[grand[1]].height)
+		{
+			keep = grand[0];
+			give = grand[1];
+		}
+		else
+		{
+			keep = grand[1];
+			give = grand[0];
+		}
+		up->children[0] = n;
+		up->children[1] = keep;
+		a->children[i] = give;
+		tree->nodes[give].parent = n;
+
+		SV_RefitAABBNode (tree, n);
+		SV_RefitAABBNode (tree, tall);
+		return tall;
+	}
+
+	return n;
+}
+
+/*
+===============
+SV_RefitAABBAncestors
+
+Fixes the boxes and heights from n up to the root, balancing on the way
+===============
+*/
+void SV_RefitAABBAncestors (aabbtree_t *tree, int n)
+{
+	while (n != AABB_NULL)
+	{
+		n = SV_BalanceAABBNode (tree, n);
+		SV_RefitAABBNode (tree, n);
+		n = tree->nodes[n].parent;
+	}
+}
+
+/*
+===============
+SV_InsertAABBLeaf
+===============
+*/
+void SV_InsertAABBLeaf (aabbtree_t *tree, int leaf)
+{
+	aabbnode_t	*l, *node, *child;
+	vec3_t		mins, maxs;
+	float		area, combined, cost, inherit, childcost[2];
+	int			n, i, sibling, oldparent, newparent;
+
+	tree->numleafs++;
+	if (tree->root == AABB_NULL)
+	{
+		tree->root = leaf;
+		tree->nodes[leaf].parent = AABB_NULL;
+		return;
+	}
+
+	// find the sibling that makes the tree grow the least
+	l = &tree->nodes[leaf];
+	n = tree->root;
+	while (tree->nodes[n].height > 0)
+	{
+		node = &tree->nodes[n];
+		area = SV_AABBArea (node->mins, node->maxs);
+		SV_AABBUnion (node->mins, node->maxs, l->mins, l->maxs, mins, maxs);
+		combined = SV_AABBArea (mins, maxs);
+
+		// a new parent for this node and the leaf
+		cost = 2 * combined;
+		// what going further down adds to this node
+		inherit = 2 * (combined - area);
+
+		for (i=0 ; i<2 ; i++)
+		{
+			child = &tree->nodes[node->children[i]];
+			SV_AABBUnion (child->mins, child->maxs, l->mins, l->maxs, mins, maxs);
+			childcost[i] = SV_AABBArea (mins, maxs) + inherit;
+			if (child->height > 0)
+				childcost[i] -= SV_AABBArea (child->mins, child->maxs);
+		}
+
+		if (cost < childcost[0] && cost < childcost[1])
+			break;
+		n = node->children[childcost[0] < childcost[1] ? 0 : 1];
+	}
+	sibling = n;
+
+	// a new parent for the sibling and the leaf
+	oldparent = tree->nodes[sibling].parent;
+	newparent = SV_AllocAABBNode (tree);
+	node = &tree->nodes[newparent];
+	node->parent = oldparent;
+	node->children[0] = sibling;
+	node->children[1] = leaf;
+	tree->nodes[sibling].parent = newparent;
+	tree->nodes[leaf].parent = newparent;
+
+	if (oldparent != AABB_NULL)
+	{
+		if (tree->nodes[oldparent].children[0] == sibling)
+			tree->nodes[oldparent].children[0] = newparent;
+		else
+			tree->nodes[oldparent].children[1] = newparent;
+	}
+	else
+		tree->root = newparent;
+
+	SV_RefitAABBAncestors (tree, newparent);
+}
+
+/*
+===============
+SV_RemoveAABBLeaf
+===============
+*/
+void SV_RemoveAABBLeaf (aabbtree_t *tree, int leaf)
+{
+	int		parent, grandparent, sibling;
+
+	tree->numleafs--;
+	if (leaf == tree->root)
+	{
+		tree->root = AABB_NULL;
+		return;
+	}
+
+	parent = tree->nodes[leaf].parent;
+	grandparent = tree->nodes[parent].parent;
+	if (tree->nodes[parent].children[0] == leaf)
+		sibling = tree->nodes[parent].children[1];
+	else
+		sibling = tree->nodes[parent].children[0];
+
+	// the sibling takes the parent's place
+	tree->nodes[sibling].parent = grandparent;
+	SV_FreeAABBNode (tree, parent);
+	if (grandparent == AABB_NULL)
+	{
+		tree->root = sibling;
+		return;
+	}
+
+	if (tree->nodes[grandparent].children[0] == parent)
+		tree->nodes[grandparent].children[0] = sibling;
+	else
+		tree->nodes[grandparent].children[1] = sibling;
+
+	SV_RefitAABBAncestors (tree, grandparent);
+}
+
+/*
+===============
+SV_AABBUnlink
+===============
+*/
+void SV_AABBUnlink (edict_t *ent)
+{
+	int		num;
+
+	num = NUM_FOR_EDICT(ent);
+	if (sv_aabbleaf[num] == AABB_NULL)
+		return;		// linked before the last SV_ClearWorld
+
+	SV_RemoveAABBLeaf (&sv_aabbtrees[sv_aabbtree[num]], sv_aabbleaf[num]);
+	SV_FreeAABBNode (&sv_aabbtrees[sv_aabbtree[num]], sv_aabbleaf[num]);
+	sv_aabbleaf[num] = AABB_NULL;
+}
+
+/*
+===============
+SV_AABBLink
+
+Leaves the edict where it is if it is still inside its fattened box
+===============
+*/
+void SV_AABBLink (edict_t *ent)
+{
+	aabbtree_t	*tree;
+	aabbnode_t	*node;
+	int			num, type, i;
+
+	num = NUM_FOR_EDICT(ent);
+	type = (ent->solid == SOLID_TRIGGER) ? AREA_TRIGGERS : AREA_SOLID;
+
+	if (sv_aabbleaf[num] != AABB_NULL)
+	{
+		if (sv_aabbtree[num] == type - AREA_SOLID)
+		{
+			node = &sv_aabbtrees[sv_aabbtree[num]].nodes[sv_aabbleaf[num]];
+			for (i=0 ; i<3 ; i++)
+				if (ent->absmin[i] < node->mins[i] || ent->absmax[i] > node->maxs[i])
+					break;
+			if (i == 3)
+				return;		// still inside
+		}
+		SV_AABBUnlink (ent);
+	}
+
+	tree = &sv_aabbtrees[type - AREA_SOLID];
+	sv_aabbtree[num] = type - AREA_SOLID;
+	sv_aabbleaf[num] = SV_AllocAABBNode (tree);
+	node = &tree->nodes[sv_aabbleaf[num]];
+	node->edict = num;
+	for (i=0 ; i<3 ; i++)
+	{
+		node->mins[i] = ent->absmin[i] - AABB_MARGIN;
+		node->maxs[i] = ent->absmax[i] + AABB_MARGIN;
+	}
+	SV_InsertAABBLeaf (tree, sv_aabbleaf[num]);
+}
+
+/*
+===============
+SV_AABBEdicts
+===============
+*/
+int SV_AABBEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int areatype)
+{
+	aabbtree_t	*tree;
+	aabbnode_t	*node;
+	edict_t		*check;
+	int			stack[64];
+	int			sp, count;
+
+	tree = &sv_aabbtrees[areatype - AREA_SOLID];
+	if (tree->root == AABB_NULL)
+		return 0;
+
+	count = 0;
+	sp = 0;
+	stack[sp++] = tree->root;
+	while (sp)
+	{
+		node = &tree->nodes[stack[--sp]];
+		if (node->mins[0] > maxs[0] || node->mins[1] > maxs[1] || node->mins[2] > maxs[2]
+			|| node->maxs[0] < mins[0] || node->maxs[1] < mins[1] || node->maxs[2] < mins[2])
+			continue;
+
+		if (node->height > 0)
+		{
+			if (sp > 62)
+				Com_Error (ERR_DROP, "SV_AABBEdicts: tree too deep");
+			stack[sp++] = node->children[1];
+			stack[sp++] = node->children[0];
+			continue;
+		}
+
+		sv_areastats.candidates++;
+		check = EDICT_NUM(node->edict);
+		if (check->solid == SOLID_NOT)
+			continue;		// deactivated
+		if (check->absmin[0] > maxs[0]
+		|| check->absmin[1] > maxs[1]
+		|| check->absmin[2] > maxs[2]
+		|| check->absmax[0] < mins[0]
+		|| check->absmax[1] < mins[1]
+		|| check->absmax[2] < mins[2])
+			continue;		// not touching
+
+		if (count == maxcount)
+		{
+			Com_Printf ("SV_AreaEdicts: MAXCOUNT\n");
+			break;
+		}
+		list[count++] = check;
+	}
+
+	return count;
+}
+
+/*
+===============
+SV_AABBHeight
+===============
+*/
+int SV_AABBHeight (aabbtree_t *tree)
+{
+	return tree->root == AABB_NULL ? 0 : tree->nodes[tree->root].height;
+}
+
+//===========================================================================
+
 /*
 ===============
 SV_CreateAreaNode
@@ -137,6 +607,65 @@ void SV_ClearWorld (void)
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
 	SV_CreateAreaNode (0, sv.models[1]->mins, sv.models[1]->maxs);
+
+	SV_ClearAABBTree (&sv_aabbtrees[0]);
+	SV_ClearAABBTree (&sv_aabbtrees[1]);
+	memset (sv_aabbleaf, 0xff, sizeof(sv_aabbleaf));	// AABB_NULL
+	sv_aabbactive = (sv_areatree->intValue != 0);
+}
+
+/*
+===============
+SV_AreaUnlink
+
+Takes a linked edict out of the areanodes or its tree
+===============
+*/
+void SV_AreaUnlink (edict_t *ent)
+{
+	if (sv_aabbactive)
+		SV_AABBUnlink (ent);
+	else
+		RemoveLink (&ent->area);
+}
+
+/*
+===============
+SV_AreaLink
+
+Puts an edict with its absmin/absmax set in the areanodes or a tree
+===============
+*/
+void SV_AreaLink (edict_t *ent)
+{
+	areanode_t	*node;
+
+	if (sv_aabbactive)
+	{
+		SV_AABBLink (ent);
+		ClearLink (&ent->area);		// so area.prev says it's linked
+		return;
+	}
+
+	// find the first node that the ent's box crosses
+	node = sv_areanodes;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if (ent->absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (ent->absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+	
+	// link it in	
+	if (ent->solid == SOLID_TRIGGER)
+		InsertLinkBefore (&ent->area, &node->trigger_edicts);
+	else
+		InsertLinkBefore (&ent->area, &node->solid_edicts);
 }
 
 
@@ -150,7 +679,7 @@ void SV_UnlinkEdict (edict_t *ent)
 {
 	if (!ent->area.prev)
 		return;		// not linked in anywhere
-	RemoveLink (&ent->area);
+	SV_AreaUnlink (ent);
 	ent->area.prev = ent->area.next = NULL;
 }
 
@@ -164,7 +693,6 @@ SV_LinkEdict
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEdict (edict_t *ent)
 {
-	areanode_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			clusters[MAX_TOTAL_ENT_LEAFS];
 	int			num_leafs;
@@ -172,7 +700,8 @@ void SV_LinkEdict (edict_t *ent)
 	int			area;
 	int			topnode;
 
-	if (ent->area.prev)
+	// a tree can leave an edict that didn't move far where it is
+	if (ent->area.prev && (!sv_aabbactive || !ent->inuse || ent->solid == SOLID_NOT))
 		SV_UnlinkEdict (ent);	// unlink from old position
 		
 	if (ent == ge->edicts)
@@ -316,32 +845,16 @@ void SV_LinkEdict (edict_t *ent)
 	if (!ent->linkcount)
 	{
 		VectorCopy (ent->s.origin, ent->s.old_origin);
+
+		// a new entity in this slot, a held event was the last one's
+		sv.events[NUM_FOR_EDICT(ent)] = 0;
 	}
 	ent->linkcount++;
 
 	if (ent->solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (ent->absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
-	
-	// link it in	
-	if (ent->solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
-
+	SV_AreaLink (ent);
 }
 
 
@@ -366,6 +879,7 @@ void SV_AreaEdicts_r (areanode_t *node)
 	{
 		next = l->next;
 		check = EDICT_FROM_AREA(l);
+		sv_areastats.candidates++;
 
 		if (check->solid == SOLID_NOT)
 			continue;		// deactivated
@@ -405,6 +919,14 @@ SV_AreaEdicts
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list,
 	int maxcount, int areatype)
 {
+	sv_areastats.queries++;
+	if (sv_aabbactive)
+	{
+		area_count = SV_AABBEdicts (mins, maxs, list, maxcount, areatype);
+		sv_areastats.returned += area_count;
+		return area_count;
+	}
+
 	area_mins = mins;
 	area_maxs = maxs;
 	area_list = list;
@@ -414,9 +936,205 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list,
 
 	SV_AreaEdicts_r (sv_areanodes);
 
+	sv_areastats.returned += area_count;
 	return area_count;
 }
 
+/*
+================
+SV_SwitchAreaTree
+
+Moves every linked edict over to the trees or the areanodes
+================
+*/
+void SV_SwitchAreaTree (qboolean aabb)
+{
+	edict_t		*ent;
+	int			i;
+
+	if (aabb == sv_aabbactive)
+		return;
+
+	for (i=1 ; i<ge->num_edicts ; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (ent->area.prev)
+			SV_AreaUnlink (ent);
+	}
+
+	sv_aabbactive = aabb;
+
+	for (i=1 ; i<ge->num_edicts ; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (ent->area.prev)
+			SV_AreaLink (ent);
+	}
+}
+
+/*
+================
+SV_AreaNodeDepth
+================
+*/
+void SV_AreaNodeDepth (areanode_t *node, int depth, int *counts)
+{
+	link_t	*l;
+
+	for (l=node->solid_edicts.next ; l != &node->solid_edicts ; l=l->next)
+		counts[depth]++;
+	for (l=node->trigger_edicts.next ; l != &node->trigger_edicts ; l=l->next)
+		counts[depth]++;
+	if (node->axis == -1)
+		return;
+	SV_AreaNodeDepth (node->children[0], depth+1, counts);
+	SV_AreaNodeDepth (node->children[1], depth+1, counts);
+}
+
+/*
+================
+SV_AreaStats_f
+
+What the edicts are linked in, and how many of them the
+SV_AreaEdicts calls since the last sv_areastats looked at
+================
+*/
+void SV_AreaStats_f (void)
+{
+	int		counts[AREA_DEPTH+1];
+	int		i, queries;
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf ("sv_areastats: no map running\n");
+		return;
+	}
+
+	if (sv_aabbactive)
+	{
+		Com_Printf ("aabb trees:   leafs  nodes  height\n");
+		for (i=0 ; i<2 ; i++)
+			Com_Printf ("%-12s  %5i  %5i  %6i\n", i ? "triggers" : "solid",
+				sv_aabbtrees[i].numleafs, sv_aabbtrees[i].numleafs ? 2*sv_aabbtrees[i].numleafs-1 : 0,
+				SV_AABBHeight (&sv_aabbtrees[i]));
+	}
+	else
+	{
+		memset (counts, 0, sizeof(counts));
+		SV_AreaNodeDepth (sv_areanodes, 0, counts);
+		Com_Printf ("areanodes, edicts at each depth:");
+		for (i=0 ; i<=AREA_DEPTH ; i++)
+			Com_Printf (" %i", counts[i]);
+		Com_Printf ("\n");
+	}
+
+	queries = sv_areastats.queries ? sv_areastats.queries : 1;
+	Com_Printf ("%i queries, %.1f edicts looked at and %.1f returned a query\n",
+		sv_areastats.queries, (float)sv_areastats.candidates / queries,
+		(float)sv_areastats.returned / queries);
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+}
+
+/*
+================
+SV_AreaBenchPass
+================
+*/
+void SV_AreaBenchPass (char *name, int traces, vec3_t *starts, vec3_t *ends, vec3_t mins, vec3_t maxs)
+{
+	edict_t		*touch[MAX_EDICTS];
+	vec3_t		tmins, tmaxs;
+	unsigned	start, traceusec, touchusec;
+	areastats_t	tracestats, touchstats;
+	int			i;
+
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+	start = Sys_Microseconds ();
+	for (i=0 ; i<traces ; i++)
+		SV_Trace (starts[i], mins, maxs, ends[i], NULL, MASK_PLAYERSOLID);
+	traceusec = Sys_Microseconds () - start;
+	tracestats = sv_areastats;
+
+	// what G_TouchTriggers asks for a player at each end
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+	start = Sys_Microseconds ();
+	for (i=0 ; i<traces ; i++)
+	{
+		VectorAdd (ends[i], mins, tmins);
+		VectorAdd (ends[i], maxs, tmaxs);
+		SV_AreaEdicts (tmins, tmaxs, touch, MAX_EDICTS, AREA_TRIGGERS);
+	}
+	touchusec = Sys_Microseconds () - start;
+	touchstats = sv_areastats;
+
+	Com_Printf ("%-10s %6.3f usec/trace %5.1f looked at %5.1f returned   %6.3f usec/touch %5.1f looked at %5.1f returned\n",
+		name, (float)traceusec / traces, (float)tracestats.candidates / traces, (float)tracestats.returned / traces,
+		(float)touchusec / traces, (float)touchstats.candidates / traces, (float)touchstats.returned / traces);
+}
+
+/*
+================
+SV_AreaBench_f
+
+sv_areabench [traces]
+
+Player sized moves from random open spots in the running map,
+traced and touched with the edicts in the areanodes, then in the
+trees.  The edicts go back where they were afterwards.
+================
+*/
+void SV_AreaBench_f (void)
+{
+	static vec3_t	player_mins = {-16, -16, -24};
+	static vec3_t	player_maxs = {16, 16, 32};
+	vec3_t		*starts, *ends, dir;
+	cmodel_t	*world;
+	areastats_t	saved;
+	qboolean	wasactive;
+	int			traces, i, j, k;
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf ("sv_areabench: no map running\n");
+		return;
+	}
+
+	traces = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 20000;
+	traces = max (traces, 1);
+
+	saved = sv_areastats;
+	starts = Z_Malloc (traces * sizeof(vec3_t));
+	ends = Z_Malloc (traces * sizeof(vec3_t));
+	world = sv.models[1];
+	for (i=0 ; i<traces ; i++)
+	{
+		for (k=0 ; k<16 ; k++)
+		{
+			for (j=0 ; j<3 ; j++)
+				starts[i][j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+			if (!(SV_PointContents (starts[i]) & MASK_SOLID))
+				break;
+		}
+		for (j=0 ; j<3 ; j++)
+			dir[j] = crand();
+		VectorNormalize (dir);
+		VectorMA (starts[i], 64 + frand() * 960, dir, ends[i]);
+	}
+
+	wasactive = sv_aabbactive;
+
+	Com_Printf ("%i moves, %i edicts\n", traces, ge->num_edicts);
+	SV_SwitchAreaTree (false);
+	SV_AreaBenchPass ("areanodes", traces, starts, ends, player_mins, player_maxs);
+	SV_SwitchAreaTree (true);
+	SV_AreaBenchPass ("aabb trees", traces, starts, ends, player_mins, player_maxs);
+	SV_SwitchAreaTree (wasactive);
+
+	sv_areastats = saved;
+	Z_Free (starts);
+	Z_Free (ends);
+}
+
 
 //===========================================================================
 
@@ -463,6 +1181,7 @@ typedef struct
 	trace_t		trace;
 	edict_t		*passedict;
 	int			contentmask;
+	antilag_t	*antilag;		// clients are clipped from here instead, if set
 } moveclip_t;
 
 
@@ -505,21 +1224,20 @@ int SV_HullForEntity (edict_t *ent)
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToList
 
+Clips the move to the entities in touchlist that its box touches,
+the list can be gathered for a bigger box than the move's
 ====================
 */
-void SV_ClipMoveToEntities ( moveclip_t *clip )
+void SV_ClipMoveToList ( moveclip_t *clip, edict_t **touchlist, int num )
 {
-	int			i, num;
-	edict_t		*touchlist[MAX_EDICTS], *touch;
+	int			i, clientnum;
+	edict_t		*touch;
 	trace_t		trace;
 	int			headnode;
 	float		*angles;
 
-	num = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist
-		, MAX_EDICTS, AREA_SOLID);
-
 	// be careful, it is possible to have an entity in this
 	// list removed before we get to it (killtriggered)
 	for (i=0 ; i<num ; i++)
@@ -527,6 +1245,13 @@ void SV_ClipMoveToEntities ( moveclip_t *clip )
 		touch = touchlist[i];
 		if (touch->solid == SOLID_NOT)
 			continue;
+		if (touch->absmin[0] > clip->boxmaxs[0]
+		|| touch->absmin[1] > clip->boxmaxs[1]
+		|| touch->absmin[2] > clip->boxmaxs[2]
+		|| touch->absmax[0] < clip->boxmins[0]
+		|| touch->absmax[1] < clip->boxmins[1]
+		|| touch->absmax[2] < clip->boxmins[2])
+			continue;		// not touching
 		if (touch == clip->passedict)
 			continue;
 		if (clip->trace.allsolid)
@@ -543,6 +1268,13 @@ void SV_ClipMoveToEntities ( moveclip_t *clip )
 		&& (touch->svflags & SVF_DEADMONSTER) )
 				continue;
 
+		if (clip->antilag)
+		{
+			clientnum = NUM_FOR_EDICT(touch);
+			if (clientnum > 0 && clientnum <= maxclients->intValue)
+				continue;	// SV_ClipMoveToAntilag has it
+		}
+
 		// might intersect, so do an exact clip
 		headnode = SV_HullForEntity (touch);
 		angles = touch->s.angles;
@@ -573,6 +1305,97 @@ void SV_ClipMoveToEntities ( moveclip_t *clip )
 	}
 }
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+void SV_ClipMoveToEntities ( moveclip_t *clip )
+{
+	int			num;
+	edict_t		*touchlist[MAX_EDICTS];
+
+	num = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist
+		, MAX_EDICTS, AREA_SOLID);
+
+	SV_ClipMoveToList (clip, touchlist, num);
+}
+
+
+/*
+====================
+SV_ClipMoveToAntilag
+
+SV_ClipMoveToEntities for the clients, at their boxes in clip->antilag
+====================
+*/
+static void SV_ClipMoveToAntilag ( moveclip_t *clip )
+{
+	int			i, j;
+	antilag_t	*lag;
+	edict_t		*touch;
+	trace_t		trace;
+	int			headnode;
+
+	lag = clip->antilag;
+	for (i=0 ; i<maxclients->intValue ; i++, lag++)
+	{
+		if (!lag->solid)
+			continue;
+		touch = EDICT_NUM(i+1);
+		if (!touch->inuse || touch->solid != SOLID_BBOX)
+			continue;	// the game decides what is solid now
+		if ((lag->svflags & SVF_DEADMONSTER) && !(touch->svflags & SVF_DEADMONSTER))
+			continue;	// respawned since, it isn't where its body was
+		if (touch == clip->passedict)
+			continue;
+		if (clip->trace.allsolid)
+			return;
+		if (clip->passedict)
+		{
+		 	if (touch->owner == clip->passedict)
+				continue;
+			if (clip->passedict->owner == touch)
+				continue;
+		}
+
+		if ( !(clip->contentmask & CONTENTS_DEADMONSTER)
+		&& (lag->svflags & SVF_DEADMONSTER) )
+				continue;
+
+		for (j=0 ; j<3 ; j++)
+			if (lag->origin[j] + lag->mins[j] > clip->boxmaxs[j]
+			|| lag->origin[j] + lag->maxs[j] < clip->boxmins[j])
+				break;
+		if (j < 3)
+			continue;	// nowhere near the move
+
+		headnode = CM_HeadnodeForBox (lag->mins, lag->maxs);
+		if (lag->svflags & SVF_MONSTER)
+			trace = CM_TransformedBoxTrace (clip->start, clip->end,
+				clip->mins2, clip->maxs2, headnode, clip->contentmask,
+				lag->origin, vec3_origin);
+		else
+			trace = CM_TransformedBoxTrace (clip->start, clip->end,
+				clip->mins, clip->maxs, headnode, clip->contentmask,
+				lag->origin, vec3_origin);
+
+		if (trace.allsolid || trace.startsolid ||
+		trace.fraction < clip->trace.fraction)
+		{
+			trace.ent = touch;
+		 	if (clip->trace.startsolid)
+			{
+				clip->trace = trace;
+				clip->trace.startsolid = true;
+			}
+			else
+				clip->trace = trace;
+		}
+	}
+}
+
 
 /*
 ==================
@@ -606,15 +1429,12 @@ boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
 
 /*
 ==================
-SV_Trace
-
-Moves the given mins/maxs volume through the world from start to end.
-
-Passedict and edicts owned by passedict are explicitly not checked.
+SV_ClipMove
 
+SV_Trace, with the clients clipped at their antilag boxes if given one
 ==================
 */
-trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
+static trace_t SV_ClipMove (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask, antilag_t *antilag)
 {
 	moveclip_t	clip;
 
@@ -637,6 +1457,7 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 	clip.mins = mins;
 	clip.maxs = maxs;
 	clip.passedict = passedict;
+	clip.antilag = antilag;
 
 	VectorCopy (mins, clip.mins2);
 	VectorCopy (maxs, clip.maxs2);
@@ -646,7 +1467,325 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 
 	// clip to other solid entities
 	SV_ClipMoveToEntities ( &clip );
+	if (antilag)
+		SV_ClipMoveToAntilag ( &clip );
 
 	return clip.trace;
 }
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+
+Passedict and edicts owned by passedict are explicitly not checked.
+
+==================
+*/
+trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
+{
+	return SV_ClipMove (start, mins, maxs, end, passedict, contentmask, NULL);
+}
+
+/*
+==================
+SV_TraceBatch
+
+SV_UnlaggedTrace for count rays of the same size, mask and passedict,
+like the pellets of one shotgun blast.  The entities are gathered once
+for the box around all of them, and the world is traced from the first
+node that splits that box instead of from the top of the map.  Comes
+out the same as tracing them one at a time.
+==================
+*/
+void SV_TraceBatch (edict_t *shooter, int count, vec3_t *starts, vec3_t *ends, vec3_t mins, vec3_t maxs, edict_t *passedict, int contentmask, trace_t *traces)
+{
+	moveclip_t	clip;
+	edict_t		*touchlist[MAX_EDICTS];
+	antilag_t	*antilag;
+	vec3_t		extents, nodemins, nodemaxs, boxmins, boxmaxs;
+	float		lo, hi;
+	int			i, j, num, topnode;
+
+	if (count <= 0)
+		return;
+	if (!mins)
+		mins = vec3_origin;
+	if (!maxs)
+		maxs = vec3_origin;
+
+	// the box the traces can't leave, with the box the
+	// hull check measures the move with, and a unit to spare
+	for (j=0 ; j<3 ; j++)
+		extents[j] = -mins[j] > maxs[j] ? -mins[j] : maxs[j];
+	for (i=0 ; i<count ; i++)
+	{
+		SV_TraceBounds (starts[i], mins, maxs, ends[i], clip.boxmins, clip.boxmaxs);
+		for (j=0 ; j<3 ; j++)
+		{
+			lo = min (starts[i][j], ends[i][j]) - extents[j] - 1;
+			hi = max (starts[i][j], ends[i][j]) + extents[j] + 1;
+			if (!i || lo < nodemins[j])
+				nodemins[j] = lo;
+			if (!i || hi > nodemaxs[j])
+				nodemaxs[j] = hi;
+			if (!i || clip.boxmins[j] < boxmins[j])
+				boxmins[j] = clip.boxmins[j];
+			if (!i || clip.boxmaxs[j] > boxmaxs[j])
+				boxmaxs[j] = clip.boxmaxs[j];
+		}
+	}
+
+	topnode = CM_TopnodeForBox (nodemins, nodemaxs, 0);
+	num = SV_AreaEdicts (boxmins, boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+	antilag = SV_AntilagFrame (shooter);
+
+	for (i=0 ; i<count ; i++)
+	{
+		memset ( &clip, 0, sizeof ( moveclip_t ) );
+
+		// clip to world
+		clip.trace = CM_BoxTrace (starts[i], ends[i], mins, maxs, topnode, contentmask);
+		clip.trace.ent = ge->edicts;
+		if (clip.trace.fraction == 0)
+		{
+			traces[i] = clip.trace;		// blocked by the world
+			continue;
+		}
+
+		clip.contentmask = contentmask;
+		clip.start = starts[i];
+		clip.end = ends[i];
+		clip.mins = mins;
+		clip.maxs = maxs;
+		clip.passedict = passedict;
+		clip.antilag = antilag;
+
+		VectorCopy (mins, clip.mins2);
+		VectorCopy (maxs, clip.maxs2);
+		SV_TraceBounds ( starts[i], clip.mins2, clip.maxs2, ends[i], clip.boxmins, clip.boxmaxs );
+
+		// clip to other solid entities
+		SV_ClipMoveToList ( &clip, touchlist, num );
+		if (antilag)
+			SV_ClipMoveToAntilag ( &clip );
+
+		traces[i] = clip.trace;
+	}
+}
+
+/*
+==================
+SV_TraceBench_f
+
+sv_tracebench [shots] [pellets]
+
+Shotgun blasts from random open spots in the running map, traced a
+pellet at a time with SV_Trace and then with SV_TraceBatch.  Any
+pellet that comes out different is counted.  Every other blast is
+fired level from exactly on the floor or ceiling over the spot, and
+each of its pellets is also traced from CM_TopnodeForBox of just its
+own move, a box on the plane that the padded batch box never is.
+==================
+*/
+void SV_TraceBench_f (void)
+{
+	vec3_t		starts[64], ends[64], angles, forward, right, up, lo, hi;
+	trace_t		single[64], batched[64], tr, fromtop;
+	cmodel_t	*world;
+	int			shots, pellets, i, j, k, mismatches;
+	unsigned	start, singleusec, batchusec;
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf ("sv_tracebench: no map running\n");
+		return;
+	}
+
+	shots = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 10000;
+	pellets = (Cmd_Argc() > 2) ? atoi(Cmd_Argv(2)) : 20;	// a super shotgun
+	shots = max (shots, 1);
+	pellets = max (1, min (pellets, 64));
+
+	world = sv.models[1];
+	singleusec = batchusec = 0;
+	mismatches = 0;
+
+	for (i=0 ; i<shots ; i++)
+	{
+		for (k=0 ; k<16 ; k++)
+		{
+			for (j=0 ; j<3 ; j++)
+				starts[0][j] = world->mins[j] + frand() * (world->maxs[j] - world->mins[j]);
+			if (!(SV_PointContents (starts[0]) & MASK_SOLID))
+				break;
+		}
+
+		if (i & 1)
+		{
+			VectorCopy (starts[0], ends[0]);
+			ends[0][2] += (i & 2) ? 8192 : -8192;
+			tr = CM_BoxTrace (starts[0], ends[0], vec3_origin, vec3_origin, 0, MASK_SHOT);
+			if (tr.fraction < 1 && tr.plane.type == PLANE_Z)
+				starts[0][2] = tr.plane.dist * tr.plane.normal[2];
+		}
+
+		angles[PITCH] = (i & 1) ? 0 : crand() * 45;
+		angles[YAW] = frand() * 360;
+		angles[ROLL] = 0;
+		AngleVectors (angles, forward, right, up);
+
+		for (j=0 ; j<pellets ; j++)
+		{
+			VectorCopy (starts[0], starts[j]);
+			VectorMA (starts[0], 8192, forward, ends[j]);
+			VectorMA (ends[j], crand() * 1000, right, ends[j]);
+			if (!(i & 1))
+				VectorMA (ends[j], crand() * 500, up, ends[j]);
+		}
+
+		start = Sys_Microseconds ();
+		for (j=0 ; j<pellets ; j++)
+			single[j] = SV_Trace (starts[j], NULL, NULL, ends[j], NULL, MASK_SHOT);
+		singleusec += Sys_Microseconds () - start;
+
+		start = Sys_Microseconds ();
+		SV_TraceBatch (NULL, pellets, starts, ends, NULL, NULL, NULL, MASK_SHOT, batched);
+		batchusec += Sys_Microseconds () - start;
+
+		for (j=0 ; j<pellets ; j++)
+		{
+			if (single[j].fraction != batched[j].fraction || single[j].ent != batched[j].ent
+				|| single[j].allsolid != batched[j].allsolid || single[j].startsolid != batched[j].startsolid
+				|| single[j].surface != batched[j].surface || single[j].contents != batched[j].contents
+				|| !VectorCompare (single[j].endpos, batched[j].endpos)
+				|| !VectorCompare (single[j].plane.normal, batched[j].plane.normal))
+				mismatches++;
+
+			if (!(i & 1))
+				continue;
+			for (k=0 ; k<3 ; k++)
+			{
+				lo[k] = min (starts[j][k], ends[j][k]);
+				hi[k] = max (starts[j][k], ends[j][k]);
+			}
+			tr = CM_BoxTrace (starts[j], ends[j], vec3_origin, vec3_origin, 0, MASK_SHOT);
+			fromtop = CM_BoxTrace (starts[j], ends[j], vec3_origin, vec3_origin, CM_TopnodeForBox (lo, hi, 0), MASK_SHOT);
+			if (tr.fraction != fromtop.fraction || tr.startsolid != fromtop.startsolid
+				|| tr.allsolid != fromtop.allsolid || tr.contents != fromtop.contents)
+				mismatches++;
+		}
+	}
+
+	Com_Printf ("%i shots of %i pellets%s\n", shots, pellets, mismatches ? va(" (%i MISMATCHES)", mismatches) : "");
+	Com_Printf ("SV_Trace:      %7i usec, %.3f usec/pellet\n", singleusec, (float)singleusec / (shots*pellets));
+	Com_Printf ("SV_TraceBatch: %7i usec, %.3f usec/pellet\n", batchusec, (float)batchusec / (shots*pellets));
+}
+
+/*
+===============================================================================
+
+LAG COMPENSATION
+
+A client aims at the world of the last frame it got, which is its
+ping old by the time the shot arrives.  The client boxes of every game
+frame are kept for ANTILAG_FRAMES frames so the game can trace hitscan
+shots against that frame instead of the present.
+===============================================================================
+*/
+
+/*
+==================
+SV_RecordAntilag
+
+Called after each game frame, with the positions the clients are
+about to be sent
+==================
+*/
+void SV_RecordAntilag (void)
+{
+	antilag_t	*lag;
+	edict_t		*ent;
+	int			i, slot;
+
+	if (!svs.antilag || sv.state != ss_game)
+		return;
+
+	slot = sv.framenum & (ANTILAG_FRAMES-1);
+	sv.antilag_frames[slot] = sv.framenum;
+	lag = svs.antilag + slot*maxclients->intValue;
+
+	for (i=0 ; i<maxclients->intValue ; i++, lag++)
+	{
+		ent = EDICT_NUM(i+1);
+		// games can switch solidity around their own traces,
+		// so keep any linked client that might be shot
+		lag->solid = ent->inuse && ent->solid != SOLID_NOT && ent->area.prev;
+		if (!lag->solid)
+			continue;
+		lag->svflags = ent->svflags;
+		VectorCopy (ent->s.origin, lag->origin);
+		VectorCopy (ent->mins, lag->mins);
+		VectorCopy (ent->maxs, lag->maxs);
+	}
+}
+
+/*
+==================
+SV_AntilagFrame
+
+The client boxes of the last frame the shooter acknowledged, or NULL
+to trace against the present.  That is the frame it was looking at
+when it fired, give or take the client's interpolation.
+==================
+*/
+static antilag_t *SV_AntilagFrame (edict_t *shooter)
+{
+	client_t	*cl;
+	int			num, framenum, back, maxback;
+
+	if (!shooter || !svs.antilag || sv_antilag->intValue <= 0)
+		return NULL;
+
+	num = NUM_FOR_EDICT(shooter);
+	if (num < 1 || num > maxclients->intValue)
+		return NULL;
+	cl = svs.clients + num - 1;
+	if (cl->state != cs_spawned || cl->relay || cl->lastframe <= 0)
+		return NULL;
+
+	// 10 Hz clients number their frames in every sv.framediv'th one
+	framenum = cl->lastframe;
+	if (!cl->tickrate)
+		framenum *= sv.framediv;
+
+	back = sv.framenum - framenum;
+	if (back < 0)
+		return NULL;	// from an earlier map
+	maxback = sv_antilag->intValue / sv.frametime;
+	if (back > maxback)
+		back = maxback;
+	if (back > ANTILAG_FRAMES-1)
+		back = ANTILAG_FRAMES-1;
+
+	framenum = sv.framenum - back;
+	if (sv.antilag_frames[framenum & (ANTILAG_FRAMES-1)] != framenum)
+		return NULL;	// not recorded this map
+
+	return svs.antilag + (framenum & (ANTILAG_FRAMES-1))*maxclients->intValue;
+}
+
+/*
+==================
+SV_UnlaggedTrace
+
+SV_Trace as the shooter saw the world: the clients are clipped at the
+boxes of the frame it last acknowledged.  Everything else, and any
+shooter that isn't a client, is traced against the present.
+==================
+*/
+trace_t SV_UnlaggedTrace (edict_t *shooter, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
+{
+	return SV_ClipMove (start, mins, maxs, end, passedict, contentmask, SV_AntilagFrame (shooter));
+}
@@ -133,6 +133,19 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+unsigned Sys_Microseconds (void)
+{
+	static LARGE_INTEGER	freq;
+	LARGE_INTEGER			count;
+
+	if (!freq.QuadPart && !QueryPerformanceFrequency (&freq))
+		return (unsigned)timeGetTime () * 1000;	// no high resolution counter
+
+	QueryPerformanceCounter (&count);
+	return (unsigned)((count.QuadPart / freq.QuadPart) * 1000000 +
+		(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+}
+
 void Sys_Mkdir (char *path)
 {
 	_mkdir (path);
@@ -209,3 +222,118 @@ void Sys_FindClose (void)
 
 
 //============================================
+
+//============================================
+
+/*
+================
+Sys_CreateThread
+
+Win32 threading primitives
+================
+*/
+typedef struct
+{
+	HANDLE	handle;
+	void	(*func) (void *parm);
+	void	*parm;
+} systhread_t;
+
+static DWORD WINAPI Sys_ThreadMain (LPVOID arg)
+{
+	systhread_t	*t = (systhread_t *)arg;
+
+	t->func (t->parm);
+	return 0;
+}
+
+void *Sys_CreateThread (void (*func) (void *parm), void *parm)
+{
+	systhread_t	*t;
+	DWORD		id;
+
+	t = malloc (sizeof(*t));
+	if (!t)
+		return NULL;
+	t->func = func;
+	t->parm = parm;
+	t->handle = CreateThread (NULL, 0, Sys_ThreadMain, t, 0, &id);
+	if (!t->handle)
+	{
+		free (t);
+		return NULL;
+	}
+	return t;
+}
+
+void Sys_WaitThread (void *thread)
+{
+	systhread_t	*t = (systhread_t *)thread;
+
+	if (!t)
+		return;
+	WaitForSingleObject (t->handle, INFINITE);
+	CloseHandle (t->handle);
+	free (t);
+}
+
+void *Sys_CreateMutex (void)
+{
+	CRITICAL_SECTION	*cs;
+
+	cs = malloc (sizeof(*cs));
+	if (cs)
+		InitializeCriticalSection (cs);
+	return cs;
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+	if (!mutex)
+		return;
+	DeleteCriticalSection ((CRITICAL_SECTION *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+	if (mutex)
+		EnterCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+	if (mutex)
+		LeaveCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void *Sys_CreateSemaphore (int value)
+{
+	return CreateSemaphore (NULL, value, 0x7fffffff, NULL);
+}
+
+void Sys_DestroySemaphore (void *sem)
+{
+	if (sem)
+		CloseHandle ((HANDLE)sem);
+}
+
+void Sys_SemaphorePost (void *sem)
+{
+	ReleaseSemaphore ((HANDLE)sem, 1, NULL);
+}
+
+void Sys_SemaphoreWait (void *sem)
+{
+	WaitForSingleObject ((HANDLE)sem, INFINITE);
+}
+
+int Sys_NumProcessors (void)
+{
+	SYSTEM_INFO	info;
+
+	GetSystemInfo (&info);
+	if (info.dwNumberOfProcessors < 1)
+		return 1;
+	return (int)info.dwNumberOfProcessors;
+}